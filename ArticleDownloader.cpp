@@ -43,6 +43,15 @@
 #endif
 #include <sys/stat.h>
 #include <errno.h>
+#ifndef DISABLE_PARCHECK
+#ifdef WIN32
+#include <par2cmdline.h>
+#include <md5.h>
+#else
+#include <libpar2/par2cmdline.h>
+#include <libpar2/md5.h>
+#endif
+#endif
 
 #include "nzbget.h"
 #include "ArticleDownloader.h"
@@ -57,6 +66,10 @@ extern DownloadQueueHolder* g_pDownloadQueueHolder;
 extern Options* g_pOptions;
 extern ServerPool* g_pServerPool;
 
+#ifndef DISABLE_PARCHECK
+static const int HASH16K_SIZE = 16 * 1024;
+#endif
+
 ArticleDownloader::ArticleDownloader()
 {
 	debug("Creating ArticleDownloader");
@@ -67,9 +80,13 @@ ArticleDownloader::ArticleDownloader()
 	m_szInfoName		= NULL;
 	m_szOutputFilename	= NULL;
 	m_pConnection		= NULL;
+	m_pSpeedServer		= NULL;
 	m_eStatus			= adUndefined;
 	m_bDuplicate		= false;
 	m_eFormat			= Decoder::efUnknown;
+	m_iArticleBytes		= 0;
+	m_iArticleLatency	= 0;
+	m_iArticleTransferTime = 0;
 	SetLastUpdateTimeNow();
 }
 
@@ -186,6 +203,7 @@ void ArticleDownloader::Run()
 		}
 
 		pLastServer = m_pConnection->GetNewsServer();
+		m_pSpeedServer = pLastServer;
 
 		m_pConnection->SetSuppressErrors(false);
 
@@ -199,6 +217,11 @@ void ArticleDownloader::Run()
 			Status = Download();
 		}
 
+		if (!IsStopped())
+		{
+			AddArticleResult(pLastServer, bConnected ? Status : adConnectError);
+		}
+
 		if (bConnected)
 		{
 			if (Status == adConnectError)
@@ -374,10 +397,23 @@ ArticleDownloader::EStatus ArticleDownloader::Download()
 	snprintf(tmp, 1024, "ARTICLE %s\r\n", m_pArticleInfo->GetMessageID());
 	tmp[1024-1] = '\0';
 
+	m_iArticleBytes = 0;
+	m_iArticleLatency = 0;
+	m_iArticleTransferTime = 0;
+	long long iTransferStart = 0;
+
 	for (int retry = 3; retry > 0; retry--)
 	{
+		long long iRequestTime = Util::CurrentMSec();
 		szResponse = m_pConnection->Request(tmp);
-		if ((szResponse && !strncmp(szResponse, "2", 1)) || m_pConnection->GetAuthError())
+		if (szResponse && !strncmp(szResponse, "2", 1))
+		{
+			iTransferStart = Util::CurrentMSec();
+			m_iArticleLatency = (int)(iTransferStart - iRequestTime);
+			m_pConnection->GetNewsServer()->AddTiming(NewsServer::tmFirstByte, m_iArticleLatency);
+			break;
+		}
+		if (m_pConnection->GetAuthError())
 		{
 			break;
 		}
@@ -396,6 +432,9 @@ ArticleDownloader::EStatus ArticleDownloader::Download()
 		m_YDecoder.Clear();
 		m_YDecoder.SetAutoSeek(g_pOptions->GetDirectWrite());
 		m_YDecoder.SetCrcCheck(g_pOptions->GetCrcCheck());
+#ifndef DISABLE_PARCHECK
+		m_YDecoder.SetHeadSize(HASH16K_SIZE);
+#endif
 
 		m_UDecoder.Clear();
 	}
@@ -405,6 +444,7 @@ ArticleDownloader::EStatus ArticleDownloader::Download()
 	bool bEnd = false;
 	const int LineBufSize = 1024*10;
 	char* szLineBuf = (char*)malloc(LineBufSize);
+	int iArticleBytes = 0;
 	Status = adRunning;
 
 	while (!IsStopped())
@@ -421,7 +461,10 @@ ArticleDownloader::EStatus ArticleDownloader::Download()
 
 		int iLen = 0;
 		char* line = m_pConnection->ReadLine(szLineBuf, LineBufSize, &iLen);
-		g_pDownloadSpeedMeter->AddSpeedReading(iLen);
+
+		// the counter is collected by speed meter, no locking here
+		m_iDownloadedBytes.Add(iLen);
+		iArticleBytes += iLen;
 
 		// Have we encountered a timeout?
 		if (!line)
@@ -485,6 +528,9 @@ ArticleDownloader::EStatus ArticleDownloader::Download()
 
 	free(szLineBuf);
 
+	m_iArticleBytes = iArticleBytes;
+	m_iArticleTransferTime = (int)(Util::CurrentMSec() - iTransferStart);
+
 	if (m_pOutFile)
 	{
 		fclose(m_pOutFile);
@@ -800,6 +846,21 @@ ArticleDownloader::EStatus ArticleDownloader::DecodeCheck()
 		{
 			detail("Successfully downloaded %s", m_szInfoName);
 
+			if (m_eFormat == Decoder::efYenc && g_pOptions->GetCrcCheck())
+			{
+				// remember position and checksum of the segment for quick par-verification
+				m_pArticleInfo->SetSegmentOffset((long long)m_YDecoder.GetBegin() - 1);
+				m_pArticleInfo->SetSegmentSize((int)(m_YDecoder.GetEnd() - m_YDecoder.GetBegin() + 1));
+				m_pArticleInfo->SetCrc(m_YDecoder.GetCalculatedCrc());
+			}
+
+#ifndef DISABLE_PARCHECK
+			if (m_eFormat == Decoder::efYenc)
+			{
+				CalcHash16k();
+			}
+#endif
+
 			if (bDirectWrite && g_pOptions->GetContinuePartial())
 			{
 				// create empty flag-file to indicate that the artcile was downloaded
@@ -900,6 +961,33 @@ bool ArticleDownloader::Terminate()
 	return terminated;
 }
 
+/*
+ * Feeds the server statistics used for the choice of servers.
+ */
+void ArticleDownloader::AddArticleResult(NewsServer* pNewsServer, EStatus eStatus)
+{
+	switch (eStatus)
+	{
+		case adFinished:
+			g_pServerPool->AddArticleResult(pNewsServer, ServerPool::arSuccess,
+				m_iArticleBytes, m_iArticleLatency, m_iArticleTransferTime);
+			break;
+
+		case adNotFound:
+			g_pServerPool->AddArticleResult(pNewsServer, ServerPool::arNotFound, 0, 0, 0);
+			break;
+
+		case adFailed:
+		case adCrcError:
+		case adConnectError:
+			g_pServerPool->AddArticleResult(pNewsServer, ServerPool::arFailure, 0, 0, 0);
+			break;
+
+		default:
+			break;
+	}
+}
+
 void ArticleDownloader::FreeConnection(bool bKeepConnected)
 {
 	if (m_pConnection)							
@@ -1134,9 +1222,18 @@ void ArticleDownloader::CompleteFileParts()
 		}
 	}
 
+	long long lFileSize = -1;
+	unsigned long lFileCrc = 0;
+	bool bHasCrc = complete && g_pOptions->GetDecode() && g_pOptions->GetParQuick() && CalcFileCrc(&lFileSize, &lFileCrc);
+
 	// the locking is needed for accessing the memebers of NZBInfo
 	g_pDownloadQueueHolder->LockQueue();
 	m_pFileInfo->GetNZBInfo()->GetCompletedFiles()->push_back(strdup(ofn));
+	if (bHasCrc || m_pFileInfo->GetHash16k())
+	{
+		m_pFileInfo->GetNZBInfo()->GetFileChecksums()->Add(Util::BaseFileName(ofn),
+			bHasCrc ? lFileSize : -1, lFileCrc, m_pFileInfo->GetHash16k());
+	}
 	if (strcmp(m_pFileInfo->GetNZBInfo()->GetDestDir(), szNZBDestDir))
 	{
 		// destination directory was changed during completion, need to move the file
@@ -1147,6 +1244,59 @@ void ArticleDownloader::CompleteFileParts()
 	SetStatus(adJoined);
 }
 
+/*
+ * Computes CRC32 of the file from CRCs of its articles.
+ * Returns false if the checksums of articles are not available (for example
+ * if the articles were not yEnc-encoded or were downloaded before the program
+ * was restarted) or if the articles do not cover the whole file.
+ */
+bool ArticleDownloader::CalcFileCrc(long long* pFileSize, unsigned long* pFileCrc)
+{
+	long long lOffset = 0;
+	unsigned long lCrc = 0;
+
+	for (FileInfo::Articles::iterator it = m_pFileInfo->GetArticles()->begin(); it != m_pFileInfo->GetArticles()->end(); it++)
+	{
+		ArticleInfo* pa = *it;
+		if (pa->GetStatus() != ArticleInfo::aiFinished || pa->GetSegmentOffset() != lOffset || pa->GetSegmentSize() <= 0)
+		{
+			return false;
+		}
+		lCrc = Util::Crc32Combine(lCrc, pa->GetCrc(), pa->GetSegmentSize());
+		lOffset += pa->GetSegmentSize();
+	}
+
+	*pFileSize = lOffset;
+	*pFileCrc = lCrc;
+	return true;
+}
+
+#ifndef DISABLE_PARCHECK
+/*
+ * Computes MD5-hash of the first 16 KB of the file if the article was the
+ * first segment of the file. The hash is used by par-renamer to detect
+ * obfuscated files without reading them from disk.
+ */
+void ArticleDownloader::CalcHash16k()
+{
+	int iHeadLen = m_YDecoder.GetHeadLen();
+	if (iHeadLen == 0 || (iHeadLen < HASH16K_SIZE && (unsigned long)iHeadLen != m_YDecoder.GetSize()))
+	{
+		// not the first segment or the segment is smaller than 16 KB
+		return;
+	}
+
+	MD5Hash hash16k;
+	MD5Context context;
+	context.Update(m_YDecoder.GetHead(), iHeadLen);
+	context.Final(hash16k);
+
+	g_pDownloadQueueHolder->LockQueue();
+	m_pFileInfo->SetHash16k(hash16k.print().c_str());
+	g_pDownloadQueueHolder->UnlockQueue();
+}
+#endif
+
 bool ArticleDownloader::MoveCompletedFiles(NZBInfo* pNZBInfo, const char* szOldDestDir)
 {
 	if (pNZBInfo->GetCompletedFiles()->empty())
@@ -72,6 +72,11 @@ private:
 	UDecoder			m_UDecoder;
 	FILE*				m_pOutFile;
 	bool				m_bDuplicate;
+	AtomicCounter		m_iDownloadedBytes;
+	NewsServer*			m_pSpeedServer;
+	int					m_iArticleBytes;
+	int					m_iArticleLatency;
+	int					m_iArticleTransferTime;
 
 	EStatus				Download();
 	bool				Write(char* szLine, int iLen);
@@ -79,7 +84,12 @@ private:
 	bool				CreateOutputFile(int iSize);
 	void				BuildOutputFilename();
 	EStatus				DecodeCheck();
+	bool				CalcFileCrc(long long* pFileSize, unsigned long* pFileCrc);
+#ifndef DISABLE_PARCHECK
+	void				CalcHash16k();
+#endif
 	void				FreeConnection(bool bKeepConnected);
+	void				AddArticleResult(NewsServer* pNewsServer, EStatus eStatus);
 	EStatus				CheckResponse(const char* szResponse, const char* szComment);
 	void				SetStatus(EStatus eStatus) { m_eStatus = eStatus; }
 	const char* 		GetTempFilename() { return m_szTempFilename; }
@@ -105,6 +115,8 @@ public:
 	void				CompleteFileParts();
 	static bool			MoveCompletedFiles(NZBInfo* pNZBInfo, const char* szOldDestDir);
 	void				SetConnection(NNTPConnection* pConnection) { m_pConnection = pConnection; }
+	int					TakeDownloadedBytes() { return m_iDownloadedBytes.Exchange(0); }
+	NewsServer*			GetSpeedServer() { return m_pSpeedServer; }
 
 	void				LogDebugInfo();
 };
@@ -114,7 +126,6 @@ class DownloadSpeedMeter
 public:
 	virtual				~DownloadSpeedMeter() {};
 	virtual int			CalcCurrentDownloadSpeed() = 0;
-	virtual void		AddSpeedReading(int iBytes) = 0;
 };
 
 #endif
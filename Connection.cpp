@@ -38,6 +38,9 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
+#include <time.h>
+#include <vector>
+#include <deque>
 #ifdef WIN32
 #include <winsock2.h>
 #include <ws2tcpip.h>
@@ -45,23 +48,72 @@
 #include <netdb.h>
 #include <unistd.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <sys/socket.h>
 #include <sys/time.h>
+#include <poll.h>
 #include <arpa/inet.h>
 #include <netinet/in.h>
 #endif
+#ifdef HAVE_SYS_SENDFILE_H
+#include <sys/sendfile.h>
+#endif
 
 #include "nzbget.h"
 #include "Connection.h"
 #include "Log.h"
+#include "Util.h"
 
 static const int CONNECTION_READBUFFER_SIZE = 1024;
+static const int CONNECTION_SENDFILE_BUFFER_SIZE = 64 * 1024;
 #ifndef HAVE_GETADDRINFO
 #ifndef HAVE_GETHOSTBYNAME_R
 Mutex* Connection::m_pMutexGetHostByName = NULL;
 #endif
 #endif
 
+#ifdef HAVE_GETADDRINFO
+// resolved addresses are reused by all connections during this time (seconds)
+static const int HOSTCACHE_TIME = 300;
+// delay before starting of connection attempt to the next address (milliseconds)
+static const int CONNECT_ATTEMPT_DELAY = 250;
+
+typedef struct
+{
+	int						iFamily;
+	int						iSockType;
+	int						iProtocol;
+	socklen_t				iAddrLen;
+	struct sockaddr_storage	Addr;
+} HostAddr;
+
+class HostAddrList : public std::vector<HostAddr> {};
+
+/*
+ * While the host is being resolved the entry is pending and its mutex is
+ * locked by the resolving thread; other connections to the same host wait
+ * on that mutex. Entries used by waiting threads are never deleted from
+ * the cache; a failed entry is removed from the cache and deleted by the
+ * last thread using it.
+ */
+struct CachedHost
+{
+	char*					szHost;
+	int						iPort;
+	time_t					tResolved;
+	int						iRotation;
+	bool					bPending;
+	int						iWaiters;
+	Mutex					mutexPending;
+	HostAddrList			AddrList;
+};
+
+class HostCache : public std::deque<CachedHost*> {};
+
+Mutex* Connection::m_pMutexHostCache = NULL;
+HostCache* Connection::m_pHostCache = NULL;
+#endif
+
 
 void Connection::Init()
 {
@@ -91,6 +143,9 @@ void Connection::Init()
 #ifndef HAVE_GETHOSTBYNAME_R
 	m_pMutexGetHostByName = new Mutex();
 #endif
+#else
+	m_pMutexHostCache = new Mutex();
+	m_pHostCache = new HostCache();
 #endif
 }
 
@@ -110,6 +165,15 @@ void Connection::Final()
 #ifndef HAVE_GETHOSTBYNAME_R
 	delete m_pMutexGetHostByName;
 #endif
+#else
+	for (HostCache::iterator it = m_pHostCache->begin(); it != m_pHostCache->end(); it++)
+	{
+		CachedHost* pCachedHost = *it;
+		free(pCachedHost->szHost);
+		delete pCachedHost;
+	}
+	delete m_pHostCache;
+	delete m_pMutexHostCache;
 #endif
 }
 
@@ -125,11 +189,13 @@ Connection::Connection(const char* szHost, int iPort, bool bTLS)
 	m_iSocket			= INVALID_SOCKET;
 	m_iBufAvail			= 0;
 	m_iTimeout			= 60;
+	m_tDeadline			= 0;
 	m_bSuppressErrors	= true;
 	m_szReadBuf			= (char*)malloc(CONNECTION_READBUFFER_SIZE + 1);
 #ifndef DISABLE_TLS
 	m_pTLSSocket		= NULL;
 	m_bTLSError			= false;
+	m_pTLSSessionCache	= NULL;
 #endif
 
 	if (szHost)
@@ -150,11 +216,13 @@ Connection::Connection(SOCKET iSocket, bool bTLS)
 	m_iSocket			= iSocket;
 	m_iBufAvail			= 0;
 	m_iTimeout			= 60;
+	m_tDeadline			= 0;
 	m_bSuppressErrors	= true;
 	m_szReadBuf			= (char*)malloc(CONNECTION_READBUFFER_SIZE + 1);
 #ifndef DISABLE_TLS
 	m_pTLSSocket		= NULL;
 	m_bTLSError			= false;
+	m_pTLSSessionCache	= NULL;
 #endif
 }
 
@@ -193,6 +261,45 @@ void Connection::SetSuppressErrors(bool bSuppressErrors)
 #endif
 }
 
+/*
+ * Sets the timeout (in seconds) for single receive and send operations.
+ * On connected sockets the timeout takes effect immediately.
+ */
+void Connection::SetTimeout(int iTimeout)
+{
+	m_iTimeout = iTimeout;
+	if (m_eStatus == csConnected && m_iSocket != INVALID_SOCKET)
+	{
+		InitSocketTimeout();
+	}
+}
+
+/*
+ * Limits the total time (in seconds) of data exchange on the connection.
+ * Receive and send operations fail once the limit is exceeded; together with
+ * the timeout of single operations this caps the lifetime of connection.
+ */
+void Connection::SetTimeLimit(int iTimeLimit)
+{
+	m_tDeadline = iTimeLimit > 0 ? time(NULL) + iTimeLimit : 0;
+}
+
+bool Connection::InitSocketTimeout()
+{
+#ifdef WIN32
+	int MSecVal = m_iTimeout * 1000;
+	int err = setsockopt(m_iSocket, SOL_SOCKET, SO_RCVTIMEO, (char*)&MSecVal, sizeof(MSecVal));
+	err = err || setsockopt(m_iSocket, SOL_SOCKET, SO_SNDTIMEO, (char*)&MSecVal, sizeof(MSecVal));
+#else
+	struct timeval TimeVal;
+	TimeVal.tv_sec = m_iTimeout;
+	TimeVal.tv_usec = 0;
+	int err = setsockopt(m_iSocket, SOL_SOCKET, SO_RCVTIMEO, (char*)&TimeVal, sizeof(TimeVal));
+	err = err || setsockopt(m_iSocket, SOL_SOCKET, SO_SNDTIMEO, (char*)&TimeVal, sizeof(TimeVal));
+#endif
+	return err == 0;
+}
+
 void Connection::SetCipher(const char* szCipher)
 {
 	if (m_szCipher)
@@ -373,6 +480,10 @@ bool Connection::Send(const char* pBuffer, int iSize)
 	int iBytesSent = 0;
 	while (iBytesSent < iSize)
 	{
+		if (TimeLimitExceeded())
+		{
+			return false;
+		}
 		int iRes = send(m_iSocket, pBuffer + iBytesSent, iSize-iBytesSent, 0);
 		if (iRes <= 0)
 		{
@@ -384,6 +495,74 @@ bool Connection::Send(const char* pBuffer, int iSize)
 	return true;
 }
 
+/*
+ * Sends "lSize" bytes from the current position of the file.
+ * On plain connections the data is transferred by kernel ("sendfile") without
+ * copying into user space; on TLS-connections (or if "sendfile" is not supported)
+ * the file is sent in chunks through a small buffer.
+ */
+bool Connection::SendFile(FILE* pFile, long long lSize)
+{
+	debug("Sending file");
+
+	if (m_eStatus != csConnected)
+	{
+		return false;
+	}
+
+	long long lBytesSent = 0;
+
+#ifdef HAVE_SYS_SENDFILE_H
+#ifndef DISABLE_TLS
+	if (!m_pTLSSocket)
+#endif
+	{
+		int iFd = fileno(pFile);
+		while (lBytesSent < lSize)
+		{
+			if (TimeLimitExceeded())
+			{
+				return false;
+			}
+			size_t iChunk = (size_t)(lSize - lBytesSent < 0x40000000 ? lSize - lBytesSent : 0x40000000);
+			ssize_t iRes = sendfile(m_iSocket, iFd, NULL, iChunk);
+			if (iRes < 0 && lBytesSent == 0 && (errno == EINVAL || errno == ENOSYS))
+			{
+				// not supported for this file, falling back to buffered send
+				break;
+			}
+			if (iRes <= 0)
+			{
+				return false;
+			}
+			lBytesSent += iRes;
+		}
+
+		if (lBytesSent == lSize)
+		{
+			return true;
+		}
+	}
+#endif
+
+	char* szBuffer = (char*)malloc(CONNECTION_SENDFILE_BUFFER_SIZE);
+	bool bOK = true;
+	while (lBytesSent < lSize)
+	{
+		int iChunk = (int)(lSize - lBytesSent < CONNECTION_SENDFILE_BUFFER_SIZE ? lSize - lBytesSent : CONNECTION_SENDFILE_BUFFER_SIZE);
+		int iRead = (int)fread(szBuffer, 1, iChunk, pFile);
+		if (iRead <= 0 || !Send(szBuffer, iRead))
+		{
+			bOK = false;
+			break;
+		}
+		lBytesSent += iRead;
+	}
+	free(szBuffer);
+
+	return bOK;
+}
+
 char* Connection::ReadLine(char* pBuffer, int iSize, int* pBytesRead)
 {
 	if (m_eStatus != csConnected)
@@ -400,6 +579,10 @@ char* Connection::ReadLine(char* pBuffer, int iSize, int* pBytesRead)
 	{
 		if (!iBufAvail)
 		{
+			if (TimeLimitExceeded())
+			{
+				break;
+			}
 			iBufAvail = recv(m_iSocket, m_szReadBuf, CONNECTION_READBUFFER_SIZE, 0);
 			if (iBufAvail < 0)
 			{
@@ -490,6 +673,11 @@ int Connection::TryRecv(char* pBuffer, int iSize)
 
 	memset(pBuffer, 0, iSize);
 
+	if (TimeLimitExceeded())
+	{
+		return -1;
+	}
+
 	int iReceived = recv(m_iSocket, pBuffer, iSize, 0);
 
 	if (iReceived < 0)
@@ -522,6 +710,10 @@ bool Connection::Recv(char * pBuffer, int iSize)
 	// Read from the socket until nothing remains
 	while (NeedBytes > 0)
 	{
+		if (TimeLimitExceeded())
+		{
+			return false;
+		}
 		int iReceived = recv(m_iSocket, pBufPtr, NeedBytes, 0);
 		// Did the recv succeed?
 		if (iReceived <= 0)
@@ -542,54 +734,18 @@ bool Connection::DoConnect()
 	m_iSocket = INVALID_SOCKET;
 	
 #ifdef HAVE_GETADDRINFO
-	struct addrinfo addr_hints, *addr_list, *addr;
-	char iPortStr[sizeof(int) * 4 + 1]; //is enough to hold any converted int
-
-	memset(&addr_hints, 0, sizeof(addr_hints));
-	addr_hints.ai_family = AF_UNSPEC;    /* Allow IPv4 or IPv6 */
-	addr_hints.ai_socktype = SOCK_STREAM,
-
-	sprintf(iPortStr, "%d", m_iPort);
-
-	int res = getaddrinfo(m_szHost, iPortStr, &addr_hints, &addr_list);
-	if (res != 0)
+	HostAddrList AddrList;
+	if (!ResolveHost(&AddrList))
 	{
-		ReportError("Could not resolve hostname %s", m_szHost, true, 0);
 		return false;
 	}
 
-	for (addr = addr_list; addr != NULL; addr = addr->ai_next)
-	{
-		bool bLastAddr = !addr->ai_next;
-		m_iSocket = socket(addr->ai_family, addr->ai_socktype, addr->ai_protocol);
-		if (m_iSocket != INVALID_SOCKET)
-		{
-			res = connect(m_iSocket , addr->ai_addr, addr->ai_addrlen);
-			if (res != -1) 
-			{
-				// Connection established
-				break;
-			}
-			// Connection failed
-			if (bLastAddr)
-			{
-				ReportError("Connection to %s failed", m_szHost, true, 0);
-			}
-			closesocket(m_iSocket);
-			m_iSocket = INVALID_SOCKET;
-		}
-		else if (bLastAddr)
-		{
-			ReportError("Socket creation failed for %s", m_szHost, true, 0);
-		}
-	}
-
-	freeaddrinfo(addr_list);
-
-	if (m_iSocket == INVALID_SOCKET)
+	if (!ConnectAddrs(&AddrList))
 	{
+		// the addresses may be outdated, resolve again on next attempt
+		ForgetCachedHost(m_szHost, m_iPort);
 		return false;
-	} 
+	}
 
 #else
 
@@ -620,16 +776,7 @@ bool Connection::DoConnect()
 	}
 #endif
 
-#ifdef WIN32
-	int MSecVal = m_iTimeout * 1000;
-	int err = setsockopt(m_iSocket, SOL_SOCKET, SO_RCVTIMEO, (char*)&MSecVal, sizeof(MSecVal));
-#else
-	struct timeval TimeVal;
-	TimeVal.tv_sec = m_iTimeout;
-	TimeVal.tv_usec = 0;
-	int err = setsockopt(m_iSocket, SOL_SOCKET, SO_RCVTIMEO, (char*)&TimeVal, sizeof(TimeVal));
-#endif
-	if (err != 0)
+	if (!InitSocketTimeout())
 	{
 		ReportError("Socket initialization failed for %s", m_szHost, true, 0);
 	}
@@ -751,6 +898,7 @@ bool Connection::StartTLS(bool bIsClient, const char* szCertFile, const char* sz
 
 	m_pTLSSocket = new TLSSocket(m_iSocket, bIsClient, szCertFile, szKeyFile, m_szCipher);
 	m_pTLSSocket->SetSuppressErrors(m_bSuppressErrors);
+	m_pTLSSocket->SetSessionCache(m_pTLSSessionCache);
 
 	return m_pTLSSocket->Start();
 }
@@ -809,6 +957,408 @@ int Connection::send(SOCKET s, const char* buf, int len, int flags)
 }
 #endif
 
+#ifdef HAVE_GETADDRINFO
+/*
+ * Returns the cache entry of the host, expired entries are deleted.
+ * Must be called with locked m_pMutexHostCache.
+ */
+CachedHost* Connection::FindCachedHost(const char* szHost, int iPort)
+{
+	time_t tCurTime = time(NULL);
+
+	for (HostCache::iterator it = m_pHostCache->begin(); it != m_pHostCache->end(); it++)
+	{
+		CachedHost* pCachedHost = *it;
+		if (!strcmp(pCachedHost->szHost, szHost) && pCachedHost->iPort == iPort)
+		{
+			if (!pCachedHost->bPending && pCachedHost->iWaiters == 0 &&
+				(tCurTime - pCachedHost->tResolved > HOSTCACHE_TIME || tCurTime < pCachedHost->tResolved))
+			{
+				m_pHostCache->erase(it);
+				free(pCachedHost->szHost);
+				delete pCachedHost;
+				return NULL;
+			}
+			return pCachedHost;
+		}
+	}
+
+	return NULL;
+}
+
+/*
+ * Copies the cached addresses of the host into the list. The addresses of
+ * each family are rotated on every call to distribute the connections among
+ * all addresses of the host. Address families are interleaved, starting with
+ * the preferred family (the family of the first address returned by getaddrinfo).
+ * Must be called with locked m_pMutexHostCache.
+ */
+void Connection::CopyCachedAddrs(CachedHost* pCachedHost, HostAddrList* pAddrList)
+{
+	HostAddrList* pCachedList = &pCachedHost->AddrList;
+	int iCount = (int)pCachedList->size();
+	int iPreferredFamily = (*pCachedList)[0].iFamily;
+	int iRotation = pCachedHost->iRotation++;
+
+	HostAddrList Preferred, Other;
+	for (int i = 0; i < iCount; i++)
+	{
+		HostAddr* pAddr = &(*pCachedList)[(i + iRotation) % iCount];
+		(pAddr->iFamily == iPreferredFamily ? Preferred : Other).push_back(*pAddr);
+	}
+
+	pAddrList->clear();
+	for (unsigned int i = 0; i < Preferred.size() || i < Other.size(); i++)
+	{
+		if (i < Preferred.size())
+		{
+			pAddrList->push_back(Preferred[i]);
+		}
+		if (i < Other.size())
+		{
+			pAddrList->push_back(Other[i]);
+		}
+	}
+}
+
+void Connection::ForgetCachedHost(const char* szHost, int iPort)
+{
+	m_pMutexHostCache->Lock();
+
+	CachedHost* pCachedHost = FindCachedHost(szHost, iPort);
+	if (pCachedHost && !pCachedHost->bPending)
+	{
+		// the entry is deleted on next lookup or when the last waiting thread leaves it
+		pCachedHost->tResolved = 0;
+	}
+
+	m_pMutexHostCache->Unlock();
+}
+
+/*
+ * Resolves the host using the cache shared by all connections.
+ * When many connections to the same host are established at once only the
+ * first one performs a DNS-lookup, others wait for it and take the result
+ * from the cache. Lookups of different hosts run in parallel.
+ */
+bool Connection::ResolveHost(HostAddrList* pAddrList)
+{
+	m_pMutexHostCache->Lock();
+
+	CachedHost* pCachedHost = FindCachedHost(m_szHost, m_iPort);
+
+	if (pCachedHost && !pCachedHost->bPending)
+	{
+		CopyCachedAddrs(pCachedHost, pAddrList);
+		m_pMutexHostCache->Unlock();
+		return true;
+	}
+
+	if (pCachedHost)
+	{
+		// another connection is resolving the host, wait for it
+		pCachedHost->iWaiters++;
+		m_pMutexHostCache->Unlock();
+
+		pCachedHost->mutexPending.Lock();
+		pCachedHost->mutexPending.Unlock();
+
+		m_pMutexHostCache->Lock();
+		pCachedHost->iWaiters--;
+		bool bResolved = !pCachedHost->AddrList.empty();
+		if (bResolved)
+		{
+			CopyCachedAddrs(pCachedHost, pAddrList);
+		}
+		else if (pCachedHost->iWaiters == 0)
+		{
+			// failed entries are not in the cache anymore
+			free(pCachedHost->szHost);
+			delete pCachedHost;
+		}
+		m_pMutexHostCache->Unlock();
+
+		if (!bResolved)
+		{
+			ReportError("Could not resolve hostname %s", m_szHost, false, 0);
+		}
+		return bResolved;
+	}
+
+	pCachedHost = new CachedHost();
+	pCachedHost->szHost = strdup(m_szHost);
+	pCachedHost->iPort = m_iPort;
+	pCachedHost->tResolved = 0;
+	pCachedHost->iRotation = 0;
+	pCachedHost->bPending = true;
+	pCachedHost->iWaiters = 0;
+	pCachedHost->mutexPending.Lock();
+	m_pHostCache->push_back(pCachedHost);
+
+	m_pMutexHostCache->Unlock();
+
+	struct addrinfo addr_hints, *addr_list, *addr;
+	char iPortStr[sizeof(int) * 4 + 1]; //is enough to hold any converted int
+
+	memset(&addr_hints, 0, sizeof(addr_hints));
+	addr_hints.ai_family = AF_UNSPEC;    /* Allow IPv4 or IPv6 */
+	addr_hints.ai_socktype = SOCK_STREAM,
+
+	sprintf(iPortStr, "%d", m_iPort);
+
+	HostAddrList AddrList;
+	int res = getaddrinfo(m_szHost, iPortStr, &addr_hints, &addr_list);
+	if (res == 0)
+	{
+		for (addr = addr_list; addr != NULL; addr = addr->ai_next)
+		{
+			if (addr->ai_addrlen > sizeof(struct sockaddr_storage))
+			{
+				continue;
+			}
+			HostAddr Addr;
+			Addr.iFamily = addr->ai_family;
+			Addr.iSockType = addr->ai_socktype;
+			Addr.iProtocol = addr->ai_protocol;
+			Addr.iAddrLen = (socklen_t)addr->ai_addrlen;
+			memcpy(&Addr.Addr, addr->ai_addr, addr->ai_addrlen);
+			AddrList.push_back(Addr);
+		}
+
+		freeaddrinfo(addr_list);
+	}
+
+	bool bResolved = !AddrList.empty();
+	bool bDelete = false;
+
+	m_pMutexHostCache->Lock();
+
+	pCachedHost->bPending = false;
+	pCachedHost->tResolved = time(NULL);
+	if (bResolved)
+	{
+		pCachedHost->AddrList = AddrList;
+		CopyCachedAddrs(pCachedHost, pAddrList);
+	}
+	else
+	{
+		for (HostCache::iterator it = m_pHostCache->begin(); it != m_pHostCache->end(); it++)
+		{
+			if (*it == pCachedHost)
+			{
+				m_pHostCache->erase(it);
+				break;
+			}
+		}
+		bDelete = pCachedHost->iWaiters == 0;
+	}
+
+	m_pMutexHostCache->Unlock();
+
+	pCachedHost->mutexPending.Unlock();
+
+	if (bDelete)
+	{
+		free(pCachedHost->szHost);
+		delete pCachedHost;
+	}
+
+	if (!bResolved)
+	{
+		ReportError("Could not resolve hostname %s", m_szHost, res != 0, 0);
+	}
+
+	return bResolved;
+}
+
+static void SetSocketNonBlocking(SOCKET iSocket, bool bNonBlocking)
+{
+#ifdef WIN32
+	u_long iMode = bNonBlocking ? 1 : 0;
+	ioctlsocket(iSocket, FIONBIO, &iMode);
+#else
+	int iFlags = fcntl(iSocket, F_GETFL, 0);
+	fcntl(iSocket, F_SETFL, bNonBlocking ? iFlags | O_NONBLOCK : iFlags & ~O_NONBLOCK);
+#endif
+}
+
+/*
+ * Connects to one of the resolved addresses. If a connection attempt doesn't
+ * succeed within a short delay the attempt to the next address is started
+ * without cancelling the previous attempts ("happy eyeballs", RFC 6555).
+ * The first established connection is used, other attempts are cancelled.
+ */
+bool Connection::ConnectAddrs(HostAddrList* pAddrList)
+{
+	std::vector<SOCKET> Attempts;
+	SOCKET iConnected = INVALID_SOCKET;
+	unsigned int iNextAddr = 0;
+	int iLastError = 0;
+	long long iCurTime = Util::CurrentMSec();
+	long long iDeadline = iCurTime + (long long)m_iTimeout * 1000;
+	long long iNextAttemptTime = iCurTime;
+
+	while (iConnected == INVALID_SOCKET)
+	{
+		iCurTime = Util::CurrentMSec();
+
+		if (iNextAddr < pAddrList->size() && (iCurTime >= iNextAttemptTime || Attempts.empty()))
+		{
+			HostAddr* pAddr = &(*pAddrList)[iNextAddr++];
+			iNextAttemptTime = iCurTime + CONNECT_ATTEMPT_DELAY;
+
+			SOCKET iSocket = socket(pAddr->iFamily, pAddr->iSockType, pAddr->iProtocol);
+			if (iSocket == INVALID_SOCKET)
+			{
+#ifdef WIN32
+				iLastError = WSAGetLastError();
+#else
+				iLastError = errno;
+#endif
+				continue;
+			}
+
+			SetSocketNonBlocking(iSocket, true);
+			int res = connect(iSocket, (struct sockaddr*)&pAddr->Addr, pAddr->iAddrLen);
+			if (res == 0)
+			{
+				iConnected = iSocket;
+				break;
+			}
+
+#ifdef WIN32
+			iLastError = WSAGetLastError();
+			bool bInProgress = iLastError == WSAEWOULDBLOCK;
+#else
+			iLastError = errno;
+			bool bInProgress = iLastError == EINPROGRESS;
+#endif
+			if (!bInProgress)
+			{
+				closesocket(iSocket);
+				continue;
+			}
+
+			Attempts.push_back(iSocket);
+			continue;
+		}
+
+		if (Attempts.empty())
+		{
+			// all attempts failed
+			break;
+		}
+
+		if (m_iTimeout > 0 && iCurTime >= iDeadline)
+		{
+#ifdef WIN32
+			iLastError = WSAETIMEDOUT;
+#else
+			iLastError = ETIMEDOUT;
+#endif
+			break;
+		}
+
+		long long iWait = m_iTimeout > 0 ? iDeadline - iCurTime : 1000;
+		if (iNextAddr < pAddrList->size() && iNextAttemptTime - iCurTime < iWait)
+		{
+			iWait = iNextAttemptTime - iCurTime;
+		}
+
+#ifdef WIN32
+		fd_set WriteSet, ErrorSet;
+		FD_ZERO(&WriteSet);
+		FD_ZERO(&ErrorSet);
+		for (std::vector<SOCKET>::iterator it = Attempts.begin(); it != Attempts.end(); it++)
+		{
+			FD_SET(*it, &WriteSet);
+			FD_SET(*it, &ErrorSet);
+		}
+
+		struct timeval WaitTime;
+		WaitTime.tv_sec = (long)(iWait / 1000);
+		WaitTime.tv_usec = (long)(iWait % 1000) * 1000;
+
+		int res = select(0, NULL, &WriteSet, &ErrorSet, &WaitTime);
+#else
+		// poll() has no limit on descriptor numbers unlike select()
+		std::vector<struct pollfd> PollSet(Attempts.size());
+		for (unsigned int i = 0; i < Attempts.size(); i++)
+		{
+			PollSet[i].fd = Attempts[i];
+			PollSet[i].events = POLLOUT;
+			PollSet[i].revents = 0;
+		}
+
+		int res = poll(&PollSet[0], (nfds_t)PollSet.size(), (int)iWait);
+#endif
+		if (res < 0)
+		{
+#ifdef WIN32
+			iLastError = WSAGetLastError();
+#else
+			iLastError = errno;
+			if (iLastError == EINTR)
+			{
+				continue;
+			}
+#endif
+			break;
+		}
+
+		int iIndex = 0;
+		for (std::vector<SOCKET>::iterator it = Attempts.begin(); it != Attempts.end(); iIndex++)
+		{
+			SOCKET iSocket = *it;
+#ifdef WIN32
+			bool bReady = FD_ISSET(iSocket, &WriteSet) || FD_ISSET(iSocket, &ErrorSet);
+#else
+			bool bReady = PollSet[iIndex].revents != 0;
+#endif
+			if (bReady)
+			{
+				int iError = 0;
+				socklen_t iErrLen = sizeof(iError);
+				getsockopt(iSocket, SOL_SOCKET, SO_ERROR, (char*)&iError, &iErrLen);
+				it = Attempts.erase(it);
+				if (iError == 0 && iConnected == INVALID_SOCKET)
+				{
+					iConnected = iSocket;
+				}
+				else
+				{
+					iLastError = iError;
+					closesocket(iSocket);
+				}
+				continue;
+			}
+			it++;
+		}
+	}
+
+	for (std::vector<SOCKET>::iterator it = Attempts.begin(); it != Attempts.end(); it++)
+	{
+		closesocket(*it);
+	}
+
+	if (iConnected == INVALID_SOCKET)
+	{
+#ifdef WIN32
+		WSASetLastError(iLastError);
+#else
+		errno = iLastError;
+#endif
+		ReportError("Connection to %s failed", m_szHost, true, 0);
+		return false;
+	}
+
+	SetSocketNonBlocking(iConnected, false);
+	m_iSocket = iConnected;
+
+	return true;
+}
+#endif
+
 #ifndef HAVE_GETADDRINFO
 unsigned int Connection::ResolveHostAddr(const char* szHost)
 {
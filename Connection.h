@@ -27,15 +27,20 @@
 #ifndef CONNECTION_H
 #define CONNECTION_H
 
-#ifndef HAVE_GETADDRINFO
-#ifndef HAVE_GETHOSTBYNAME_R
+#include <stdio.h>
+#include <time.h>
+
 #include "Thread.h"
-#endif
-#endif
 #ifndef DISABLE_TLS
 #include "TLS.h"
 #endif
 
+#ifdef HAVE_GETADDRINFO
+class HostAddrList;
+class HostCache;
+struct CachedHost;
+#endif
+
 class Connection
 {
 public:
@@ -58,24 +63,38 @@ protected:
 	char*				m_szBufPtr;
 	EStatus				m_eStatus;
 	int					m_iTimeout;
+	time_t				m_tDeadline;
 	bool				m_bSuppressErrors;
 	char				m_szRemoteAddr[20];
 #ifndef DISABLE_TLS
 	TLSSocket*			m_pTLSSocket;
 	bool				m_bTLSError;
+	TLSSessionCache*	m_pTLSSessionCache;
 #endif
 #ifndef HAVE_GETADDRINFO
 #ifndef HAVE_GETHOSTBYNAME_R
 	static Mutex*		m_pMutexGetHostByName;
 #endif
+#endif
+#ifdef HAVE_GETADDRINFO
+	static Mutex*		m_pMutexHostCache;
+	static HostCache*	m_pHostCache;
 #endif
 
 						Connection(SOCKET iSocket, bool bTLS);
 	void				ReportError(const char* szMsgPrefix, const char* szMsgArg, bool PrintErrCode, int herrno);
 	bool				DoConnect();
 	bool				DoDisconnect();
+	bool				InitSocketTimeout();
+	bool				TimeLimitExceeded() { return m_tDeadline > 0 && time(NULL) >= m_tDeadline; }
 #ifndef HAVE_GETADDRINFO
 	unsigned int		ResolveHostAddr(const char* szHost);
+#else
+	bool				ResolveHost(HostAddrList* pAddrList);
+	bool				ConnectAddrs(HostAddrList* pAddrList);
+	static CachedHost*	FindCachedHost(const char* szHost, int iPort);
+	static void			CopyCachedAddrs(CachedHost* pCachedHost, HostAddrList* pAddrList);
+	static void			ForgetCachedHost(const char* szHost, int iPort);
 #endif
 #ifndef DISABLE_TLS
 	int					recv(SOCKET s, char* buf, int len, int flags);
@@ -92,6 +111,7 @@ public:
 	virtual bool		Disconnect();
 	bool				Bind();
 	bool				Send(const char* pBuffer, int iSize);
+	bool				SendFile(FILE* pFile, long long lSize);
 	bool				Recv(char* pBuffer, int iSize);
 	int					TryRecv(char* pBuffer, int iSize);
 	char*				ReadLine(char* pBuffer, int iSize, int* pBytesRead);
@@ -104,13 +124,15 @@ public:
 	bool				GetTLS() { return m_bTLS; }
 	const char*			GetCipher() { return m_szCipher; }
 	void				SetCipher(const char* szCipher);
-	void				SetTimeout(int iTimeout) { m_iTimeout = iTimeout; }
+	void				SetTimeout(int iTimeout);
+	void				SetTimeLimit(int iTimeLimit);
 	EStatus				GetStatus() { return m_eStatus; }
 	void				SetSuppressErrors(bool bSuppressErrors);
 	bool				GetSuppressErrors() { return m_bSuppressErrors; }
 	const char*			GetRemoteAddr();
 #ifndef DISABLE_TLS
 	bool				StartTLS(bool bIsClient, const char* szCertFile, const char* szKeyFile);
+	void				SetTLSSessionCache(TLSSessionCache* pTLSSessionCache) { m_pTLSSessionCache = pTLSSessionCache; }
 #endif
 };
 
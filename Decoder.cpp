@@ -45,7 +45,6 @@
 #include "Util.h"
 
 const char* Decoder::FormatNames[] = { "Unknown", "yEnc", "UU" };
-unsigned int YDecoder::crc_tab[256];
 
 Decoder::Decoder()
 {
@@ -116,7 +115,6 @@ Decoder::EFormat Decoder::DetectFormat(const char* buffer, int len)
 void YDecoder::Init()
 {
 	debug("Initializing global decoder");
-	crc32gentab();
 }
 
 void YDecoder::Final()
@@ -126,9 +124,32 @@ void YDecoder::Final()
 
 YDecoder::YDecoder()
 {
+	m_pHead = NULL;
+	m_iHeadSize = 0;
 	Clear();
 }
 
+YDecoder::~YDecoder()
+{
+	if (m_pHead)
+	{
+		free(m_pHead);
+	}
+}
+
+/*
+ * Enables capturing of the first "iHeadSize" bytes of the file, if the
+ * decoded article is the first segment of the file.
+ */
+void YDecoder::SetHeadSize(int iHeadSize)
+{
+	if (m_iHeadSize != iHeadSize)
+	{
+		m_pHead = (char*)realloc(m_pHead, iHeadSize);
+		m_iHeadSize = iHeadSize;
+	}
+}
+
 void YDecoder::Clear()
 {
 	Decoder::Clear();
@@ -144,65 +165,12 @@ void YDecoder::Clear()
 	m_iEnd = 0xFFFFFFFF;
 	m_iSize = 0;
 	m_iEndSize = 0;
+	m_iHeadLen = 0;
 	m_bAutoSeek = false;
 	m_bNeedSetPos = false;
 	m_bCrcCheck = false;
 }
 
-/* from crc32.c (http://www.koders.com/c/fid699AFE0A656F0022C9D6B9D1743E697B69CE5815.aspx)
- *
- * (c) 1999,2000 Krzysztof Dabrowski
- * (c) 1999,2000 ElysiuM deeZine
- * Released under GPL (thanks)
- *
- * chksum_crc32gentab() --      to a global crc_tab[256], this one will
- *				calculate the crcTable for crc32-checksums.
- *				it is generated to the polynom [..]
- */
-void YDecoder::crc32gentab()
-{
-	unsigned long crc, poly;
-	int i, j;
-
-	poly = 0xEDB88320L;
-	for (i = 0; i < 256; i++)
-	{
-		crc = i;
-		for (j = 8; j > 0; j--)
-		{
-			if (crc & 1)
-			{
-				crc = (crc >> 1) ^ poly;
-			}
-			else
-			{
-				crc >>= 1;
-			}
-		}
-		crc_tab[i] = crc;
-	}
-}
-
-/* This is modified version of chksum_crc() from
- * crc32.c (http://www.koders.com/c/fid699AFE0A656F0022C9D6B9D1743E697B69CE5815.aspx)
- * (c) 1999,2000 Krzysztof Dabrowski
- * (c) 1999,2000 ElysiuM deeZine
- *
- * chksum_crc() -- to a given block, this one calculates the
- *				crc32-checksum until the length is
- *				reached. the crc32-checksum will be
- *				the result.
- */
-unsigned long YDecoder::crc32m(unsigned long startCrc, unsigned char *block, unsigned int length)
-{
-	register unsigned long crc = startCrc;
-	for (unsigned long i = 0; i < length; i++)
-	{
-		crc = ((crc >> 8) & 0x00FFFFFF) ^ crc_tab[(crc ^ *block++) & 0xFF];
-	}
-	return crc;
-}
-
 unsigned int YDecoder::DecodeBuffer(char* buffer)
 {
 	if (m_bBody && !m_bEnd)
@@ -253,7 +221,7 @@ BreakLoop:
 
 		if (m_bCrcCheck)
 		{
-			m_lCalculatedCRC = crc32m(m_lCalculatedCRC, (unsigned char *)buffer, (unsigned int)(optr - buffer));
+			m_lCalculatedCRC = Util::Crc32m(m_lCalculatedCRC, (unsigned char *)buffer, (unsigned int)(optr - buffer));
 		}
 		return (unsigned int)(optr - buffer);
 	}
@@ -330,6 +298,13 @@ bool YDecoder::Write(char* buffer, int len, FILE* outfile)
 			m_bNeedSetPos = false;
 		}
 		fwrite(buffer, 1, wcnt, outfile);
+
+		if (m_pHead && m_iHeadLen < m_iHeadSize && (!m_bPart || m_iBegin == 1))
+		{
+			int iLen = (int)wcnt < m_iHeadSize - m_iHeadLen ? (int)wcnt : m_iHeadSize - m_iHeadLen;
+			memcpy(m_pHead + m_iHeadLen, buffer, iLen);
+			m_iHeadLen += iLen;
+		}
 	}
 	return true;
 }
@@ -69,7 +69,6 @@ public:
 class YDecoder: public Decoder
 {
 protected:
-	static unsigned int		crc_tab[256];
 	bool					m_bBegin;
 	bool					m_bPart;
 	bool					m_bBody;
@@ -84,18 +83,27 @@ protected:
 	bool					m_bAutoSeek;
 	bool					m_bNeedSetPos;
 	bool					m_bCrcCheck;
+	char*					m_pHead;
+	int						m_iHeadSize;
+	int						m_iHeadLen;
 
 	unsigned int			DecodeBuffer(char* buffer);
-	static void				crc32gentab();
-	unsigned long			crc32m(unsigned long startCrc, unsigned char *block, unsigned int length);
 
 public:
 							YDecoder();
+	virtual					~YDecoder();
 	virtual EStatus			Check();
 	virtual void			Clear();
 	virtual bool			Write(char* buffer, int len, FILE* outfile);
 	void					SetAutoSeek(bool bAutoSeek) { m_bAutoSeek = m_bNeedSetPos = bAutoSeek; }
 	void					SetCrcCheck(bool bCrcCheck) { m_bCrcCheck = bCrcCheck; }
+	unsigned long			GetBegin() { return m_iBegin; }
+	unsigned long			GetEnd() { return m_iEnd; }
+	unsigned long			GetCalculatedCrc() { return m_lCalculatedCRC; }
+	unsigned long			GetSize() { return m_iSize; }
+	void					SetHeadSize(int iHeadSize);
+	const char*				GetHead() { return m_pHead; }
+	int						GetHeadLen() { return m_iHeadLen; }
 
 	static void				Init();
 	static void				Final();
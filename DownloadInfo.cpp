@@ -208,6 +208,73 @@ ScriptStatus::EStatus ScriptStatusList::CalcTotalStatus()
 }
 
 
+FileChecksum::FileChecksum(const char* szFilename, long long lSize, unsigned long lCrc, const char* szHash16k)
+{
+	m_szFilename = strdup(szFilename);
+	m_lSize = lSize;
+	m_lCrc = lCrc;
+	m_szHash16k = szHash16k ? strdup(szHash16k) : NULL;
+	m_bParVerified = false;
+}
+
+FileChecksum::~FileChecksum()
+{
+	if (m_szFilename)
+	{
+		free(m_szFilename);
+	}
+	if (m_szHash16k)
+	{
+		free(m_szHash16k);
+	}
+}
+
+void FileChecksum::SetFilename(const char* szFilename)
+{
+	if (m_szFilename)
+	{
+		free(m_szFilename);
+	}
+	m_szFilename = strdup(szFilename);
+}
+
+
+FileChecksumList::~FileChecksumList()
+{
+	Clear();
+}
+
+void FileChecksumList::Clear()
+{
+	for (iterator it = begin(); it != end(); it++)
+	{
+		delete *it;
+	}
+	clear();
+}
+
+void FileChecksumList::Add(const char* szFilename, long long lSize, unsigned long lCrc, const char* szHash16k)
+{
+	push_back(new FileChecksum(szFilename, lSize, lCrc, szHash16k));
+}
+
+FileChecksum* FileChecksumList::Find(const char* szFilename)
+{
+	// search from the end: if the file was downloaded more than once
+	// the last download is the relevant one
+	for (reverse_iterator it = rbegin(); it != rend(); it++)
+	{
+		FileChecksum* pFileChecksum = *it;
+		if (!strcmp(pFileChecksum->GetFilename(), szFilename))
+		{
+			return pFileChecksum;
+		}
+	}
+
+	return NULL;
+}
+
+
 NZBInfo::NZBInfo()
 {
 	debug("Creating NZBInfo");
@@ -226,6 +293,8 @@ NZBInfo::NZBInfo()
 	m_eUnpackStatus = usNone;
 	m_eCleanupStatus = csNone;
 	m_eMoveStatus = msNone;
+	m_eDirectUnpackStatus = dsNone;
+	m_pDirectUnpackThread = NULL;
 	m_bDeleted = false;
 	m_bParCleanup = false;
 	m_bCleanupDisk = false;
@@ -234,6 +303,7 @@ NZBInfo::NZBInfo()
 	m_Owner = NULL;
 	m_Messages.clear();
 	m_iIDMessageGen = 0;
+	m_iDownloadRate = 0;
 	m_iIDGen++;
 	m_iID = m_iIDGen;
 }
@@ -457,6 +527,13 @@ void NZBInfo::AppendMessage(Message::EKind eKind, time_t tTime, const char * szT
 	m_mutexLog.Lock();
 	Message* pMessage = new Message(++m_iIDMessageGen, eKind, tTime, szText);
 	m_Messages.push_back(pMessage);
+
+	while (m_Messages.size() > (unsigned int)g_pOptions->GetLogBufferSize())
+	{
+		Message* pMessage = m_Messages.front();
+		delete pMessage;
+		m_Messages.pop_front();
+	}
 	m_mutexLog.Unlock();
 }
 
@@ -506,6 +583,9 @@ ArticleInfo::ArticleInfo()
 	m_iSize 			= 0;
 	m_eStatus			= aiUndefined;
 	m_szResultFilename	= NULL;
+	m_lSegmentOffset	= -1;
+	m_iSegmentSize		= 0;
+	m_lCrc				= 0;
 }
 
 ArticleInfo::~ ArticleInfo()
@@ -560,6 +640,7 @@ FileInfo::FileInfo()
 	m_bExtraPriority = false;
 	m_iActiveDownloads = 0;
 	m_bAutoDeleted = false;
+	m_szHash16k = NULL;
 	m_iIDGen++;
 	m_iID = m_iIDGen;
 }
@@ -580,6 +661,10 @@ FileInfo::~ FileInfo()
 	{
 		free(m_szOutputFilename);
 	}
+	if (m_szHash16k)
+	{
+		free(m_szHash16k);
+	}
 	if (m_pMutexOutputFile)
 	{
 		delete m_pMutexOutputFile;
@@ -641,6 +726,15 @@ void FileInfo::SetFilename(const char* szFilename)
 	m_szFilename = strdup(szFilename);
 }
 
+void FileInfo::SetHash16k(const char* szHash16k)
+{
+	if (m_szHash16k)
+	{
+		free(m_szHash16k);
+	}
+	m_szHash16k = strdup(szHash16k);
+}
+
 void FileInfo::MakeValidFilename()
 {
 	Util::MakeValidFilename(m_szFilename, '_', false);
@@ -54,6 +54,9 @@ private:
 	int					m_iSize;
 	EStatus				m_eStatus;
 	char*				m_szResultFilename;
+	long long			m_lSegmentOffset;
+	int					m_iSegmentSize;
+	unsigned long		m_lCrc;
 
 public:
 						ArticleInfo();
@@ -68,6 +71,12 @@ public:
 	void				SetStatus(EStatus Status) { m_eStatus = Status; }
 	const char*			GetResultFilename() { return m_szResultFilename; }
 	void 				SetResultFilename(const char* v);
+	long long			GetSegmentOffset() { return m_lSegmentOffset; }
+	void				SetSegmentOffset(long long lSegmentOffset) { m_lSegmentOffset = lSegmentOffset; }
+	int					GetSegmentSize() { return m_iSegmentSize; }
+	void				SetSegmentSize(int iSegmentSize) { m_iSegmentSize = iSegmentSize; }
+	unsigned long		GetCrc() { return m_lCrc; }
+	void				SetCrc(unsigned long lCrc) { m_lCrc = lCrc; }
 };
 
 class FileInfo
@@ -97,6 +106,7 @@ private:
 	bool				m_bExtraPriority;
 	int					m_iActiveDownloads;
 	bool				m_bAutoDeleted;
+	char*				m_szHash16k;
 
 	static int			m_iIDGen;
 
@@ -144,6 +154,8 @@ public:
 	void				SetActiveDownloads(int iActiveDownloads);
 	bool				GetAutoDeleted() { return m_bAutoDeleted; }
 	void				SetAutoDeleted(bool bAutoDeleted) { m_bAutoDeleted = bAutoDeleted; }
+	const char*			GetHash16k() { return m_szHash16k; }
+	void				SetHash16k(const char* szHash16k);
 };
                               
 typedef std::deque<FileInfo*> FileQueue;
@@ -250,6 +262,47 @@ public:
 	ScriptStatus::EStatus	CalcTotalStatus();
 };
 
+/*
+ * Checksums of a completed file computed during download:
+ *  - CRC32 of the file, computed from CRCs of articles, used by par-checker
+ *    for quick verification of files. The size is "-1" if the CRC is not known;
+ *  - MD5-hash of the first 16 KB of the file ("hash16k" in par2-terms), used
+ *    by par-renamer to find obfuscated files without reading them from disk.
+ * The flag "ParVerified" is set if the file was already verified against
+ * par2-file during download (option "ParIncremental").
+ */
+class FileChecksum
+{
+private:
+	char* 				m_szFilename;
+	long long			m_lSize;
+	unsigned long		m_lCrc;
+	char*				m_szHash16k;
+	bool				m_bParVerified;
+
+public:
+						FileChecksum(const char* szFilename, long long lSize, unsigned long lCrc, const char* szHash16k);
+						~FileChecksum();
+	const char*			GetFilename() { return m_szFilename; }
+	void				SetFilename(const char* szFilename);
+	long long			GetSize() { return m_lSize; }
+	unsigned long		GetCrc() { return m_lCrc; }
+	const char*			GetHash16k() { return m_szHash16k; }
+	bool				GetParVerified() { return m_bParVerified; }
+	void				SetParVerified(bool bParVerified) { m_bParVerified = bParVerified; }
+};
+
+typedef std::deque<FileChecksum*> FileChecksumListBase;
+
+class FileChecksumList : public FileChecksumListBase
+{
+public:
+						~FileChecksumList();
+	void				Add(const char* szFilename, long long lSize, unsigned long lCrc, const char* szHash16k);
+	FileChecksum*		Find(const char* szFilename);
+	void				Clear();
+};
+
 class NZBInfoList;
 
 class NZBInfo
@@ -295,6 +348,14 @@ public:
 		msSuccess
 	};
 
+	enum EDirectUnpackStatus
+	{
+		dsNone,
+		dsRunning,
+		dsFailure,
+		dsSuccess
+	};
+
 	typedef std::vector<char*>			Files;
 	typedef std::deque<Message*>		Messages;
 
@@ -309,12 +370,15 @@ private:
 	int		 			m_iParkedFileCount;
 	long long 			m_lSize;
 	Files				m_completedFiles;
+	FileChecksumList	m_fileChecksums;
 	bool				m_bPostProcess;
 	ERenameStatus		m_eRenameStatus;
 	EParStatus			m_eParStatus;
 	EUnpackStatus		m_eUnpackStatus;
 	ECleanupStatus		m_eCleanupStatus;
 	EMoveStatus			m_eMoveStatus;
+	EDirectUnpackStatus	m_eDirectUnpackStatus;
+	Thread*				m_pDirectUnpackThread;
 	char*				m_szQueuedFilename;
 	bool				m_bDeleted;
 	bool				m_bParCleanup;
@@ -327,6 +391,8 @@ private:
 	Mutex				m_mutexLog;
 	Messages			m_Messages;
 	int					m_iIDMessageGen;
+	AtomicCounter		m_iSpeedBytes;
+	int					m_iDownloadRate;
 
 	static int			m_iIDGen;
 
@@ -358,6 +424,7 @@ public:
 	void				BuildFinalDirName(char* szFinalDirBuf, int iBufSize);
 	Files*				GetCompletedFiles() { return &m_completedFiles; }		// needs locking (for shared objects)
 	void				ClearCompletedFiles();
+	FileChecksumList*	GetFileChecksums() { return &m_fileChecksums; }		// needs locking (for shared objects)
 	bool				GetPostProcess() { return m_bPostProcess; }
 	void				SetPostProcess(bool bPostProcess) { m_bPostProcess = bPostProcess; }
 	ERenameStatus		GetRenameStatus() { return m_eRenameStatus; }
@@ -370,6 +437,10 @@ public:
 	void				SetCleanupStatus(ECleanupStatus eCleanupStatus) { m_eCleanupStatus = eCleanupStatus; }
 	EMoveStatus			GetMoveStatus() { return m_eMoveStatus; }
 	void				SetMoveStatus(EMoveStatus eMoveStatus) { m_eMoveStatus = eMoveStatus; }
+	EDirectUnpackStatus	GetDirectUnpackStatus() { return m_eDirectUnpackStatus; }			// needs locking (for shared objects)
+	void				SetDirectUnpackStatus(EDirectUnpackStatus eDirectUnpackStatus) { m_eDirectUnpackStatus = eDirectUnpackStatus; }	// needs locking (for shared objects)
+	Thread*				GetDirectUnpackThread() { return m_pDirectUnpackThread; }			// needs locking (for shared objects)
+	void				SetDirectUnpackThread(Thread* pDirectUnpackThread) { m_pDirectUnpackThread = pDirectUnpackThread; }	// needs locking (for shared objects)
 	const char*			GetQueuedFilename() { return m_szQueuedFilename; }
 	void				SetQueuedFilename(const char* szQueuedFilename);
 	bool				GetDeleted() { return m_bDeleted; }
@@ -385,6 +456,10 @@ public:
 	void				AppendMessage(Message::EKind eKind, time_t tTime, const char* szText);
 	Messages*			LockMessages();
 	void				UnlockMessages();
+	void				AddSpeedBytes(int iBytes) { m_iSpeedBytes.Add(iBytes); }
+	int					TakeSpeedBytes() { return m_iSpeedBytes.Exchange(0); }
+	int					GetDownloadRate() { return m_iDownloadRate; }
+	void				SetDownloadRate(int iDownloadRate) { m_iDownloadRate = iDownloadRate; }
 };
 
 typedef std::deque<NZBInfo*> NZBInfoListBase;
@@ -61,6 +61,7 @@ FeedCoordinator::FeedCoordinator()
 	debug("Creating FeedCoordinator");
 	m_bForce = false;
 	m_bSave = false;
+	m_pThreadPool = ThreadPool::GetPool("feed");
 
 	m_UrlCoordinatorObserver.m_pOwner = this;
 	g_pUrlCoordinator->Attach(&m_UrlCoordinatorObserver);
@@ -97,6 +98,8 @@ void FeedCoordinator::Run()
 {
 	debug("Entering FeedCoordinator-loop");
 
+	m_pThreadPool->SetMaxWorkers(g_pOptions->GetUrlConnections());
+
 	m_mutexDownloads.Lock();
 	if (g_pOptions->GetServerMode() && g_pOptions->GetSaveQueue() && g_pOptions->GetReloadQueue())
 	{
@@ -251,6 +254,7 @@ void FeedCoordinator::StartFeedDownload(FeedInfo* pFeedInfo, bool bForce)
 
 	FeedDownloader* pFeedDownloader = new FeedDownloader();
 	pFeedDownloader->SetAutoDestroy(true);
+	pFeedDownloader->SetThreadPool(m_pThreadPool);
 	pFeedDownloader->Attach(this);
 	pFeedDownloader->SetFeedInfo(pFeedInfo);
 	pFeedDownloader->SetURL(pFeedInfo->GetUrl());
@@ -54,6 +54,7 @@ private:
 private:
 	Feeds					m_Feeds;
 	ActiveDownloads			m_ActiveDownloads;
+	ThreadPool*				m_pThreadPool;
 	FeedHistory				m_FeedHistory;
 	Mutex					m_mutexDownloads;
 	UrlCoordinatorObserver	m_UrlCoordinatorObserver;
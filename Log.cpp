@@ -32,6 +32,7 @@
 #include "win32.h"
 #else
 #include <pthread.h>
+#include <unistd.h>
 #endif
 
 #include <stdlib.h>
@@ -47,11 +48,375 @@
 
 extern Options* g_pOptions;
 
+static const int FILEBUFFER_INITIAL_SIZE = 16 * 1024;
+static const int FILEBUFFER_FLUSH_SIZE = 64 * 1024;
+static const int FILEBUFFER_MAX_SIZE = 4 * 1024 * 1024;
+static const int COMPRESS_BUFFER_SIZE = 64 * 1024;
+static const int COMPRESS_FLUSH_CHUNKS = 16;
+
+/*
+ * Writes the messages collected in log's file buffer into the log-file.
+ * The log-file is kept open between writes. It is reopened if it was
+ * removed or renamed (external log rotation) or if the reopen was requested
+ * via Log::ReopenFile (SIGHUP).
+ * The writer also rotates the log-file by size and by time according to
+ * options "LogRotateSize" and "LogRotateInterval".
+ */
+class LogWriter : public Thread
+{
+private:
+	Log*				m_pOwner;
+	FILE*				m_pFile;
+	char*				m_szBuffer;
+	int					m_iBufferSize;
+	Event				m_eventWakeUp;
+	long long			m_lRotateSize;
+	int					m_iRotateInterval;
+	int					m_iRotateKeep;
+	bool				m_bRotateCompress;
+	time_t				m_tRotated;
+
+	void				Flush();
+	void				OpenFile();
+	void				CloseFile();
+	bool				FileReplaced();
+	void				CheckRotate();
+	void				Rotate();
+	void				Compress(const char* szFilename, const char* szGzFilename);
+
+protected:
+	virtual void		Run();
+
+public:
+						LogWriter(Log* pOwner);
+						~LogWriter();
+	virtual void		Stop();
+	void				WakeUp() { m_eventWakeUp.Set(); }
+};
+
+LogWriter::LogWriter(Log* pOwner)
+{
+	m_pOwner = pOwner;
+	m_pFile = NULL;
+	m_iBufferSize = FILEBUFFER_INITIAL_SIZE;
+	m_szBuffer = (char*)malloc(m_iBufferSize);
+	m_lRotateSize = (long long)g_pOptions->GetLogRotateSize() * 1024 * 1024;
+	m_iRotateInterval = g_pOptions->GetLogRotateInterval() * 60 * 60;
+	m_iRotateKeep = g_pOptions->GetLogRotateKeep();
+	m_bRotateCompress = g_pOptions->GetLogRotateCompress();
+	m_tRotated = time(NULL);
+}
+
+LogWriter::~LogWriter()
+{
+	CloseFile();
+	free(m_szBuffer);
+}
+
+void LogWriter::Run()
+{
+	while (!IsStopped())
+	{
+		// flush once per second or earlier if woken up on error messages
+		// or if the buffer grows large
+		m_eventWakeUp.Wait(1000);
+		Flush();
+		CheckRotate();
+	}
+
+	Flush();
+	CloseFile();
+}
+
+void LogWriter::Stop()
+{
+	Thread::Stop();
+	WakeUp();
+}
+
+void LogWriter::Flush()
+{
+	// swap buffers, the file is then written without holding the log lock
+	m_pOwner->m_mutexLog.Lock();
+	char* szBuffer = m_pOwner->m_szFileBuffer;
+	int iBufferSize = m_pOwner->m_iFileBufferSize;
+	int iLen = m_pOwner->m_iFileBufferLen;
+	int iLost = m_pOwner->m_iFileLost;
+	bool bReopen = m_pOwner->m_bReopenFile;
+	m_pOwner->m_szFileBuffer = m_szBuffer;
+	m_pOwner->m_iFileBufferSize = m_iBufferSize;
+	m_pOwner->m_iFileBufferLen = 0;
+	m_pOwner->m_iFileLost = 0;
+	m_pOwner->m_bReopenFile = false;
+	m_pOwner->m_mutexLog.Unlock();
+
+	m_szBuffer = szBuffer;
+	m_iBufferSize = iBufferSize;
+
+	if (bReopen || FileReplaced())
+	{
+		CloseFile();
+	}
+
+	if (iLen == 0 && iLost == 0)
+	{
+		return;
+	}
+
+	if (!m_pFile)
+	{
+		OpenFile();
+		if (!m_pFile)
+		{
+			return;
+		}
+	}
+
+	if (iLost > 0)
+	{
+		fprintf(m_pFile, "WARNING	%i log messages were lost because the log-file could not be written fast enough%s", iLost, LINE_ENDING);
+	}
+	fwrite(m_szBuffer, 1, iLen, m_pFile);
+	fflush(m_pFile);
+}
+
+void LogWriter::OpenFile()
+{
+	m_pFile = fopen(m_pOwner->m_szLogFilename, "ab");
+	if (!m_pFile)
+	{
+		perror(m_pOwner->m_szLogFilename);
+	}
+}
+
+void LogWriter::CloseFile()
+{
+	if (m_pFile)
+	{
+		fclose(m_pFile);
+		m_pFile = NULL;
+	}
+}
+
+bool LogWriter::FileReplaced()
+{
+#ifdef WIN32
+	// open files can not be renamed or deleted on Windows
+	return false;
+#else
+	if (!m_pFile)
+	{
+		return false;
+	}
+
+	struct stat statFile;
+	struct stat statOpen;
+	if (stat(m_pOwner->m_szLogFilename, &statFile) != 0 || fstat(fileno(m_pFile), &statOpen) != 0)
+	{
+		return true;
+	}
+
+	return statFile.st_ino != statOpen.st_ino || statFile.st_dev != statOpen.st_dev;
+#endif
+}
+
+void LogWriter::CheckRotate()
+{
+	if (!m_pFile)
+	{
+		return;
+	}
+
+	if ((m_lRotateSize > 0 && ftell(m_pFile) >= m_lRotateSize) ||
+		(m_iRotateInterval > 0 && time(NULL) - m_tRotated >= m_iRotateInterval))
+	{
+		Rotate();
+	}
+}
+
+/*
+ * Builds the name of a rotated log-file: "<LogFile>.<Index>" or "<LogFile>.<Index>.gz".
+ * Returns false if the name doesn't fit into the buffer.
+ */
+static bool RotatedFilename(char* szBuffer, int iBufSize, const char* szLogFilename, int iIndex, bool bCompressed)
+{
+	int iLen = bCompressed ?
+		snprintf(szBuffer, iBufSize, "%s.%i.gz", szLogFilename, iIndex) :
+		snprintf(szBuffer, iBufSize, "%s.%i", szLogFilename, iIndex);
+	szBuffer[iBufSize-1] = '\0';
+	return iLen >= 0 && iLen < iBufSize;
+}
+
+/*
+ * Renames the log-file into "<LogFile>.1" shifting older files
+ * to "<LogFile>.2", "<LogFile>.3", etc. and deletes files exceeding
+ * the retention count.
+ */
+void LogWriter::Rotate()
+{
+	const char* szLogFilename = m_pOwner->m_szLogFilename;
+
+	CloseFile();
+	m_tRotated = time(NULL);
+
+	for (int i = m_iRotateKeep; i >= 1; i--)
+	{
+		char szFilename[1024];
+		char szGzFilename[1024];
+		if (!RotatedFilename(szFilename, 1024, szLogFilename, i, false) ||
+			!RotatedFilename(szGzFilename, 1024, szLogFilename, i, true))
+		{
+			continue;
+		}
+
+		if (i == m_iRotateKeep)
+		{
+			remove(szFilename);
+			remove(szGzFilename);
+			continue;
+		}
+
+		char szNewFilename[1024];
+		char szNewGzFilename[1024];
+		if (!RotatedFilename(szNewFilename, 1024, szLogFilename, i + 1, false) ||
+			!RotatedFilename(szNewGzFilename, 1024, szLogFilename, i + 1, true))
+		{
+			continue;
+		}
+
+		if (Util::FileExists(szFilename))
+		{
+			rename(szFilename, szNewFilename);
+		}
+		if (Util::FileExists(szGzFilename))
+		{
+			rename(szGzFilename, szNewGzFilename);
+		}
+	}
+
+	if (m_iRotateKeep <= 0)
+	{
+		remove(szLogFilename);
+		return;
+	}
+
+	char szRotatedFilename[1024];
+	char szGzFilename[1024];
+	if (!RotatedFilename(szRotatedFilename, 1024, szLogFilename, 1, false) ||
+		!RotatedFilename(szGzFilename, 1024, szLogFilename, 1, true))
+	{
+		// the name of log-file is too long, keep writing into the same file
+		return;
+	}
+
+	if (rename(szLogFilename, szRotatedFilename) != 0)
+	{
+		perror(szLogFilename);
+		return;
+	}
+
+	// the new log-file is opened on next write
+
+	if (m_bRotateCompress)
+	{
+		Compress(szRotatedFilename, szGzFilename);
+	}
+}
+
+/*
+ * Compresses the rotated log-file using a fixed size buffer. The messages
+ * logged in the meantime are periodically flushed into the new log-file.
+ * If the writer is stopped the compression is aborted and the rotated
+ * file is kept uncompressed.
+ */
+void LogWriter::Compress(const char* szFilename, const char* szGzFilename)
+{
+#ifndef DISABLE_GZIP
+	FILE* pInFile = fopen(szFilename, "rb");
+	if (!pInFile)
+	{
+		perror(szFilename);
+		return;
+	}
+
+	FILE* pOutFile = fopen(szGzFilename, "wb");
+	if (!pOutFile)
+	{
+		perror(szGzFilename);
+		fclose(pInFile);
+		return;
+	}
+
+	char* szBuffer = (char*)malloc(COMPRESS_BUFFER_SIZE);
+	GZipStream zstream(COMPRESS_BUFFER_SIZE);
+	bool bOK = true;
+	bool bFinished = false;
+
+	for (int iChunk = 1; bOK && !bFinished; iChunk++)
+	{
+		int iReadBytes = (int)fread(szBuffer, 1, COMPRESS_BUFFER_SIZE, pInFile);
+		if (ferror(pInFile) || IsStopped())
+		{
+			bOK = false;
+			break;
+		}
+
+		zstream.Write(szBuffer, iReadBytes, iReadBytes < COMPRESS_BUFFER_SIZE);
+
+		while (bOK && !bFinished)
+		{
+			const void* pOutBuf;
+			int iOutLen;
+			GZipStream::EStatus eStatus = zstream.Read(&pOutBuf, &iOutLen);
+			bOK = eStatus != GZipStream::zlError &&
+				(iOutLen == 0 || (int)fwrite(pOutBuf, 1, iOutLen, pOutFile) == iOutLen);
+			bFinished = eStatus == GZipStream::zlFinished;
+			if (iOutLen == 0)
+			{
+				// the next block must be provided
+				break;
+			}
+		}
+
+		if (iChunk % COMPRESS_FLUSH_CHUNKS == 0)
+		{
+			Flush();
+		}
+	}
+
+	free(szBuffer);
+	fclose(pInFile);
+	bOK = fclose(pOutFile) == 0 && bOK;
+
+	if (bOK)
+	{
+		remove(szFilename);
+	}
+	else
+	{
+		if (!IsStopped())
+		{
+			perror(szGzFilename);
+		}
+		remove(szGzFilename);
+	}
+#endif
+}
+
+//************************************************************
+// Log
+
 Log::Log()
 {
 	m_Messages.clear();
 	m_iIDGen = 0;
 	m_szLogFilename = NULL;
+	m_pLogWriter = NULL;
+	m_iFileBufferSize = FILEBUFFER_INITIAL_SIZE;
+	m_szFileBuffer = (char*)malloc(m_iFileBufferSize);
+	m_iFileBufferLen = 0;
+	m_iFileLost = 0;
+	m_bReopenFile = false;
 #ifdef DEBUG
 	m_bExtraDebug = Util::FileExists("extradebug");
 #endif
@@ -59,11 +424,13 @@ Log::Log()
 
 Log::~Log()
 {
+	StopWriter();
 	Clear();
 	if (m_szLogFilename)
 	{
 		free(m_szLogFilename);
 	}
+	free(m_szFileBuffer);
 }
 
 void Log::Filelog(const char* msg, ...)
@@ -90,19 +457,30 @@ void Log::Filelog(const char* msg, ...)
 		szTime[50-1] = '\0';
 		szTime[strlen(szTime) - 1] = '\0'; // trim LF
 
-		FILE* file = fopen(m_szLogFilename, "ab+");
-		if (file)
-		{
+		char szLine[1024 + 100];
+#ifdef DEBUG
 #ifdef WIN32
-			unsigned long iThreadId = GetCurrentThreadId();
+		unsigned long iThreadId = GetCurrentThreadId();
 #else
-			unsigned long iThreadId = (unsigned long)pthread_self();
+		unsigned long iThreadId = (unsigned long)pthread_self();
 #endif
-#ifdef DEBUG
-			fprintf(file, "%s\t%lu\t%s%s", szTime, iThreadId, tmp2, LINE_ENDING);
+		snprintf(szLine, sizeof(szLine), "%s\t%lu\t%s%s", szTime, iThreadId, tmp2, LINE_ENDING);
 #else
-			fprintf(file, "%s\t%s%s", szTime, tmp2, LINE_ENDING);
+		snprintf(szLine, sizeof(szLine), "%s\t%s%s", szTime, tmp2, LINE_ENDING);
 #endif
+		szLine[sizeof(szLine)-1] = '\0';
+		int iLen = strlen(szLine);
+
+		if (m_pLogWriter)
+		{
+			AppendFileBuffer(szLine, iLen);
+			return;
+		}
+
+		FILE* file = fopen(m_szLogFilename, "ab+");
+		if (file)
+		{
+			fwrite(szLine, 1, iLen, file);
 			fclose(file);
 		}
 		else
@@ -112,6 +490,116 @@ void Log::Filelog(const char* msg, ...)
 	}
 }
 
+void Log::AppendFileBuffer(const char* szLine, int iLen)
+{
+	if (m_iFileBufferLen + iLen > m_iFileBufferSize)
+	{
+		if (m_iFileBufferLen + iLen > FILEBUFFER_MAX_SIZE)
+		{
+			// the writer can't keep up with the messages, discard the message
+			m_iFileLost++;
+			return;
+		}
+
+		while (m_iFileBufferLen + iLen > m_iFileBufferSize)
+		{
+			m_iFileBufferSize *= 2;
+		}
+		m_szFileBuffer = (char*)realloc(m_szFileBuffer, m_iFileBufferSize);
+	}
+
+	memcpy(m_szFileBuffer + m_iFileBufferLen, szLine, iLen);
+	m_iFileBufferLen += iLen;
+
+	if (m_iFileBufferLen >= FILEBUFFER_FLUSH_SIZE && m_iFileBufferLen - iLen < FILEBUFFER_FLUSH_SIZE)
+	{
+		WakeUpWriter();
+	}
+}
+
+void Log::WakeUpWriter()
+{
+	if (m_pLogWriter)
+	{
+		m_pLogWriter->WakeUp();
+	}
+}
+
+/*
+ * Writes the pending content of file buffer synchronously.
+ * Must be called with locked m_mutexLog.
+ */
+void Log::WriteFileBuffer()
+{
+	if (m_iFileBufferLen == 0)
+	{
+		return;
+	}
+
+	FILE* file = fopen(m_szLogFilename, "ab+");
+	if (file)
+	{
+		fwrite(m_szFileBuffer, 1, m_iFileBufferLen, file);
+		fclose(file);
+	}
+	else
+	{
+		perror(m_szLogFilename);
+	}
+
+	m_iFileBufferLen = 0;
+}
+
+/*
+ * Starts the background writing of log-file. Must be called after
+ * daemonizing because the thread doesn't survive the fork.
+ */
+void Log::StartWriter()
+{
+	if (!m_szLogFilename || m_pLogWriter)
+	{
+		return;
+	}
+
+	LogWriter* pLogWriter = new LogWriter(this);
+
+	m_mutexLog.Lock();
+	m_pLogWriter = pLogWriter;
+	m_mutexLog.Unlock();
+
+	pLogWriter->Start();
+}
+
+/*
+ * Stops the background writing, writes all pending messages and
+ * switches back to synchronous writing. Must be called before
+ * Thread::Final.
+ */
+void Log::StopWriter()
+{
+	m_mutexLog.Lock();
+	LogWriter* pLogWriter = m_pLogWriter;
+	m_mutexLog.Unlock();
+
+	if (!pLogWriter)
+	{
+		return;
+	}
+
+	pLogWriter->Stop();
+	while (pLogWriter->IsRunning())
+	{
+		usleep(10 * 1000);
+	}
+
+	m_mutexLog.Lock();
+	m_pLogWriter = NULL;
+	WriteFileBuffer();
+	m_mutexLog.Unlock();
+
+	delete pLogWriter;
+}
+
 #ifdef DEBUG
 #undef debug
 #ifdef HAVE_VARIADIC_MACROS
@@ -180,6 +668,7 @@ void error(const char* msg, ...)
 	if (eMessageTarget == Options::mtLog || eMessageTarget == Options::mtBoth)
 	{
 		g_pLog->Filelog("ERROR\t%s", tmp2);
+		g_pLog->WakeUpWriter();
 	}
 	if (eMessageTarget == Options::mtScreen || eMessageTarget == Options::mtBoth)
 	{
@@ -279,6 +768,7 @@ void abort(const char* msg, ...)
 	printf("\n%s", tmp2);
 
 	g_pLog->Filelog(tmp2);
+	g_pLog->WriteFileBuffer();
 
 	g_pLog->m_mutexLog.Unlock();
 
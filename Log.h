@@ -75,6 +75,8 @@ public:
 	const char*			GetText() { return m_szText; }
 };
 
+class LogWriter;
+
 class Log
 {
 public:
@@ -85,12 +87,23 @@ private:
 	Messages			m_Messages;
 	char*				m_szLogFilename;
 	unsigned int		m_iIDGen;
+	LogWriter*			m_pLogWriter;
+	char*				m_szFileBuffer;
+	int					m_iFileBufferSize;
+	int					m_iFileBufferLen;
+	int					m_iFileLost;
+	volatile bool		m_bReopenFile;
 #ifdef DEBUG
 	bool				m_bExtraDebug;
 #endif
 
 	void				Filelog(const char* msg, ...);
 	void				AppendMessage(Message::EKind eKind, const char* szText);
+	void				AppendFileBuffer(const char* szLine, int iLen);
+	void				WriteFileBuffer();
+	void				WakeUpWriter();
+
+	friend class LogWriter;
 
 	friend void error(const char* msg, ...);
 	friend void warn(const char* msg, ...);
@@ -113,6 +126,9 @@ public:
 	void				Clear();
 	void				ResetLog();
 	void				InitOptions();
+	void				StartWriter();
+	void				StopWriter();
+	void				ReopenFile() { m_bReopenFile = true; }
 };
 
 #ifdef DEBUG
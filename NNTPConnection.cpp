@@ -42,6 +42,7 @@
 #include "NNTPConnection.h"
 #include "Connection.h"
 #include "NewsServer.h"
+#include "Util.h"
 
 static const int CONNECTION_LINEBUFFER_SIZE = 1024*10;
 
@@ -52,6 +53,9 @@ NNTPConnection::NNTPConnection(NewsServer* pNewsServer) : Connection(pNewsServer
 	m_szLineBuf = (char*)malloc(CONNECTION_LINEBUFFER_SIZE);
 	m_bAuthError = false;
 	SetCipher(pNewsServer->GetCipher());
+#ifndef DISABLE_TLS
+	SetTLSSessionCache(pNewsServer->GetTLSSessionCache());
+#endif
 }
 
 NNTPConnection::~NNTPConnection()
@@ -86,10 +90,12 @@ const char* NNTPConnection::Request(const char* req)
 	{
 		debug("%s requested authorization", GetHost());
 
+		long long iAuthStart = Util::CurrentMSec();
 		if (!Authenticate())
 		{
 			return NULL;
 		}
+		m_pNewsServer->AddTiming(NewsServer::tmAuth, (int)(Util::CurrentMSec() - iAuthStart));
 
 		//try again
 		WriteLine(req);
@@ -228,6 +234,27 @@ const char* NNTPConnection::JoinGroup(const char* grp)
 	return answer;
 }
 
+/*
+ * Sends a cheap command to prevent the server from closing an idle connection.
+ * Any answer means the connection is still alive.
+ */
+bool NNTPConnection::KeepAlive()
+{
+	const char* answer = Request("DATE\r\n");
+	if (!answer)
+	{
+		debug("Keep-alive request to %s failed", GetHost());
+		return false;
+	}
+
+	if (strncmp(answer, "111", 3))
+	{
+		debug("Unexpected answer from %s on keep-alive request: %s", GetHost(), answer);
+	}
+
+	return true;
+}
+
 bool NNTPConnection::Connect()
 {
 	debug("Opening connection to %s", GetHost());
@@ -237,6 +264,8 @@ bool NNTPConnection::Connect()
 		return true;
 	}
 
+	long long iConnectStart = Util::CurrentMSec();
+
 	if (!Connection::Connect())
 	{
 		return false;
@@ -258,11 +287,17 @@ bool NNTPConnection::Connect()
 		return false;
 	}
 
-	if ((m_pNewsServer->GetUser() && strlen(m_pNewsServer->GetUser()) > 0 &&
-		 m_pNewsServer->GetPassword() && strlen(m_pNewsServer->GetPassword()) > 0) &&
-		!Authenticate())
+	long long iAuthStart = Util::CurrentMSec();
+	m_pNewsServer->AddTiming(NewsServer::tmConnect, (int)(iAuthStart - iConnectStart));
+
+	if (m_pNewsServer->GetUser() && strlen(m_pNewsServer->GetUser()) > 0 &&
+		m_pNewsServer->GetPassword() && strlen(m_pNewsServer->GetPassword()) > 0)
 	{
-		return false;
+		if (!Authenticate())
+		{
+			return false;
+		}
+		m_pNewsServer->AddTiming(NewsServer::tmAuth, (int)(Util::CurrentMSec() - iAuthStart));
 	}
 
 	debug("Connection to %s established", GetHost());
@@ -52,6 +52,7 @@ public:
 	NewsServer*			GetNewsServer() { return m_pNewsServer; }
 	const char* 		Request(const char* req);
 	const char*			JoinGroup(const char* grp);
+	bool				KeepAlive();
 	bool				GetAuthError() { return m_bAuthError; }
 };
 
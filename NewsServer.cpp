@@ -38,20 +38,34 @@
 
 #include "nzbget.h"
 #include "NewsServer.h"
+#ifndef DISABLE_TLS
+#include "TLS.h"
+#endif
+
+// new timing samples are added to the average with weight 1/TIMING_SMOOTHING
+static const int TIMING_SMOOTHING = 8;
 
 NewsServer::NewsServer(int iID, bool bActive, const char* szName, const char* szHost, int iPort,
 	const char* szUser, const char* szPass, bool bJoinGroup, bool bTLS,
-	const char* szCipher, int iMaxConnections, int iLevel, int iGroup)
+	const char* szCipher, int iMaxConnections, int iWarmConnections, int iLevel, int iGroup)
 {
 	m_iID = iID;
 	m_bActive = bActive;
 	m_iPort = iPort;
 	m_iLevel = iLevel;
 	m_iNormLevel = iLevel;
+	m_iWeight = 100;
+	m_bDemoted = false;
 	m_iGroup = iGroup;
 	m_iMaxConnections = iMaxConnections;
+	m_iWarmConnections = iWarmConnections < iMaxConnections ? iWarmConnections : iMaxConnections;
 	m_bJoinGroup = bJoinGroup;
 	m_bTLS = bTLS;
+	m_iDownloadRate = 0;
+	memset(m_iTimings, 0, sizeof(m_iTimings));
+#ifndef DISABLE_TLS
+	m_pTLSSessionCache = bTLS ? new TLSSessionCache() : NULL;
+#endif
 	m_szHost = szHost ? strdup(szHost) : NULL;
 	m_szUser = szUser ? strdup(szUser) : NULL;
 	m_szPassword = szPass ? strdup(szPass) : NULL;
@@ -91,4 +105,15 @@ NewsServer::~NewsServer()
 	{
 		free(m_szCipher);
 	}
+#ifndef DISABLE_TLS
+	delete m_pTLSSessionCache;
+#endif
+}
+
+void NewsServer::AddTiming(ETiming eTiming, int iMSec)
+{
+	m_mutexTimings.Lock();
+	int iOldValue = m_iTimings[eTiming];
+	m_iTimings[eTiming] = iOldValue == 0 ? iMSec : (iOldValue * (TIMING_SMOOTHING - 1) + iMSec) / TIMING_SMOOTHING;
+	m_mutexTimings.Unlock();
 }
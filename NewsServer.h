@@ -27,8 +27,23 @@
 #ifndef NEWSSERVER_H
 #define NEWSSERVER_H
 
+#include "Thread.h"
+
+#ifndef DISABLE_TLS
+class TLSSessionCache;
+#endif
+
 class NewsServer
 {
+public:
+	enum ETiming
+	{
+		tmConnect,
+		tmAuth,
+		tmFirstByte,
+		tmIdle
+	};
+
 private:
 	int				m_iID;
 	bool			m_bActive;
@@ -39,16 +54,27 @@ private:
 	char*			m_szUser;
 	char*			m_szPassword;
 	int				m_iMaxConnections;
+	int				m_iWarmConnections;
 	int				m_iLevel;
 	int				m_iNormLevel;
+	int				m_iWeight;
+	bool			m_bDemoted;
 	bool			m_bJoinGroup;
 	bool			m_bTLS;
 	char*			m_szCipher;
+	AtomicCounter	m_iSpeedBytes;
+	int				m_iDownloadRate;
+	int				m_iTimings[4];
+	Mutex			m_mutexTimings;
+#ifndef DISABLE_TLS
+	TLSSessionCache*	m_pTLSSessionCache;
+#endif
 
 public:
 					NewsServer(int iID, bool bActive, const char* szName, const char* szHost, int iPort,
 						const char* szUser, const char* szPass, bool bJoinGroup,
-						bool bTLS, const char* szCipher, int iMaxConnections, int iLevel, int iGroup);
+						bool bTLS, const char* szCipher, int iMaxConnections, int iWarmConnections,
+						int iLevel, int iGroup);
 					~NewsServer();
 	int				GetID() { return m_iID; }
 	bool			GetActive() { return m_bActive; }
@@ -60,12 +86,31 @@ public:
 	const char*		GetUser() { return m_szUser; }
 	const char*		GetPassword() { return m_szPassword; }
 	int				GetMaxConnections() { return m_iMaxConnections; }
+	int				GetWarmConnections() { return m_iWarmConnections; }
 	int				GetLevel() { return m_iLevel; }
 	int				GetNormLevel() { return m_iNormLevel; }
 	void			SetNormLevel(int iLevel) { m_iNormLevel = iLevel; }
+	int				GetWeight() { return m_iWeight; }
+	void			SetWeight(int iWeight) { m_iWeight = iWeight; }
+	bool			GetDemoted() { return m_bDemoted; }
+	void			SetDemoted(bool bDemoted) { m_bDemoted = bDemoted; }
 	int				GetJoinGroup() { return m_bJoinGroup; }
 	bool			GetTLS() { return m_bTLS; }
 	const char*		GetCipher() { return m_szCipher; }
+	void			AddSpeedBytes(int iBytes) { m_iSpeedBytes.Add(iBytes); }
+	int				TakeSpeedBytes() { return m_iSpeedBytes.Exchange(0); }
+	int				GetDownloadRate() { return m_iDownloadRate; }
+	void			SetDownloadRate(int iDownloadRate) { m_iDownloadRate = iDownloadRate; }
+
+	/*
+	 * Timings are moving averages in milliseconds, updated by connections
+	 * of the server; zero means no data yet.
+	 */
+	void			AddTiming(ETiming eTiming, int iMSec);
+	int				GetTiming(ETiming eTiming) { return m_iTimings[eTiming]; }
+#ifndef DISABLE_TLS
+	TLSSessionCache*	GetTLSSessionCache() { return m_pTLSSessionCache; }
+#endif
 };
 
 #endif
@@ -177,6 +177,19 @@ static const char* OPTION_SCRIPTORDER			= "ScriptOrder";
 static const char* OPTION_DEFSCRIPT				= "DefScript";
 static const char* OPTION_EXTCLEANUPDISK		= "ExtCleanupDisk";
 static const char* OPTION_FEEDHISTORY			= "FeedHistory";
+static const char* OPTION_PARTHREADS			= "ParThreads";
+static const char* OPTION_PARQUICK				= "ParQuick";
+static const char* OPTION_DIRECTUNPACK			= "DirectUnpack";
+static const char* OPTION_POSTJOBS				= "PostJobs";
+static const char* OPTION_UNPACKJOBS			= "UnpackJobs";
+static const char* OPTION_SCRIPTJOBS			= "ScriptJobs";
+static const char* OPTION_SCRIPTTIMELIMIT		= "ScriptTimeLimit";
+static const char* OPTION_PARINCREMENTAL		= "ParIncremental";
+static const char* OPTION_LOGROTATESIZE			= "LogRotateSize";
+static const char* OPTION_LOGROTATEINTERVAL		= "LogRotateInterval";
+static const char* OPTION_LOGROTATEKEEP			= "LogRotateKeep";
+static const char* OPTION_LOGROTATECOMPRESS		= "LogRotateCompress";
+static const char* OPTION_DEMOTESERVERS			= "DemoteServers";
 
 // obsolete options
 static const char* OPTION_POSTLOGKIND			= "PostLogKind";
@@ -566,6 +579,19 @@ Options::Options(int argc, char* argv[])
 	m_bUnpackPauseQueue		= false;
 	m_szExtCleanupDisk		= NULL;
 	m_iFeedHistory			= 0;
+	m_iParThreads			= 0;
+	m_bParQuick				= false;
+	m_bDirectUnpack			= false;
+	m_iPostJobs				= 0;
+	m_iUnpackJobs			= 0;
+	m_iScriptJobs			= 0;
+	m_iScriptTimeLimit		= 0;
+	m_bParIncremental		= false;
+	m_iLogRotateSize		= 0;
+	m_iLogRotateInterval	= 0;
+	m_iLogRotateKeep		= 0;
+	m_bLogRotateCompress	= false;
+	m_bDemoteServers		= false;
 
 	// Option "ConfigFile" will be initialized later, but we want
 	// to see it at the top of option list, so we add it first
@@ -918,6 +944,19 @@ void Options::InitDefault()
 	SetOption(OPTION_UNPACKPAUSEQUEUE, "no");
 	SetOption(OPTION_EXTCLEANUPDISK, "");
 	SetOption(OPTION_FEEDHISTORY, "7");
+	SetOption(OPTION_PARTHREADS, "0");
+	SetOption(OPTION_PARQUICK, "yes");
+	SetOption(OPTION_DIRECTUNPACK, "no");
+	SetOption(OPTION_POSTJOBS, "1");
+	SetOption(OPTION_UNPACKJOBS, "1");
+	SetOption(OPTION_SCRIPTJOBS, "1");
+	SetOption(OPTION_SCRIPTTIMELIMIT, "0");
+	SetOption(OPTION_PARINCREMENTAL, "no");
+	SetOption(OPTION_LOGROTATESIZE, "0");
+	SetOption(OPTION_LOGROTATEINTERVAL, "0");
+	SetOption(OPTION_LOGROTATEKEEP, "5");
+	SetOption(OPTION_LOGROTATECOMPRESS, "yes");
+	SetOption(OPTION_DEMOTESERVERS, "no");
 }
 
 void Options::InitOptFile()
@@ -1073,6 +1112,14 @@ void Options::InitOptions()
 	m_iParTimeLimit			= ParseIntValue(OPTION_PARTIMELIMIT, 10);
 	m_iKeepHistory			= ParseIntValue(OPTION_KEEPHISTORY, 10);
 	m_iFeedHistory			= ParseIntValue(OPTION_FEEDHISTORY, 10);
+	m_iParThreads			= ParseIntValue(OPTION_PARTHREADS, 10);
+	m_iPostJobs				= ParseIntValue(OPTION_POSTJOBS, 10);
+	m_iUnpackJobs			= ParseIntValue(OPTION_UNPACKJOBS, 10);
+	m_iScriptJobs			= ParseIntValue(OPTION_SCRIPTJOBS, 10);
+	m_iScriptTimeLimit		= ParseIntValue(OPTION_SCRIPTTIMELIMIT, 10);
+	m_iLogRotateSize		= ParseIntValue(OPTION_LOGROTATESIZE, 10);
+	m_iLogRotateInterval	= ParseIntValue(OPTION_LOGROTATEINTERVAL, 10);
+	m_iLogRotateKeep		= ParseIntValue(OPTION_LOGROTATEKEEP, 10);
 
 	CheckDir(&m_szNzbDir, OPTION_NZBDIR, m_iNzbDirInterval == 0, true);
 
@@ -1106,6 +1153,11 @@ void Options::InitOptions()
 	m_bUnpack				= (bool)ParseEnumValue(OPTION_UNPACK, BoolCount, BoolNames, BoolValues);
 	m_bUnpackCleanupDisk	= (bool)ParseEnumValue(OPTION_UNPACKCLEANUPDISK, BoolCount, BoolNames, BoolValues);
 	m_bUnpackPauseQueue		= (bool)ParseEnumValue(OPTION_UNPACKPAUSEQUEUE, BoolCount, BoolNames, BoolValues);
+	m_bParQuick				= (bool)ParseEnumValue(OPTION_PARQUICK, BoolCount, BoolNames, BoolValues);
+	m_bParIncremental		= (bool)ParseEnumValue(OPTION_PARINCREMENTAL, BoolCount, BoolNames, BoolValues);
+	m_bLogRotateCompress	= (bool)ParseEnumValue(OPTION_LOGROTATECOMPRESS, BoolCount, BoolNames, BoolValues);
+	m_bDemoteServers		= (bool)ParseEnumValue(OPTION_DEMOTESERVERS, BoolCount, BoolNames, BoolValues);
+	m_bDirectUnpack			= (bool)ParseEnumValue(OPTION_DIRECTUNPACK, BoolCount, BoolNames, BoolValues);
 
 	const char* OutputModeNames[] = { "loggable", "logable", "log", "colored", "color", "ncurses", "curses" };
 	const int OutputModeValues[] = { omLoggable, omLoggable, omLoggable, omColored, omColored, omNCurses, omNCurses };
@@ -2075,8 +2127,12 @@ void Options::InitServers()
 		sprintf(optname, "Server%i.Connections", n);
 		const char* nconnections = GetOption(optname);
 
+		sprintf(optname, "Server%i.WarmConnections", n);
+		const char* nwarmconnections = GetOption(optname);
+
 		bool definition = nactive || nname || nlevel || ngroup || nhost || nport ||
-			nusername || npassword || nconnections || njoingroup || ntls || ncipher;
+			nusername || npassword || nconnections || njoingroup || ntls || ncipher ||
+			nwarmconnections;
 		bool completed = nhost && nport && nconnections;
 
 		if (!definition)
@@ -2089,6 +2145,7 @@ void Options::InitServers()
 			NewsServer* pNewsServer = new NewsServer(n, bActive, nname,
 				nhost, atoi(nport), nusername, npassword,
 				bJoinGroup, bTLS, ncipher, atoi((char*)nconnections),
+				nwarmconnections ? atoi((char*)nwarmconnections) : 0,
 				nlevel ? atoi((char*)nlevel) : 0,
 				ngroup ? atoi((char*)ngroup) : 0);
 			g_pServerPool->AddServer(pNewsServer);
@@ -2574,7 +2631,8 @@ bool Options::ValidateOptionName(const char * optname)
 			!strcasecmp(p, ".port") || !strcasecmp(p, ".username") ||
 			!strcasecmp(p, ".password") || !strcasecmp(p, ".joingroup") ||
 			!strcasecmp(p, ".encryption") || !strcasecmp(p, ".connections") ||
-			!strcasecmp(p, ".cipher") || !strcasecmp(p, ".group")))
+			!strcasecmp(p, ".cipher") || !strcasecmp(p, ".group") ||
+			!strcasecmp(p, ".warmconnections")))
 		{
 			return true;
 		}
@@ -2669,11 +2727,33 @@ void Options::CheckOptions()
 	}
 #endif
 
+#ifdef DISABLE_GZIP
+	if (m_bLogRotateCompress && (m_iLogRotateSize > 0 || m_iLogRotateInterval > 0))
+	{
+		LocateOptionSrcPos(OPTION_LOGROTATECOMPRESS);
+		ConfigError("Invalid value for option \"%s\": program was compiled without gzip-support", OPTION_LOGROTATECOMPRESS);
+		m_bLogRotateCompress = false;
+	}
+#endif
+
 	if (!m_bDecode)
 	{
 		m_bDirectWrite = false;
 	}
 
+	if (m_iPostJobs < 1)
+	{
+		m_iPostJobs = 1;
+	}
+	if (m_iUnpackJobs < 1)
+	{
+		m_iUnpackJobs = 1;
+	}
+	if (m_iScriptJobs < 1)
+	{
+		m_iScriptJobs = 1;
+	}
+
 	// if option "ConfigTemplate" is not set, use "WebDir" as default location for template
 	// (for compatibility with versions 9 and 10).
 	if (!m_szConfigTemplate || m_szConfigTemplate[0] == '\0')
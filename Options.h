@@ -312,6 +312,19 @@ private:
 	bool				m_bUnpackPauseQueue;
 	char*				m_szExtCleanupDisk;
 	int					m_iFeedHistory;
+	int					m_iParThreads;
+	bool				m_bParQuick;
+	bool				m_bDirectUnpack;
+	int					m_iPostJobs;
+	int					m_iUnpackJobs;
+	int					m_iScriptJobs;
+	int					m_iScriptTimeLimit;
+	bool				m_bParIncremental;
+	int					m_iLogRotateSize;
+	int					m_iLogRotateInterval;
+	int					m_iLogRotateKeep;
+	bool				m_bLogRotateCompress;
+	bool				m_bDemoteServers;
 
 	// Parsed command-line parameters
 	bool				m_bServerMode;
@@ -472,6 +485,19 @@ public:
 	bool				GetUnpackPauseQueue() { return m_bUnpackPauseQueue; }
 	const char*			GetExtCleanupDisk() { return m_szExtCleanupDisk; }
 	int					GetFeedHistory() { return m_iFeedHistory; }
+	int					GetParThreads() { return m_iParThreads; }
+	bool				GetParQuick() { return m_bParQuick; }
+	bool				GetDirectUnpack() { return m_bDirectUnpack; }
+	int					GetPostJobs() { return m_iPostJobs; }
+	int					GetUnpackJobs() { return m_iUnpackJobs; }
+	int					GetScriptJobs() { return m_iScriptJobs; }
+	int					GetScriptTimeLimit() { return m_iScriptTimeLimit; }
+	bool				GetParIncremental() { return m_bParIncremental; }
+	int					GetLogRotateSize() { return m_iLogRotateSize; }
+	int					GetLogRotateInterval() { return m_iLogRotateInterval; }
+	int					GetLogRotateKeep() { return m_iLogRotateKeep; }
+	bool				GetLogRotateCompress() { return m_bLogRotateCompress; }
+	bool				GetDemoteServers() { return m_bDemoteServers; }
 
 	Category*			FindCategory(const char* szName, bool bSearchAliases) { return m_Categories.FindCategory(szName, bSearchAliases); }
 
@@ -40,12 +40,15 @@
 #ifdef WIN32
 #include <par2cmdline.h>
 #include <par2repairer.h>
+#include <md5.h>
 #else
 #include <unistd.h>
 #include <libpar2/par2cmdline.h>
 #include <libpar2/par2repairer.h>
+#include <libpar2/md5.h>
 #endif
 #include <algorithm>
+#include <vector>
 
 #include "nzbget.h"
 #include "ParChecker.h"
@@ -75,8 +78,10 @@ private:
 public:
 	Result		PreProcess(const char *szParFilename);
 	Result		Process(bool dorepair);
+	bool		VerifyFileCrc(Par2RepairerSourceFile* pSourceFile, const char* szFilename, long long lSize, unsigned long lCrc);
 
 	friend class ParChecker;
+	friend class ParPrechecker;
 };
 
 Result Repairer::PreProcess(const char *szParFilename)
@@ -86,31 +91,57 @@ Result Repairer::PreProcess(const char *szParFilename)
 	BugfixesPatchVersion2();
 #endif
 
+	std::vector<char*> args;
+	args.push_back(strdup("par2"));
+	args.push_back(strdup("r"));
+	args.push_back(strdup("-v"));
+	args.push_back(strdup("-v"));
+	args.push_back(strdup(szParFilename));
+
 	if (g_pOptions->GetParScan() == Options::psFull)
 	{
-		char szWildcardParam[1024];
-		strncpy(szWildcardParam, szParFilename, 1024);
-		szWildcardParam[1024-1] = '\0';
-		char* szBasename = Util::BaseFileName(szWildcardParam);
-		if (szBasename != szWildcardParam && strlen(szBasename) > 0)
+		// pass all completed files from the directory of the par-file as extra files;
+		// temporary files (files being currently downloaded or written) are skipped
+		char szDirectory[1024];
+		strncpy(szDirectory, szParFilename, 1024);
+		szDirectory[1024-1] = '\0';
+		char* szBasename = Util::BaseFileName(szDirectory);
+		if (szBasename != szDirectory)
 		{
-			szBasename[0] = '*';
-			szBasename[1] = '\0';
-		}
+			szBasename[-1] = '\0';
 
-		const char* argv[] = { "par2", "r", "-v", "-v", szParFilename, szWildcardParam };
-		if (!commandLine.Parse(6, (char**)argv))
-		{
-			return eInvalidCommandLineArguments;
+			DirBrowser dir(szDirectory);
+			while (const char* filename = dir.Next())
+			{
+				int iLen = strlen(filename);
+				if (!strcmp(filename, ".") || !strcmp(filename, "..") ||
+					(iLen > 4 && !strcasecmp(filename + iLen - 4, ".tmp")))
+				{
+					continue;
+				}
+
+				char szFullFilename[1024];
+				snprintf(szFullFilename, 1024, "%s%c%s", szDirectory, PATH_SEPARATOR, filename);
+				szFullFilename[1024-1] = '\0';
+
+				if (strcmp(szFullFilename, szParFilename) && Util::FileExists(szFullFilename))
+				{
+					args.push_back(strdup(szFullFilename));
+				}
+			}
 		}
 	}
-	else
+
+	bool bParsed = commandLine.Parse(args.size(), &args[0]);
+
+	for (std::vector<char*>::iterator it = args.begin(); it != args.end(); it++)
 	{
-		const char* argv[] = { "par2", "r", "-v", "-v", szParFilename };
-		if (!commandLine.Parse(5, (char**)argv))
-		{
-			return eInvalidCommandLineArguments;
-		}
+		free(*it);
+	}
+
+	if (!bParsed)
+	{
+		return eInvalidCommandLineArguments;
 	}
 
 	return Par2Repairer::PreProcess(commandLine);
@@ -152,6 +183,181 @@ bool MissingFilesComparator::operator()(CommandLine::ExtraFile* pFile1, CommandL
 }
 
 
+static const int VERIFY_BUFFER_SIZE = 1024 * 1024;
+
+/*
+ * Shared state of parallel verification. The files are picked up
+ * one by one by verifier threads.
+ */
+class VerifyQueue
+{
+public:
+	struct Item
+	{
+		char*		szFilename;
+		long long	lSize;
+		MD5Hash		hashFull;
+	};
+
+	typedef std::deque<Item*>	Items;
+
+private:
+	Items			m_Items;
+	unsigned int	m_iNextItem;
+	long long		m_lTotalSize;
+	long long		m_lProcessedSize;
+	bool			m_bCancelled;
+	bool			m_bFailed;
+	Mutex			m_mutexQueue;
+
+public:
+					VerifyQueue();
+					~VerifyQueue();
+	void			AddItem(const char* szFilename, long long lSize, const MD5Hash& hashFull);
+	Item*			NextItem();
+	void			AddProgress(long long lSize);
+	void			Failed();
+	void			Cancel() { m_bCancelled = true; }
+	bool			GetCancelled() { return m_bCancelled; }
+	bool			GetFailed() { return m_bFailed; }
+	int				GetItemCount() { return m_Items.size(); }
+	int				CalcProgress();
+};
+
+VerifyQueue::VerifyQueue()
+{
+	m_iNextItem = 0;
+	m_lTotalSize = 0;
+	m_lProcessedSize = 0;
+	m_bCancelled = false;
+	m_bFailed = false;
+}
+
+VerifyQueue::~VerifyQueue()
+{
+	for (Items::iterator it = m_Items.begin(); it != m_Items.end(); it++)
+	{
+		Item* pItem = *it;
+		free(pItem->szFilename);
+		delete pItem;
+	}
+}
+
+void VerifyQueue::AddItem(const char* szFilename, long long lSize, const MD5Hash& hashFull)
+{
+	Item* pItem = new Item();
+	pItem->szFilename = strdup(szFilename);
+	pItem->lSize = lSize;
+	pItem->hashFull = hashFull;
+	m_Items.push_back(pItem);
+	m_lTotalSize += lSize;
+}
+
+VerifyQueue::Item* VerifyQueue::NextItem()
+{
+	m_mutexQueue.Lock();
+	Item* pItem = !m_bCancelled && m_iNextItem < m_Items.size() ? m_Items[m_iNextItem++] : NULL;
+	m_mutexQueue.Unlock();
+	return pItem;
+}
+
+void VerifyQueue::AddProgress(long long lSize)
+{
+	m_mutexQueue.Lock();
+	m_lProcessedSize += lSize;
+	m_mutexQueue.Unlock();
+}
+
+void VerifyQueue::Failed()
+{
+	// one bad file is enough to fall back to block-by-block verification,
+	// there is no need to check other files
+	m_bFailed = true;
+	m_bCancelled = true;
+}
+
+int VerifyQueue::CalcProgress()
+{
+	m_mutexQueue.Lock();
+	int iProgress = m_lTotalSize > 0 ? (int)(m_lProcessedSize * 1000 / m_lTotalSize) : 0;
+	m_mutexQueue.Unlock();
+	return iProgress;
+}
+
+
+/*
+ * Calculates MD5-hashes of whole files taken from the verify queue and
+ * compares them with the hashes from par2-file.
+ */
+class FileVerifier : public Thread
+{
+private:
+	VerifyQueue*	m_pQueue;
+
+	bool			VerifyFile(VerifyQueue::Item* pItem, char* pBuffer);
+
+public:
+					FileVerifier(VerifyQueue* pQueue) : m_pQueue(pQueue) {}
+	virtual void	Run();
+};
+
+void FileVerifier::Run()
+{
+	char* pBuffer = (char*)malloc(VERIFY_BUFFER_SIZE);
+
+	while (VerifyQueue::Item* pItem = m_pQueue->NextItem())
+	{
+		if (!VerifyFile(pItem, pBuffer) && !m_pQueue->GetCancelled())
+		{
+			debug("File %s is damaged or missing", pItem->szFilename);
+			m_pQueue->Failed();
+		}
+	}
+
+	free(pBuffer);
+}
+
+bool FileVerifier::VerifyFile(VerifyQueue::Item* pItem, char* pBuffer)
+{
+	if (Util::FileSize(pItem->szFilename) != pItem->lSize)
+	{
+		return false;
+	}
+
+	FILE* pFile = fopen(pItem->szFilename, "rb");
+	if (!pFile)
+	{
+		return false;
+	}
+
+	MD5Context context;
+	long long lSize = 0;
+	while (!m_pQueue->GetCancelled())
+	{
+		int iReadBytes = fread(pBuffer, 1, VERIFY_BUFFER_SIZE, pFile);
+		if (iReadBytes <= 0)
+		{
+			break;
+		}
+		context.Update(pBuffer, iReadBytes);
+		lSize += iReadBytes;
+		m_pQueue->AddProgress(iReadBytes);
+	}
+
+	fclose(pFile);
+
+	if (m_pQueue->GetCancelled())
+	{
+		return false;
+	}
+
+	MD5Hash hashFull;
+	context.Final(hashFull);
+
+	return lSize == pItem->lSize && hashFull == pItem->hashFull;
+}
+
+
 ParChecker::ParChecker()
 {
     debug("Creating ParChecker");
@@ -399,20 +605,27 @@ ParChecker::EStatus ParChecker::RunParCheck(const char* szParFilename)
 	m_szErrMsg = NULL;
 	
 	m_eStage = ptVerifyingSources;
-    res = pRepairer->Process(false);
-    debug("ParChecker: Process-result=%i", res);
-
-	if (!IsStopped() && pRepairer->missingfilecount > 0 && g_pOptions->GetParScan() == Options::psAuto && AddMissingFiles())
+	if (VerifyParallel())
 	{
-		res = pRepairer->Process(false);
-		debug("ParChecker: Process-result=%i", res);
+		res = eSuccess;
 	}
-
-	if (!IsStopped() && res == eRepairNotPossible && CheckSplittedFragments())
+	else if (!IsStopped())
 	{
-		pRepairer->UpdateVerificationResults();
 		res = pRepairer->Process(false);
 		debug("ParChecker: Process-result=%i", res);
+
+		if (!IsStopped() && pRepairer->missingfilecount > 0 && g_pOptions->GetParScan() == Options::psAuto && AddMissingFiles())
+		{
+			res = pRepairer->Process(false);
+			debug("ParChecker: Process-result=%i", res);
+		}
+
+		if (!IsStopped() && res == eRepairNotPossible && CheckSplittedFragments())
+		{
+			pRepairer->UpdateVerificationResults();
+			res = pRepairer->Process(false);
+			debug("ParChecker: Process-result=%i", res);
+		}
 	}
 
 	bool bMoreFilesLoaded = true;
@@ -512,6 +725,10 @@ ParChecker::EStatus ParChecker::RunParCheck(const char* szParFilename)
 			m_iFilesToRepair = pRepairer->damagedfilecount + pRepairer->missingfilecount;
 			UpdateProgress();
 
+#ifdef HAVE_PAR2_THREADS
+			pRepairer->threadcount = g_pOptions->GetParThreads() > 0 ? g_pOptions->GetParThreads() : Util::NumberOfCpuCores();
+#endif
+
 			res = pRepairer->Process(true);
     		debug("ParChecker: Process-result=%i", res);
 			if (res == eSuccess)
@@ -556,6 +773,239 @@ ParChecker::EStatus ParChecker::RunParCheck(const char* szParFilename)
 	return eStatus;
 }
 
+/*
+ * Verifies the files of par-set using multiple threads. Each file is checked as a whole:
+ * its MD5-hash is compared with the hash stored in par2-file. The files whose checksums
+ * were computed during download are checked using these checksums (quick verification)
+ * and are not read again.
+ * If a file is already known to be damaged or missing (wrong size or CRC mismatch)
+ * the MD5-pass is skipped, because libpar2 must read all files block by block anyway.
+ * Returns true if all files are intact. Otherwise (or if the verification was
+ * cancelled) the files must be scanned block by block by libpar2.
+ */
+bool ParChecker::VerifyParallel()
+{
+	Repairer* pRepairer = (Repairer*)m_pRepairer;
+
+	char szDirectory[1024];
+	strncpy(szDirectory, m_szParFilename, 1024);
+	szDirectory[1024-1] = '\0';
+	char* szBasename = Util::BaseFileName(szDirectory);
+	if (szBasename == szDirectory)
+	{
+		return false;
+	}
+	szBasename[-1] = '\0';
+
+	VerifyQueue queue;
+	int iQuickFiles = 0;
+
+	for (std::map<MD5Hash, Par2RepairerSourceFile*>::iterator it = pRepairer->sourcefilemap.begin();
+		it != pRepairer->sourcefilemap.end(); it++)
+	{
+		Par2RepairerSourceFile* pSourceFile = it->second;
+		DescriptionPacket* pDescriptionPacket = pSourceFile->GetDescriptionPacket();
+		if (!pDescriptionPacket)
+		{
+			return false;
+		}
+
+		char szFilename[1024];
+		snprintf(szFilename, 1024, "%s%c%s", szDirectory, PATH_SEPARATOR, pDescriptionPacket->FileName().c_str());
+		szFilename[1024-1] = '\0';
+
+		if (Util::FileSize(szFilename) != pDescriptionPacket->FileSize())
+		{
+			debug("File %s is missing or has wrong size, verifying block by block", szFilename);
+			return false;
+		}
+
+		// the files verified during download are only checked for presence
+		if (g_pOptions->GetParQuick())
+		{
+			bool bDamaged = false;
+			if (IsFileVerified(pDescriptionPacket->FileName().c_str()) ||
+				VerifyFileQuick(pSourceFile, szFilename, &bDamaged))
+			{
+				iQuickFiles++;
+				continue;
+			}
+			if (bDamaged)
+			{
+				debug("File %s is damaged, verifying block by block", szFilename);
+				return false;
+			}
+		}
+
+		queue.AddItem(szFilename, pDescriptionPacket->FileSize(), pDescriptionPacket->HashFull());
+	}
+
+	if (iQuickFiles > 0)
+	{
+		debug("%i file(s) of %s confirmed using checksums from download", iQuickFiles, m_szInfoName);
+	}
+
+	if (queue.GetItemCount() == 0)
+	{
+		return iQuickFiles > 0;
+	}
+
+	int iThreads = g_pOptions->GetParThreads() > 0 ? g_pOptions->GetParThreads() : Util::NumberOfCpuCores();
+	if (iThreads > queue.GetItemCount())
+	{
+		iThreads = queue.GetItemCount();
+	}
+
+	debug("Verifying %i file(s) using %i thread(s)", queue.GetItemCount(), iThreads);
+
+	std::deque<FileVerifier*> verifiers;
+	for (int i = 0; i < iThreads; i++)
+	{
+		FileVerifier* pVerifier = new FileVerifier(&queue);
+		verifiers.push_back(pVerifier);
+		pVerifier->Start();
+	}
+
+	bool bRunning = true;
+	while (bRunning)
+	{
+		usleep(100 * 1000);
+
+		if (IsStopped() || m_bCancelled)
+		{
+			queue.Cancel();
+		}
+
+		m_iFileProgress = queue.CalcProgress();
+		m_iStageProgress = m_iFileProgress;
+		UpdateProgress();
+
+		bRunning = false;
+		for (std::deque<FileVerifier*>::iterator it = verifiers.begin(); it != verifiers.end(); it++)
+		{
+			bRunning |= (*it)->IsRunning();
+		}
+	}
+
+	for (std::deque<FileVerifier*>::iterator it = verifiers.begin(); it != verifiers.end(); it++)
+	{
+		delete *it;
+	}
+
+	if (queue.GetFailed())
+	{
+		debug("Parallel verification of %s failed, verifying block by block", m_szInfoName);
+	}
+
+	m_iFileProgress = 0;
+	m_iStageProgress = 0;
+
+	return !queue.GetCancelled();
+}
+
+/*
+ * Par2-files do not contain the CRC of the whole file but contain CRCs of all
+ * blocks. The CRC of the file is combined from CRCs of blocks. The last block
+ * is padded with zeros in par2 and therefore must be read from disk.
+ */
+bool Repairer::VerifyFileCrc(Par2RepairerSourceFile* pSourceFile, const char* szFilename, long long lSize, unsigned long lCrc)
+{
+	DescriptionPacket* pDescriptionPacket = pSourceFile->GetDescriptionPacket();
+	VerificationPacket* pVerificationPacket = pSourceFile->GetVerificationPacket();
+
+	if (!pDescriptionPacket || !pVerificationPacket)
+	{
+		return false;
+	}
+
+	long long lFileSize = pDescriptionPacket->FileSize();
+	long long lBlockSize = blocksize;
+	int iBlockCount = pVerificationPacket->BlockCount();
+
+	// the file could have been changed or deleted since download
+	if (lSize != lFileSize || Util::FileSize(szFilename) != lFileSize ||
+		lBlockSize <= 0 || iBlockCount != (int)((lFileSize + lBlockSize - 1) / lBlockSize))
+	{
+		return false;
+	}
+
+	if (iBlockCount == 0)
+	{
+		return lCrc == 0;
+	}
+
+	// all full blocks have the same size, the operator which appends a block to
+	// the CRC is linear and is precomputed for each bit
+	unsigned long lAppendBlock[32];
+	for (int b = 0; b < 32; b++)
+	{
+		lAppendBlock[b] = Util::Crc32Combine(1UL << b, 0, lBlockSize);
+	}
+
+	unsigned long lParCrc = 0;
+	for (int i = 0; i < iBlockCount - 1; i++)
+	{
+		unsigned long lShifted = 0;
+		for (int b = 0; b < 32; b++)
+		{
+			if (lParCrc & (1UL << b))
+			{
+				lShifted ^= lAppendBlock[b];
+			}
+		}
+		lParCrc = lShifted ^ (u32)pVerificationPacket->VerificationEntry(i)->crc;
+	}
+
+	long long lLastOffset = lBlockSize * (iBlockCount - 1);
+	int iLastSize = (int)(lFileSize - lLastOffset);
+
+	FILE* pFile = fopen(szFilename, "rb");
+	if (!pFile)
+	{
+		return false;
+	}
+
+	unsigned char* pBuffer = (unsigned char*)malloc((size_t)lBlockSize);
+	memset(pBuffer + iLastSize, 0, (size_t)(lBlockSize - iLastSize));
+#ifdef WIN32
+	bool bOK = !_fseeki64(pFile, lLastOffset, SEEK_SET);
+#else
+	bool bOK = !fseeko(pFile, lLastOffset, SEEK_SET);
+#endif
+	bOK = bOK && (int)fread(pBuffer, 1, iLastSize, pFile) == iLastSize;
+	fclose(pFile);
+
+	if (bOK)
+	{
+		unsigned long lLastCrc = Util::Crc32(pBuffer, iLastSize);
+		bOK = Util::Crc32(pBuffer, (unsigned long)lBlockSize) == (u32)pVerificationPacket->VerificationEntry(iBlockCount - 1)->crc;
+		lParCrc = Util::Crc32Combine(lParCrc, lLastCrc, iLastSize);
+	}
+
+	free(pBuffer);
+
+	return bOK && lParCrc == lCrc;
+}
+
+/*
+ * Quick verification of a file using its CRC32 computed during download.
+ * Returns true if the file is intact. If the checksum of the file is known
+ * but doesn't match, the file is damaged and "pDamaged" is set to true.
+ */
+bool ParChecker::VerifyFileQuick(void* pSourceFile, const char* szFilename, bool* pDamaged)
+{
+	long long lSize;
+	unsigned long lCrc;
+	if (!FindFileCrc(Util::BaseFileName(szFilename), &lSize, &lCrc))
+	{
+		return false;
+	}
+
+	bool bOK = ((Repairer*)m_pRepairer)->VerifyFileCrc((Par2RepairerSourceFile*)pSourceFile, szFilename, lSize, lCrc);
+	*pDamaged = !bOK;
+	return bOK;
+}
+
 bool ParChecker::LoadMorePars()
 {
 	m_mutexQueuedParFiles.Lock();
@@ -919,4 +1369,296 @@ void ParChecker::DeleteLeftovers()
 	}
 }
 
+ParPrechecker::~ParPrechecker()
+{
+	for (Jobs::iterator it = m_Jobs.begin(); it != m_Jobs.end(); it++)
+	{
+		delete *it;
+	}
+	for (Jobs::iterator it = m_PendingFiles.begin(); it != m_PendingFiles.end(); it++)
+	{
+		delete *it;
+	}
+	for (ParSets::iterator it = m_ParSets.begin(); it != m_ParSets.end(); it++)
+	{
+		DeleteParSet(*it);
+	}
+}
+
+void ParPrechecker::DeleteParSet(ParSet* pParSet)
+{
+	delete (Repairer*)pParSet->m_pRepairer;
+	free(pParSet->m_szParFilename);
+	delete pParSet;
+}
+
+void ParPrechecker::FileCompleted(int iNZBID, const char* szFilename, Ranges* pDamagedRanges)
+{
+	Job* pJob = new Job();
+	pJob->m_iNZBID = iNZBID;
+	pJob->m_szFilename = strdup(szFilename);
+	if (pDamagedRanges)
+	{
+		pJob->m_damagedRanges = *pDamagedRanges;
+	}
+
+	m_mutexJobs.Lock();
+	m_Jobs.push_back(pJob);
+	m_mutexJobs.Unlock();
+	m_eventJobs.Set();
+
+	if (!IsRunning() && !IsStopped())
+	{
+		Start();
+	}
+}
+
+void ParPrechecker::NZBCompleted(int iNZBID)
+{
+	// the job without filename releases the par-sets of nzb-file
+	Job* pJob = new Job();
+	pJob->m_iNZBID = iNZBID;
+	pJob->m_szFilename = NULL;
+
+	m_mutexJobs.Lock();
+	m_Jobs.push_back(pJob);
+	m_mutexJobs.Unlock();
+	m_eventJobs.Set();
+}
+
+void ParPrechecker::Stop()
+{
+	Thread::Stop();
+	m_eventJobs.Set();
+}
+
+void ParPrechecker::Run()
+{
+	debug("Entering ParPrechecker-loop");
+
+	while (!IsStopped())
+	{
+		m_mutexJobs.Lock();
+		Job* pJob = NULL;
+		if (!m_Jobs.empty())
+		{
+			pJob = m_Jobs.front();
+			m_Jobs.pop_front();
+		}
+		m_mutexJobs.Unlock();
+
+		if (pJob)
+		{
+			ProcessJob(pJob);
+		}
+		else
+		{
+			m_eventJobs.Wait(1000);
+		}
+	}
+
+	debug("Exiting ParPrechecker-loop");
+}
+
+void ParPrechecker::ProcessJob(Job* pJob)
+{
+	if (!pJob->m_szFilename)
+	{
+		ForgetNZB(pJob->m_iNZBID);
+		delete pJob;
+		return;
+	}
+
+	if (ParCoordinator::ParseParFilename(Util::BaseFileName(pJob->m_szFilename), NULL, NULL))
+	{
+		LoadParSet(pJob);
+		delete pJob;
+		return;
+	}
+
+	if (CheckFile(pJob))
+	{
+		delete pJob;
+	}
+	else
+	{
+		// the par-set of the file is not loaded yet
+		m_PendingFiles.push_back(pJob);
+	}
+}
+
+void ParPrechecker::LoadParSet(Job* pJob)
+{
+	for (ParSets::iterator it = m_ParSets.begin(); it != m_ParSets.end(); it++)
+	{
+		ParSet* pParSet = *it;
+		if (pParSet->m_iNZBID == pJob->m_iNZBID &&
+			ParCoordinator::SameParCollection(Util::BaseFileName(pParSet->m_szParFilename), Util::BaseFileName(pJob->m_szFilename)))
+		{
+			// already loaded
+			return;
+		}
+	}
+
+	debug("Loading par-set from %s", pJob->m_szFilename);
+
+	Repairer* pRepairer = new Repairer();
+	Result res = pRepairer->PreProcess(pJob->m_szFilename);
+	if (res != eSuccess || pRepairer->blocksize <= 0)
+	{
+		// the next par2-file of the collection will be tried
+		debug("Could not load par-set from %s", pJob->m_szFilename);
+		delete pRepairer;
+		return;
+	}
+
+	ParSet* pParSet = new ParSet();
+	pParSet->m_iNZBID = pJob->m_iNZBID;
+	pParSet->m_szParFilename = strdup(pJob->m_szFilename);
+	pParSet->m_pRepairer = pRepairer;
+	pParSet->m_iBlocksNeeded = 0;
+	pParSet->m_iBlocksRequested = 0;
+	m_ParSets.push_back(pParSet);
+
+	// check the files downloaded before the par2-file
+	for (Jobs::iterator it = m_PendingFiles.begin(); it != m_PendingFiles.end(); )
+	{
+		Job* pPendingJob = *it;
+		if (pPendingJob->m_iNZBID == pJob->m_iNZBID && CheckFile(pPendingJob))
+		{
+			it = m_PendingFiles.erase(it);
+			delete pPendingJob;
+		}
+		else
+		{
+			it++;
+		}
+	}
+}
+
+/*
+ * Verifies the file using its CRC computed during download. If the file has
+ * damaged parts (failed articles) the par-blocks needed to repair them are
+ * requested at once.
+ * Returns false if the file doesn't belong to any of loaded par-sets.
+ */
+bool ParPrechecker::CheckFile(Job* pJob)
+{
+	const char* szBasename = Util::BaseFileName(pJob->m_szFilename);
+
+	for (ParSets::iterator it = m_ParSets.begin(); it != m_ParSets.end(); it++)
+	{
+		ParSet* pParSet = *it;
+		if (pParSet->m_iNZBID != pJob->m_iNZBID)
+		{
+			continue;
+		}
+
+		Repairer* pRepairer = (Repairer*)pParSet->m_pRepairer;
+		for (std::map<MD5Hash, Par2RepairerSourceFile*>::iterator it2 = pRepairer->sourcefilemap.begin();
+			it2 != pRepairer->sourcefilemap.end(); it2++)
+		{
+			Par2RepairerSourceFile* pSourceFile = it2->second;
+			DescriptionPacket* pDescriptionPacket = pSourceFile->GetDescriptionPacket();
+			if (!pDescriptionPacket || strcmp(pDescriptionPacket->FileName().c_str(), szBasename))
+			{
+				continue;
+			}
+
+			if (pJob->m_damagedRanges.empty())
+			{
+				long long lSize;
+				unsigned long lCrc;
+				if (FindFileCrc(pJob->m_iNZBID, szBasename, &lSize, &lCrc))
+				{
+					if (pRepairer->VerifyFileCrc(pSourceFile, pJob->m_szFilename, lSize, lCrc))
+					{
+						debug("File %s verified during download", szBasename);
+						FileVerified(pJob->m_iNZBID, szBasename);
+					}
+					else
+					{
+						detail("File %s is damaged, it will be repaired during par-check", szBasename);
+					}
+				}
+				return true;
+			}
+
+			// count par-blocks covering the damaged parts of the file
+			long long lBlockSize = pRepairer->blocksize;
+			long long lFileSize = pDescriptionPacket->FileSize();
+			int iFileBlocks = (int)((lFileSize + lBlockSize - 1) / lBlockSize);
+			std::vector<bool> damagedBlocks(iFileBlocks, false);
+			int iBlocks = 0;
+			for (Ranges::iterator it3 = pJob->m_damagedRanges.begin(); it3 != pJob->m_damagedRanges.end(); it3++)
+			{
+				Range& range = *it3;
+				if (range.m_lOffset >= lFileSize || range.m_lSize == 0)
+				{
+					continue;
+				}
+				long long lEnd = range.m_lSize > 0 && range.m_lOffset + range.m_lSize < lFileSize ?
+					range.m_lOffset + range.m_lSize : lFileSize;
+				for (int iBlock = (int)(range.m_lOffset / lBlockSize); iBlock <= (int)((lEnd - 1) / lBlockSize); iBlock++)
+				{
+					if (!damagedBlocks[iBlock])
+					{
+						damagedBlocks[iBlock] = true;
+						iBlocks++;
+					}
+				}
+			}
+
+			pParSet->m_iBlocksNeeded += iBlocks;
+			int iBlocksToRequest = pParSet->m_iBlocksNeeded - pParSet->m_iBlocksRequested;
+			if (iBlocksToRequest > 0)
+			{
+				detail("File %s is damaged, requesting %i par-block(s) during download", szBasename, iBlocksToRequest);
+				if (!RequestMorePars(pJob->m_iNZBID, pParSet->m_szParFilename, iBlocksToRequest))
+				{
+					detail("Not enough par-blocks available for %s, the remaining blocks will be requested during par-check", szBasename);
+				}
+				// the blocks are not requested again for the next damaged files;
+				// what is still missing is determined by par-check after download
+				pParSet->m_iBlocksRequested = pParSet->m_iBlocksNeeded;
+			}
+
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void ParPrechecker::ForgetNZB(int iNZBID)
+{
+	for (ParSets::iterator it = m_ParSets.begin(); it != m_ParSets.end(); )
+	{
+		ParSet* pParSet = *it;
+		if (pParSet->m_iNZBID == iNZBID)
+		{
+			it = m_ParSets.erase(it);
+			DeleteParSet(pParSet);
+		}
+		else
+		{
+			it++;
+		}
+	}
+
+	for (Jobs::iterator it = m_PendingFiles.begin(); it != m_PendingFiles.end(); )
+	{
+		Job* pJob = *it;
+		if (pJob->m_iNZBID == iNZBID)
+		{
+			it = m_PendingFiles.erase(it);
+			delete pJob;
+		}
+		else
+		{
+			it++;
+		}
+	}
+}
+
 #endif
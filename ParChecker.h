@@ -80,6 +80,8 @@ private:
 	SourceList			m_sourceFiles;
 
 	EStatus				RunParCheck(const char* szParFilename);
+	bool				VerifyParallel();
+	bool				VerifyFileQuick(void* pSourceFile, const char* szFilename, bool* pDamaged);
 	void				WriteBrokenLog(EStatus eStatus);
 	void				Cleanup();
 	bool				LoadMorePars();
@@ -102,6 +104,15 @@ protected:
 	virtual void		UpdateProgress() {}
 	virtual void		Completed() {}
 	virtual void		PrintMessage(Message::EKind eKind, const char* szFormat, ...) {}
+	/**
+	* Returns size and CRC32 of the file computed during download,
+	* or false if the checksum of the file is not available
+	*/
+	virtual bool		FindFileCrc(const char* szFilename, long long* pSize, unsigned long* pCrc) { return false; }
+	/**
+	* Returns true if the file was already verified during download
+	*/
+	virtual bool		IsFileVerified(const char* szFilename) { return false; }
 	EStage				GetStage() { return m_eStage; }
 	const char*			GetProgressLabel() { return m_szProgressLabel; }
 	int					GetFileProgress() { return m_iFileProgress; }
@@ -123,6 +134,75 @@ public:
 	bool				GetCancelled() { return m_bCancelled; }
 };
 
+/*
+ * Verifies the files of par-sets during download, each file as soon as it is
+ * completed, using the checksums computed by ArticleDownloader. The par-set is
+ * loaded as soon as the first par2-file of the collection is downloaded.
+ * The damaged parts of the files are counted in par-blocks, so the extra
+ * par-files can be requested before the download of nzb-file ends.
+ */
+class ParPrechecker : public Thread
+{
+public:
+	struct Range
+	{
+		long long		m_lOffset;
+		long long		m_lSize;		// "-1" means "till the end of file"
+	};
+
+	typedef std::deque<Range>		Ranges;
+
+private:
+	class Job
+	{
+	public:
+		int				m_iNZBID;
+		char*			m_szFilename;
+		Ranges			m_damagedRanges;
+						~Job() { free(m_szFilename); }
+	};
+
+	class ParSet
+	{
+	public:
+		int				m_iNZBID;
+		char*			m_szParFilename;
+		void*			m_pRepairer;	// declared as void* to prevent the including of libpar2-headers into this header-file
+		int				m_iBlocksNeeded;
+		int				m_iBlocksRequested;
+	};
+
+	typedef std::deque<Job*>		Jobs;
+	typedef std::deque<ParSet*>		ParSets;
+
+	Jobs				m_Jobs;
+	Mutex				m_mutexJobs;
+	Event				m_eventJobs;
+	Jobs				m_PendingFiles;
+	ParSets				m_ParSets;
+
+	void				ProcessJob(Job* pJob);
+	void				LoadParSet(Job* pJob);
+	bool				CheckFile(Job* pJob);
+	void				ForgetNZB(int iNZBID);
+	void				DeleteParSet(ParSet* pParSet);
+
+protected:
+	/**
+	* Returns size and CRC32 of the file computed during download
+	*/
+	virtual bool		FindFileCrc(int iNZBID, const char* szFilename, long long* pSize, unsigned long* pCrc) = 0;
+	virtual void		FileVerified(int iNZBID, const char* szFilename) = 0;
+	virtual bool		RequestMorePars(int iNZBID, const char* szParFilename, int iBlockNeeded) = 0;
+
+public:
+	virtual				~ParPrechecker();
+	virtual void		Run();
+	virtual void		Stop();
+	void				FileCompleted(int iNZBID, const char* szFilename, Ranges* pDamagedRanges);
+	void				NZBCompleted(int iNZBID);
+};
+
 #endif
 
 #endif
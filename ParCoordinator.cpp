@@ -35,6 +35,7 @@
 #include <string.h>
 #include <stdio.h>
 #include <stdarg.h>
+#include <vector>
 #ifdef WIN32
 #include <direct.h>
 #else
@@ -56,7 +57,7 @@ extern DiskState* g_pDiskState;
 #ifndef DISABLE_PARCHECK
 bool ParCoordinator::PostParChecker::RequestMorePars(int iBlockNeeded, int* pBlockFound)
 {
-	return m_pOwner->RequestMorePars(m_pPostInfo->GetNZBInfo(), GetParFilename(), iBlockNeeded, pBlockFound);
+	return m_pOwner->RequestMorePars(m_pPostInfo, m_pPostInfo->GetNZBInfo(), GetParFilename(), iBlockNeeded, pBlockFound);
 }
 
 void ParCoordinator::PostParChecker::UpdateProgress()
@@ -76,6 +77,69 @@ void ParCoordinator::PostParChecker::PrintMessage(Message::EKind eKind, const ch
 	m_pOwner->PrintMessage(m_pPostInfo, eKind, "%s", szText);
 }
 
+bool ParCoordinator::PostParChecker::FindFileCrc(const char* szFilename, long long* pSize, unsigned long* pCrc)
+{
+	// the locking is needed for accessing the members of NZBInfo
+	g_pQueueCoordinator->LockQueue();
+
+	FileChecksum* pFileChecksum = m_pPostInfo->GetNZBInfo()->GetFileChecksums()->Find(szFilename);
+	bool bFound = pFileChecksum && pFileChecksum->GetSize() >= 0;
+	if (bFound)
+	{
+		*pSize = pFileChecksum->GetSize();
+		*pCrc = pFileChecksum->GetCrc();
+	}
+
+	g_pQueueCoordinator->UnlockQueue();
+
+	return bFound;
+}
+
+bool ParCoordinator::PostParChecker::IsFileVerified(const char* szFilename)
+{
+	// the locking is needed for accessing the members of NZBInfo
+	g_pQueueCoordinator->LockQueue();
+
+	FileChecksum* pFileChecksum = m_pPostInfo->GetNZBInfo()->GetFileChecksums()->Find(szFilename);
+	bool bVerified = pFileChecksum && pFileChecksum->GetParVerified();
+
+	g_pQueueCoordinator->UnlockQueue();
+
+	return bVerified;
+}
+
+bool ParCoordinator::PostParRenamer::FindHash16k(const char* szFilename, char* szHash, int iBufSize)
+{
+	// the locking is needed for accessing the members of NZBInfo
+	g_pQueueCoordinator->LockQueue();
+
+	FileChecksum* pFileChecksum = m_pPostInfo->GetNZBInfo()->GetFileChecksums()->Find(szFilename);
+	bool bFound = pFileChecksum && pFileChecksum->GetHash16k();
+	if (bFound)
+	{
+		strncpy(szHash, pFileChecksum->GetHash16k(), iBufSize);
+		szHash[iBufSize-1] = '\0';
+	}
+
+	g_pQueueCoordinator->UnlockQueue();
+
+	return bFound;
+}
+
+void ParCoordinator::PostParRenamer::FileRenamed(const char* szOldFilename, const char* szNewFilename)
+{
+	// keep the checksums from download usable for quick par-verification
+	g_pQueueCoordinator->LockQueue();
+
+	FileChecksum* pFileChecksum = m_pPostInfo->GetNZBInfo()->GetFileChecksums()->Find(szOldFilename);
+	if (pFileChecksum)
+	{
+		pFileChecksum->SetFilename(szNewFilename);
+	}
+
+	g_pQueueCoordinator->UnlockQueue();
+}
+
 void ParCoordinator::PostParRenamer::UpdateProgress()
 {
 	m_pOwner->UpdateParRenameProgress();
@@ -92,6 +156,76 @@ void ParCoordinator::PostParRenamer::PrintMessage(Message::EKind eKind, const ch
 	
 	m_pOwner->PrintMessage(m_pPostInfo, eKind, "%s", szText);
 }
+
+static NZBInfo* FindNZBInfo(DownloadQueue* pDownloadQueue, int iNZBID)
+{
+	for (NZBInfoList::iterator it = pDownloadQueue->GetNZBInfoList()->begin(); it != pDownloadQueue->GetNZBInfoList()->end(); it++)
+	{
+		NZBInfo* pNZBInfo = *it;
+		if (pNZBInfo->GetID() == iNZBID)
+		{
+			return pNZBInfo;
+		}
+	}
+	return NULL;
+}
+
+bool ParCoordinator::DownloadParPrechecker::FindFileCrc(int iNZBID, const char* szFilename, long long* pSize, unsigned long* pCrc)
+{
+	DownloadQueue* pDownloadQueue = g_pQueueCoordinator->LockQueue();
+
+	NZBInfo* pNZBInfo = FindNZBInfo(pDownloadQueue, iNZBID);
+	FileChecksum* pFileChecksum = pNZBInfo ? pNZBInfo->GetFileChecksums()->Find(szFilename) : NULL;
+	bool bFound = pFileChecksum && pFileChecksum->GetSize() >= 0;
+	if (bFound)
+	{
+		*pSize = pFileChecksum->GetSize();
+		*pCrc = pFileChecksum->GetCrc();
+	}
+
+	g_pQueueCoordinator->UnlockQueue();
+
+	return bFound;
+}
+
+void ParCoordinator::DownloadParPrechecker::FileVerified(int iNZBID, const char* szFilename)
+{
+	DownloadQueue* pDownloadQueue = g_pQueueCoordinator->LockQueue();
+
+	NZBInfo* pNZBInfo = FindNZBInfo(pDownloadQueue, iNZBID);
+	FileChecksum* pFileChecksum = pNZBInfo ? pNZBInfo->GetFileChecksums()->Find(szFilename) : NULL;
+	if (pFileChecksum)
+	{
+		pFileChecksum->SetParVerified(true);
+	}
+
+	g_pQueueCoordinator->UnlockQueue();
+}
+
+bool ParCoordinator::DownloadParPrechecker::RequestMorePars(int iNZBID, const char* szParFilename, int iBlockNeeded)
+{
+	DownloadQueue* pDownloadQueue = g_pQueueCoordinator->LockQueue();
+	NZBInfo* pNZBInfo = FindNZBInfo(pDownloadQueue, iNZBID);
+	if (pNZBInfo)
+	{
+		// keep the object alive during the request
+		pNZBInfo->AddReference();
+	}
+	g_pQueueCoordinator->UnlockQueue();
+
+	if (!pNZBInfo)
+	{
+		return false;
+	}
+
+	bool bOK = m_pOwner->RequestMorePars(NULL, pNZBInfo, szParFilename, iBlockNeeded, NULL);
+
+	g_pQueueCoordinator->LockQueue();
+	pNZBInfo->Release();
+	g_pQueueCoordinator->UnlockQueue();
+
+	return bOK;
+}
 #endif
 
 ParCoordinator::ParCoordinator()
@@ -102,6 +236,7 @@ ParCoordinator::ParCoordinator()
 	m_bStopped = false;
 	m_ParChecker.m_pOwner = this;
 	m_ParRenamer.m_pOwner = this;
+	m_ParPrechecker.m_pOwner = this;
 #endif
 }
 
@@ -132,6 +267,13 @@ void ParCoordinator::Stop()
 			m_ParChecker.Kill();
 		}
 	}
+
+	// stopping also prevents the starting of prechecker during shutdown
+	m_ParPrechecker.Stop();
+	while (m_ParPrechecker.IsRunning())
+	{
+		usleep(50 * 1000);
+	}
 }
 #endif
 
@@ -281,6 +423,80 @@ void ParCoordinator::StartParRenameJob(PostInfo* pPostInfo)
 	m_ParRenamer.Start();
 }
 
+/**
+ * Passes the completed file to the incremental par-verification.
+ * The damaged ranges of the file are the gaps between successfully decoded
+ * segments, as reported by the decoder. If a segment's position is unknown
+ * the gap is extended to the next known segment (or to the end of file).
+ * DownloadQueue must be locked prior to call of this function.
+ */
+void ParCoordinator::FileCompleted(FileInfo* pFileInfo)
+{
+	if (!g_pOptions->GetParIncremental() || !g_pOptions->GetParQuick() ||
+		g_pOptions->GetParCheck() == Options::pcManual)
+	{
+		return;
+	}
+
+	ParPrechecker::Ranges damagedRanges;
+	bool bDamaged = false;
+	bool bInGap = false;
+	long long lGapStart = 0;
+	long long lPrevEnd = 0;
+	for (FileInfo::Articles::iterator it = pFileInfo->GetArticles()->begin(); it != pFileInfo->GetArticles()->end(); it++)
+	{
+		ArticleInfo* pArticle = *it;
+		bool bFinished = pArticle->GetStatus() == ArticleInfo::aiFinished;
+		bDamaged |= !bFinished;
+		if (bFinished && pArticle->GetSegmentOffset() >= 0 && pArticle->GetSegmentSize() > 0)
+		{
+			if (bInGap && pArticle->GetSegmentOffset() > lGapStart)
+			{
+				ParPrechecker::Range range;
+				range.m_lOffset = lGapStart;
+				range.m_lSize = pArticle->GetSegmentOffset() - lGapStart;
+				damagedRanges.push_back(range);
+			}
+			bInGap = false;
+			lPrevEnd = pArticle->GetSegmentOffset() + pArticle->GetSegmentSize();
+		}
+		else if (!bInGap)
+		{
+			bInGap = true;
+			lGapStart = lPrevEnd;
+		}
+	}
+
+	if (!bDamaged)
+	{
+		damagedRanges.clear();
+	}
+	else if (bInGap)
+	{
+		ParPrechecker::Range range;
+		range.m_lOffset = lGapStart;
+		range.m_lSize = -1;
+		damagedRanges.push_back(range);
+	}
+
+	char szFullFilename[1024];
+	snprintf(szFullFilename, 1024, "%s%c%s", pFileInfo->GetNZBInfo()->GetDestDir(), (int)PATH_SEPARATOR, pFileInfo->GetFilename());
+	szFullFilename[1024-1] = '\0';
+
+	m_ParPrechecker.FileCompleted(pFileInfo->GetNZBInfo()->GetID(), szFullFilename, &damagedRanges);
+}
+
+/**
+ * DownloadQueue must be locked prior to call of this function.
+ */
+void ParCoordinator::NZBCompleted(NZBInfo* pNZBInfo)
+{
+	if (m_ParPrechecker.IsRunning())
+	{
+		m_ParPrechecker.NZBCompleted(pNZBInfo->GetID());
+	}
+}
+
 bool ParCoordinator::Cancel()
 {
 	if (m_eCurrentJob == jkParCheck)
@@ -372,9 +588,11 @@ void ParCoordinator::ParCheckCompleted()
 /**
 * Unpause par2-files
 * returns true, if the files with required number of blocks were unpaused,
-* or false if there are no more files in queue for this collection or not enough blocks
+* or false if there are no more files in queue for this collection or not enough blocks.
+* The requests made during download (pPostInfo is NULL) are incremental: the blocks
+* of files unpaused before are already accounted for and only paused files are considered.
 */
-bool ParCoordinator::RequestMorePars(NZBInfo* pNZBInfo, const char* szParFilename, int iBlockNeeded, int* pBlockFound)
+bool ParCoordinator::RequestMorePars(PostInfo* pPostInfo, NZBInfo* pNZBInfo, const char* szParFilename, int iBlockNeeded, int* pBlockFound)
 {
 	DownloadQueue* pDownloadQueue = g_pQueueCoordinator->LockQueue();
 	
@@ -382,67 +600,32 @@ bool ParCoordinator::RequestMorePars(NZBInfo* pNZBInfo, const char* szParFilenam
 	blocks.clear();
 	int iBlockFound = 0;
     int iCurBlockFound = 0;
+	bool bPausedOnly = !pPostInfo;
 
-	FindPars(pDownloadQueue, pNZBInfo, szParFilename, &blocks, true, true, &iCurBlockFound);
+	FindPars(pDownloadQueue, pNZBInfo, szParFilename, &blocks, true, true, bPausedOnly, &iCurBlockFound);
     iBlockFound += iCurBlockFound;
 	if (iBlockFound < iBlockNeeded)
 	{
-		FindPars(pDownloadQueue, pNZBInfo, szParFilename, &blocks, true, false, &iCurBlockFound);
+		FindPars(pDownloadQueue, pNZBInfo, szParFilename, &blocks, true, false, bPausedOnly, &iCurBlockFound);
         iBlockFound += iCurBlockFound;
 	}
 	if (iBlockFound < iBlockNeeded && !g_pOptions->GetStrictParName())
 	{
-		FindPars(pDownloadQueue, pNZBInfo, szParFilename, &blocks, false, false, &iCurBlockFound);
+		FindPars(pDownloadQueue, pNZBInfo, szParFilename, &blocks, false, false, bPausedOnly, &iCurBlockFound);
         iBlockFound += iCurBlockFound;
 	}
 
 	if (iBlockFound >= iBlockNeeded)
 	{
-		// 1. first unpause all files with par-blocks less or equal iBlockNeeded
-		// starting from the file with max block count.
-		// if par-collection was built exponentially and all par-files present,
-		// this step selects par-files with exact number of blocks we need.
-		while (iBlockNeeded > 0)
-		{               
-			BlockInfo* pBestBlockInfo = NULL;
-			for (Blocks::iterator it = blocks.begin(); it != blocks.end(); it++)
-			{
-				BlockInfo* pBlockInfo = *it;
-				if (pBlockInfo->m_iBlockCount <= iBlockNeeded &&
-				   (!pBestBlockInfo || pBestBlockInfo->m_iBlockCount < pBlockInfo->m_iBlockCount))
-				{
-					pBestBlockInfo = pBlockInfo;
-				}
-			}
-			if (pBestBlockInfo)
-			{
-				if (pBestBlockInfo->m_pFileInfo->GetPaused())
-				{
-					m_ParChecker.PrintMessage(Message::mkInfo, "Unpausing %s%c%s for par-recovery", pNZBInfo->GetName(), (int)PATH_SEPARATOR, pBestBlockInfo->m_pFileInfo->GetFilename());
-					pBestBlockInfo->m_pFileInfo->SetPaused(false);
-					pBestBlockInfo->m_pFileInfo->SetExtraPriority(true);
-				}
-				iBlockNeeded -= pBestBlockInfo->m_iBlockCount;
-				blocks.remove(pBestBlockInfo);
-				delete pBestBlockInfo;
-			}
-			else
-			{
-				break;
-			}
-		}
-			
-		// 2. then unpause other files
-		// this step only needed if the par-collection was built not exponentially 
-		// or not all par-files present (or some of them were corrupted)
-		// this step is not optimal, but we hope, that the first step will work good 
-		// in most cases and we will not need the second step often
-		while (iBlockNeeded > 0)
+		Blocks selected;
+		SelectPars(&blocks, iBlockNeeded, &selected);
+
+		for (Blocks::iterator it = selected.begin(); it != selected.end(); it++)
 		{
-			BlockInfo* pBlockInfo = blocks.front();
+			BlockInfo* pBlockInfo = *it;
 			if (pBlockInfo->m_pFileInfo->GetPaused())
 			{
-				m_ParChecker.PrintMessage(Message::mkInfo, "Unpausing %s%c%s for par-recovery", pNZBInfo->GetName(), (int)PATH_SEPARATOR, pBlockInfo->m_pFileInfo->GetFilename());
+				PrintMessage(pPostInfo, Message::mkInfo, "Unpausing %s%c%s for par-recovery", pNZBInfo->GetName(), (int)PATH_SEPARATOR, pBlockInfo->m_pFileInfo->GetFilename());
 				pBlockInfo->m_pFileInfo->SetPaused(false);
 				pBlockInfo->m_pFileInfo->SetExtraPriority(true);
 			}
@@ -465,7 +648,7 @@ bool ParCoordinator::RequestMorePars(NZBInfo* pNZBInfo, const char* szParFilenam
 
 	bool bOK = iBlockNeeded <= 0;
 
-	if (bOK && g_pOptions->GetParPauseQueue())
+	if (bOK && pPostInfo && g_pOptions->GetParPauseQueue())
 	{
 		UnpauseDownload();
 	}
@@ -473,8 +656,76 @@ bool ParCoordinator::RequestMorePars(NZBInfo* pNZBInfo, const char* szParFilenam
 	return bOK;
 }
 
+/*
+ * Selects the set of par-files which together contain at least iBlockNeeded
+ * blocks and require the smallest amount of data to be downloaded. The remaining
+ * size of each par-file is taken from FileInfo; the files which are already
+ * unpaused are downloaded anyway and cost nothing. From sets of equal size the
+ * set with fewer files is preferred.
+ * The selection is a 0/1-knapsack problem solved using dynamic programming
+ * over the number of blocks.
+ */
+void ParCoordinator::SelectPars(Blocks* pBlocks, int iBlockNeeded, Blocks* pSelected)
+{
+	if (iBlockNeeded <= 0)
+	{
+		return;
+	}
+
+	std::vector<BlockInfo*> items(pBlocks->begin(), pBlocks->end());
+	int iItemCount = items.size();
+	int iStates = iBlockNeeded + 1;
+
+	// minimal cost (download size and number of files) to get at least "b" blocks;
+	// size "-1" means the block count can't be reached
+	std::vector<long long> cost(iStates, -1);
+	std::vector<int> fileCount(iStates, 0);
+	std::vector<bool> taken(iItemCount * iStates, false);
+	cost[0] = 0;
+
+	for (int i = 0; i < iItemCount; i++)
+	{
+		BlockInfo* pBlockInfo = items[i];
+		long long lSize = pBlockInfo->m_pFileInfo->GetPaused() ? pBlockInfo->m_pFileInfo->GetRemainingSize() : 0;
+
+		// states are processed in descending order, so each file is used only once
+		for (int b = iBlockNeeded; b > 0; b--)
+		{
+			int iFrom = b > pBlockInfo->m_iBlockCount ? b - pBlockInfo->m_iBlockCount : 0;
+			if (cost[iFrom] < 0)
+			{
+				continue;
+			}
+
+			long long lNewCost = cost[iFrom] + lSize;
+			int iNewFileCount = fileCount[iFrom] + 1;
+			if (cost[b] < 0 || lNewCost < cost[b] || (lNewCost == cost[b] && iNewFileCount < fileCount[b]))
+			{
+				cost[b] = lNewCost;
+				fileCount[b] = iNewFileCount;
+				taken[i * iStates + b] = true;
+			}
+		}
+	}
+
+	if (cost[iBlockNeeded] < 0)
+	{
+		return;
+	}
+
+	int b = iBlockNeeded;
+	for (int i = iItemCount - 1; i >= 0 && b > 0; i--)
+	{
+		if (taken[i * iStates + b])
+		{
+			pSelected->push_back(items[i]);
+			b = b > items[i]->m_iBlockCount ? b - items[i]->m_iBlockCount : 0;
+		}
+	}
+}
+
 void ParCoordinator::FindPars(DownloadQueue* pDownloadQueue, NZBInfo* pNZBInfo, const char* szParFilename,
-	Blocks* pBlocks, bool bStrictParName, bool bExactParName, int* pBlockFound)
+	Blocks* pBlocks, bool bStrictParName, bool bExactParName, bool bPausedOnly, int* pBlockFound)
 {
     *pBlockFound = 0;
 	
@@ -498,6 +749,7 @@ void ParCoordinator::FindPars(DownloadQueue* pDownloadQueue, NZBInfo* pNZBInfo,
 		FileInfo* pFileInfo = *it;
 		int iBlocks = 0;
 		if (pFileInfo->GetNZBInfo() == pNZBInfo &&
+			(!bPausedOnly || pFileInfo->GetPaused()) &&
 			ParseParFilename(pFileInfo->GetFilename(), NULL, &iBlocks) &&
 			iBlocks > 0)
 		{
@@ -697,7 +949,10 @@ void ParCoordinator::PrintMessage(PostInfo* pPostInfo, Message::EKind eKind, con
 	va_end(args);
 	szText[1024-1] = '\0';
 
-	pPostInfo->AppendMessage(eKind, szText);
+	if (pPostInfo)
+	{
+		pPostInfo->AppendMessage(eKind, szText);
+	}
 
 	switch (eKind)
 	{
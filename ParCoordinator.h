@@ -50,6 +50,8 @@ private:
 		virtual void	UpdateProgress();
 		virtual void	Completed() { m_pOwner->ParCheckCompleted(); }
 		virtual void	PrintMessage(Message::EKind eKind, const char* szFormat, ...);
+		virtual bool	FindFileCrc(const char* szFilename, long long* pSize, unsigned long* pCrc);
+		virtual bool	IsFileVerified(const char* szFilename);
 	public:
 		PostInfo*		GetPostInfo() { return m_pPostInfo; }
 		void			SetPostInfo(PostInfo* pPostInfo) { m_pPostInfo = pPostInfo; }
@@ -57,6 +59,18 @@ private:
 		friend class ParCoordinator;
 	};
 
+	class DownloadParPrechecker: public ParPrechecker
+	{
+	private:
+		ParCoordinator*	m_pOwner;
+	protected:
+		virtual bool	FindFileCrc(int iNZBID, const char* szFilename, long long* pSize, unsigned long* pCrc);
+		virtual void	FileVerified(int iNZBID, const char* szFilename);
+		virtual bool	RequestMorePars(int iNZBID, const char* szParFilename, int iBlockNeeded);
+
+		friend class ParCoordinator;
+	};
+
 	class PostParRenamer: public ParRenamer
 	{
 	private:
@@ -66,6 +80,8 @@ private:
 		virtual void	UpdateProgress();
 		virtual void	Completed() { m_pOwner->ParRenameCompleted(); }
 		virtual void	PrintMessage(Message::EKind eKind, const char* szFormat, ...);
+		virtual bool	FindHash16k(const char* szFilename, char* szHash, int iBufSize);
+		virtual void	FileRenamed(const char* szOldFilename, const char* szNewFilename);
 	public:
 		PostInfo*		GetPostInfo() { return m_pPostInfo; }
 		void			SetPostInfo(PostInfo* pPostInfo) { m_pPostInfo = pPostInfo; }
@@ -91,6 +107,7 @@ private:
 	PostParChecker		m_ParChecker;
 	bool				m_bStopped;
 	PostParRenamer		m_ParRenamer;
+	DownloadParPrechecker	m_ParPrechecker;
 	EJobKind			m_eCurrentJob;
 
 protected:
@@ -101,7 +118,8 @@ protected:
 	void				ParCheckCompleted();
 	void				ParRenameCompleted();
 	void				CheckPauseState(PostInfo* pPostInfo);
-	bool				RequestMorePars(NZBInfo* pNZBInfo, const char* szParFilename, int iBlockNeeded, int* pBlockFound);
+	bool				RequestMorePars(PostInfo* pPostInfo, NZBInfo* pNZBInfo, const char* szParFilename, int iBlockNeeded, int* pBlockFound);
+	void				SelectPars(Blocks* pBlocks, int iBlockNeeded, Blocks* pSelected);
 	void				PrintMessage(PostInfo* pPostInfo, Message::EKind eKind, const char* szFormat, ...);
 #endif
 
@@ -119,9 +137,11 @@ public:
 #ifndef DISABLE_PARCHECK
 	bool				AddPar(FileInfo* pFileInfo, bool bDeleted);
 	void				FindPars(DownloadQueue* pDownloadQueue, NZBInfo* pNZBInfo, const char* szParFilename, 
-							Blocks* pBlocks, bool bStrictParName, bool bExactParName, int* pBlockFound);
+							Blocks* pBlocks, bool bStrictParName, bool bExactParName, bool bPausedOnly, int* pBlockFound);
 	void				StartParCheckJob(PostInfo* pPostInfo);
 	void				StartParRenameJob(PostInfo* pPostInfo);
+	void				FileCompleted(FileInfo* pFileInfo);
+	void				NZBCompleted(NZBInfo* pNZBInfo);
 	void				Stop();
 	bool				Cancel();
 #endif
@@ -63,6 +63,175 @@ public:
 	friend class ParRenamer;
 };
 
+static const int HASH16K_SIZE = 16 * 1024;
+
+/*
+ * Shared state of parallel hashing. The files are picked up one by one
+ * by hasher threads; several files being read at the same time keep
+ * the disk busy.
+ */
+class HashQueue
+{
+public:
+	struct Item
+	{
+		char*		szFilename;
+		char		szHash16k[33];
+		bool		bHashed;
+		bool		bError;
+	};
+
+	typedef std::deque<Item*>	Items;
+
+private:
+	Items			m_Items;
+	unsigned int	m_iNextItem;
+	int				m_iProcessed;
+	bool			m_bCancelled;
+	Mutex			m_mutexQueue;
+
+public:
+					HashQueue();
+					~HashQueue();
+	Item*			AddItem(const char* szFilename);
+	Item*			NextItem();
+	void			ItemProcessed();
+	void			Cancel() { m_bCancelled = true; }
+	bool			GetCancelled() { return m_bCancelled; }
+	Items*			GetItems() { return &m_Items; }
+	int				GetProcessed();
+};
+
+HashQueue::HashQueue()
+{
+	m_iNextItem = 0;
+	m_iProcessed = 0;
+	m_bCancelled = false;
+}
+
+HashQueue::~HashQueue()
+{
+	for (Items::iterator it = m_Items.begin(); it != m_Items.end(); it++)
+	{
+		Item* pItem = *it;
+		free(pItem->szFilename);
+		delete pItem;
+	}
+}
+
+HashQueue::Item* HashQueue::AddItem(const char* szFilename)
+{
+	Item* pItem = new Item();
+	pItem->szFilename = strdup(szFilename);
+	pItem->szHash16k[0] = '\0';
+	pItem->bHashed = false;
+	pItem->bError = false;
+	m_Items.push_back(pItem);
+	return pItem;
+}
+
+/*
+ * Returns next item which needs hashing. Items having the hash already
+ * (computed during download) are skipped.
+ */
+HashQueue::Item* HashQueue::NextItem()
+{
+	Item* pItem = NULL;
+	m_mutexQueue.Lock();
+	while (!m_bCancelled && !pItem && m_iNextItem < m_Items.size())
+	{
+		pItem = m_Items[m_iNextItem++];
+		if (pItem->bHashed)
+		{
+			pItem = NULL;
+		}
+	}
+	m_mutexQueue.Unlock();
+	return pItem;
+}
+
+void HashQueue::ItemProcessed()
+{
+	m_mutexQueue.Lock();
+	m_iProcessed++;
+	m_mutexQueue.Unlock();
+}
+
+int HashQueue::GetProcessed()
+{
+	m_mutexQueue.Lock();
+	int iProcessed = m_iProcessed;
+	m_mutexQueue.Unlock();
+	return iProcessed;
+}
+
+
+/*
+ * Computes hash16k of files taken from the hash queue.
+ */
+class FileHasher : public Thread
+{
+private:
+	HashQueue*		m_pQueue;
+
+	void			HashFile(HashQueue::Item* pItem, char* pBuffer);
+
+public:
+					FileHasher(HashQueue* pQueue) : m_pQueue(pQueue) {}
+	virtual void	Run();
+};
+
+void FileHasher::Run()
+{
+	char* pBuffer = (char*)malloc(HASH16K_SIZE);
+
+	while (HashQueue::Item* pItem = m_pQueue->NextItem())
+	{
+		HashFile(pItem, pBuffer);
+		m_pQueue->ItemProcessed();
+	}
+
+	free(pBuffer);
+}
+
+void FileHasher::HashFile(HashQueue::Item* pItem, char* pBuffer)
+{
+	debug("Computing hash for %s", pItem->szFilename);
+
+	FILE* pFile = fopen(pItem->szFilename, "rb");
+	if (!pFile)
+	{
+		pItem->bError = true;
+		return;
+	}
+
+	// load first 16K of the file into buffer
+	int iReadBytes = fread(pBuffer, 1, HASH16K_SIZE, pFile);
+	int iError = ferror(pFile);
+	fclose(pFile);
+
+	if (iReadBytes != HASH16K_SIZE && iError)
+	{
+		pItem->bError = true;
+		return;
+	}
+
+	MD5Hash hash16k;
+	MD5Context context;
+	context.Update(pBuffer, iReadBytes);
+	context.Final(hash16k);
+
+	strncpy(pItem->szHash16k, hash16k.print().c_str(), sizeof(pItem->szHash16k));
+	pItem->szHash16k[sizeof(pItem->szHash16k)-1] = '\0';
+	pItem->bHashed = true;
+}
+
+
+bool ParRenamer::HashLess::operator()(const char* szHash1, const char* szHash2) const
+{
+	return strcmp(szHash1, szHash2) < 0;
+}
+
 ParRenamer::FileHash::FileHash(const char* szFilename, const char* szHash)
 {
 	m_szFilename = strdup(szFilename);
@@ -106,11 +275,11 @@ ParRenamer::~ParRenamer()
 
 void ParRenamer::Cleanup()
 {
-	for (FileHashList::iterator it = m_fileHashList.begin(); it != m_fileHashList.end(); it++)
+	for (FileHashMap::iterator it = m_fileHashMap.begin(); it != m_fileHashMap.end(); it++)
 	{
-		delete *it;
+		delete it->second;
 	}
-	m_fileHashList.clear();
+	m_fileHashMap.clear();
 }
 
 void ParRenamer::SetDestDir(const char * szDestDir)
@@ -207,8 +376,13 @@ void ParRenamer::LoadParFile(const char* szParFilename)
 		}
 		
 		Par2RepairerSourceFile* sourceFile = (*it).second;
-		m_fileHashList.push_back(new FileHash(sourceFile->GetDescriptionPacket()->FileName().c_str(),
-			sourceFile->GetDescriptionPacket()->Hash16k().print().c_str()));
+		FileHash* pFileHash = new FileHash(sourceFile->GetDescriptionPacket()->FileName().c_str(),
+			sourceFile->GetDescriptionPacket()->Hash16k().print().c_str());
+		if (!m_fileHashMap.insert(FileHashMap::value_type(pFileHash->GetHash(), pFileHash)).second)
+		{
+			// files with the same hash16k (identical first 16 KB), the first one wins
+			delete pFileHash;
+		}
 	}
 
 	delete pRepairer;
@@ -216,17 +390,10 @@ void ParRenamer::LoadParFile(const char* szParFilename)
 
 void ParRenamer::CheckFiles()
 {
-	int iFileCount = 0;
-	DirBrowser dir2(m_szDestDir);
-	while (const char* filename = dir2.Next())
-	{
-		if (strcmp(filename, ".") && strcmp(filename, "..") && !m_bCancelled)
-		{
-			iFileCount++;
-		}
-	}
+	HashQueue queue;
 
-	int iCurFile = 0;
+	// hashes computed during download need no disk reads
+	int iKnownHashes = 0;
 	DirBrowser dir(m_szDestDir);
 	while (const char* filename = dir.Next())
 	{
@@ -236,78 +403,111 @@ void ParRenamer::CheckFiles()
 			snprintf(szFullFilename, 1024, "%s%c%s", m_szDestDir, PATH_SEPARATOR, filename);
 			szFullFilename[1024-1] = '\0';
 
-			snprintf(m_szProgressLabel, 1024, "Checking file %s", filename);
+			if (Util::DirectoryExists(szFullFilename))
+			{
+				continue;
+			}
+
+			HashQueue::Item* pItem = queue.AddItem(szFullFilename);
+			if (FindHash16k(filename, pItem->szHash16k, sizeof(pItem->szHash16k)))
+			{
+				pItem->bHashed = true;
+				iKnownHashes++;
+			}
+		}
+	}
+
+	int iFileCount = queue.GetItems()->size();
+	int iHashCount = iFileCount - iKnownHashes;
+
+	debug("Checking %i file(s), %i hash(es) known from download", iFileCount, iKnownHashes);
+
+	if (iHashCount > 0)
+	{
+		int iThreads = g_pOptions->GetParThreads() > 0 ? g_pOptions->GetParThreads() : Util::NumberOfCpuCores();
+		if (iThreads > iHashCount)
+		{
+			iThreads = iHashCount;
+		}
+
+		std::deque<FileHasher*> hashers;
+		for (int i = 0; i < iThreads; i++)
+		{
+			FileHasher* pHasher = new FileHasher(&queue);
+			hashers.push_back(pHasher);
+			pHasher->Start();
+		}
+
+		bool bRunning = true;
+		while (bRunning)
+		{
+			usleep(100 * 1000);
+
+			if (IsStopped() || m_bCancelled)
+			{
+				queue.Cancel();
+			}
+
+			snprintf(m_szProgressLabel, 1024, "Checking files for %s", m_szInfoName);
 			m_szProgressLabel[1024-1] = '\0';
-			m_iStageProgress = iCurFile * 1000 / iFileCount;
+			m_iStageProgress = queue.GetProcessed() * 1000 / iHashCount;
 			UpdateProgress();
-			iCurFile++;
-			
-			CheckFile(szFullFilename);
+
+			bRunning = false;
+			for (std::deque<FileHasher*>::iterator it = hashers.begin(); it != hashers.end(); it++)
+			{
+				bRunning |= (*it)->IsRunning();
+			}
+		}
+
+		for (std::deque<FileHasher*>::iterator it = hashers.begin(); it != hashers.end(); it++)
+		{
+			delete *it;
+		}
+	}
+
+	for (HashQueue::Items::iterator it = queue.GetItems()->begin(); it != queue.GetItems()->end() && !m_bCancelled; it++)
+	{
+		HashQueue::Item* pItem = *it;
+		if (pItem->bError)
+		{
+			PrintMessage(Message::mkError, "Could not read file %s", pItem->szFilename);
+		}
+		else if (pItem->bHashed)
+		{
+			CheckFile(pItem->szFilename, pItem->szHash16k);
 		}
 	}
 }
 
-void ParRenamer::CheckFile(const char* szFilename)
+void ParRenamer::CheckFile(const char* szFilename, const char* szHash16k)
 {
-	debug("Computing hash for %s", szFilename);
-
-	const int iBlockSize = 16*1024;
-	
-    FILE* pFile = fopen(szFilename, "rb");
-    if (!pFile)
-    {
-		PrintMessage(Message::mkError, "Could not open file %s", szFilename);
-        return;
-    }
+	debug("file: %s; hash16k: %s", Util::BaseFileName(szFilename), szHash16k);
 
-	// load first 16K of the file into buffer
-	
-	void* pBuffer = malloc(iBlockSize);
-	
-    int iReadBytes = fread(pBuffer, 1, iBlockSize, pFile);
-	int iError = ferror(pFile);
-	if (iReadBytes != iBlockSize && iError)
+	FileHashMap::iterator it = m_fileHashMap.find(szHash16k);
+	if (it == m_fileHashMap.end())
 	{
-		PrintMessage(Message::mkError, "Could not read file %s", szFilename);
 		return;
 	}
-	
-    fclose(pFile);
-	
-	MD5Hash hash16k;
-	MD5Context context;
-	context.Update(pBuffer, iReadBytes);
-	context.Final(hash16k);
-	
-	free(pBuffer);
-	
-	debug("file: %s; hash16k: %s", Util::BaseFileName(szFilename), hash16k.print().c_str());
-	
-	for (FileHashList::iterator it = m_fileHashList.begin(); it != m_fileHashList.end(); it++)
+
+	FileHash* pFileHash = it->second;
+	debug("Found correct filename: %s", pFileHash->GetFilename());
+
+	char szDstFilename[1024];
+	snprintf(szDstFilename, 1024, "%s%c%s", m_szDestDir, PATH_SEPARATOR, pFileHash->GetFilename());
+	szDstFilename[1024-1] = '\0';
+
+	if (!Util::FileExists(szDstFilename))
 	{
-		FileHash* pFileHash = *it;
-		if (!strcmp(pFileHash->GetHash(), hash16k.print().c_str()))
+		PrintMessage(Message::mkInfo, "Renaming %s to %s", Util::BaseFileName(szFilename), pFileHash->GetFilename());
+		if (Util::MoveFile(szFilename, szDstFilename))
 		{
-			debug("Found correct filename: %s", pFileHash->GetFilename());
-			
-			char szDstFilename[1024];
-			snprintf(szDstFilename, 1024, "%s%c%s", m_szDestDir, PATH_SEPARATOR, pFileHash->GetFilename());
-			szDstFilename[1024-1] = '\0';
-			
-			if (!Util::FileExists(szDstFilename))
-			{
-				PrintMessage(Message::mkInfo, "Renaming %s to %s", Util::BaseFileName(szFilename), pFileHash->GetFilename());
-				if (Util::MoveFile(szFilename, szDstFilename))
-				{
-					m_iRenamedCount++;
-				}
-				else
-				{
-					PrintMessage(Message::mkError, "Could not rename %s to %s", szFilename, szDstFilename);
-				}
-			}
-			
-			break;
+			m_iRenamedCount++;
+			FileRenamed(Util::BaseFileName(szFilename), pFileHash->GetFilename());
+		}
+		else
+		{
+			PrintMessage(Message::mkError, "Could not rename %s to %s", szFilename, szDstFilename);
 		}
 	}
 }
@@ -29,6 +29,7 @@
 #ifndef DISABLE_PARCHECK
 
 #include <deque>
+#include <map>
 
 #include "Thread.h"
 #include "Log.h"
@@ -55,7 +56,12 @@ public:
 		const char*		GetHash() { return m_szHash; }
 	};
 
-	typedef std::deque<FileHash*>		FileHashList;
+	struct HashLess
+	{
+		bool			operator()(const char* szHash1, const char* szHash2) const;
+	};
+
+	typedef std::map<const char*, FileHash*, HashLess>		FileHashMap;
 	
 private:
 	char*				m_szInfoName;
@@ -64,19 +70,25 @@ private:
 	char*				m_szProgressLabel;
 	int					m_iStageProgress;
 	bool				m_bCancelled;
-	FileHashList		m_fileHashList;
+	FileHashMap			m_fileHashMap;
 	int					m_iRenamedCount;
 
 	void				Cleanup();
 	void				LoadParFiles();
 	void				LoadParFile(const char* szParFilename);
 	void				CheckFiles();
-	void				CheckFile(const char* szFilename);
+	void				CheckFile(const char* szFilename, const char* szHash16k);
 
 protected:
 	virtual void		UpdateProgress() {}
 	virtual void		Completed() {}
 	virtual void		PrintMessage(Message::EKind eKind, const char* szFormat, ...) {}
+	/*
+	 * Returns hash16k of the file if it is known without reading the file
+	 * (for example if it was computed during download).
+	 */
+	virtual bool		FindHash16k(const char* szFilename, char* szHash, int iBufSize) { return false; }
+	virtual void		FileRenamed(const char* szOldFilename, const char* szNewFilename) {}
 	const char*			GetProgressLabel() { return m_szProgressLabel; }
 	int					GetStageProgress() { return m_iStageProgress; }
 
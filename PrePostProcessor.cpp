@@ -165,6 +165,7 @@ void PrePostProcessor::Run()
 		usleep(iStepMSec * 1000);
 	}
 
+	WaitDirectUnpack();
 	Cleanup();
 
 	debug("Exiting PrePostProcessor-loop");
@@ -179,9 +180,9 @@ void PrePostProcessor::Stop()
 	m_ParCoordinator.Stop();
 #endif
 
-	if (!pDownloadQueue->GetPostQueue()->empty())
+	for (PostQueue::iterator it = pDownloadQueue->GetPostQueue()->begin(); it != pDownloadQueue->GetPostQueue()->end(); it++)
 	{
-		PostInfo* pPostInfo = pDownloadQueue->GetPostQueue()->front();
+		PostInfo* pPostInfo = *it;
 		if ((pPostInfo->GetStage() == PostInfo::ptUnpacking ||
 			 pPostInfo->GetStage() == PostInfo::ptExecutingScript) && 
 			pPostInfo->GetPostThread())
@@ -193,9 +194,40 @@ void PrePostProcessor::Stop()
 		}
 	}
 
+	for (NZBInfoList::iterator it = pDownloadQueue->GetNZBInfoList()->begin(); it != pDownloadQueue->GetNZBInfoList()->end(); it++)
+	{
+		DirectUnpack::Cancel(*it);
+	}
+
 	g_pQueueCoordinator->UnlockQueue();
 }
 
+/*
+ * Waits until the direct unpack threads cancelled in Stop() are finished.
+ * The threads are auto-destroyed; each thread unregisters itself from its
+ * NZBInfo (which it holds a reference to) when it is done.
+ */
+void PrePostProcessor::WaitDirectUnpack()
+{
+	bool bRunning = true;
+	while (bRunning)
+	{
+		bRunning = false;
+		DownloadQueue* pDownloadQueue = g_pQueueCoordinator->LockQueue();
+		for (NZBInfoList::iterator it = pDownloadQueue->GetNZBInfoList()->begin(); it != pDownloadQueue->GetNZBInfoList()->end(); it++)
+		{
+			bRunning |= (*it)->GetDirectUnpackThread() != NULL;
+		}
+		g_pQueueCoordinator->UnlockQueue();
+
+		if (bRunning)
+		{
+			debug("Waiting for direct unpack to finish");
+			usleep(100 * 1000);
+		}
+	}
+}
+
 void PrePostProcessor::QueueCoordinatorUpdate(Subject * Caller, void * Aspect)
 {
 	if (IsStopped())
@@ -211,6 +243,14 @@ void PrePostProcessor::QueueCoordinatorUpdate(Subject * Caller, void * Aspect)
 	else if ((pAspect->eAction == QueueCoordinator::eaFileCompleted ||
 		pAspect->eAction == QueueCoordinator::eaFileDeleted))
 	{
+		if (pAspect->eAction == QueueCoordinator::eaFileCompleted)
+		{
+			DirectUnpack::FileDownloaded(pAspect->pNZBInfo);
+#ifndef DISABLE_PARCHECK
+			m_ParCoordinator.FileCompleted(pAspect->pFileInfo);
+#endif
+		}
+
 		if (
 #ifndef DISABLE_PARCHECK
 			!m_ParCoordinator.AddPar(pAspect->pFileInfo, pAspect->eAction == QueueCoordinator::eaFileDeleted) &&
@@ -256,6 +296,11 @@ void PrePostProcessor::NZBAdded(DownloadQueue* pDownloadQueue, NZBInfo* pNZBInfo
 
 void PrePostProcessor::NZBDownloaded(DownloadQueue* pDownloadQueue, NZBInfo* pNZBInfo)
 {
+	DirectUnpack::NZBDownloaded(pNZBInfo);
+#ifndef DISABLE_PARCHECK
+	m_ParCoordinator.NZBCompleted(pNZBInfo);
+#endif
+
 	if (!pNZBInfo->GetPostProcess() && g_pOptions->GetDecode())
 	{
 		info("Queueing %s for post-processing", pNZBInfo->GetName());
@@ -287,6 +332,11 @@ void PrePostProcessor::NZBDownloaded(DownloadQueue* pDownloadQueue, NZBInfo* pNZ
 
 void PrePostProcessor::NZBDeleted(DownloadQueue* pDownloadQueue, NZBInfo* pNZBInfo)
 {
+	DirectUnpack::Cancel(pNZBInfo);
+#ifndef DISABLE_PARCHECK
+	m_ParCoordinator.NZBCompleted(pNZBInfo);
+#endif
+
 	if (g_pOptions->GetDeleteCleanupDisk() && pNZBInfo->GetCleanupDisk())
 	{
 		// download was cancelled, deleting already downloaded files from disk
@@ -501,72 +551,125 @@ void PrePostProcessor::CheckPostQueue()
 {
 	DownloadQueue* pDownloadQueue = g_pQueueCoordinator->LockQueue();
 
-	if (!pDownloadQueue->GetPostQueue()->empty())
+	int iActiveJobs = 0;
+	int iClassJobs[jcCount] = { 0 };
+	for (PostQueue::iterator it = pDownloadQueue->GetPostQueue()->begin(); it != pDownloadQueue->GetPostQueue()->end(); it++)
+	{
+		PostInfo* pPostInfo = *it;
+		if (pPostInfo->GetWorking())
+		{
+			iClassJobs[GetActiveJobClass(pPostInfo)]++;
+		}
+		if (pPostInfo->GetWorking() || pPostInfo->GetStartTime() > 0)
+		{
+			iActiveJobs++;
+		}
+	}
+
+	// the jobs are started in the order of post-queue; a job which has already
+	// completed some stages continues before new jobs are started
+	unsigned int iIndex = 0;
+	while (iIndex < pDownloadQueue->GetPostQueue()->size())
 	{
-		PostInfo* pPostInfo = pDownloadQueue->GetPostQueue()->front();
-		if (!pPostInfo->GetWorking())
+		PostInfo* pPostInfo = pDownloadQueue->GetPostQueue()->at(iIndex);
+		iIndex++;
+
+		if (pPostInfo->GetWorking())
 		{
+			continue;
+		}
+
+		bool bWasActive = pPostInfo->GetStartTime() > 0;
+
 #ifndef DISABLE_PARCHECK
-			if (pPostInfo->GetRequestParCheck() && pPostInfo->GetNZBInfo()->GetParStatus() <= NZBInfo::psSkipped &&
-				g_pOptions->GetParCheck() != Options::pcManual)
-			{
-				pPostInfo->GetNZBInfo()->SetParStatus(NZBInfo::psNone);
-				pPostInfo->SetRequestParCheck(false);
-				pPostInfo->SetStage(PostInfo::ptQueued);
-				pPostInfo->GetNZBInfo()->GetScriptStatuses()->Clear();
-				DeletePostThread(pPostInfo);
-			}
-			else if (pPostInfo->GetRequestParCheck() && pPostInfo->GetNZBInfo()->GetParStatus() <= NZBInfo::psSkipped &&
-				g_pOptions->GetParCheck() == Options::pcManual)
-			{
-				pPostInfo->SetRequestParCheck(false);
-				pPostInfo->GetNZBInfo()->SetParStatus(NZBInfo::psManual);
-				DeletePostThread(pPostInfo);
+		if (pPostInfo->GetRequestParCheck() && pPostInfo->GetNZBInfo()->GetParStatus() <= NZBInfo::psSkipped &&
+			g_pOptions->GetParCheck() != Options::pcManual)
+		{
+			pPostInfo->GetNZBInfo()->SetParStatus(NZBInfo::psNone);
+			pPostInfo->SetRequestParCheck(false);
+			pPostInfo->SetStage(PostInfo::ptQueued);
+			pPostInfo->GetNZBInfo()->GetScriptStatuses()->Clear();
+			DeletePostThread(pPostInfo);
+		}
+		else if (pPostInfo->GetRequestParCheck() && pPostInfo->GetNZBInfo()->GetParStatus() <= NZBInfo::psSkipped &&
+			g_pOptions->GetParCheck() == Options::pcManual)
+		{
+			pPostInfo->SetRequestParCheck(false);
+			pPostInfo->GetNZBInfo()->SetParStatus(NZBInfo::psManual);
+			DeletePostThread(pPostInfo);
 
-				FileInfo* pFileInfo = GetQueueGroup(pDownloadQueue, pPostInfo->GetNZBInfo());
-				if (pFileInfo)
-				{
-					info("Downloading all remaining files for manual par-check for %s", pPostInfo->GetNZBInfo()->GetName());
-					g_pQueueCoordinator->GetQueueEditor()->LockedEditEntry(pDownloadQueue, pFileInfo->GetID(), false, QueueEditor::eaGroupResume, 0, NULL);
-					pPostInfo->SetStage(PostInfo::ptFinished);
-					pPostInfo->GetNZBInfo()->SetPostProcess(false);
-				}
-				else
-				{
-					info("There are no par-files remain for download for %s", pPostInfo->GetNZBInfo()->GetName());
-					pPostInfo->SetStage(PostInfo::ptQueued);
-				}
+			FileInfo* pFileInfo = GetQueueGroup(pDownloadQueue, pPostInfo->GetNZBInfo());
+			if (pFileInfo)
+			{
+				info("Downloading all remaining files for manual par-check for %s", pPostInfo->GetNZBInfo()->GetName());
+				g_pQueueCoordinator->GetQueueEditor()->LockedEditEntry(pDownloadQueue, pFileInfo->GetID(), false, QueueEditor::eaGroupResume, 0, NULL);
+				pPostInfo->SetStage(PostInfo::ptFinished);
+				pPostInfo->GetNZBInfo()->SetPostProcess(false);
 			}
-			else if (pPostInfo->GetRequestParRename())
+			else
 			{
-				pPostInfo->GetNZBInfo()->SetRenameStatus(NZBInfo::rsNone);
-				pPostInfo->SetRequestParRename(false);
+				info("There are no par-files remain for download for %s", pPostInfo->GetNZBInfo()->GetName());
 				pPostInfo->SetStage(PostInfo::ptQueued);
-				DeletePostThread(pPostInfo);
 			}
+		}
+		else if (pPostInfo->GetRequestParRename())
+		{
+			pPostInfo->GetNZBInfo()->SetRenameStatus(NZBInfo::rsNone);
+			pPostInfo->SetRequestParRename(false);
+			pPostInfo->SetStage(PostInfo::ptQueued);
+			DeletePostThread(pPostInfo);
+		}
 
 #endif
-			if (pPostInfo->GetDeleted())
+		if (pPostInfo->GetDeleted())
+		{
+			pPostInfo->SetStage(PostInfo::ptFinished);
+		}
+
+		if (pPostInfo->GetStage() == PostInfo::ptQueued && !g_pOptions->GetPausePostProcess())
+		{
+			if (!bWasActive && iActiveJobs >= g_pOptions->GetPostJobs())
 			{
-				pPostInfo->SetStage(PostInfo::ptFinished);
+				// all slots are occupied, the jobs are started in order of post-queue
+				break;
 			}
 
-			if (pPostInfo->GetStage() == PostInfo::ptQueued && !g_pOptions->GetPausePostProcess())
+			EJobClass eJobClass = GetNextJobClass(pPostInfo);
+			if (iClassJobs[eJobClass] >= GetJobClassLimit(eJobClass))
 			{
-				DeletePostThread(pPostInfo);
-				StartJob(pDownloadQueue, pPostInfo);
+				// the resource needed for the next stage is busy, this job must wait
+				// but the next jobs may need other resources
+				continue;
 			}
-			else if (pPostInfo->GetStage() == PostInfo::ptFinished)
+
+			DeletePostThread(pPostInfo);
+			StartJob(pDownloadQueue, pPostInfo);
+
+			if (pPostInfo->GetWorking())
 			{
-				UpdatePauseState(false, NULL);
-				JobCompleted(pDownloadQueue, pPostInfo);
+				iClassJobs[GetActiveJobClass(pPostInfo)]++;
 			}
-			else if (!g_pOptions->GetPausePostProcess())
+			if (!bWasActive)
 			{
-				error("Internal error: invalid state in post-processor");
+				iActiveJobs++;
 			}
 		}
+		else if (pPostInfo->GetStage() == PostInfo::ptFinished)
+		{
+			JobCompleted(pDownloadQueue, pPostInfo);
+			if (bWasActive)
+			{
+				iActiveJobs--;
+			}
+			iIndex--;
+		}
+		else if (!g_pOptions->GetPausePostProcess())
+		{
+			error("Internal error: invalid state in post-processor");
+		}
 	}
+
+	CheckPauseState(pDownloadQueue);
 	
 	g_pQueueCoordinator->UnlockQueue();
 }
@@ -611,10 +714,15 @@ void PrePostProcessor::DeletePostThread(PostInfo* pPostInfo)
 
 void PrePostProcessor::StartJob(DownloadQueue* pDownloadQueue, PostInfo* pPostInfo)
 {
+	if (!pPostInfo->GetStartTime())
+	{
+		pPostInfo->SetStartTime(time(NULL));
+	}
+
 #ifndef DISABLE_PARCHECK
 	if (pPostInfo->GetNZBInfo()->GetRenameStatus() == NZBInfo::rsNone)
 	{
-		UpdatePauseState(g_pOptions->GetParPauseQueue(), "par-rename");
+		PauseQueue(g_pOptions->GetParPauseQueue(), "par-rename");
 		m_ParCoordinator.StartParRenameJob(pPostInfo);
 		return;
 	}
@@ -622,7 +730,7 @@ void PrePostProcessor::StartJob(DownloadQueue* pDownloadQueue, PostInfo* pPostIn
 	{
 		if (m_ParCoordinator.FindMainPars(pPostInfo->GetNZBInfo()->GetDestDir(), NULL))
 		{
-			UpdatePauseState(g_pOptions->GetParPauseQueue(), "par-check");
+			PauseQueue(g_pOptions->GetParPauseQueue(), "par-check");
 			m_ParCoordinator.StartParCheckJob(pPostInfo);
 		}
 		else
@@ -684,34 +792,97 @@ void PrePostProcessor::StartJob(DownloadQueue* pDownloadQueue, PostInfo* pPostIn
 	pPostInfo->SetStageProgress(0);
 	SaveQueue(pDownloadQueue);
 
-	if (!pPostInfo->GetStartTime())
-	{
-		pPostInfo->SetStartTime(time(NULL));
-	}
 	pPostInfo->SetStageTime(time(NULL));
 
 	if (bUnpack)
 	{
-		UpdatePauseState(g_pOptions->GetUnpackPauseQueue(), "unpack");
+		PauseQueue(g_pOptions->GetUnpackPauseQueue(), "unpack");
 		UnpackController::StartJob(pPostInfo);
 	}
 	else if (bCleanup)
 	{
-		UpdatePauseState(g_pOptions->GetUnpackPauseQueue() || g_pOptions->GetScriptPauseQueue(), "cleanup");
+		PauseQueue(g_pOptions->GetUnpackPauseQueue() || g_pOptions->GetScriptPauseQueue(), "cleanup");
 		CleanupController::StartJob(pPostInfo);
 	}
 	else if (bMoveInter)
 	{
-		UpdatePauseState(g_pOptions->GetUnpackPauseQueue() || g_pOptions->GetScriptPauseQueue(), "move");
+		PauseQueue(g_pOptions->GetUnpackPauseQueue() || g_pOptions->GetScriptPauseQueue(), "move");
 		MoveController::StartJob(pPostInfo);
 	}
 	else
 	{
-		UpdatePauseState(g_pOptions->GetScriptPauseQueue(), "post-process-script");
+		PauseQueue(g_pOptions->GetScriptPauseQueue(), "post-process-script");
 		PostScriptController::StartJob(pPostInfo);
 	}
 }
 
+/**
+ * Returns the resource class of the stage the job is currently executing.
+ * Par-jobs are marked as working before the par-checker reports its first
+ * stage, therefore working jobs in stage "queued" belong to class "par".
+ */
+PrePostProcessor::EJobClass PrePostProcessor::GetActiveJobClass(PostInfo* pPostInfo)
+{
+	switch (pPostInfo->GetStage())
+	{
+		case PostInfo::ptUnpacking:
+		case PostInfo::ptMoving:
+			return jcUnpack;
+
+		case PostInfo::ptExecutingScript:
+			return jcScript;
+
+		default:
+			return jcPar;
+	}
+}
+
+/**
+ * Returns the resource class of the next stage of a queued job.
+ * This is a simplified version of the conditions used in "StartJob".
+ */
+PrePostProcessor::EJobClass PrePostProcessor::GetNextJobClass(PostInfo* pPostInfo)
+{
+	NZBInfo* pNZBInfo = pPostInfo->GetNZBInfo();
+
+#ifndef DISABLE_PARCHECK
+	if (pNZBInfo->GetRenameStatus() == NZBInfo::rsNone || pNZBInfo->GetParStatus() == NZBInfo::psNone)
+	{
+		return jcPar;
+	}
+#endif
+
+	NZBParameter* pUnpackParameter = pNZBInfo->GetParameters()->Find("*Unpack:", false);
+	bool bUnpack = !(pUnpackParameter && !strcasecmp(pUnpackParameter->GetValue(), "no")) &&
+		pNZBInfo->GetUnpackStatus() == NZBInfo::usNone;
+
+	bool bMoveInter = !bUnpack &&
+		pNZBInfo->GetMoveStatus() == NZBInfo::msNone &&
+		strlen(g_pOptions->GetInterDir()) > 0 &&
+		!strncmp(pNZBInfo->GetDestDir(), g_pOptions->GetInterDir(), strlen(g_pOptions->GetInterDir()));
+
+	return bUnpack || bMoveInter ? jcUnpack : jcScript;
+}
+
+int PrePostProcessor::GetJobClassLimit(EJobClass eJobClass)
+{
+	switch (eJobClass)
+	{
+		case jcPar:
+			// ParCoordinator can process only one par-job at a time
+			return 1;
+
+		case jcUnpack:
+			return g_pOptions->GetUnpackJobs();
+
+		case jcScript:
+			return g_pOptions->GetScriptJobs();
+
+		default:
+			return 1;
+	}
+}
+
 void PrePostProcessor::JobCompleted(DownloadQueue* pDownloadQueue, PostInfo* pPostInfo)
 {
 	pPostInfo->SetWorking(false);
@@ -838,6 +1009,45 @@ void PrePostProcessor::ApplySchedulerState()
 	}
 }
 
+/**
+ * Pauses download queue if the job which is being started requires it.
+ * Unpausing is made in "CheckPauseState" when no active job needs the pause.
+ */
+void PrePostProcessor::PauseQueue(bool bNeedPause, const char* szReason)
+{
+	if (bNeedPause)
+	{
+		UpdatePauseState(true, szReason);
+	}
+}
+
+/**
+ * Keeps the download queue paused as long as at least one of active
+ * post-processing jobs requires that.
+ */
+void PrePostProcessor::CheckPauseState(DownloadQueue* pDownloadQueue)
+{
+	for (PostQueue::iterator it = pDownloadQueue->GetPostQueue()->begin(); it != pDownloadQueue->GetPostQueue()->end(); it++)
+	{
+		PostInfo* pPostInfo = *it;
+		if (pPostInfo->GetWorking())
+		{
+			EJobClass eJobClass = GetActiveJobClass(pPostInfo);
+			if ((eJobClass == jcPar && g_pOptions->GetParPauseQueue()) ||
+				(eJobClass == jcUnpack && g_pOptions->GetUnpackPauseQueue()) ||
+				(eJobClass == jcScript && g_pOptions->GetScriptPauseQueue()))
+			{
+				return;
+			}
+		}
+	}
+
+	if (m_bPostPause)
+	{
+		UpdatePauseState(false, NULL);
+	}
+}
+
 void PrePostProcessor::UpdatePauseState(bool bNeedPause, const char* szReason)
 {
 	if (bNeedPause)
@@ -1007,9 +1217,9 @@ bool PrePostProcessor::PostQueueMove(IDList* pIDList, EEditAction eAction, int i
 		iIndex++;
 	}
 
-	if (pPostInfo)
+	// NOTE: only items which are not currently being processed can be moved
+	if (pPostInfo && !pPostInfo->GetWorking())
 	{
-		// NOTE: only items which are not currently being processed can be moved
 
 		unsigned int iNewIndex = 0;
 		switch (eAction)
@@ -56,6 +56,14 @@ private:
 		virtual void	Update(Subject* Caller, void* Aspect) { m_pOwner->QueueCoordinatorUpdate(Caller, Aspect); }
 	};
 
+	enum EJobClass
+	{
+		jcPar,
+		jcUnpack,
+		jcScript,
+		jcCount
+	};
+
 	class PostParCoordinator: public ParCoordinator
 	{
 	private:
@@ -87,6 +95,11 @@ private:
 	void				ApplySchedulerState();
 	void				CheckScheduledResume();
 	void				UpdatePauseState(bool bNeedPause, const char* szReason);
+	void				PauseQueue(bool bNeedPause, const char* szReason);
+	void				CheckPauseState(DownloadQueue* pDownloadQueue);
+	EJobClass			GetActiveJobClass(PostInfo* pPostInfo);
+	EJobClass			GetNextJobClass(PostInfo* pPostInfo);
+	int					GetJobClassLimit(EJobClass eJobClass);
 	bool				PauseDownload();
 	bool				UnpauseDownload();
 	void				NZBAdded(DownloadQueue* pDownloadQueue, NZBInfo* pNZBInfo);
@@ -102,6 +115,7 @@ private:
 	void				HistoryReturn(DownloadQueue* pDownloadQueue, HistoryList::iterator itHistory, HistoryInfo* pHistoryInfo, bool bReprocess);
 	void				HistorySetParameter(HistoryInfo* pHistoryInfo, const char* szText);
 	void				Cleanup();
+	void				WaitDirectUnpack();
 	FileInfo*			GetQueueGroup(DownloadQueue* pDownloadQueue, NZBInfo* pNZBInfo);
 	void				CheckHistory();
 	void				DeletePostThread(PostInfo* pPostInfo);
@@ -68,6 +68,8 @@ QueueCoordinator::QueueCoordinator()
 	m_tPausedFrom = 0;
 	m_bStandBy = true;
 	m_iServerConfigGeneration = 0;
+	m_tDownloadRatesTime = time(NULL);
+	m_pThreadPool = ThreadPool::GetPool("download");
 
 	YDecoder::Init();
 }
@@ -123,11 +125,12 @@ void QueueCoordinator::Run()
 	m_tLastCheck = m_tStartServer;
 	bool bWasStandBy = true;
 	bool bArticeDownloadsRunning = false;
-	int iResetCounter = 0;
+	time_t tResetTime = time(NULL);
 
 	while (!IsStopped())
 	{
 		bool bDownloadsChecked = false;
+		bool bArticleStarted = false;
 		if (!(g_pOptions->GetPauseDownload() || g_pOptions->GetPauseDownload2()))
 		{
 			NNTPConnection* pConnection = g_pServerPool->GetConnection(0, NULL, NULL);
@@ -147,6 +150,7 @@ void QueueCoordinator::Run()
 				{
 					StartArticleDownload(pFileInfo, pArticleInfo, pConnection);
 					bArticeDownloadsRunning = true;
+					bArticleStarted = true;
 				}
 				else
 				{
@@ -175,24 +179,30 @@ void QueueCoordinator::Run()
 			bWasStandBy = bStandBy;
 		}
 
-		// sleep longer in StandBy
-		int iSleepInterval = bStandBy ? 100 : 5;
-		usleep(iSleepInterval * 1000);
+		if (!bArticleStarted)
+		{
+			// wait until an article download completes (which frees a connection),
+			// new files are added or the timeout expires
+			m_eventWakeUp.Wait(100);
+		}
 
 		if (!bStandBy)
 		{
-			AddSpeedReading(0);
+			CollectSpeedReadings();
 		}
 
-		iResetCounter += iSleepInterval;
-		if (iResetCounter >= 1000)
+		time_t tCurTime = time(NULL);
+		if (tCurTime != tResetTime)
 		{
 			// this code should not be called too often, once per second is OK
-			g_pServerPool->CloseUnusedConnections();
+			g_pServerPool->MaintainConnections(m_bHasMoreJobs &&
+				!(g_pOptions->GetPauseDownload() || g_pOptions->GetPauseDownload2()));
+			g_pServerPool->UpdateServerStats();
 			ResetHangingDownloads();
-			iResetCounter = 0;
+			tResetTime = tCurTime;
 			AdjustStartTime();
 			AdjustDownloadsLimit();
+			UpdateDownloadRates(tCurTime);
 		}
 	}
 
@@ -209,6 +219,8 @@ void QueueCoordinator::Run()
 	}
 	debug("QueueCoordinator: Downloads are completed");
 
+	g_pServerPool->StopMaintenance();
+
 	debug("Exiting QueueCoordinator-loop");
 }
 
@@ -235,6 +247,7 @@ void QueueCoordinator::AdjustDownloadsLimit()
 	}
 
 	m_iDownloadsLimit = iDownloadsLimit;
+	m_pThreadPool->SetMaxWorkers(iDownloadsLimit);
 }
 
 void QueueCoordinator::AddNZBFileToQueue(NZBFile* pNZBFile, bool bAddFirst)
@@ -329,10 +342,12 @@ void QueueCoordinator::AddNZBFileToQueue(NZBFile* pNZBFile, bool bAddFirst)
 	}
 
 	m_mutexDownloadQueue.Unlock();
+
+	m_eventWakeUp.Set();
 }
 
 /*
- * NOTE: see note to "AddSpeedReading"
+ * NOTE: the speed meter is updated by queue coordinator only, see "CollectSpeedReadings"
  */
 int QueueCoordinator::CalcCurrentDownloadSpeed()
 {
@@ -415,6 +430,73 @@ void QueueCoordinator::AddSpeedReading(int iBytes)
 	}
 }
 
+/*
+ * Downloaders count the received bytes in their own counters without
+ * locking. The counters are collected here and when a download completes.
+ * Both happen with locked DownloadQueue, which serializes the updates of
+ * speed meter.
+ */
+void QueueCoordinator::CollectSpeedReadings()
+{
+	m_mutexDownloadQueue.Lock();
+	int iBytes = 0;
+	for (ActiveDownloads::iterator it = m_ActiveDownloads.begin(); it != m_ActiveDownloads.end(); it++)
+	{
+		iBytes += TakeDownloadedBytes(*it);
+	}
+	AddSpeedReading(iBytes);
+	m_mutexDownloadQueue.Unlock();
+}
+
+/*
+ * Takes the bytes counted by downloader and adds them to the speed counters of
+ * the news server and of the nzb. The downloader counts only its own bytes to
+ * avoid the updating of shared counters for every received line.
+ * The queue must be locked.
+ */
+int QueueCoordinator::TakeDownloadedBytes(ArticleDownloader* pArticleDownloader)
+{
+	int iBytes = pArticleDownloader->TakeDownloadedBytes();
+	if (iBytes > 0)
+	{
+		NewsServer* pNewsServer = pArticleDownloader->GetSpeedServer();
+		if (pNewsServer)
+		{
+			pNewsServer->AddSpeedBytes(iBytes);
+		}
+		pArticleDownloader->GetFileInfo()->GetNZBInfo()->AddSpeedBytes(iBytes);
+	}
+	return iBytes;
+}
+
+/*
+ * Calculates per-server and per-nzb download rates from the bytes
+ * reported by downloaders since the last call.
+ */
+void QueueCoordinator::UpdateDownloadRates(time_t tCurTime)
+{
+	int iTimeDiff = (int)(tCurTime - m_tDownloadRatesTime);
+	m_tDownloadRatesTime = tCurTime;
+	if (iTimeDiff <= 0)
+	{
+		return;
+	}
+
+	for (ServerPool::Servers::iterator it = g_pServerPool->GetServers()->begin(); it != g_pServerPool->GetServers()->end(); it++)
+	{
+		NewsServer* pNewsServer = *it;
+		pNewsServer->SetDownloadRate(pNewsServer->TakeSpeedBytes() / iTimeDiff);
+	}
+
+	m_mutexDownloadQueue.Lock();
+	for (NZBInfoList::iterator it = m_DownloadQueue.GetNZBInfoList()->begin(); it != m_DownloadQueue.GetNZBInfoList()->end(); it++)
+	{
+		NZBInfo* pNZBInfo = *it;
+		pNZBInfo->SetDownloadRate(pNZBInfo->TakeSpeedBytes() / iTimeDiff);
+	}
+	m_mutexDownloadQueue.Unlock();
+}
+
 void QueueCoordinator::ResetSpeedStat()
 {
 	time_t tCurTime = time(NULL);
@@ -478,6 +560,7 @@ bool QueueCoordinator::DeleteQueueEntry(FileInfo* pFileInfo)
 void QueueCoordinator::Stop()
 {
 	Thread::Stop();
+	m_eventWakeUp.Set();
 
 	debug("Stopping ArticleDownloads");
 	m_mutexDownloadQueue.Lock();
@@ -581,6 +664,7 @@ void QueueCoordinator::StartArticleDownload(FileInfo* pFileInfo, ArticleInfo* pA
 
 	ArticleDownloader* pArticleDownloader = new ArticleDownloader();
 	pArticleDownloader->SetAutoDestroy(true);
+	pArticleDownloader->SetThreadPool(m_pThreadPool);
 	pArticleDownloader->Attach(this);
 	pArticleDownloader->SetFileInfo(pFileInfo);
 	pArticleDownloader->SetArticleInfo(pArticleInfo);
@@ -697,6 +781,8 @@ void QueueCoordinator::ArticleCompleted(ArticleDownloader* pArticleDownloader)
 		deleteFileObj = true;
 	}
 
+	AddSpeedReading(TakeDownloadedBytes(pArticleDownloader));
+
 	// delete Download from Queue
 	for (ActiveDownloads::iterator it = m_ActiveDownloads.begin(); it != m_ActiveDownloads.end(); it++)
 	{
@@ -727,6 +813,9 @@ void QueueCoordinator::ArticleCompleted(ArticleDownloader* pArticleDownloader)
 	}
 
 	m_mutexDownloadQueue.Unlock();
+
+	// let the coordinator start the next article without waiting
+	m_eventWakeUp.Set();
 }
 
 void QueueCoordinator::DeleteFileInfo(FileInfo* pFileInfo, bool bCompleted)
@@ -1041,6 +1130,12 @@ bool QueueCoordinator::MergeQueueEntries(NZBInfo* pDestNZBInfo, NZBInfo* pSrcNZB
 	}
 	pSrcNZBInfo->GetCompletedFiles()->clear();
 
+	for (FileChecksumList::iterator it = pSrcNZBInfo->GetFileChecksums()->begin(); it != pSrcNZBInfo->GetFileChecksums()->end(); it++)
+	{
+		pDestNZBInfo->GetFileChecksums()->push_back(*it);
+	}
+	pSrcNZBInfo->GetFileChecksums()->clear();
+
 	// concatenate QueuedFilenames using character '|' as separator
 	int iLen = strlen(pDestNZBInfo->GetQueuedFilename()) + strlen(pSrcNZBInfo->GetQueuedFilename()) + 1;
 	char* szQueuedFilename = (char*)malloc(iLen);
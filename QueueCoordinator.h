@@ -64,7 +64,9 @@ private:
 	Mutex			 		m_mutexDownloadQueue;
 	bool					m_bHasMoreJobs;
 	int						m_iDownloadsLimit;
+	ThreadPool*				m_pThreadPool;
 	int						m_iServerConfigGeneration;
+	Event					m_eventWakeUp;
 
 	// statistics
 	static const int		SPEEDMETER_SLOTS = 30;    
@@ -74,6 +76,7 @@ private:
     int 					m_iSpeedTime[SPEEDMETER_SLOTS];
     int                     m_iSpeedStartTime; 
 	time_t					m_tSpeedCorrection;
+	time_t					m_tDownloadRatesTime;
 #ifdef HAVE_SPINLOCK
 	SpinLock				m_spinlockSpeed;
 #else
@@ -99,6 +102,10 @@ private:
 	void					EnterLeaveStandBy(bool bEnter);
 	void					AdjustStartTime();
 	void					AdjustDownloadsLimit();
+	void					AddSpeedReading(int iBytes);
+	void					CollectSpeedReadings();
+	int						TakeDownloadedBytes(ArticleDownloader* pArticleDownloader);
+	void					UpdateDownloadRates(time_t tCurTime);
 
 public:
 							QueueCoordinator();                
@@ -110,7 +117,6 @@ public:
 	// statistics
 	long long 				CalcRemainingSize();
 	virtual int				CalcCurrentDownloadSpeed();
-	virtual void			AddSpeedReading(int iBytes);
 	void					CalcStat(int* iUpTimeSec, int* iDnTimeSec, long long* iAllBytes, bool* bStandBy);
 
 	// Editing the queue
@@ -51,6 +51,13 @@
 
 extern Options* g_pOptions;
 
+// max. number of requests processed at the same time, other requests wait in the queue
+static const int MAX_REQUEST_THREADS = 20;
+// timeout for single receive or send operation of a request (seconds)
+static const int REQUEST_TIMEOUT = 30;
+// max. time a request may occupy a worker thread (seconds)
+static const int REQUEST_TIME_LIMIT = 5 * 60;
+
 //*****************************************************************
 // RemoteServer
 
@@ -60,6 +67,10 @@ RemoteServer::RemoteServer(bool bTLS)
 
 	m_bTLS = bTLS;
 	m_pConnection = NULL;
+
+	// both servers (plain and secure) share the same pool
+	m_pThreadPool = ThreadPool::GetPool("request");
+	m_pThreadPool->SetMaxWorkers(MAX_REQUEST_THREADS);
 }
 
 RemoteServer::~RemoteServer()
@@ -128,6 +139,7 @@ void RemoteServer::Run()
 
 		RequestProcessor* commandThread = new RequestProcessor();
 		commandThread->SetAutoDestroy(true);
+		commandThread->SetThreadPool(m_pThreadPool);
 		commandThread->SetConnection(pAcceptedConnection);
 #ifndef DISABLE_TLS
 		commandThread->SetTLS(m_bTLS);
@@ -171,6 +183,11 @@ void RequestProcessor::Run()
 
 	m_pConnection->SetSuppressErrors(true);
 
+	// slow or idle clients must not occupy the worker for long,
+	// other requests may be waiting in the queue of the pool
+	m_pConnection->SetTimeout(REQUEST_TIMEOUT);
+	m_pConnection->SetTimeLimit(REQUEST_TIME_LIMIT);
+
 #ifndef DISABLE_TLS
 	if (m_bTLS && !m_pConnection->StartTLS(false, g_pOptions->GetSecureCert(), g_pOptions->GetSecureKey()))
 	{
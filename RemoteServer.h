@@ -35,6 +35,7 @@ class RemoteServer : public Thread
 private:
 	bool				m_bTLS;
 	Connection*			m_pConnection;
+	ThreadPool*			m_pThreadPool;
 
 public:
 						RemoteServer(bool bTLS);
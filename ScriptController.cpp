@@ -38,12 +38,18 @@
 #include <unistd.h>
 #include <sys/wait.h>
 #include <signal.h>
+#include <poll.h>
+#ifdef HAVE_POSIX_SPAWN
+#include <spawn.h>
+#endif
 #endif
 #include <sys/stat.h>
 #include <errno.h>
 #include <fcntl.h>
 #include <stdio.h>
 #include <stdarg.h>
+#include <list>
+#include <vector>
 
 #include "nzbget.h"
 #include "ScriptController.h"
@@ -62,12 +68,27 @@ static const int POSTPROCESS_SUCCESS = 93;
 static const int POSTPROCESS_ERROR = 94;
 static const int POSTPROCESS_NONE = 95;
 
-#ifndef WIN32
+static const int LINE_BUFFER_SIZE = 10240;
+
+#if !defined(WIN32) && !defined(HAVE_POSIX_SPAWN)
 #define CHILD_WATCHDOG 1
 #endif
 
-#ifdef CHILD_WATCHDOG
+// time (seconds) given to a script to exit after it was asked to terminate
+static const int TERMINATE_GRACE_SECONDS = 10;
+
 /**
+ * ScriptMonitor serves all running child processes in one shared thread.
+ *
+ * Reactor (POSIX):
+ * The output pipes of all running scripts are multiplexed with poll(); the
+ * received output is passed to the controllers which split it into lines
+ * and process them (log-prefixes, [NZB]-commands). The handler of signal
+ * SIGCHLD wakes up the monitor via a pipe, the exited children are then
+ * reaped and the waiting controllers are notified. The output of scripts
+ * is therefore not read by the threads which started the scripts.
+ *
+ * Child watchdog:
  * Sometimes the forked child process doesn't start properly and hangs
  * just during the starting. I didn't find any explanation about what
  * could cause that problem except of a general advice, that
@@ -78,35 +99,386 @@ static const int POSTPROCESS_NONE = 95;
  * 2) parent process waits for a line for 60 seconds. If it didn't receive it
  *    the cild process assumed to hang and will be killed. Another attempt
  *    will be made.
+ *
+ * Time limit:
+ * Scripts running longer than allowed by their time limit are asked to
+ * terminate and are killed if they don't exit within a grace period.
  */
- 
-class ChildWatchDog : public Thread
+class ScriptMonitor : public Thread
 {
 private:
-	pid_t			m_hProcessID;
+	class Entry
+	{
+	public:
+		ScriptController*	m_pController;
+#ifndef WIN32
+		pid_t				m_hProcessID;
+		int					m_iReadPipe;
+		bool				m_bEOF;
+		bool				m_bExited;
+		int					m_iStatus;
+#endif
+		time_t				m_tStart;
+		int					m_iTimeout;
+		time_t				m_tTerminate;
+		bool				m_bKilled;
+	};
+
+	typedef std::list<Entry*>	Entries;
+	typedef std::vector<Entry*>	EntryList;
+
+	Entries				m_entries;
+	Mutex				m_mutexEntries;
+
+	void				CheckTimeout(Entry* pEntry, time_t tCurrent);
+#ifndef WIN32
+	void				ReadOutput(Entry* pEntry);
+	void				CheckExited(Entry* pEntry);
+	void				Finish(Entry* pEntry);
+#endif
+
 protected:
-	virtual void	Run();
+	virtual void		Run();
+
 public:
-	void			SetProcessID(pid_t hProcessID) { m_hProcessID = hProcessID; }
+						~ScriptMonitor();
+	virtual void		Stop();
+#ifdef WIN32
+	void				Add(ScriptController* pController, int iTimeout);
+	void				Remove(ScriptController* pController);
+#else
+	void				Add(ScriptController* pController, pid_t hProcessID, int iReadPipe, int iTimeout);
+	static void			WakeUp();
+#endif
 };
 
-void ChildWatchDog::Run()
+static ScriptMonitor* g_pScriptMonitor = NULL;
+
+#ifndef WIN32
+// pipe to wake up ScriptMonitor from signal handler and other threads
+static int g_iWakeUpPipe[2] = { -1, -1 };
+
+static void ChildSignalHandler(int iSignal)
 {
-	static const int WAIT_SECONDS = 60;
-	time_t tStart = time(NULL);
-	while (!IsStopped() && (time(NULL) - tStart) < WAIT_SECONDS)
+	ScriptMonitor::WakeUp();
+}
+
+/*
+ * Creates a pipe with close-on-exec flag set on both ends.
+ * Several scripts can be started at the same time from different threads;
+ * a child process must not inherit the pipes of other scripts, otherwise
+ * the other script doesn't get EOF on its pipe until our child exits.
+ * The ends passed to the child are duplicated onto stdin/stdout/stderr,
+ * which clears the flag on the copies.
+ */
+static bool CreateCloexecPipe(int* p)
+{
+#ifdef HAVE_PIPE2
+	return pipe2(p, O_CLOEXEC) == 0;
+#else
+	if (pipe(p))
 	{
-		usleep(10 * 1000);
+		return false;
 	}
+	fcntl(p[0], F_SETFD, FD_CLOEXEC);
+	fcntl(p[1], F_SETFD, FD_CLOEXEC);
+	return true;
+#endif
+}
+#endif
 
-	if (!IsStopped())
+ScriptMonitor::~ScriptMonitor()
+{
+	for (Entries::iterator it = m_entries.begin(); it != m_entries.end(); it++)
 	{
-		info("Restarting hanging child process");
-		kill(m_hProcessID, SIGKILL);
+		delete *it;
 	}
+	m_entries.clear();
 }
+
+void ScriptMonitor::Stop()
+{
+	Thread::Stop();
+#ifndef WIN32
+	WakeUp();
 #endif
+}
+
+#ifdef WIN32
+void ScriptMonitor::Add(ScriptController* pController, int iTimeout)
+#else
+/*
+ * Starts to serve the child process. The monitor takes the ownership of the
+ * read end of the pipe and sets the controller's event when the process has
+ * exited and its output is processed.
+ */
+void ScriptMonitor::Add(ScriptController* pController, pid_t hProcessID, int iReadPipe, int iTimeout)
+#endif
+{
+	Entry* pEntry = new Entry();
+	pEntry->m_pController = pController;
+#ifndef WIN32
+	pEntry->m_hProcessID = hProcessID;
+	pEntry->m_iReadPipe = iReadPipe;
+	pEntry->m_bEOF = false;
+	pEntry->m_bExited = false;
+	pEntry->m_iStatus = 0;
+#endif
+	pEntry->m_tStart = time(NULL);
+	pEntry->m_iTimeout = iTimeout;
+	pEntry->m_tTerminate = 0;
+	pEntry->m_bKilled = false;
+
+	m_mutexEntries.Lock();
+	m_entries.push_back(pEntry);
+	m_mutexEntries.Unlock();
+
+#ifndef WIN32
+	WakeUp();
+#endif
+}
+
+#ifdef WIN32
+void ScriptMonitor::Remove(ScriptController* pController)
+{
+	m_mutexEntries.Lock();
+	for (Entries::iterator it = m_entries.begin(); it != m_entries.end(); it++)
+	{
+		Entry* pEntry = *it;
+		if (pEntry->m_pController == pController)
+		{
+			m_entries.erase(it);
+			delete pEntry;
+			break;
+		}
+	}
+	m_mutexEntries.Unlock();
+}
+
+void ScriptMonitor::Run()
+{
+	debug("Entering ScriptMonitor-loop");
+
+	while (!IsStopped())
+	{
+		time_t tCurrent = time(NULL);
+		m_mutexEntries.Lock();
+		for (Entries::iterator it = m_entries.begin(); it != m_entries.end(); it++)
+		{
+			CheckTimeout(*it, tCurrent);
+		}
+		m_mutexEntries.Unlock();
+		usleep(200 * 1000);
+	}
+
+	debug("Exiting ScriptMonitor-loop");
+}
+
+#else
+
+/*
+ * Wakes up the monitor-thread. Can be called from signal handler.
+ */
+void ScriptMonitor::WakeUp()
+{
+	int iSaveErrno = errno;
+	if (g_iWakeUpPipe[1] > -1)
+	{
+		write(g_iWakeUpPipe[1], "W", 1);
+	}
+	errno = iSaveErrno;
+}
 
+void ScriptMonitor::Run()
+{
+	debug("Entering ScriptMonitor-loop");
+
+	// SIGCHLD is blocked in all other threads (see ScriptController::Init)
+	sigset_t sigMask;
+	sigemptyset(&sigMask);
+	sigaddset(&sigMask, SIGCHLD);
+	pthread_sigmask(SIG_UNBLOCK, &sigMask, NULL);
+
+	EntryList entries;
+	EntryList polledEntries;
+	std::vector<struct pollfd> pollFds;
+
+	while (!IsStopped())
+	{
+		entries.clear();
+		polledEntries.clear();
+		pollFds.clear();
+
+		struct pollfd pfd;
+		pfd.fd = g_iWakeUpPipe[0];
+		pfd.events = POLLIN;
+		pfd.revents = 0;
+		pollFds.push_back(pfd);
+
+		// only this thread removes entries, other threads can add new
+		// entries while the monitor waits for events
+		m_mutexEntries.Lock();
+		for (Entries::iterator it = m_entries.begin(); it != m_entries.end(); it++)
+		{
+			Entry* pEntry = *it;
+			entries.push_back(pEntry);
+			if (!pEntry->m_bEOF)
+			{
+				pfd.fd = pEntry->m_iReadPipe;
+				pollFds.push_back(pfd);
+				polledEntries.push_back(pEntry);
+			}
+		}
+		m_mutexEntries.Unlock();
+
+		// time limits are checked once per second
+		poll(&pollFds.front(), pollFds.size(), entries.empty() ? -1 : 1000);
+
+		if (pollFds[0].revents)
+		{
+			char buf[64];
+			while (read(g_iWakeUpPipe[0], buf, sizeof(buf)) > 0) ;
+		}
+
+		for (int i = 1; i < (int)pollFds.size(); i++)
+		{
+			if (pollFds[i].revents)
+			{
+				ReadOutput(polledEntries[i - 1]);
+			}
+		}
+
+		time_t tCurrent = time(NULL);
+		for (EntryList::iterator it = entries.begin(); it != entries.end(); it++)
+		{
+			Entry* pEntry = *it;
+			CheckExited(pEntry);
+			CheckTimeout(pEntry, tCurrent);
+
+			// if the script was terminated don't wait for EOF: the pipe can be still
+			// open in a process started by the script outside of its process group
+			if (pEntry->m_bExited && (pEntry->m_bEOF || pEntry->m_pController->m_bTerminated))
+			{
+				Finish(pEntry);
+			}
+		}
+	}
+
+	// release the controllers which are still waiting
+	m_mutexEntries.Lock();
+	entries.assign(m_entries.begin(), m_entries.end());
+	m_mutexEntries.Unlock();
+	for (EntryList::iterator it = entries.begin(); it != entries.end(); it++)
+	{
+		Entry* pEntry = *it;
+		pEntry->m_pController->m_bTerminated = true;
+		Finish(pEntry);
+	}
+
+	debug("Exiting ScriptMonitor-loop");
+}
+
+void ScriptMonitor::ReadOutput(Entry* pEntry)
+{
+	char buf[4096];
+	int iLen = read(pEntry->m_iReadPipe, buf, sizeof(buf));
+	if (iLen > 0)
+	{
+		pEntry->m_pController->ReceiveOutput(buf, iLen);
+	}
+	else if (iLen == 0 || (errno != EAGAIN && errno != EINTR))
+	{
+		close(pEntry->m_iReadPipe);
+		pEntry->m_bEOF = true;
+	}
+}
+
+void ScriptMonitor::CheckExited(Entry* pEntry)
+{
+	if (pEntry->m_bExited)
+	{
+		return;
+	}
+
+	int iStatus = 0;
+	pid_t hPid = waitpid(pEntry->m_hProcessID, &iStatus, WNOHANG);
+	if (hPid == pEntry->m_hProcessID || (hPid == -1 && errno == ECHILD))
+	{
+		debug("Child %i exited", (int)pEntry->m_hProcessID);
+		pEntry->m_bExited = true;
+		pEntry->m_iStatus = iStatus;
+		// the process-id can be reused by the system from now on
+		pEntry->m_pController->m_hProcess = 0;
+	}
+}
+
+void ScriptMonitor::Finish(Entry* pEntry)
+{
+	if (!pEntry->m_bEOF)
+	{
+		close(pEntry->m_iReadPipe);
+	}
+
+	ScriptController* pController = pEntry->m_pController;
+
+	// process the last line if it was not terminated with a new line character
+	pController->ReceiveOutput(NULL, 0);
+	pController->m_iExitStatus = pEntry->m_iStatus;
+
+	m_mutexEntries.Lock();
+	m_entries.remove(pEntry);
+	m_mutexEntries.Unlock();
+	delete pEntry;
+
+	// the controller can be destroyed as soon as the event is set
+	pController->m_eventFinished.Set();
+}
+#endif
+
+void ScriptMonitor::CheckTimeout(Entry* pEntry, time_t tCurrent)
+{
+#ifdef CHILD_WATCHDOG
+	static const int WAIT_SECONDS = 60;
+
+	if (!pEntry->m_pController->m_bChildConfirmed)
+	{
+		if (!pEntry->m_bExited && !pEntry->m_bKilled && tCurrent - pEntry->m_tStart >= WAIT_SECONDS)
+		{
+			info("Restarting hanging child process");
+			kill(pEntry->m_hProcessID, SIGKILL);
+			// the process will be restarted with a new entry
+			pEntry->m_bKilled = true;
+		}
+		return;
+	}
+#endif
+
+#ifndef WIN32
+	if (pEntry->m_bExited)
+	{
+		return;
+	}
+#endif
+
+	if (pEntry->m_iTimeout > 0 && !pEntry->m_tTerminate &&
+		tCurrent - pEntry->m_tStart >= pEntry->m_iTimeout)
+	{
+		warn("Time limit for %s exceeded, terminating", pEntry->m_pController->GetInfoName());
+		pEntry->m_tTerminate = tCurrent;
+		pEntry->m_pController->Interrupt();
+#ifdef WIN32
+		// the process is killed at once
+		pEntry->m_bKilled = true;
+#endif
+	}
+	else if (pEntry->m_tTerminate && !pEntry->m_bKilled &&
+		tCurrent - pEntry->m_tTerminate >= TERMINATE_GRACE_SECONDS)
+	{
+		warn("%s didn't terminate within %i seconds, killing", pEntry->m_pController->GetInfoName(), TERMINATE_GRACE_SECONDS);
+		pEntry->m_bKilled = true;
+		pEntry->m_pController->Terminate();
+	}
+}
 
 EnvironmentStrings::EnvironmentStrings()
 {
@@ -199,6 +571,18 @@ ScriptController::ScriptController()
 	m_szInfoName = NULL;
 	m_szLogPrefix = NULL;
 	m_bTerminated = false;
+	m_bNeedWrite = false;
+	m_pWritePipe = NULL;
+	m_hProcess = 0;
+	m_iTimeout = 0;
+	m_szLineBuf = NULL;
+	m_iLineLen = 0;
+	m_bFirstLine = true;
+	m_bStartError = false;
+#ifndef WIN32
+	m_bChildConfirmed = true;
+	m_iExitStatus = 0;
+#endif
 	m_environmentStrings.InitFromCurrentProcess();
 }
 
@@ -357,6 +741,56 @@ void ScriptController::PrepareArgs()
 	}
 }
 
+void ScriptController::Init()
+{
+#ifndef WIN32
+	CreateCloexecPipe(g_iWakeUpPipe);
+	fcntl(g_iWakeUpPipe[0], F_SETFL, O_NONBLOCK);
+	fcntl(g_iWakeUpPipe[1], F_SETFL, O_NONBLOCK);
+
+	// Signal SIGCHLD is handled by ScriptMonitor only. The signal is blocked in
+	// the calling thread and in all threads created by it later, otherwise it
+	// could interrupt system calls (for example socket reads) in other threads.
+	sigset_t sigMask;
+	sigemptyset(&sigMask);
+	sigaddset(&sigMask, SIGCHLD);
+	pthread_sigmask(SIG_BLOCK, &sigMask, NULL);
+
+	struct sigaction sigAction;
+	memset(&sigAction, 0, sizeof(sigAction));
+	sigAction.sa_handler = ChildSignalHandler;
+	sigemptyset(&sigAction.sa_mask);
+	sigAction.sa_flags = SA_RESTART | SA_NOCLDSTOP;
+	sigaction(SIGCHLD, &sigAction, NULL);
+#endif
+
+	debug("Starting ScriptMonitor");
+	g_pScriptMonitor = new ScriptMonitor();
+	g_pScriptMonitor->SetAutoDestroy(false);
+	g_pScriptMonitor->Start();
+}
+
+void ScriptController::Final()
+{
+	debug("Stopping ScriptMonitor");
+	g_pScriptMonitor->Stop();
+	while (g_pScriptMonitor->IsRunning())
+	{
+		usleep(10 * 1000);
+	}
+	delete g_pScriptMonitor;
+	g_pScriptMonitor = NULL;
+
+#ifndef WIN32
+	signal(SIGCHLD, SIG_DFL);
+	int iReadPipe = g_iWakeUpPipe[0];
+	int iWritePipe = g_iWakeUpPipe[1];
+	g_iWakeUpPipe[0] = g_iWakeUpPipe[1] = -1;
+	close(iReadPipe);
+	close(iWritePipe);
+#endif
+}
+
 int ScriptController::Execute()
 {
 	PrepareEnvOptions(NULL);
@@ -366,8 +800,8 @@ int ScriptController::Execute()
 	int pipein;
 
 #ifdef CHILD_WATCHDOG
-	bool bChildConfirmed = false;
-	while (!bChildConfirmed && !m_bTerminated)
+	m_bChildConfirmed = false;
+	while (!m_bChildConfirmed && !m_bTerminated)
 	{
 #endif
 
@@ -401,11 +835,20 @@ int ScriptController::Execute()
 
 	CreatePipe(&hReadPipe, &hWritePipe, &SecurityAttributes, 0);
 
+	// create pipe to send data to the child process (stdin)
+	HANDLE hReadInPipe = 0, hWriteInPipe = 0;
+	if (m_bNeedWrite)
+	{
+		CreatePipe(&hReadInPipe, &hWriteInPipe, &SecurityAttributes, 0);
+		// the "write" end must not be inherited by the child process
+		SetHandleInformation(hWriteInPipe, HANDLE_FLAG_INHERIT, 0);
+	}
+
 	STARTUPINFO StartupInfo;
 	memset(&StartupInfo, 0, sizeof(StartupInfo));
 	StartupInfo.cb = sizeof(StartupInfo);
 	StartupInfo.dwFlags = STARTF_USESTDHANDLES;
-	StartupInfo.hStdInput = 0;
+	StartupInfo.hStdInput = hReadInPipe;
 	StartupInfo.hStdOutput = hWritePipe;
 	StartupInfo.hStdError = hWritePipe;
 
@@ -433,6 +876,11 @@ int ScriptController::Execute()
 			error("Could not find file %s", m_szScript);
 		}
 		free(szEnvironmentStrings);
+		if (m_bNeedWrite)
+		{
+			CloseHandle(hReadInPipe);
+			CloseHandle(hWriteInPipe);
+		}
 		return -1;
 	}
 
@@ -447,15 +895,32 @@ int ScriptController::Execute()
 
 	pipein = _open_osfhandle((intptr_t)hReadPipe, _O_RDONLY);
 
+	if (m_bNeedWrite)
+	{
+		// close unused "read" end
+		CloseHandle(hReadInPipe);
+		m_pWritePipe = _fdopen(_open_osfhandle((intptr_t)hWriteInPipe, _O_WRONLY), "w");
+	}
+
 #else
 
 	int p[2];
 	int pipeout;
 
 	// create the pipe
-	if (pipe(p))
+	if (!CreateCloexecPipe(p))
+	{
+		error("Could not open pipe: errno %i", errno);
+		return -1;
+	}
+
+	// create pipe to send data to the child process (stdin)
+	int pw[2];
+	if (m_bNeedWrite && !CreateCloexecPipe(pw))
 	{
 		error("Could not open pipe: errno %i", errno);
+		close(p[0]);
+		close(p[1]);
 		return -1;
 	}
 
@@ -464,6 +929,79 @@ int ScriptController::Execute()
 	pipein = p[0];
 	pipeout = p[1];
 
+	// both posix_spawn and fork start the child in the current directory
+	// if the working directory is not available
+	const char* szWorkingDir = m_szWorkingDir;
+	if (szWorkingDir && !Util::DirectoryExists(szWorkingDir))
+	{
+		error("Could not change working directory for %s to %s", m_szInfoName, szWorkingDir);
+		szWorkingDir = NULL;
+	}
+
+#ifdef HAVE_POSIX_SPAWN
+	// posix_spawn doesn't copy the address space of the (large, multithreaded)
+	// parent process and therefore starts child processes much faster than fork.
+	posix_spawn_file_actions_t fileActions;
+	posix_spawn_file_actions_init(&fileActions);
+
+	// make the pipeout to be the same as stdout and stderr;
+	// all pipes have close-on-exec flag, the duplicated descriptors don't
+	posix_spawn_file_actions_adddup2(&fileActions, pipeout, 1);
+	posix_spawn_file_actions_adddup2(&fileActions, pipeout, 2);
+	posix_spawn_file_actions_addclose(&fileActions, pipeout);
+	posix_spawn_file_actions_addclose(&fileActions, pipein);
+
+	if (m_bNeedWrite)
+	{
+		// make the "read" end of the second pipe to be the stdin
+		posix_spawn_file_actions_addclose(&fileActions, pw[1]);
+		posix_spawn_file_actions_adddup2(&fileActions, pw[0], 0);
+		posix_spawn_file_actions_addclose(&fileActions, pw[0]);
+	}
+
+	if (szWorkingDir)
+	{
+		posix_spawn_file_actions_addchdir_np(&fileActions, szWorkingDir);
+	}
+
+	// create new process group (see Terminate() where it is used);
+	// SIGCHLD is blocked in our threads but must not be blocked in the child
+	posix_spawnattr_t spawnAttr;
+	posix_spawnattr_init(&spawnAttr);
+	sigset_t sigMask;
+	sigemptyset(&sigMask);
+	posix_spawnattr_setsigmask(&spawnAttr, &sigMask);
+#ifdef POSIX_SPAWN_SETSID
+	posix_spawnattr_setflags(&spawnAttr, POSIX_SPAWN_SETSID | POSIX_SPAWN_SETSIGMASK);
+#else
+	posix_spawnattr_setflags(&spawnAttr, POSIX_SPAWN_SETPGROUP | POSIX_SPAWN_SETSIGMASK);
+	posix_spawnattr_setpgroup(&spawnAttr, 0);
+#endif
+
+	debug("spawning");
+	pid_t pid = 0;
+	int iErrCode = posix_spawnp(&pid, m_szScript, &fileActions, &spawnAttr, (char* const*)m_szArgs, pEnvironmentStrings);
+
+	posix_spawnattr_destroy(&spawnAttr);
+	posix_spawn_file_actions_destroy(&fileActions);
+	free(pEnvironmentStrings);
+
+	if (iErrCode)
+	{
+		error("Could not start %s: %s", m_szScript, strerror(iErrCode));
+		close(pipein);
+		close(pipeout);
+		if (m_bNeedWrite)
+		{
+			close(pw[0]);
+			close(pw[1]);
+		}
+		return -1;
+	}
+
+	debug("spawned");
+	debug("Child Process-ID: %i", (int)pid);
+#else
 	debug("forking");
 	pid_t pid = fork();
 
@@ -471,6 +1009,13 @@ int ScriptController::Execute()
 	{
 		error("Could not start %s: errno %i", m_szInfoName, errno);
 		free(pEnvironmentStrings);
+		close(pipein);
+		close(pipeout);
+		if (m_bNeedWrite)
+		{
+			close(pw[0]);
+			close(pw[1]);
+		}
 		return -1;
 	}
 	else if (pid == 0)
@@ -479,6 +1024,11 @@ int ScriptController::Execute()
 
 		// create new process group (see Terminate() where it is used)
 		setsid();
+
+		// SIGCHLD is blocked in our threads but must not be blocked in the child
+		sigset_t sigMask;
+		sigemptyset(&sigMask);
+		sigprocmask(SIG_SETMASK, &sigMask, NULL);
 			
 		// close up the "read" end
 		close(pipein);
@@ -489,12 +1039,23 @@ int ScriptController::Execute()
 		
 		close(pipeout);
 
+		if (m_bNeedWrite)
+		{
+			// make the "read" end of the second pipe to be the stdin
+			close(pw[1]);
+			dup2(pw[0], 0);
+			close(pw[0]);
+		}
+
 #ifdef CHILD_WATCHDOG
 		fwrite("\n", 1, 1, stdout);
 		fflush(stdout);
 #endif
 
-		chdir(m_szWorkingDir);
+		if (szWorkingDir)
+		{
+			chdir(szWorkingDir);
+		}
 		environ = pEnvironmentStrings;
 		execvp(m_szScript, (char* const*)m_szArgs);
 		// NOTE: the text "[ERROR] Could not start " is checked later,
@@ -509,72 +1070,61 @@ int ScriptController::Execute()
 	debug("Child Process-ID: %i", (int)pid);
 
 	free(pEnvironmentStrings);
+#endif
 
 	m_hProcess = pid;
 
 	// close unused "write" end
 	close(pipeout);
-#endif
 
-	// open the read end
-	FILE* readpipe = fdopen(pipein, "r");
-	if (!readpipe)
+	if (m_bNeedWrite)
 	{
-		error("Could not open pipe to %s", m_szInfoName);
-		return -1;
+		// close unused "read" end
+		close(pw[0]);
+		m_pWritePipe = fdopen(pw[1], "w");
 	}
-	
-#ifdef CHILD_WATCHDOG
-	debug("Creating child watchdog");
-	ChildWatchDog* pWatchDog = new ChildWatchDog();
-	pWatchDog->SetAutoDestroy(false);
-	pWatchDog->SetProcessID(pid);
-	pWatchDog->Start();
 #endif
-	
-	char* buf = (char*)malloc(10240);
+
+	m_szLineBuf = (char*)malloc(LINE_BUFFER_SIZE);
+	m_iLineLen = 0;
+	m_bFirstLine = true;
+	m_bStartError = false;
+
+#ifdef WIN32
+	g_pScriptMonitor->Add(this, m_iTimeout);
 
 	debug("Entering pipe-loop");
-	bool bFirstLine = true;
-	bool bStartError = false;
-	while (!feof(readpipe) && !m_bTerminated)
+	char buf[1024];
+	int iLen;
+	while (!m_bTerminated && (iLen = read(pipein, buf, sizeof(buf))) > 0)
 	{
-		if (ReadLine(buf, 10240, readpipe))
-		{
-#ifdef CHILD_WATCHDOG
-			if (!bChildConfirmed)
-			{
-				bChildConfirmed = true;
-				pWatchDog->Stop();
-				debug("Child confirmed");
-				continue;
-			}
-#endif
-			if (bFirstLine && !strncmp(buf, "[ERROR] Could not start ", 24))
-			{
-				bStartError = true;
-			}
-			ProcessOutput(buf);
-			bFirstLine = false;
-		}
+		ReceiveOutput(buf, iLen);
 	}
+	ReceiveOutput(NULL, 0);
 	debug("Exited pipe-loop");
 
-#ifdef CHILD_WATCHDOG
-	debug("Destroying WatchDog");
-	if (!bChildConfirmed)
-	{
-		pWatchDog->Stop();
-	}
-	while (pWatchDog->IsRunning())
+	g_pScriptMonitor->Remove(this);
+	close(pipein);
+#else
+	// the output is read and processed by ScriptMonitor
+	fcntl(pipein, F_SETFL, O_NONBLOCK);
+	g_pScriptMonitor->Add(this, pid, pipein, m_iTimeout);
+
+	debug("Waiting for %s", m_szInfoName);
+	while (!m_eventFinished.Wait(60 * 1000)) ;
+	debug("%s finished", m_szInfoName);
+#endif
+
+	free(m_szLineBuf);
+	m_szLineBuf = NULL;
+
+	m_mutexWrite.Lock();
+	if (m_pWritePipe)
 	{
-		usleep(1 * 1000);
+		fclose(m_pWritePipe);
+		m_pWritePipe = NULL;
 	}
-	delete pWatchDog;
-#endif
-	
-	free(buf);
-	fclose(readpipe);
+	m_mutexWrite.Unlock();
 
 	if (m_bTerminated)
 	{
@@ -589,12 +1139,10 @@ int ScriptController::Execute()
 	GetExitCodeProcess(m_hProcess, &dExitCode);
 	iExitCode = dExitCode;
 #else
-	int iStatus = 0;
-	waitpid(m_hProcess, &iStatus, 0);
-	if (WIFEXITED(iStatus))
+	if (WIFEXITED(m_iExitStatus))
 	{
-		iExitCode = WEXITSTATUS(iStatus);
-		if (iExitCode == 254 && bStartError)
+		iExitCode = WEXITSTATUS(m_iExitStatus);
+		if (iExitCode == 254 && m_bStartError)
 		{
 			iExitCode = -1;
 		}
@@ -602,7 +1150,7 @@ int ScriptController::Execute()
 #endif
 	
 #ifdef CHILD_WATCHDOG
-	}	// while (!bChildConfirmed && !m_bTerminated)
+	}	// while (!m_bChildConfirmed && !m_bTerminated)
 #endif
 	
 	debug("Exit code %i", iExitCode);
@@ -615,33 +1163,133 @@ void ScriptController::Terminate()
 	debug("Stopping %s", m_szInfoName);
 	m_bTerminated = true;
 
+	if (!m_hProcess)
+	{
+		// the process was not started yet or has already exited
+		return;
+	}
+
 #ifdef WIN32
 	BOOL bOK = TerminateProcess(m_hProcess, -1);
 #else
+	bool bOK = SendSignal(SIGKILL);
+#endif
+
+	if (bOK)
+	{
+		debug("Terminated %s", m_szInfoName);
+	}
+	else
+	{
+		error("Could not terminate %s", m_szInfoName);
+	}
+
+	debug("Stopped %s", m_szInfoName);
+}
+
+/*
+ * Asks the process to exit, used if the time limit is exceeded. On POSIX
+ * the process gets signal SIGTERM and can clean up; ScriptMonitor kills it
+ * if it doesn't exit within a grace period. On Windows the process is
+ * terminated at once.
+ */
+void ScriptController::Interrupt()
+{
+#ifdef WIN32
+	Terminate();
+#else
+	debug("Interrupting %s", m_szInfoName);
+	m_bTerminated = true;
+
+	if (m_hProcess && !SendSignal(SIGTERM))
+	{
+		error("Could not terminate %s", m_szInfoName);
+	}
+#endif
+}
+
+#ifndef WIN32
+bool ScriptController::SendSignal(int iSignal)
+{
 	pid_t hKillProcess = m_hProcess;
 	if (getpgid(hKillProcess) == hKillProcess)
 	{
 		// if the child process has its own group (setsid() was successful), kill the whole group
 		hKillProcess = -hKillProcess;
 	}
-	bool bOK = kill(hKillProcess, SIGKILL) == 0;
+	return kill(hKillProcess, iSignal) == 0;
+}
 #endif
 
-	if (bOK)
+/*
+ * Sends text to the standard input of the child process.
+ * Requires "SetNeedWrite(true)" before the process is started.
+ */
+bool ScriptController::Write(const char* szText)
+{
+	m_mutexWrite.Lock();
+	bool bOK = m_pWritePipe && fwrite(szText, 1, strlen(szText), m_pWritePipe) == strlen(szText) &&
+		!fflush(m_pWritePipe);
+	m_mutexWrite.Unlock();
+	return bOK;
+}
+
+/*
+ * Splits the output of the child process into lines. Called with the received
+ * data (from ScriptMonitor on POSIX) or with iLen == 0 at the end of output.
+ */
+void ScriptController::ReceiveOutput(const char* szData, int iLen)
+{
+	for (int i = 0; i < iLen; i++)
 	{
-		debug("Terminated %s", m_szInfoName);
+		m_szLineBuf[m_iLineLen++] = szData[i];
+		m_szLineBuf[m_iLineLen] = '\0';
+		if (IsLineEnd(m_szLineBuf, m_iLineLen) || m_iLineLen == LINE_BUFFER_SIZE - 1)
+		{
+			CompleteLine();
+		}
 	}
-	else
+
+	if (iLen == 0 && m_iLineLen > 0)
 	{
-		error("Could not terminate %s", m_szInfoName);
+		CompleteLine();
 	}
+}
 
-	debug("Stopped %s", m_szInfoName);
+void ScriptController::CompleteLine()
+{
+	m_iLineLen = 0;
+
+#ifdef CHILD_WATCHDOG
+	if (!m_bChildConfirmed)
+	{
+		m_bChildConfirmed = true;
+		debug("Child confirmed");
+		return;
+	}
+#endif
+
+	if (m_bFirstLine && !strncmp(m_szLineBuf, "[ERROR] Could not start ", 24))
+	{
+		m_bStartError = true;
+	}
+	m_bFirstLine = false;
+
+	ProcessLine(m_szLineBuf);
+}
+
+/*
+ * Checks if the output received so far (iLen characters in szBuf) forms a
+ * complete line. Called after every received character.
+ */
+bool ScriptController::IsLineEnd(char* szBuf, int iLen)
+{
+	return szBuf[iLen - 1] == '\n';
 }
 
-bool ScriptController::ReadLine(char* szBuf, int iBufSize, FILE* pStream)
+void ScriptController::ProcessLine(char* szLine)
 {
-	return fgets(szBuf, iBufSize, pStream);
+	ProcessOutput(szLine);
 }
 
 void ScriptController::ProcessOutput(char* szText)
@@ -806,6 +1454,7 @@ void PostScriptController::ExecuteScript(const char* szScriptName, const char* s
 	SetInfoName(szInfoName);
 
 	SetLogPrefix(szDisplayName);
+	SetTimeout(g_pOptions->GetScriptTimeLimit() * 60);
 	PrepareParams(szScriptName);
 
 	int iExitCode = Execute();
@@ -1023,6 +1672,7 @@ void NZBScriptController::ExecuteScript(const char* szScript, const char* szNZBF
 	pScriptController->SetEnvVar("NZBNP_PRIORITY", szPriority);
 	pScriptController->SetEnvVar("NZBNP_TOP", szAddTop);
 	pScriptController->SetEnvVar("NZBNP_PAUSED", szAddPaused);
+	pScriptController->SetTimeout(g_pOptions->GetScriptTimeLimit() * 60);
 
 	pScriptController->Execute();
 
@@ -1140,6 +1790,7 @@ void NZBAddedScriptController::Run()
 	szLogPrefix[1024-1] = '\0';
 	if (char* ext = strrchr(szLogPrefix, '.')) *ext = '\0'; // strip file extension
 	SetLogPrefix(szLogPrefix);
+	SetTimeout(g_pOptions->GetScriptTimeLimit() * 60);
 
 	Execute();
 
@@ -1177,6 +1828,7 @@ void SchedulerScriptController::Run()
 	szLogPrefix[1024-1] = '\0';
 	if (char* ext = strrchr(szLogPrefix, '.')) *ext = '\0'; // strip file extension
 	SetLogPrefix(szLogPrefix);
+	SetTimeout(g_pOptions->GetScriptTimeLimit() * 60);
 
 	Execute();
 }
@@ -65,19 +65,41 @@ private:
 	const char*			m_szLogPrefix;
 	EnvironmentStrings	m_environmentStrings;
 	bool				m_bTerminated;
+	bool				m_bNeedWrite;
+	FILE*				m_pWritePipe;
+	Mutex				m_mutexWrite;
 #ifdef WIN32
 	HANDLE				m_hProcess;
 	char				m_szCmdLine[2048];
 #else
 	pid_t				m_hProcess;
+	bool				m_bChildConfirmed;
+	int					m_iExitStatus;
+	Event				m_eventFinished;
 #endif
+	int					m_iTimeout;
+	char*				m_szLineBuf;
+	int					m_iLineLen;
+	bool				m_bFirstLine;
+	bool				m_bStartError;
+
+	void				ReceiveOutput(const char* szData, int iLen);
+	void				CompleteLine();
+	void				Interrupt();
+#ifndef WIN32
+	bool				SendSignal(int iSignal);
+#endif
+
+	friend class ScriptMonitor;
 
 protected:
 	void				ProcessOutput(char* szText);
-	virtual bool		ReadLine(char* szBuf, int iBufSize, FILE* pStream);
+	virtual bool		IsLineEnd(char* szBuf, int iLen);
+	virtual void		ProcessLine(char* szLine);
 	void				PrintMessage(Message::EKind eKind, const char* szFormat, ...);
 	virtual void		AddMessage(Message::EKind eKind, const char* szText);
 	bool				GetTerminated() { return m_bTerminated; }
+	bool				Write(const char* szText);
 	void				ResetEnv();
 	void				PrepareEnvOptions(const char* szStripPrefix);
 	void				PrepareEnvParameters(NZBInfo* pNZBInfo, const char* szStripPrefix);
@@ -86,6 +108,8 @@ protected:
 public:
 						ScriptController();
 	virtual				~ScriptController();
+	static void			Init();
+	static void			Final();
 	int					Execute();
 	void				Terminate();
 
@@ -96,6 +120,8 @@ public:
 	void				SetInfoName(const char* szInfoName) { m_szInfoName = szInfoName; }
 	const char*			GetInfoName() { return m_szInfoName; }
 	void				SetLogPrefix(const char* szLogPrefix) { m_szLogPrefix = szLogPrefix; }
+	void				SetNeedWrite(bool bNeedWrite) { m_bNeedWrite = bNeedWrite; }
+	void				SetTimeout(int iTimeout) { m_iTimeout = iTimeout; }
 	void				SetEnvVar(const char* szName, const char* szValue);
 	void				SetEnvVarSpecial(const char* szPrefix, const char* szName, const char* szValue);
 };
@@ -42,14 +42,126 @@
 
 #include "nzbget.h"
 #include "ServerPool.h"
+#include "Options.h"
 #include "Log.h"
+#include "Util.h"
+
+extern Options* g_pOptions;
 
 static const int CONNECTION_HOLD_SECODNS = 5;
+static const int CONNECTION_HOLD_ACTIVE_SECONDS = 60;
+static const int KEEPALIVE_INTERVAL_SECONDS = 30;
+static const int WARMUP_RETRY_SECONDS = 60;
+static const int MAINTENANCE_THREADS = 4;
+// server statistics are collected over STATS_SLOTS * STATS_SLOT_SECONDS seconds
+static const int STATS_SLOTS = 6;
+static const int STATS_SLOT_SECONDS = 10;
+// the statistics of servers with less articles are not used
+static const int STATS_MIN_ARTICLES = 20;
+// weights (in percent of the best server on the level) and limits for demotion
+static const int MIN_WEIGHT = 5;
+static const int DEMOTE_WEIGHT = 30;
+static const int DEMOTE_NOTFOUND_PERCENT = 50;
+static const int DEMOTE_FAILURE_PERCENT = 30;
+static const int DEMOTE_SECONDS = 300;
 
 ServerPool::PooledConnection::PooledConnection(NewsServer* server) : NNTPConnection(server)
 {
 	m_bInUse = false;
-	m_tFreeTime = 0;
+	m_bMaintenance = false;
+	m_iFreeTime = 0;
+	m_iRetryTime = 0;
+}
+
+void ServerPool::PooledConnection::SetFreeTimeNow()
+{
+	m_iFreeTime = Util::CurrentMSec();
+}
+
+ServerPool::ServerStats::ServerStats(NewsServer* pNewsServer)
+{
+	m_pNewsServer = pNewsServer;
+	m_tDemotedUntil = 0;
+	NextSlot();
+}
+
+void ServerPool::ServerStats::NextSlot()
+{
+	Slot slot;
+	memset(&slot, 0, sizeof(slot));
+	m_Slots.push_back(slot);
+	if ((int)m_Slots.size() > STATS_SLOTS)
+	{
+		m_Slots.pop_front();
+	}
+}
+
+void ServerPool::ServerStats::Reset()
+{
+	m_Slots.clear();
+	NextSlot();
+}
+
+void ServerPool::ServerStats::AddArticle(EArticleResult eResult, int iBytes, int iLatency, int iTransferTime)
+{
+	Slot& slot = m_Slots.back();
+	switch (eResult)
+	{
+		case arSuccess:
+			slot.iSuccess++;
+			slot.iBytes += iBytes;
+			slot.iLatency += iLatency;
+			slot.iTransferTime += iTransferTime;
+			break;
+
+		case arNotFound:
+			slot.iNotFound++;
+			break;
+
+		case arFailure:
+			slot.iFailure++;
+			break;
+	}
+}
+
+void ServerPool::ServerStats::CalcTotals(Slot* pTotals)
+{
+	memset(pTotals, 0, sizeof(Slot));
+	for (Slots::iterator it = m_Slots.begin(); it != m_Slots.end(); it++)
+	{
+		Slot& slot = *it;
+		pTotals->iBytes += slot.iBytes;
+		pTotals->iLatency += slot.iLatency;
+		pTotals->iTransferTime += slot.iTransferTime;
+		pTotals->iSuccess += slot.iSuccess;
+		pTotals->iNotFound += slot.iNotFound;
+		pTotals->iFailure += slot.iFailure;
+	}
+}
+
+ServerPool::MaintenanceJob::MaintenanceJob(ServerPool* pOwner, PooledConnection* pConnection, bool bKeepAlive)
+{
+	m_pOwner = pOwner;
+	m_pConnection = pConnection;
+	m_bKeepAlive = bKeepAlive;
+}
+
+void ServerPool::MaintenanceJob::Run()
+{
+	// errors are reported by downloads using the connection later
+	m_pConnection->SetSuppressErrors(true);
+
+	bool bSuccess = m_bKeepAlive ? m_pConnection->KeepAlive() : m_pConnection->Connect();
+	if (!bSuccess)
+	{
+		debug("%s of connection to server%i failed", m_bKeepAlive ? "Keep-alive" : "Warm-up",
+			m_pConnection->GetNewsServer()->GetID());
+		m_pConnection->Disconnect();
+	}
+
+	m_pConnection->SetSuppressErrors(false);
+
+	m_pOwner->FinishMaintenance(m_pConnection, bSuccess);
 }
 
 ServerPool::ServerPool()
@@ -59,6 +171,14 @@ ServerPool::ServerPool()
 	m_iMaxNormLevel = 0;
 	m_iTimeout = 60;
 	m_iGeneration = 0;
+	m_bQueueActive = false;
+	m_iMaintenanceJobs = 0;
+	m_bMaintenanceStopped = false;
+
+	m_pThreadPool = ThreadPool::GetPool("connection");
+	m_pThreadPool->SetMaxWorkers(MAINTENANCE_THREADS);
+
+	m_tStatsSlotTime = time(NULL);
 }
 
 ServerPool::~ ServerPool()
@@ -67,18 +187,25 @@ ServerPool::~ ServerPool()
 
 	m_Levels.clear();
 
+	// connections must be deleted first, they use their servers when closing
+	for (Connections::iterator it = m_Connections.begin(); it != m_Connections.end(); it++)
+	{
+		delete *it;
+	}
+	m_Connections.clear();
+
 	for (Servers::iterator it = m_Servers.begin(); it != m_Servers.end(); it++)
 	{
 		delete *it;
 	}
 	m_Servers.clear();
-	m_SortedServers.clear();
 
-	for (Connections::iterator it = m_Connections.begin(); it != m_Connections.end(); it++)
+	for (ServerStatsList::iterator it = m_ServerStats.begin(); it != m_ServerStats.end(); it++)
 	{
 		delete *it;
 	}
-	m_Connections.clear();
+	m_ServerStats.clear();
+	m_SortedServers.clear();
 }
 
 void ServerPool::AddServer(NewsServer* pNewsServer)
@@ -87,6 +214,7 @@ void ServerPool::AddServer(NewsServer* pNewsServer)
 
 	m_Servers.push_back(pNewsServer);
 	m_SortedServers.push_back(pNewsServer);
+	m_ServerStats.push_back(new ServerStats(pNewsServer));
 }
 
 /*
@@ -193,9 +321,19 @@ void ServerPool::InitConnections()
 	m_mutexConnections.Unlock();
 }
 
+/*
+ * Free connections of servers on the level are chosen randomly with the
+ * probability proportional to the weights of their servers.
+ * Connections of demoted servers are used only if no other server of the
+ * level can be used for the article, even if other servers are busy now.
+ */
 NNTPConnection* ServerPool::GetConnection(int iLevel, NewsServer* pWantServer, Servers* pIgnoreServers)
 {
 	PooledConnection* pConnection = NULL;
+	PooledConnection* pDemotedConnection = NULL;
+	bool bPreferredServer = false;
+	// one free connection per server, connected ones are preferred
+	Connections candidates;
 
 	m_mutexConnections.Lock();
 
@@ -205,12 +343,11 @@ NNTPConnection* ServerPool::GetConnection(int iLevel, NewsServer* pWantServer, S
 		{
 			PooledConnection* pCandidateConnection = *it;
 			NewsServer* pCandidateServer = pCandidateConnection->GetNewsServer();
-			if (!pCandidateConnection->GetInUse() && pCandidateServer->GetActive() &&
-				pCandidateServer->GetNormLevel() == iLevel && 
+			if (pCandidateServer->GetActive() && pCandidateServer->GetNormLevel() == iLevel && 
 				(!pWantServer || pCandidateServer == pWantServer ||
 				 (pWantServer->GetGroup() > 0 && pWantServer->GetGroup() == pCandidateServer->GetGroup())))
 			{
-				// free connection found, check if it's not from the server which should be ignored
+				// check if it's not from the server which should be ignored
 				bool bUseConnection = true;
 				if (pIgnoreServers && !pWantServer)
 				{
@@ -227,17 +364,67 @@ NNTPConnection* ServerPool::GetConnection(int iLevel, NewsServer* pWantServer, S
 					}
 				}
 
-				if (bUseConnection)
+				if (!bUseConnection)
+				{
+					continue;
+				}
+
+				if (pCandidateServer->GetDemoted() && !pWantServer)
 				{
-					pConnection = pCandidateConnection;
-					pConnection->SetInUse(true);
-					break;
+					if (!pCandidateConnection->GetInUse() &&
+						(!pDemotedConnection || (pDemotedConnection->GetStatus() != Connection::csConnected &&
+						 pCandidateConnection->GetStatus() == Connection::csConnected)))
+					{
+						pDemotedConnection = pCandidateConnection;
+					}
+					continue;
+				}
+
+				bPreferredServer = true;
+
+				if (!pCandidateConnection->GetInUse())
+				{
+					Connections::iterator it2 = candidates.begin();
+					while (it2 != candidates.end() && (*it2)->GetNewsServer() != pCandidateServer) it2++;
+					if (it2 == candidates.end())
+					{
+						candidates.push_back(pCandidateConnection);
+					}
+					else if ((*it2)->GetStatus() != Connection::csConnected &&
+						pCandidateConnection->GetStatus() == Connection::csConnected)
+					{
+						*it2 = pCandidateConnection;
+					}
 				}
 			}
 		}
 
+		// the server is chosen by weight, not the connection: otherwise servers with
+		// many connections would be preferred and a warm connection would rarely be
+		// taken if the server has many disconnected ones
+		int iTotalWeight = 0;
+		for (Connections::iterator it = candidates.begin(); it != candidates.end(); it++)
+		{
+			PooledConnection* pCandidateConnection = *it;
+			iTotalWeight += pCandidateConnection->GetNewsServer()->GetWeight();
+			if (rand() % iTotalWeight < pCandidateConnection->GetNewsServer()->GetWeight())
+			{
+				pConnection = pCandidateConnection;
+			}
+		}
+
+		if (!pConnection && !bPreferredServer)
+		{
+			pConnection = pDemotedConnection;
+		}
+
 		if (pConnection)
 		{
+			pConnection->SetInUse(true);
+			if (pConnection->GetStatus() == Connection::csConnected && pConnection->GetFreeTime() > 0)
+			{
+				pConnection->GetNewsServer()->AddTiming(NewsServer::tmIdle, (int)(Util::CurrentMSec() - pConnection->GetFreeTime()));
+			}
 			m_Levels[iLevel]--;
 		}
 	}
@@ -274,8 +461,6 @@ void ServerPool::CloseUnusedConnections()
 {
 	m_mutexConnections.Lock();
 
-	time_t curtime = ::time(NULL);
-
 	int i = 0;
 	for (Connections::iterator it = m_Connections.begin(); it != m_Connections.end(); )
 	{
@@ -297,26 +482,322 @@ void ServerPool::CloseUnusedConnections()
 			bDeleted = true;
 		}
 
-		if (!bDeleted && !pConnection->GetInUse() && pConnection->GetStatus() == Connection::csConnected)
+		if (!bDeleted)
+		{
+			it++;
+			i++;
+		}
+	}
+
+	// close idle connections except the warm ones
+	long long iCurTime = Util::CurrentMSec();
+	int iHoldTime = (m_bQueueActive ? CONNECTION_HOLD_ACTIVE_SECONDS : CONNECTION_HOLD_SECODNS) * 1000;
+
+	for (Servers::iterator it = m_Servers.begin(); it != m_Servers.end(); it++)
+	{
+		NewsServer* pNewsServer = *it;
+		int iWarmConnections = 0;
+
+		for (Connections::iterator it2 = m_Connections.begin(); it2 != m_Connections.end(); it2++)
 		{
-			int tdiff = (int)(curtime - pConnection->GetFreeTime());
-			if (tdiff > CONNECTION_HOLD_SECODNS)
+			PooledConnection* pConnection = *it2;
+			if (pConnection->GetNewsServer() == pNewsServer && !pConnection->GetInUse() &&
+				pConnection->GetStatus() == Connection::csConnected)
 			{
-				debug("Closing (and keeping) unused connection to server%i", pConnection->GetNewsServer()->GetID());
-				pConnection->Disconnect();
+				if (iWarmConnections < pNewsServer->GetWarmConnections())
+				{
+					iWarmConnections++;
+				}
+				else if (iCurTime - pConnection->GetFreeTime() > iHoldTime)
+				{
+					debug("Closing (and keeping) unused connection to server%i", pNewsServer->GetID());
+					pConnection->Disconnect();
+				}
 			}
 		}
+	}
 
-		if (!bDeleted)
+	m_mutexConnections.Unlock();
+}
+
+void ServerPool::MaintainConnections(bool bQueueActive)
+{
+	m_bQueueActive = bQueueActive;
+	CloseUnusedConnections();
+	WarmUpConnections();
+}
+
+/*
+ * Keeps the configured number of idle connections of each server connected:
+ * sends keep-alive requests on connections idle for too long and opens new
+ * connections if there are not enough of them.
+ */
+void ServerPool::WarmUpConnections()
+{
+	m_mutexConnections.Lock();
+
+	if (m_bMaintenanceStopped)
+	{
+		m_mutexConnections.Unlock();
+		return;
+	}
+
+	long long iCurTime = Util::CurrentMSec();
+
+	for (Servers::iterator it = m_Servers.begin(); it != m_Servers.end(); it++)
+	{
+		NewsServer* pNewsServer = *it;
+		if (pNewsServer->GetWarmConnections() == 0 || !pNewsServer->GetActive() ||
+			pNewsServer->GetNormLevel() == -1)
 		{
-			it++;
-			i++;
+			continue;
+		}
+
+		int iWarmConnections = 0;
+
+		for (Connections::iterator it2 = m_Connections.begin(); it2 != m_Connections.end(); it2++)
+		{
+			PooledConnection* pConnection = *it2;
+			if (pConnection->GetNewsServer() != pNewsServer)
+			{
+				continue;
+			}
+
+			if (pConnection->GetMaintenance())
+			{
+				iWarmConnections++;
+			}
+			else if (!pConnection->GetInUse() && pConnection->GetStatus() == Connection::csConnected &&
+				iWarmConnections < pNewsServer->GetWarmConnections())
+			{
+				iWarmConnections++;
+				if (iCurTime - pConnection->GetFreeTime() > KEEPALIVE_INTERVAL_SECONDS * 1000)
+				{
+					StartMaintenance(pConnection, true);
+				}
+			}
+		}
+
+		for (Connections::iterator it2 = m_Connections.begin();
+			it2 != m_Connections.end() && iWarmConnections < pNewsServer->GetWarmConnections(); it2++)
+		{
+			PooledConnection* pConnection = *it2;
+			if (pConnection->GetNewsServer() == pNewsServer && !pConnection->GetInUse() &&
+				pConnection->GetStatus() != Connection::csConnected &&
+				iCurTime >= pConnection->GetRetryTime())
+			{
+				iWarmConnections++;
+				StartMaintenance(pConnection, false);
+			}
 		}
 	}
 
 	m_mutexConnections.Unlock();
 }
 
+/*
+ * Takes the connection out of the pool until the job is finished.
+ * Must be called with locked m_mutexConnections.
+ */
+void ServerPool::StartMaintenance(PooledConnection* pConnection, bool bKeepAlive)
+{
+	debug("%s connection to server%i", bKeepAlive ? "Keeping alive" : "Warming up",
+		pConnection->GetNewsServer()->GetID());
+
+	pConnection->SetInUse(true);
+	pConnection->SetMaintenance(true);
+	m_Levels[pConnection->GetNewsServer()->GetNormLevel()]--;
+	m_iMaintenanceJobs++;
+
+	MaintenanceJob* pJob = new MaintenanceJob(this, pConnection, bKeepAlive);
+	pJob->SetAutoDestroy(true);
+	pJob->SetThreadPool(m_pThreadPool);
+	pJob->Start();
+}
+
+void ServerPool::FinishMaintenance(PooledConnection* pConnection, bool bSuccess)
+{
+	m_mutexConnections.Lock();
+
+	pConnection->SetMaintenance(false);
+	pConnection->SetRetryTime(bSuccess ? 0 : Util::CurrentMSec() + WARMUP_RETRY_SECONDS * 1000);
+	m_iMaintenanceJobs--;
+
+	m_mutexConnections.Unlock();
+
+	FreeConnection(pConnection, true);
+}
+
+/*
+ * Cancels running warm-up and keep-alive jobs and waits for their completion.
+ * No new jobs are started afterwards.
+ */
+void ServerPool::StopMaintenance()
+{
+	m_mutexConnections.Lock();
+	m_bMaintenanceStopped = true;
+	for (Connections::iterator it = m_Connections.begin(); it != m_Connections.end(); it++)
+	{
+		PooledConnection* pConnection = *it;
+		if (pConnection->GetMaintenance())
+		{
+			pConnection->SetSuppressErrors(true);
+			pConnection->Cancel();
+		}
+	}
+	m_mutexConnections.Unlock();
+
+	while (true)
+	{
+		m_mutexConnections.Lock();
+		bool bCompleted = m_iMaintenanceJobs == 0;
+		m_mutexConnections.Unlock();
+
+		if (bCompleted)
+		{
+			break;
+		}
+		usleep(10 * 1000);
+	}
+}
+
+void ServerPool::AddArticleResult(NewsServer* pNewsServer, EArticleResult eResult,
+	int iBytes, int iLatency, int iTransferTime)
+{
+	m_mutexStats.Lock();
+
+	for (ServerStatsList::iterator it = m_ServerStats.begin(); it != m_ServerStats.end(); it++)
+	{
+		ServerStats* pStats = *it;
+		if (pStats->GetNewsServer() == pNewsServer)
+		{
+			pStats->AddArticle(eResult, iBytes, iLatency, iTransferTime);
+			break;
+		}
+	}
+
+	m_mutexStats.Unlock();
+}
+
+/*
+ * The score of a server is the amount of article data it delivers per
+ * millisecond of a connection, reduced by the share of unsuccessful articles.
+ * The weight of a server is its score in percent of the best score on the level.
+ */
+void ServerPool::UpdateServerStats()
+{
+	time_t tCurTime = time(NULL);
+
+	m_mutexStats.Lock();
+
+	bool bNextSlot = tCurTime - m_tStatsSlotTime >= STATS_SLOT_SECONDS || tCurTime < m_tStatsSlotTime;
+	if (bNextSlot)
+	{
+		m_tStatsSlotTime = tCurTime;
+	}
+
+	int iCount = (int)m_ServerStats.size();
+	std::vector<ServerStats::Slot> Totals(iCount);
+	std::vector<double> Scores(iCount, -1.0);
+
+	for (int i = 0; i < iCount; i++)
+	{
+		ServerStats* pStats = m_ServerStats[i];
+		ServerStats::Slot* pTotals = &Totals[i];
+		pStats->CalcTotals(pTotals);
+		if (bNextSlot)
+		{
+			pStats->NextSlot();
+		}
+
+		int iArticles = pTotals->iSuccess + pTotals->iNotFound + pTotals->iFailure;
+		if (iArticles >= STATS_MIN_ARTICLES)
+		{
+			long long iTime = pTotals->iLatency + pTotals->iTransferTime;
+			Scores[i] = iTime > 0 ? (double)pTotals->iBytes / iTime * pTotals->iSuccess / iArticles : 0.0;
+		}
+	}
+
+	for (int i = 0; i < iCount; i++)
+	{
+		ServerStats* pStats = m_ServerStats[i];
+		NewsServer* pNewsServer = pStats->GetNewsServer();
+
+		double fBestScore = 0.0;
+		for (int j = 0; j < iCount; j++)
+		{
+			if (m_ServerStats[j]->GetNewsServer()->GetNormLevel() == pNewsServer->GetNormLevel() &&
+				Scores[j] > fBestScore)
+			{
+				fBestScore = Scores[j];
+			}
+		}
+
+		int iWeight = 100;
+		if (Scores[i] >= 0.0 && fBestScore > 0.0)
+		{
+			iWeight = (int)(Scores[i] * 100 / fBestScore);
+		}
+		pNewsServer->SetWeight(iWeight > MIN_WEIGHT ? iWeight : MIN_WEIGHT);
+
+		if (pNewsServer->GetDemoted())
+		{
+			if (tCurTime >= pStats->GetDemotedUntil() || !g_pOptions->GetDemoteServers())
+			{
+				info("Server %s is used again", pNewsServer->GetName());
+				pNewsServer->SetDemoted(false);
+				pNewsServer->SetWeight(100);
+				pStats->Reset();
+			}
+		}
+		else if (g_pOptions->GetDemoteServers() && Scores[i] >= 0.0 && HasAlternativeServer(pNewsServer))
+		{
+			ServerStats::Slot* pTotals = &Totals[i];
+			int iArticles = pTotals->iSuccess + pTotals->iNotFound + pTotals->iFailure;
+			if (iWeight < DEMOTE_WEIGHT ||
+				pTotals->iNotFound * 100 / iArticles > DEMOTE_NOTFOUND_PERCENT ||
+				pTotals->iFailure * 100 / iArticles > DEMOTE_FAILURE_PERCENT)
+			{
+				DemoteServer(pStats, pTotals, tCurTime);
+			}
+		}
+	}
+
+	m_mutexStats.Unlock();
+}
+
+/*
+ * Checks if there is another usable server on the level, otherwise the demotion makes no sense.
+ */
+bool ServerPool::HasAlternativeServer(NewsServer* pNewsServer)
+{
+	for (Servers::iterator it = m_Servers.begin(); it != m_Servers.end(); it++)
+	{
+		NewsServer* pCandidateServer = *it;
+		if (pCandidateServer != pNewsServer && pCandidateServer->GetActive() && !pCandidateServer->GetDemoted() &&
+			pCandidateServer->GetNormLevel() == pNewsServer->GetNormLevel() && pNewsServer->GetNormLevel() > -1)
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+void ServerPool::DemoteServer(ServerStats* pStats, ServerStats::Slot* pTotals, time_t tCurTime)
+{
+	NewsServer* pNewsServer = pStats->GetNewsServer();
+	int iArticles = pTotals->iSuccess + pTotals->iNotFound + pTotals->iFailure;
+	int iSpeed = pTotals->iTransferTime > 0 ? (int)(pTotals->iBytes * 1000 / pTotals->iTransferTime / 1024) : 0;
+	int iLatency = pTotals->iSuccess > 0 ? (int)(pTotals->iLatency / pTotals->iSuccess) : 0;
+
+	info("Demoting server %s for %i seconds: %i KB/s per connection, latency %i ms, %i%% of articles not found, %i%% failed",
+		pNewsServer->GetName(), DEMOTE_SECONDS, iSpeed, iLatency,
+		pTotals->iNotFound * 100 / iArticles, pTotals->iFailure * 100 / iArticles);
+
+	pNewsServer->SetDemoted(true);
+	pStats->SetDemotedUntil(tCurTime + DEMOTE_SECONDS);
+}
+
 void ServerPool::Changed()
 {
 	debug("Server config has been changed");
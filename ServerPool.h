@@ -28,6 +28,7 @@
 #define SERVERPOOL_H
 
 #include <vector>
+#include <deque>
 #include <time.h>
 
 #include "Thread.h"
@@ -39,22 +40,86 @@ class ServerPool
 public:
 	typedef std::vector<NewsServer*>		Servers;
 
+	enum EArticleResult
+	{
+		arSuccess,
+		arNotFound,
+		arFailure
+	};
+
 private:
 	class PooledConnection : public NNTPConnection
 	{
 	private:
 		bool			m_bInUse;
-		time_t			m_tFreeTime;
+		bool			m_bMaintenance;
+		long long		m_iFreeTime;
+		long long		m_iRetryTime;
 	public:
 						PooledConnection(NewsServer* server);
 		bool			GetInUse() { return m_bInUse; }
 		void			SetInUse(bool bInUse) { m_bInUse = bInUse; }
-		time_t			GetFreeTime() { return m_tFreeTime; }
-		void			SetFreeTimeNow() { m_tFreeTime = ::time(NULL); }
+		bool			GetMaintenance() { return m_bMaintenance; }
+		void			SetMaintenance(bool bMaintenance) { m_bMaintenance = bMaintenance; }
+		long long		GetFreeTime() { return m_iFreeTime; }
+		void			SetFreeTimeNow();
+		long long		GetRetryTime() { return m_iRetryTime; }
+		void			SetRetryTime(long long iRetryTime) { m_iRetryTime = iRetryTime; }
+	};
+
+	/*
+	 * Connects (warm-up) or sends a keep-alive request on an idle connection
+	 * outside of the queue coordinator thread.
+	 */
+	class MaintenanceJob : public Thread
+	{
+	private:
+		ServerPool*		m_pOwner;
+		PooledConnection*	m_pConnection;
+		bool			m_bKeepAlive;
+	protected:
+		virtual void	Run();
+	public:
+						MaintenanceJob(ServerPool* pOwner, PooledConnection* pConnection, bool bKeepAlive);
+	};
+
+	/*
+	 * Results of article downloads from one server during the last minute,
+	 * collected in slots of a few seconds each.
+	 */
+	class ServerStats
+	{
+	public:
+		typedef struct
+		{
+			long long	iBytes;
+			long long	iLatency;
+			long long	iTransferTime;
+			int			iSuccess;
+			int			iNotFound;
+			int			iFailure;
+		} Slot;
+
+	private:
+		typedef std::deque<Slot>	Slots;
+
+		NewsServer*		m_pNewsServer;
+		Slots			m_Slots;
+		time_t			m_tDemotedUntil;
+	public:
+						ServerStats(NewsServer* pNewsServer);
+		NewsServer*		GetNewsServer() { return m_pNewsServer; }
+		void			AddArticle(EArticleResult eResult, int iBytes, int iLatency, int iTransferTime);
+		void			NextSlot();
+		void			Reset();
+		void			CalcTotals(Slot* pTotals);
+		time_t			GetDemotedUntil() { return m_tDemotedUntil; }
+		void			SetDemotedUntil(time_t tDemotedUntil) { m_tDemotedUntil = tDemotedUntil; }
 	};
 
 	typedef std::vector<int>				Levels;
 	typedef std::vector<PooledConnection*>	Connections;
+	typedef std::vector<ServerStats*>		ServerStatsList;
 
 	Servers				m_Servers;
 	Servers				m_SortedServers;
@@ -64,9 +129,21 @@ private:
 	Mutex			 	m_mutexConnections;
 	int					m_iTimeout;
 	int					m_iGeneration;
+	bool				m_bQueueActive;
+	int					m_iMaintenanceJobs;
+	bool				m_bMaintenanceStopped;
+	ThreadPool*			m_pThreadPool;
+	ServerStatsList		m_ServerStats;
+	Mutex				m_mutexStats;
+	time_t				m_tStatsSlotTime;
 
 	void				NormalizeLevels();
 	static bool			CompareServers(NewsServer* pServer1, NewsServer* pServer2);
+	void				WarmUpConnections();
+	void				StartMaintenance(PooledConnection* pConnection, bool bKeepAlive);
+	void				FinishMaintenance(PooledConnection* pConnection, bool bSuccess);
+	bool				HasAlternativeServer(NewsServer* pNewsServer);
+	void				DemoteServer(ServerStats* pStats, ServerStats::Slot* pTotals, time_t tCurTime);
 
 public:
 						ServerPool();
@@ -79,6 +156,21 @@ public:
 	NNTPConnection*		GetConnection(int iLevel, NewsServer* pWantServer, Servers* pIgnoreServers);
 	void 				FreeConnection(NNTPConnection* pConnection, bool bUsed);
 	void				CloseUnusedConnections();
+
+	/*
+	 * Closes unneeded and opens warm connections, must be called once per second.
+	 * While the queue has pending downloads idle connections are held longer.
+	 */
+	void				MaintainConnections(bool bQueueActive);
+	void				StopMaintenance();
+
+	/*
+	 * Article results are used to weight the choice of servers within a level.
+	 * UpdateServerStats recalculates the weights and must be called once per second.
+	 */
+	void				AddArticleResult(NewsServer* pNewsServer, EArticleResult eResult,
+							int iBytes, int iLatency, int iTransferTime);
+	void				UpdateServerStats();
 	void				Changed();
 	int					GetGeneration() { return m_iGeneration; }
 
@@ -46,6 +46,14 @@
 #include <time.h>
 #include <errno.h>
 #include <list>
+#if defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+#include <cpuid.h>
+#elif defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_X64))
+#include <intrin.h>
+#elif defined(__linux__) && defined(__aarch64__)
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#endif
 
 #ifdef WIN32
 #include "nzbget.h"
@@ -182,6 +190,49 @@ static void openssl_dynlock_lock(int mode, struct CRYPTO_dynlock_value *l, const
 #endif /* HAVE_OPENSSL */
 
 
+/*
+ * Without hardware support for AES the cipher ChaCha20-Poly1305 is
+ * much faster than AES-GCM.
+ */
+static bool g_bPreferChaCha20 = false;
+
+static bool HasAESAcceleration()
+{
+#if defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+	unsigned int eax, ebx, ecx, edx;
+	return __get_cpuid(1, &eax, &ebx, &ecx, &edx) && (ecx & bit_AES);
+#elif defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_X64))
+	int CPUInfo[4];
+	__cpuid(CPUInfo, 1);
+	return (CPUInfo[2] & (1 << 25)) != 0;
+#elif defined(__linux__) && defined(__aarch64__)
+	return (getauxval(AT_HWCAP) & HWCAP_AES) != 0;
+#else
+	return false;
+#endif
+}
+
+
+TLSSessionCache::TLSSessionCache()
+{
+	m_pSessionData = NULL;
+	m_iSessionSize = 0;
+}
+
+TLSSessionCache::~TLSSessionCache()
+{
+	if (m_pSessionData)
+	{
+#ifdef HAVE_LIBGNUTLS
+		free(m_pSessionData);
+#endif /* HAVE_LIBGNUTLS */
+#ifdef HAVE_OPENSSL
+		SSL_SESSION_free((SSL_SESSION*)m_pSessionData);
+#endif /* HAVE_OPENSSL */
+	}
+}
+
+
 void TLSSocket::Init()
 {
 	debug("Initializing TLS library");
@@ -230,6 +281,9 @@ void TLSSocket::Init()
 	CRYPTO_set_dynlock_lock_callback(openssl_dynlock_lock);
 	
 #endif /* HAVE_OPENSSL */
+
+	g_bPreferChaCha20 = !HasAESAcceleration();
+	debug("Hardware AES support: %s", g_bPreferChaCha20 ? "no" : "yes");
 }
 
 void TLSSocket::Final()
@@ -271,6 +325,7 @@ TLSSocket::TLSSocket(SOCKET iSocket, bool bIsClient, const char* szCertFile, con
 	m_bSuppressErrors = false;
 	m_bInitialized = false;
 	m_bConnected = false;
+	m_pSessionCache = NULL;
 }
 
 TLSSocket::~TLSSocket()
@@ -368,9 +423,15 @@ bool TLSSocket::Start()
 
 	m_bInitialized = true;
 
-	const char* szPriority = m_szCipher ? m_szCipher : "NORMAL";
+	const char* szPriority = m_szCipher ? m_szCipher :
+		g_bPreferChaCha20 ? "NORMAL:-CIPHER-ALL:+CHACHA20-POLY1305:+CIPHER-ALL" : "NORMAL";
 
 	m_iRetCode = gnutls_priority_set_direct((gnutls_session_t)m_pSession, szPriority, NULL);
+	if (m_iRetCode != 0 && !m_szCipher && g_bPreferChaCha20)
+	{
+		// older GnuTLS versions don't support ChaCha20
+		m_iRetCode = gnutls_priority_set_direct((gnutls_session_t)m_pSession, "NORMAL", NULL);
+	}
 	if (m_iRetCode != 0)
 	{
 		ReportError("Could not select cipher for TLS session");
@@ -389,6 +450,8 @@ bool TLSSocket::Start()
 
 	gnutls_transport_set_ptr((gnutls_session_t)m_pSession, (gnutls_transport_ptr_t)(size_t)m_iSocket);
 
+	LoadSession();
+
 	m_iRetCode = gnutls_handshake((gnutls_session_t)m_pSession);
 	if (m_iRetCode != 0)
 	{
@@ -398,6 +461,19 @@ bool TLSSocket::Start()
 	}
 
 	m_bConnected = true;
+
+	if (m_bIsClient && m_pSessionCache)
+	{
+		debug("TLS session %s", gnutls_session_is_resumed((gnutls_session_t)m_pSession) ? "resumed" : "established");
+#if GNUTLS_VERSION_NUMBER >= 0x030603
+		// in TLS 1.3 the session ticket is sent after the handshake, the session is saved on closing
+		if (gnutls_protocol_get_version((gnutls_session_t)m_pSession) != GNUTLS_TLS1_3)
+#endif
+		{
+			SaveSession();
+		}
+	}
+
 	return true;
 #endif /* HAVE_LIBGNUTLS */
 
@@ -441,6 +517,14 @@ bool TLSSocket::Start()
 		return false;
 	}
 
+	if (!m_szCipher && g_bPreferChaCha20)
+	{
+		SSL_set_cipher_list((SSL*)m_pSession, "CHACHA20:ALL:!COMPLEMENTOFDEFAULT:!eNULL");
+#if OPENSSL_VERSION_NUMBER >= 0x10101000L
+		SSL_set_ciphersuites((SSL*)m_pSession, "TLS_CHACHA20_POLY1305_SHA256:TLS_AES_256_GCM_SHA384:TLS_AES_128_GCM_SHA256");
+#endif
+	}
+
 	if (!SSL_set_fd((SSL*)m_pSession, m_iSocket))
 	{
 		ReportError("Could not set the file descriptor for TLS");
@@ -448,6 +532,8 @@ bool TLSSocket::Start()
 		return false;
 	}
 
+	LoadSession();
+
 	int error_code = m_bIsClient ? SSL_connect((SSL*)m_pSession) : SSL_accept((SSL*)m_pSession);
 	if (error_code < 1)
 	{
@@ -457,14 +543,97 @@ bool TLSSocket::Start()
 	}
 
 	m_bConnected = true;
+
+	if (m_bIsClient && m_pSessionCache)
+	{
+		debug("TLS session %s", SSL_session_reused((SSL*)m_pSession) ? "resumed" : "established");
+#ifdef TLS1_3_VERSION
+		// in TLS 1.3 the session ticket is sent after the handshake, the session is saved on closing
+		if (SSL_version((SSL*)m_pSession) != TLS1_3_VERSION)
+#endif
+		{
+			SaveSession();
+		}
+	}
+
 	return true;
 #endif /* HAVE_OPENSSL */
 }
 
+/*
+ * Passes the session saved in the cache to the new session.
+ */
+void TLSSocket::LoadSession()
+{
+	if (!m_bIsClient || !m_pSessionCache)
+	{
+		return;
+	}
+
+	m_pSessionCache->m_mutexSession.Lock();
+
+	if (m_pSessionCache->m_pSessionData)
+	{
+#ifdef HAVE_LIBGNUTLS
+		gnutls_session_set_data((gnutls_session_t)m_pSession, m_pSessionCache->m_pSessionData, m_pSessionCache->m_iSessionSize);
+#endif /* HAVE_LIBGNUTLS */
+#ifdef HAVE_OPENSSL
+		SSL_set_session((SSL*)m_pSession, (SSL_SESSION*)m_pSessionCache->m_pSessionData);
+#endif /* HAVE_OPENSSL */
+	}
+
+	m_pSessionCache->m_mutexSession.Unlock();
+}
+
+/*
+ * Stores the current session in the cache, replacing the previously saved session.
+ */
+void TLSSocket::SaveSession()
+{
+#ifdef HAVE_LIBGNUTLS
+	gnutls_datum_t SessionData;
+	if (gnutls_session_get_data2((gnutls_session_t)m_pSession, &SessionData) != 0)
+	{
+		return;
+	}
+
+	void* pSessionData = malloc(SessionData.size);
+	memcpy(pSessionData, SessionData.data, SessionData.size);
+	gnutls_free(SessionData.data);
+
+	m_pSessionCache->m_mutexSession.Lock();
+	free(m_pSessionCache->m_pSessionData);
+	m_pSessionCache->m_pSessionData = pSessionData;
+	m_pSessionCache->m_iSessionSize = SessionData.size;
+	m_pSessionCache->m_mutexSession.Unlock();
+#endif /* HAVE_LIBGNUTLS */
+
+#ifdef HAVE_OPENSSL
+	SSL_SESSION* pSessionData = SSL_get1_session((SSL*)m_pSession);
+	if (!pSessionData)
+	{
+		return;
+	}
+
+	m_pSessionCache->m_mutexSession.Lock();
+	if (m_pSessionCache->m_pSessionData)
+	{
+		SSL_SESSION_free((SSL_SESSION*)m_pSessionCache->m_pSessionData);
+	}
+	m_pSessionCache->m_pSessionData = pSessionData;
+	m_pSessionCache->m_mutexSession.Unlock();
+#endif /* HAVE_OPENSSL */
+}
+
 void TLSSocket::Close()
 {
 	if (m_pSession)
 	{
+		if (m_bConnected && m_bIsClient && m_pSessionCache)
+		{
+			SaveSession();
+		}
+
 #ifdef HAVE_LIBGNUTLS
 		if (m_bConnected)
 		{
@@ -534,7 +703,18 @@ int TLSSocket::Recv(char* pBuffer, int iSize)
 	int ret;
 
 #ifdef HAVE_LIBGNUTLS
-	ret = gnutls_record_recv((gnutls_session_t)m_pSession, pBuffer, iSize);
+	// GNUTLS_E_AGAIN is also returned after processing of post-handshake messages
+	// (such as TLS 1.3 session tickets); a real timeout of socket sets errno
+	for (int iRetry = 0; iRetry < 10; iRetry++)
+	{
+		errno = 0;
+		ret = gnutls_record_recv((gnutls_session_t)m_pSession, pBuffer, iSize);
+		if (!((ret == GNUTLS_E_AGAIN || ret == GNUTLS_E_INTERRUPTED) && errno != EAGAIN && errno != EWOULDBLOCK))
+		{
+			break;
+		}
+	}
+	m_iRetCode = ret;
 #endif /* HAVE_LIBGNUTLS */
 
 #ifdef HAVE_OPENSSL
@@ -27,6 +27,28 @@
 
 #ifndef DISABLE_TLS
 
+#include "Thread.h"
+
+/*
+ * Keeps the TLS session of a news server. New connections to the server
+ * resume the session (using session ticket or session id) instead of
+ * performing a full handshake.
+ */
+class TLSSessionCache
+{
+private:
+	Mutex				m_mutexSession;
+	// GnuTLS: serialized session data; OpenSSL: SSL_SESSION
+	void*				m_pSessionData;
+	int					m_iSessionSize;
+
+	friend class TLSSocket;
+
+public:
+						TLSSessionCache();
+						~TLSSessionCache();
+};
+
 class TLSSocket
 {
 private:
@@ -39,12 +61,15 @@ private:
 	int					m_iRetCode;
 	bool				m_bInitialized;
 	bool				m_bConnected;
+	TLSSessionCache*	m_pSessionCache;
 
 	// using "void*" to prevent the including of GnuTLS/OpenSSL header files into TLS.h
 	void*				m_pContext;
 	void*				m_pSession;
 
 	void				ReportError(const char* szErrMsg);
+	void				LoadSession();
+	void				SaveSession();
 
 public:
 						TLSSocket(SOCKET iSocket, bool bIsClient, const char* szCertFile, const char* szKeyFile, const char* szCipher);
@@ -56,6 +81,7 @@ public:
 	int					Send(const char* pBuffer, int iSize);
 	int					Recv(char* pBuffer, int iSize);
 	void				SetSuppressErrors(bool bSuppressErrors) { m_bSuppressErrors = bSuppressErrors; }
+	void				SetSessionCache(TLSSessionCache* pSessionCache) { m_pSessionCache = pSessionCache; }
 };
 
 #endif
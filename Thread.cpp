@@ -34,6 +34,7 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <errno.h>
 
 #ifdef WIN32
@@ -41,13 +42,37 @@
 #else
 #include <fcntl.h>
 #include <pthread.h>
+#include <sys/time.h>
+#include <unistd.h>
 #endif
 
+#include "nzbget.h"
 #include "Log.h"
 #include "Thread.h"
 
-int Thread::m_iThreadCount = 1; // take the main program thread into account
+AtomicCounter Thread::m_iThreadCount(1); // take the main program thread into account
 Mutex* Thread::m_pMutexThread;
+Mutex* ThreadPool::m_pMutexPools;
+ThreadPool::Pools* ThreadPool::m_pPools;
+
+// idle workers exit after this time (milliseconds)
+static const int POOL_IDLE_TIMEOUT = 60000;
+
+class PoolWorker : public Thread
+{
+private:
+	ThreadPool*		m_pOwner;
+	Thread*			m_pJob;
+	Event			m_eventWakeUp;
+
+	friend class ThreadPool;
+
+protected:
+	virtual void	Run();
+
+public:
+					PoolWorker(ThreadPool* pOwner, Thread* pJob);
+};
 
 
 Mutex::Mutex()
@@ -140,17 +165,138 @@ void SpinLock::Unlock()
 #endif
 
 
+#ifndef WIN32
+struct EventObj
+{
+	pthread_mutex_t			mutex;
+	pthread_cond_t			cond;
+	bool					bSignaled;
+};
+#endif
+
+Event::Event()
+{
+#ifdef WIN32
+	m_pEventObj = CreateEvent(NULL, FALSE, FALSE, NULL);
+#else
+	EventObj* pEventObj = (EventObj*)malloc(sizeof(EventObj));
+	pthread_mutex_init(&pEventObj->mutex, NULL);
+	pthread_cond_init(&pEventObj->cond, NULL);
+	pEventObj->bSignaled = false;
+	m_pEventObj = pEventObj;
+#endif
+}
+
+Event::~Event()
+{
+#ifdef WIN32
+	CloseHandle((HANDLE)m_pEventObj);
+#else
+	EventObj* pEventObj = (EventObj*)m_pEventObj;
+	pthread_cond_destroy(&pEventObj->cond);
+	pthread_mutex_destroy(&pEventObj->mutex);
+	free(pEventObj);
+#endif
+}
+
+void Event::Set()
+{
+#ifdef WIN32
+	SetEvent((HANDLE)m_pEventObj);
+#else
+	EventObj* pEventObj = (EventObj*)m_pEventObj;
+	pthread_mutex_lock(&pEventObj->mutex);
+	pEventObj->bSignaled = true;
+	pthread_cond_signal(&pEventObj->cond);
+	pthread_mutex_unlock(&pEventObj->mutex);
+#endif
+}
+
+bool Event::Wait(int iTimeoutMSec)
+{
+#ifdef WIN32
+	return WaitForSingleObject((HANDLE)m_pEventObj, iTimeoutMSec) == WAIT_OBJECT_0;
+#else
+	EventObj* pEventObj = (EventObj*)m_pEventObj;
+
+	struct timeval now;
+	gettimeofday(&now, NULL);
+	long long lNSec = (long long)now.tv_usec * 1000 + (long long)iTimeoutMSec * 1000000;
+	struct timespec abstime;
+	abstime.tv_sec = now.tv_sec + (time_t)(lNSec / 1000000000);
+	abstime.tv_nsec = (long)(lNSec % 1000000000);
+
+	pthread_mutex_lock(&pEventObj->mutex);
+	while (!pEventObj->bSignaled)
+	{
+		if (pthread_cond_timedwait(&pEventObj->cond, &pEventObj->mutex, &abstime) == ETIMEDOUT)
+		{
+			break;
+		}
+	}
+	bool bSignaled = pEventObj->bSignaled;
+	pEventObj->bSignaled = false;
+	pthread_mutex_unlock(&pEventObj->mutex);
+
+	return bSignaled;
+#endif
+}
+
+
+AtomicCounter::AtomicCounter(int iValue)
+{
+	m_iValue = iValue;
+}
+
+int AtomicCounter::Add(int iDelta)
+{
+#ifdef WIN32
+	return InterlockedExchangeAdd(&m_iValue, iDelta) + iDelta;
+#elif defined(HAVE_ATOMIC_BUILTINS)
+	return __sync_add_and_fetch(&m_iValue, iDelta);
+#else
+	m_mutexValue.Lock();
+	m_iValue += iDelta;
+	int iValue = m_iValue;
+	m_mutexValue.Unlock();
+	return iValue;
+#endif
+}
+
+int AtomicCounter::Exchange(int iValue)
+{
+#ifdef WIN32
+	return InterlockedExchange(&m_iValue, iValue);
+#elif defined(HAVE_ATOMIC_BUILTINS)
+	int iOldValue = m_iValue;
+	while (!__sync_bool_compare_and_swap(&m_iValue, iOldValue, iValue))
+	{
+		iOldValue = m_iValue;
+	}
+	return iOldValue;
+#else
+	m_mutexValue.Lock();
+	int iOldValue = m_iValue;
+	m_iValue = iValue;
+	m_mutexValue.Unlock();
+	return iOldValue;
+#endif
+}
+
+
 void Thread::Init()
 {
 	debug("Initializing global thread data");
 
 	m_pMutexThread = new Mutex();
+	ThreadPool::Init();
 }
 
 void Thread::Final()
 {
 	debug("Finalizing global thread data");
 
+	ThreadPool::Final();
 	delete m_pMutexThread;
 }
 
@@ -167,6 +313,7 @@ Thread::Thread()
 	m_bRunning = false;
 	m_bStopped = false;
 	m_bAutoDestroy = false;
+	m_pThreadPool = NULL;
 }
 
 Thread::~Thread()
@@ -182,6 +329,12 @@ void Thread::Start()
 	debug("Starting Thread");
 
 	m_bRunning = true;
+
+	if (m_pThreadPool)
+	{
+		m_pThreadPool->Start(this);
+		return;
+	}
 	
 	// NOTE: we must guarantee, that in a time we set m_bRunning
 	// to value returned from pthread_create, the thread-object still exists.
@@ -219,6 +372,11 @@ bool Thread::Kill()
 {
 	debug("Killing Thread");
 
+	if (m_pThreadPool)
+	{
+		return m_pThreadPool->Kill(this);
+	}
+
 	m_pMutexThread->Lock();
 
 #ifdef WIN32
@@ -227,11 +385,12 @@ bool Thread::Kill()
 	bool terminated = pthread_cancel(*(pthread_t*)m_pThreadObj) == 0;
 #endif
 
+	m_pMutexThread->Unlock();
+
 	if (terminated)
 	{
-		m_iThreadCount--;
+		m_iThreadCount.Add(-1);
 	}
-	m_pMutexThread->Unlock();
 	return terminated;
 }
 
@@ -241,13 +400,24 @@ void __cdecl Thread::thread_handler(void* pObject)
 void* Thread::thread_handler(void* pObject)
 #endif
 {
+	// wait until Start() has finished (see note in Start())
 	m_pMutexThread->Lock();
-	m_iThreadCount++;
 	m_pMutexThread->Unlock();
 
-	debug("Entering Thread-func");
+	m_iThreadCount.Add(1);
 
-	Thread* pThread = (Thread*)pObject;
+	ExecuteThread((Thread*)pObject);
+
+	m_iThreadCount.Add(-1);
+
+#ifndef WIN32
+	return NULL;
+#endif
+}
+
+void Thread::ExecuteThread(Thread* pThread)
+{
+	debug("Entering Thread-func");
 
 	pThread->Run();
 
@@ -260,20 +430,318 @@ void* Thread::thread_handler(void* pObject)
 		debug("Autodestroying Thread-object");
 		delete pThread;
 	}
+}
 
-	m_pMutexThread->Lock();
-	m_iThreadCount--;
-	m_pMutexThread->Unlock();
+int Thread::GetThreadCount()
+{
+	return m_iThreadCount.Get();
+}
 
-#ifndef WIN32
-	return NULL;
-#endif
+
+PoolWorker::PoolWorker(ThreadPool* pOwner, Thread* pJob)
+{
+	m_pOwner = pOwner;
+	m_pJob = pJob;
+	SetAutoDestroy(true);
 }
 
-int Thread::GetThreadCount()
+void PoolWorker::Run()
 {
-	m_pMutexThread->Lock();
-	int iThreadCount = m_iThreadCount;
-	m_pMutexThread->Unlock();
-	return iThreadCount;
+	while (m_pJob)
+	{
+		Thread::ExecuteThread(m_pJob);
+		m_pOwner->WaitJob(this);
+	}
+}
+
+
+void ThreadPool::Init()
+{
+	m_pMutexPools = new Mutex();
+	m_pPools = new Pools();
+}
+
+/*
+ * Stops idle workers of all pools and waits (max. 1 second) for busy workers
+ * to complete. Pools with still running workers are not destroyed because
+ * the workers continue to use them.
+ */
+void ThreadPool::Final()
+{
+	for (Pools::iterator it = m_pPools->begin(); it != m_pPools->end(); it++)
+	{
+		(*it)->Stop();
+	}
+
+	for (int iWait = 0; iWait < 100 && !m_pPools->empty(); iWait++)
+	{
+		for (Pools::iterator it = m_pPools->begin(); it != m_pPools->end(); )
+		{
+			ThreadPool* pPool = *it;
+			if (pPool->GetWorkerCount() == 0)
+			{
+				delete pPool;
+				m_pPools->erase(it);
+				it = m_pPools->begin();
+				continue;
+			}
+			it++;
+		}
+		if (!m_pPools->empty())
+		{
+			usleep(10 * 1000);
+		}
+	}
+
+	for (Pools::iterator it = m_pPools->begin(); it != m_pPools->end(); it++)
+	{
+		debug("Thread pool %s has running workers", (*it)->GetName());
+	}
+
+	delete m_pPools;
+	delete m_pMutexPools;
+}
+
+ThreadPool* ThreadPool::GetPool(const char* szName)
+{
+	m_pMutexPools->Lock();
+
+	ThreadPool* pPool = NULL;
+	for (Pools::iterator it = m_pPools->begin(); it != m_pPools->end(); it++)
+	{
+		if (!strcmp((*it)->GetName(), szName))
+		{
+			pPool = *it;
+			break;
+		}
+	}
+
+	if (!pPool)
+	{
+		pPool = new ThreadPool(szName);
+		m_pPools->push_back(pPool);
+	}
+
+	m_pMutexPools->Unlock();
+
+	return pPool;
+}
+
+ThreadPool::ThreadPool(const char* szName)
+{
+	debug("Creating ThreadPool %s", szName);
+
+	m_szName = strdup(szName);
+	m_iMaxWorkers = 1;
+	m_iWorkerCount = 0;
+	m_bStopped = false;
+}
+
+ThreadPool::~ThreadPool()
+{
+	debug("Destroying ThreadPool %s", m_szName);
+
+	free(m_szName);
+}
+
+void ThreadPool::SetMaxWorkers(int iMaxWorkers)
+{
+	m_mutexPool.Lock();
+
+	m_iMaxWorkers = iMaxWorkers;
+
+	// start workers for queued jobs if the limit was increased
+	while (!m_Jobs.empty() && m_iWorkerCount < m_iMaxWorkers)
+	{
+		Thread* pJob = m_Jobs.front();
+		m_Jobs.pop_front();
+		StartWorker(pJob);
+	}
+
+	m_mutexPool.Unlock();
+}
+
+int ThreadPool::GetWorkerCount()
+{
+	m_mutexPool.Lock();
+	int iWorkerCount = m_iWorkerCount;
+	m_mutexPool.Unlock();
+	return iWorkerCount;
+}
+
+void ThreadPool::Start(Thread* pJob)
+{
+	m_mutexPool.Lock();
+
+	if (!m_IdleWorkers.empty())
+	{
+		// the most recently used worker is preferred, other workers can expire
+		PoolWorker* pWorker = m_IdleWorkers.back();
+		m_IdleWorkers.pop_back();
+		m_BusyWorkers.push_back(pWorker);
+		pWorker->m_pJob = pJob;
+		pWorker->m_eventWakeUp.Set();
+	}
+	else if (m_iWorkerCount < m_iMaxWorkers)
+	{
+		StartWorker(pJob);
+	}
+	else
+	{
+		debug("All workers of thread pool %s are busy, queueing job", m_szName);
+		m_Jobs.push_back(pJob);
+	}
+
+	m_mutexPool.Unlock();
+}
+
+/*
+ * NOTE: the pool must be locked prior to call of this function
+ */
+bool ThreadPool::StartWorker(Thread* pJob)
+{
+	PoolWorker* pWorker = new PoolWorker(this, pJob);
+	m_BusyWorkers.push_back(pWorker);
+	m_iWorkerCount++;
+
+	pWorker->Start();
+
+	if (!pWorker->IsRunning())
+	{
+		error("Could not start worker thread for thread pool %s", m_szName);
+		m_BusyWorkers.pop_back();
+		m_iWorkerCount--;
+		delete pWorker;
+		pJob->m_bRunning = false;
+		return false;
+	}
+
+	return true;
+}
+
+/*
+ * Called by worker after completing of a job. Assigns the next job from
+ * the queue or waits until a new job is started. If no job is assigned the
+ * worker leaves the pool.
+ */
+void ThreadPool::WaitJob(PoolWorker* pWorker)
+{
+	m_mutexPool.Lock();
+
+	pWorker->m_pJob = NULL;
+
+	Workers::iterator it = m_BusyWorkers.begin();
+	while (it != m_BusyWorkers.end() && *it != pWorker)
+	{
+		it++;
+	}
+	if (it == m_BusyWorkers.end())
+	{
+		// the worker was detached from the pool in Kill()
+		m_mutexPool.Unlock();
+		return;
+	}
+
+	if (!m_Jobs.empty() && !m_bStopped)
+	{
+		pWorker->m_pJob = m_Jobs.front();
+		m_Jobs.pop_front();
+		m_mutexPool.Unlock();
+		return;
+	}
+
+	m_BusyWorkers.erase(it);
+	m_IdleWorkers.push_back(pWorker);
+
+	bool bSignaled = true;
+	while (!pWorker->m_pJob && !m_bStopped && bSignaled)
+	{
+		m_mutexPool.Unlock();
+		bSignaled = pWorker->m_eventWakeUp.Wait(POOL_IDLE_TIMEOUT);
+		m_mutexPool.Lock();
+	}
+
+	if (!pWorker->m_pJob)
+	{
+		for (Workers::iterator it2 = m_IdleWorkers.begin(); it2 != m_IdleWorkers.end(); it2++)
+		{
+			if (*it2 == pWorker)
+			{
+				m_IdleWorkers.erase(it2);
+				break;
+			}
+		}
+		m_iWorkerCount--;
+	}
+
+	m_mutexPool.Unlock();
+}
+
+/*
+ * Removes a queued job or terminates the worker executing the job.
+ * The terminated worker is detached from the pool; its object is not deleted
+ * because its state is unknown.
+ */
+bool ThreadPool::Kill(Thread* pJob)
+{
+	m_mutexPool.Lock();
+
+	for (Jobs::iterator it = m_Jobs.begin(); it != m_Jobs.end(); it++)
+	{
+		if (*it == pJob)
+		{
+			m_Jobs.erase(it);
+			pJob->m_bRunning = false;
+			m_mutexPool.Unlock();
+			return true;
+		}
+	}
+
+	bool bTerminated = false;
+	for (Workers::iterator it = m_BusyWorkers.begin(); it != m_BusyWorkers.end(); it++)
+	{
+		PoolWorker* pWorker = *it;
+		if (pWorker->m_pJob == pJob)
+		{
+			m_BusyWorkers.erase(it);
+			m_iWorkerCount--;
+			bTerminated = pWorker->Kill();
+			break;
+		}
+	}
+
+	m_mutexPool.Unlock();
+
+	return bTerminated;
+}
+
+bool ThreadPool::WaitJobs(int iTimeoutMSec)
+{
+	while (true)
+	{
+		m_mutexPool.Lock();
+		bool bCompleted = m_BusyWorkers.empty() && m_Jobs.empty();
+		m_mutexPool.Unlock();
+
+		if (bCompleted || iTimeoutMSec <= 0)
+		{
+			return bCompleted;
+		}
+
+		usleep(10 * 1000);
+		iTimeoutMSec -= 10;
+	}
+}
+
+void ThreadPool::Stop()
+{
+	m_mutexPool.Lock();
+
+	m_bStopped = true;
+	for (Workers::iterator it = m_IdleWorkers.begin(); it != m_IdleWorkers.end(); it++)
+	{
+		(*it)->m_eventWakeUp.Set();
+	}
+
+	m_mutexPool.Unlock();
 }
@@ -27,6 +27,8 @@
 #ifndef THREAD_H
 #define THREAD_H
 
+#include <deque>
+
 class Mutex
 {
 private:
@@ -57,21 +59,80 @@ public:
 };
 #endif
 
+/*
+ * Event object for waking up of a waiting thread.
+ * The event is reset automatically when the waiting thread is released.
+ */
+class Event
+{
+private:
+	void*					m_pEventObj;
+
+public:
+							Event();
+							~Event();
+	void					Set();
+
+	/*
+	 * Waits until the event is set or the timeout (milliseconds) expires.
+	 * Returns true if the event was set.
+	 */
+	bool					Wait(int iTimeoutMSec);
+};
+
+/*
+ * Integer counter which can be modified by many threads without locking.
+ * If the platform doesn't provide atomic operations a mutex is used.
+ */
+class AtomicCounter
+{
+private:
+#ifdef WIN32
+	volatile long			m_iValue;
+#else
+	volatile int			m_iValue;
+#ifndef HAVE_ATOMIC_BUILTINS
+	Mutex					m_mutexValue;
+#endif
+#endif
+
+public:
+							AtomicCounter(int iValue = 0);
+
+	/*
+	 * Adds the value and returns the new value of the counter.
+	 */
+	int						Add(int iDelta);
+	int						Get() { return Add(0); }
+
+	/*
+	 * Sets the new value and returns the old value of the counter.
+	 */
+	int						Exchange(int iValue);
+};
+
+class ThreadPool;
+
 class Thread
 {
 private:
 	static Mutex*			m_pMutexThread;
-	static int				m_iThreadCount;
+	static AtomicCounter	m_iThreadCount;
 	void*	 				m_pThreadObj;
 	bool 					m_bRunning;
 	bool					m_bStopped;
 	bool					m_bAutoDestroy;
+	ThreadPool*				m_pThreadPool;
 
 #ifdef WIN32
 	static void __cdecl 	thread_handler(void* pObject);
 #else
 	static void				*thread_handler(void* pObject);
 #endif
+	static void				ExecuteThread(Thread* pThread);
+
+	friend class ThreadPool;
+	friend class PoolWorker;
 
 public:
 							Thread();
@@ -88,10 +149,70 @@ public:
 	void 					SetRunning(bool bOnOff) { m_bRunning = bOnOff; }
 	bool					GetAutoDestroy() { return m_bAutoDestroy; }
 	void					SetAutoDestroy(bool bAutoDestroy) { m_bAutoDestroy = bAutoDestroy; }
+	ThreadPool*				GetThreadPool() { return m_pThreadPool; }
+	void					SetThreadPool(ThreadPool* pThreadPool) { m_pThreadPool = pThreadPool; }
 	static int				GetThreadCount();
 
 protected:
 	virtual void 			Run() {}; // Virtual function - override in derivatives
 };
 
+class PoolWorker;
+
+/*
+ * Named group of worker threads for short-lived jobs.
+ * A Thread-object assigned to a pool (see Thread::SetThreadPool) doesn't
+ * create a new system thread on Start() but is executed by an idle worker
+ * of the pool. The number of workers is limited; jobs started when all
+ * workers are busy wait in the queue. Workers idle for too long exit.
+ */
+class ThreadPool
+{
+private:
+	typedef std::deque<ThreadPool*>	Pools;
+	typedef std::deque<PoolWorker*>	Workers;
+	typedef std::deque<Thread*>		Jobs;
+
+	static Mutex*			m_pMutexPools;
+	static Pools*			m_pPools;
+	char*					m_szName;
+	int						m_iMaxWorkers;
+	int						m_iWorkerCount;
+	Workers					m_BusyWorkers;
+	Workers					m_IdleWorkers;
+	Jobs					m_Jobs;
+	Mutex					m_mutexPool;
+	bool					m_bStopped;
+
+	bool					StartWorker(Thread* pJob);
+	void					WaitJob(PoolWorker* pWorker);
+	void					Stop();
+
+	friend class PoolWorker;
+
+public:
+							ThreadPool(const char* szName);
+							~ThreadPool();
+	static void				Init();
+	static void				Final();
+
+	/*
+	 * Returns the pool with the given name, the pool is created on first request.
+	 * Pools exist until the program exits.
+	 */
+	static ThreadPool*		GetPool(const char* szName);
+
+	const char*				GetName() { return m_szName; }
+	void					SetMaxWorkers(int iMaxWorkers);
+	int						GetWorkerCount();
+	void					Start(Thread* pJob);
+	bool					Kill(Thread* pJob);
+
+	/*
+	 * Waits until all started and queued jobs are completed.
+	 * Returns false if the jobs are still running after the timeout.
+	 */
+	bool					WaitJobs(int iTimeoutMSec);
+};
+
 #endif
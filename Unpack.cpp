@@ -100,6 +100,7 @@ void UnpackController::Run()
 	m_szName[1024-1] = '\0';
 
 	m_bCleanedUpDisk = false;
+	m_bProgressPrinted = false;
 	m_szPassword[0] = '\0';
 	m_szFinalDir[0] = '\0';
 	
@@ -121,6 +122,8 @@ void UnpackController::Run()
 	snprintf(m_szInfoNameUp, 1024, "Unpack for %s", m_szName); // first letter in upper case
 	m_szInfoNameUp[1024-1] = '\0';
 
+	WaitDirectUnpack();
+
 	CheckStateFiles();
 
 #ifndef DISABLE_PARCHECK
@@ -153,7 +156,11 @@ void UnpackController::Run()
 		m_bUnpackOK = true;
 		m_bUnpackStartError = false;
 
-		if (m_bHasRarFiles || m_bHasNonStdRarFiles)
+		if (m_bHasRarFiles && !m_bHasNonStdRarFiles && CheckDirectUnpack())
+		{
+			PrintMessage(Message::mkInfo, "Using files unpacked during download");
+		}
+		else if (m_bHasRarFiles || m_bHasNonStdRarFiles)
 		{
 			ExecuteUnrar();
 		}
@@ -335,6 +342,97 @@ void UnpackController::CheckStateFiles()
 	m_bHasParFiles = ParCoordinator::FindMainPars(m_szDestDir, NULL);
 }
 
+/*
+ * Waits until the direct unpack (if active) is finished.
+ */
+void UnpackController::WaitDirectUnpack()
+{
+	bool bWaitMessage = false;
+	while (!IsStopped())
+	{
+		g_pDownloadQueueHolder->LockQueue();
+		bool bRunning = m_pPostInfo->GetNZBInfo()->GetDirectUnpackStatus() == NZBInfo::dsRunning;
+		g_pDownloadQueueHolder->UnlockQueue();
+
+		if (!bRunning)
+		{
+			break;
+		}
+
+		if (!bWaitMessage)
+		{
+			PrintMessage(Message::mkInfo, "Waiting for direct unpack of %s", m_szName);
+			SetProgressLabel("Waiting for direct unpack");
+			bWaitMessage = true;
+		}
+
+		usleep(200 * 1000);
+	}
+
+	if (bWaitMessage)
+	{
+		SetProgressLabel("");
+	}
+}
+
+/*
+ * Checks if the rar-archive was successfully unpacked during download.
+ * The result of direct unpack can be used only if the directory contains
+ * only one rar-set. Damaged volumes (which need par-repair) make unrar fail
+ * during direct unpack, in this case the normal unpack is used.
+ * If the result can be used the list of archive files is filled for cleanup.
+ */
+bool UnpackController::CheckDirectUnpack()
+{
+	g_pDownloadQueueHolder->LockQueue();
+	NZBInfo* pNZBInfo = m_pPostInfo->GetNZBInfo();
+	bool bDirectOK = pNZBInfo->GetDirectUnpackStatus() == NZBInfo::dsSuccess;
+	// the result is used only once, the next unpack attempt (if any) must start unrar
+	pNZBInfo->SetDirectUnpackStatus(NZBInfo::dsNone);
+	g_pDownloadQueueHolder->UnlockQueue();
+
+	if (!bDirectOK || Util::DirEmpty(m_szUnpackDir))
+	{
+		return false;
+	}
+
+	RegEx regExRar(".*\\.rar$");
+	RegEx regExRarMultiSeq(".*\\.(r|s)[0-9][0-9]$");
+
+	int iFirstVolumes = 0;
+	FileList archiveFiles;
+
+	DirBrowser dir(m_szDestDir);
+	while (const char* filename = dir.Next())
+	{
+		if (regExRar.Match(filename) || regExRarMultiSeq.Match(filename))
+		{
+			archiveFiles.push_back(strdup(filename));
+			if (DirectUnpack::IsFirstVolume(filename))
+			{
+				iFirstVolumes++;
+			}
+		}
+	}
+
+	if (iFirstVolumes != 1)
+	{
+		archiveFiles.Clear();
+		return false;
+	}
+
+	for (FileList::iterator it = archiveFiles.begin(); it != archiveFiles.end(); it++)
+	{
+		m_archiveFiles.push_back(*it);
+	}
+	archiveFiles.clear();
+
+	m_bAllOKMessageReceived = true;
+	m_eUnpacker = upUnrar;
+
+	return true;
+}
+
 void UnpackController::CreateUnpackDir()
 {
 	m_bInterDir = strlen(g_pOptions->GetInterDir()) > 0 &&
@@ -524,62 +622,52 @@ bool UnpackController::Cleanup()
  * In order to print progress continuously we analyze the output after every char
  * and update post-job progress information.
  */
-bool UnpackController::ReadLine(char* szBuf, int iBufSize, FILE* pStream)
+bool UnpackController::IsLineEnd(char* szBuf, int iLen)
 {
-	bool bPrinted = false;
-
-	int i = 0;
-
-	for (; i < iBufSize - 1; i++)
+	if (szBuf[iLen - 1] == '\n')
 	{
-		int ch = fgetc(pStream);
-		szBuf[i] = ch;
-		szBuf[i+1] = '\0';
-		if (ch == EOF)
-		{
-			break;
-		}
-		if (ch == '\n')
-		{
-			i++;
-			break;
-		}
+		return true;
+	}
 
-		char* szBackspace = strrchr(szBuf, '\b');
-		if (szBackspace)
+	char* szBackspace = strrchr(szBuf, '\b');
+	if (szBackspace)
+	{
+		if (!m_bProgressPrinted)
 		{
-			if (!bPrinted)
+			char tmp[1024];
+			strncpy(tmp, szBuf, 1024);
+			tmp[1024-1] = '\0';
+			char* szTmpPercent = strrchr(tmp, '\b');
+			if (szTmpPercent)
 			{
-				char tmp[1024];
-				strncpy(tmp, szBuf, 1024);
-				tmp[1024-1] = '\0';
-				char* szTmpPercent = strrchr(tmp, '\b');
-				if (szTmpPercent)
-				{
-					*szTmpPercent = '\0';
-				}
-				if (strncmp(szBuf, "...", 3))
-				{
-					ProcessOutput(tmp);
-				}
-				bPrinted = true;
+				*szTmpPercent = '\0';
 			}
-			if (strchr(szBackspace, '%'))
+			if (strncmp(szBuf, "...", 3))
 			{
-				int iPercent = atoi(szBackspace + 1);
-				m_pPostInfo->SetStageProgress(iPercent * 10);
+				ProcessOutput(tmp);
 			}
+			m_bProgressPrinted = true;
+		}
+		if (strchr(szBackspace, '%'))
+		{
+			int iPercent = atoi(szBackspace + 1);
+			m_pPostInfo->SetStageProgress(iPercent * 10);
 		}
 	}
 
-	szBuf[i] = '\0';
+	return false;
+}
 
-	if (bPrinted)
+void UnpackController::ProcessLine(char* szLine)
+{
+	if (m_bProgressPrinted)
 	{
-		szBuf[0] = '\0';
+		// the line was already printed before the progress information
+		m_bProgressPrinted = false;
+		return;
 	}
 
-	return i > 0;
+	ScriptController::ProcessLine(szLine);
 }
 
 void UnpackController::AddMessage(Message::EKind eKind, const char* szText)
@@ -643,6 +731,389 @@ void UnpackController::SetProgressLabel(const char* szProgressLabel)
 }
 
 
+
+/*
+ * Checks if the file is the first volume of a rar-archive:
+ * "name.part01.rar" (also "part1", "part001") or "name.rar" for
+ * old-style naming (name.rar, name.r00, name.r01, ...).
+ */
+bool DirectUnpack::IsFirstVolume(const char* szFilename)
+{
+	int iLen = strlen(szFilename);
+	if (iLen < 4 || strcasecmp(szFilename + iLen - 4, ".rar"))
+	{
+		return false;
+	}
+
+	// find ".partNN" before the extension
+	const char* p = szFilename + iLen - 4;
+	const char* szDigits = p;
+	while (szDigits > szFilename && isdigit(szDigits[-1]))
+	{
+		szDigits--;
+	}
+	if (szDigits == p || szDigits - szFilename < 5 || strncasecmp(szDigits - 5, ".part", 5))
+	{
+		return true;
+	}
+
+	return atoi(szDigits) == 1;
+}
+
+void DirectUnpack::BuildUnpackDir(NZBInfo* pNZBInfo, char* szBuffer, int iBufSize)
+{
+	// must be the same directory as used by UnpackController
+	bool bInterDir = strlen(g_pOptions->GetInterDir()) > 0 &&
+		!strncmp(pNZBInfo->GetDestDir(), g_pOptions->GetInterDir(), strlen(g_pOptions->GetInterDir()));
+	if (bInterDir)
+	{
+		char szFinalDir[1024];
+		pNZBInfo->BuildFinalDirName(szFinalDir, 1024);
+		szFinalDir[1024-1] = '\0';
+		snprintf(szBuffer, iBufSize, "%s%c%s", szFinalDir, PATH_SEPARATOR, "_unpack");
+	}
+	else
+	{
+		snprintf(szBuffer, iBufSize, "%s%c%s", pNZBInfo->GetDestDir(), PATH_SEPARATOR, "_unpack");
+	}
+	szBuffer[iBufSize-1] = '\0';
+}
+
+/*
+ * Called by PrePostProcessor when a file is downloaded.
+ * The names of downloaded files are taken from the list of completed files
+ * of the nzb, which has the names the files were saved under on disk.
+ * The download queue must be locked.
+ */
+void DirectUnpack::FileDownloaded(NZBInfo* pNZBInfo)
+{
+	DirectUnpack* pDirectUnpack = (DirectUnpack*)pNZBInfo->GetDirectUnpackThread();
+	if (pDirectUnpack)
+	{
+		// unrar may wait for this volume
+		pDirectUnpack->m_mutexVolume.Lock();
+		pDirectUnpack->UpdateDownloadedFiles(pNZBInfo);
+		pDirectUnpack->CheckNextVolume();
+		pDirectUnpack->m_mutexVolume.Unlock();
+		return;
+	}
+
+	if (!g_pOptions->GetUnpack() || !g_pOptions->GetDirectUnpack() ||
+		pNZBInfo->GetDirectUnpackStatus() != NZBInfo::dsNone)
+	{
+		return;
+	}
+
+	NZBParameter* pParameter = pNZBInfo->GetParameters()->Find("*Unpack:", false);
+	if (pParameter && !strcasecmp(pParameter->GetValue(), "no"))
+	{
+		return;
+	}
+
+	const char* szArchiveName = NULL;
+	for (NZBInfo::Files::iterator it = pNZBInfo->GetCompletedFiles()->begin(); it != pNZBInfo->GetCompletedFiles()->end(); it++)
+	{
+		const char* szFilename = Util::BaseFileName(*it);
+		if (IsFirstVolume(szFilename))
+		{
+			szArchiveName = szFilename;
+			break;
+		}
+	}
+
+	if (!szArchiveName)
+	{
+		return;
+	}
+
+	pDirectUnpack = new DirectUnpack();
+	pDirectUnpack->m_pNZBInfo = pNZBInfo;
+	pDirectUnpack->m_bDownloadCompleted = false;
+	pDirectUnpack->m_bAllOKMessageReceived = false;
+	pDirectUnpack->m_bWaitingVolume = false;
+	pDirectUnpack->m_szNextVolume[0] = '\0';
+	pDirectUnpack->UpdateDownloadedFiles(pNZBInfo);
+
+	strncpy(pDirectUnpack->m_szName, pNZBInfo->GetName(), 1024);
+	pDirectUnpack->m_szName[1024-1] = '\0';
+	strncpy(pDirectUnpack->m_szDestDir, pNZBInfo->GetDestDir(), 1024);
+	pDirectUnpack->m_szDestDir[1024-1] = '\0';
+	strncpy(pDirectUnpack->m_szArchiveName, szArchiveName, 1024);
+	pDirectUnpack->m_szArchiveName[1024-1] = '\0';
+	BuildUnpackDir(pNZBInfo, pDirectUnpack->m_szUnpackDir, 1024);
+
+	pDirectUnpack->m_szPassword[0] = '\0';
+	pParameter = pNZBInfo->GetParameters()->Find("*Unpack:Password", false);
+	if (pParameter)
+	{
+		strncpy(pDirectUnpack->m_szPassword, pParameter->GetValue(), 1024-1);
+		pDirectUnpack->m_szPassword[1024-1] = '\0';
+	}
+
+	pNZBInfo->AddReference();
+	pNZBInfo->SetDirectUnpackStatus(NZBInfo::dsRunning);
+	pNZBInfo->SetDirectUnpackThread(pDirectUnpack);
+
+	pDirectUnpack->SetAutoDestroy(true);
+	pDirectUnpack->Start();
+}
+
+/*
+ * Called by PrePostProcessor when all files of the nzb are downloaded.
+ * If unrar waits for a volume which wasn't downloaded it must not wait any longer.
+ * The download queue must be locked.
+ */
+void DirectUnpack::NZBDownloaded(NZBInfo* pNZBInfo)
+{
+	DirectUnpack* pDirectUnpack = (DirectUnpack*)pNZBInfo->GetDirectUnpackThread();
+	if (pDirectUnpack)
+	{
+		pDirectUnpack->m_mutexVolume.Lock();
+		pDirectUnpack->m_bDownloadCompleted = true;
+		pDirectUnpack->UpdateDownloadedFiles(pNZBInfo);
+		pDirectUnpack->CheckNextVolume();
+		pDirectUnpack->m_mutexVolume.Unlock();
+	}
+}
+
+/*
+ * Stops direct unpack if it's running, for example if the nzb was deleted.
+ * The download queue must be locked.
+ */
+void DirectUnpack::Cancel(NZBInfo* pNZBInfo)
+{
+	DirectUnpack* pDirectUnpack = (DirectUnpack*)pNZBInfo->GetDirectUnpackThread();
+	if (pDirectUnpack)
+	{
+		pDirectUnpack->Stop();
+	}
+}
+
+DirectUnpack::~DirectUnpack()
+{
+	for (FileList::iterator it = m_DownloadedFiles.begin(); it != m_DownloadedFiles.end(); it++)
+	{
+		free(*it);
+	}
+}
+
+void DirectUnpack::Run()
+{
+	snprintf(m_szInfoName, 1024, "direct unpack for %s", m_szName);
+	m_szInfoName[1024-1] = '\0';
+
+	SetInfoName(m_szInfoName);
+	SetWorkingDir(m_szDestDir);
+
+	PrintMessage(Message::mkInfo, "Unpacking %s during download", m_szName);
+
+	char szErrBuf[1024];
+	if (!Util::ForceDirectories(m_szUnpackDir, szErrBuf, sizeof(szErrBuf)))
+	{
+		PrintMessage(Message::mkError, "Could not create directory %s: %s", m_szUnpackDir, szErrBuf);
+	}
+	else if (!IsStopped())
+	{
+		ExecuteUnrar();
+	}
+
+	bool bOK = m_bAllOKMessageReceived && !GetTerminated() && !IsStopped();
+
+	if (bOK)
+	{
+		PrintMessage(Message::mkInfo, "Direct unpack for %s successful", m_szName);
+	}
+	else
+	{
+		PrintMessage(Message::mkWarning, "Direct unpack for %s failed, the files will be unpacked after download", m_szName);
+		Util::DeleteDirectoryWithContent(m_szUnpackDir);
+	}
+
+	g_pDownloadQueueHolder->LockQueue();
+	m_pNZBInfo->SetDirectUnpackStatus(bOK ? NZBInfo::dsSuccess : NZBInfo::dsFailure);
+	m_pNZBInfo->SetDirectUnpackThread(NULL);
+	m_pNZBInfo->Release();
+	g_pDownloadQueueHolder->UnlockQueue();
+}
+
+void DirectUnpack::Stop()
+{
+	debug("Stopping direct unpack");
+	Thread::Stop();
+	Terminate();
+}
+
+void DirectUnpack::ExecuteUnrar()
+{
+	// Format: 
+	//   unrar x -y -p- -o+ -vp name.part01.rar ./_unpack
+	// Option "-vp" makes unrar to ask before processing of each next volume.
+
+	char szPasswordParam[1024];
+	const char* szArgs[9];
+	szArgs[0] = g_pOptions->GetUnrarCmd();
+	szArgs[1] = "x";
+	szArgs[2] = "-y";
+	szArgs[3] = "-p-";
+	if (strlen(m_szPassword) > 0)
+	{
+		snprintf(szPasswordParam, 1024, "-p%s", m_szPassword);
+		szArgs[3] = szPasswordParam;
+	}
+	szArgs[4] = "-o+";
+	szArgs[5] = "-vp";
+	szArgs[6] = m_szArchiveName;
+	szArgs[7] = m_szUnpackDir;
+	szArgs[8] = NULL;
+	SetArgs(szArgs, false);
+
+	SetScript(g_pOptions->GetUnrarCmd());
+	SetLogPrefix("Unrar");
+	SetNeedWrite(true);
+
+	int iExitCode = Execute();
+	SetLogPrefix(NULL);
+
+	if (iExitCode != 0)
+	{
+		m_bAllOKMessageReceived = false;
+		if (iExitCode > 0 && !GetTerminated())
+		{
+			PrintMessage(Message::mkError, "Unrar error code: %i", iExitCode);
+		}
+	}
+}
+
+/*
+ * Lets unrar continue if the volume it waits for is downloaded or tells
+ * unrar to quit if the volume will not be available. Called when unrar asks
+ * for the next volume and when a file of the nzb is downloaded.
+ * The mutex m_mutexVolume must be locked.
+ */
+void DirectUnpack::CheckNextVolume()
+{
+	if (!m_bWaitingVolume)
+	{
+		return;
+	}
+
+	const char* szNextVolume = Util::BaseFileName(m_szNextVolume);
+	bool bDownloaded = false;
+	for (FileList::iterator it = m_DownloadedFiles.begin(); it != m_DownloadedFiles.end(); it++)
+	{
+		if (!strcmp(*it, szNextVolume))
+		{
+			bDownloaded = true;
+			break;
+		}
+	}
+
+	if (bDownloaded)
+	{
+		Write("C\n");
+	}
+	else if (m_bDownloadCompleted || IsStopped())
+	{
+		PrintMessage(Message::mkWarning, "Could not find %s", m_szNextVolume);
+		Write("Q\n");
+	}
+	else
+	{
+		debug("Waiting for %s", m_szNextVolume);
+		return;
+	}
+
+	m_bWaitingVolume = false;
+	m_szNextVolume[0] = '\0';
+}
+
+/*
+ * Adds the files completed since the last call to the list of downloaded files.
+ * The download queue and the mutex m_mutexVolume must be locked.
+ */
+void DirectUnpack::UpdateDownloadedFiles(NZBInfo* pNZBInfo)
+{
+	for (NZBInfo::Files::iterator it = pNZBInfo->GetCompletedFiles()->begin(); it != pNZBInfo->GetCompletedFiles()->end(); it++)
+	{
+		const char* szFilename = Util::BaseFileName(*it);
+		bool bKnown = false;
+		for (FileList::iterator it2 = m_DownloadedFiles.begin(); it2 != m_DownloadedFiles.end(); it2++)
+		{
+			if (!strcmp(*it2, szFilename))
+			{
+				bKnown = true;
+				break;
+			}
+		}
+		if (!bKnown)
+		{
+			m_DownloadedFiles.push_back(strdup(szFilename));
+		}
+	}
+}
+
+/**
+ * Unlike normal lines the prompt of unrar for the next volume is not terminated
+ * with a new line character.
+ */
+bool DirectUnpack::IsLineEnd(char* szBuf, int iLen)
+{
+	return szBuf[iLen - 1] == '\n' || (iLen >= 6 && !strncmp(szBuf + iLen - 6, "[Q]uit", 6));
+}
+
+/**
+ * Progress information (printed using backspace control character) is removed.
+ */
+void DirectUnpack::ProcessLine(char* szLine)
+{
+	char* szBackspace = strchr(szLine, '\b');
+	if (szBackspace)
+	{
+		*szBackspace = '\0';
+	}
+
+	ScriptController::ProcessLine(szLine);
+}
+
+void DirectUnpack::AddMessage(Message::EKind eKind, const char* szText)
+{
+	// depending on version unrar prints the prompt on the same line as the
+	// volume name ("Insert disk with name.part02.rar [C]ontinue, [Q]uit")
+	// or on a separate line
+	if (!strncmp(szText, "Unrar: Insert disk with ", 24))
+	{
+		m_mutexVolume.Lock();
+		strncpy(m_szNextVolume, szText + 24, 1024);
+		m_szNextVolume[1024-1] = '\0';
+		char* szPrompt = strstr(m_szNextVolume, " [C]ontinue");
+		if (szPrompt)
+		{
+			*szPrompt = '\0';
+		}
+		m_mutexVolume.Unlock();
+	}
+
+	if (strstr(szText, "[C]ontinue, [Q]uit") && strlen(m_szNextVolume) > 0)
+	{
+		// the messages are processed by ScriptMonitor which must not be
+		// blocked; the answer is sent when the volume is downloaded
+		m_mutexVolume.Lock();
+		m_bWaitingVolume = true;
+		CheckNextVolume();
+		m_mutexVolume.Unlock();
+		return;
+	}
+
+	ScriptController::AddMessage(eKind, szText);
+	m_pNZBInfo->AppendMessage(eKind, 0, szText);
+
+	if (!strncmp(szText, "Unrar: All OK", 13))
+	{
+		m_bAllOKMessageReceived = true;
+	}
+}
+
+
 void MoveController::StartJob(PostInfo* pPostInfo)
 {
 	MoveController* pMoveController = new MoveController();
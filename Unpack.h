@@ -71,16 +71,20 @@ private:
 	bool				m_bUnpackOK;
 	bool				m_bUnpackStartError;
 	bool				m_bCleanedUpDisk;
+	bool				m_bProgressPrinted;
 	EUnpacker			m_eUnpacker;
 	FileList			m_archiveFiles;
 
 protected:
-	virtual bool		ReadLine(char* szBuf, int iBufSize, FILE* pStream);
+	virtual bool		IsLineEnd(char* szBuf, int iLen);
+	virtual void		ProcessLine(char* szLine);
 	virtual void		AddMessage(Message::EKind eKind, const char* szText);
 	void				ExecuteUnrar();
 	void				ExecuteSevenZip(bool bMultiVolumes);
 	void				Completed();
 	void				CreateUnpackDir();
+	void				WaitDirectUnpack();
+	bool				CheckDirectUnpack();
 	bool				Cleanup();
 	void				CheckStateFiles();
 	void				CheckArchiveFiles(bool bScanNonStdFiles);
@@ -96,6 +100,51 @@ public:
 	static void			StartJob(PostInfo* pPostInfo);
 };
 
+/*
+ * Unpacks rar-archives during download. Unrar is started as soon as the first
+ * volume is downloaded and is fed with next volumes when they become available.
+ * The result is used by UnpackController; if direct unpack fails the normal
+ * unpack is performed after download.
+ */
+class DirectUnpack : public Thread, public ScriptController
+{
+private:
+	typedef std::deque<char*>		FileList;
+
+	NZBInfo*			m_pNZBInfo;
+	char				m_szName[1024];
+	char				m_szInfoName[1024];
+	char				m_szDestDir[1024];
+	char				m_szUnpackDir[1024];
+	char				m_szArchiveName[1024];
+	char				m_szPassword[1024];
+	char				m_szNextVolume[1024];
+	bool				m_bWaitingVolume;
+	FileList			m_DownloadedFiles;
+	Mutex				m_mutexVolume;
+	bool				m_bAllOKMessageReceived;
+	bool				m_bDownloadCompleted;
+
+	void				ExecuteUnrar();
+	void				CheckNextVolume();
+	void				UpdateDownloadedFiles(NZBInfo* pNZBInfo);
+
+protected:
+	virtual bool		IsLineEnd(char* szBuf, int iLen);
+	virtual void		ProcessLine(char* szLine);
+	virtual void		AddMessage(Message::EKind eKind, const char* szText);
+
+public:
+	virtual				~DirectUnpack();
+	virtual void		Run();
+	virtual void		Stop();
+	static bool			IsFirstVolume(const char* szFilename);
+	static void			BuildUnpackDir(NZBInfo* pNZBInfo, char* szBuffer, int iBufSize);
+	static void			FileDownloaded(NZBInfo* pNZBInfo);
+	static void			NZBDownloaded(NZBInfo* pNZBInfo);
+	static void			Cancel(NZBInfo* pNZBInfo);
+};
+
 class MoveController : public Thread, public ScriptController
 {
 private:
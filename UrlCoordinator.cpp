@@ -117,6 +117,7 @@ UrlCoordinator::UrlCoordinator()
 
 	m_bHasMoreJobs = true;
 	m_bForce = false;
+	m_pThreadPool = ThreadPool::GetPool("url");
 }
 
 UrlCoordinator::~UrlCoordinator()
@@ -146,6 +147,8 @@ void UrlCoordinator::Run()
 {
 	debug("Entering UrlCoordinator-loop");
 
+	m_pThreadPool->SetMaxWorkers(g_pOptions->GetUrlConnections());
+
 	int iResetCounter = 0;
 
 	while (!IsStopped())
@@ -317,6 +320,7 @@ void UrlCoordinator::StartUrlDownload(UrlInfo* pUrlInfo)
 
 	UrlDownloader* pUrlDownloader = new UrlDownloader();
 	pUrlDownloader->SetAutoDestroy(true);
+	pUrlDownloader->SetThreadPool(m_pThreadPool);
 	pUrlDownloader->Attach(this);
 	pUrlDownloader->SetUrlInfo(pUrlInfo);
 	pUrlDownloader->SetURL(pUrlInfo->GetURL());
@@ -54,6 +54,7 @@ public:
 
 private:
 	ActiveDownloads			m_ActiveDownloads;
+	ThreadPool*				m_pThreadPool;
 	bool					m_bHasMoreJobs;
 	bool					m_bForce;
 
@@ -42,6 +42,7 @@
 #include <WinIoCtl.h>
 #else
 #include <unistd.h>
+#include <sys/time.h>
 #include <sys/statvfs.h>
 #include <pwd.h>
 #endif
@@ -223,19 +224,42 @@ StringBuilder::~StringBuilder()
 
 void StringBuilder::Append(const char* szStr)
 {
-	int iPartLen = strlen(szStr);
-	if (m_iUsedSize + iPartLen + 1 > m_iBufferSize)
+	Append(szStr, strlen(szStr));
+}
+
+/*
+ * Appends iLen bytes, the data may contain null-characters.
+ */
+void StringBuilder::Append(const char* szStr, int iLen)
+{
+	if (m_iUsedSize + iLen + 1 > m_iBufferSize)
 	{
-		m_iBufferSize += iPartLen + 10240;
+		// grow geometrically to keep the number of reallocations low for large responses
+		m_iBufferSize += iLen + 10240 + m_iBufferSize / 2;
 		m_szBuffer = (char*)realloc(m_szBuffer, m_iBufferSize);
 	}
-	strcpy(m_szBuffer + m_iUsedSize, szStr);
-	m_iUsedSize += iPartLen;
+	memcpy(m_szBuffer + m_iUsedSize, szStr, iLen);
+	m_iUsedSize += iLen;
 	m_szBuffer[m_iUsedSize] = '\0';
 }
 
+/*
+ * Replaces iLen bytes at position iPos, the range must be within already appended data.
+ */
+void StringBuilder::Overwrite(int iPos, const char* szStr, int iLen)
+{
+	memcpy(m_szBuffer + iPos, szStr, iLen);
+}
+
+void StringBuilder::Erase(int iPos, int iLen)
+{
+	memmove(m_szBuffer + iPos, m_szBuffer + iPos + iLen, m_iUsedSize - iPos - iLen + 1);
+	m_iUsedSize -= iLen;
+}
+
 
 char Util::VersionRevisionBuf[40];
+unsigned long Util::Crc32Tab[256];
 
 char* Util::BaseFileName(const char* filename)
 {
@@ -541,6 +565,147 @@ float Util::Int64ToFloat(long long Int64)
 	return ((unsigned long)(1 << 30)) * 4.0f * Hi + Lo;
 }
 
+/* from crc32.c (http://www.koders.com/c/fid699AFE0A656F0022C9D6B9D1743E697B69CE5815.aspx)
+ *
+ * (c) 1999,2000 Krzysztof Dabrowski
+ * (c) 1999,2000 ElysiuM deeZine
+ * Released under GPL (thanks)
+ *
+ * chksum_crc32gentab() --      to a global crc_tab[256], this one will
+ *				calculate the crcTable for crc32-checksums.
+ *				it is generated to the polynom [..]
+ */
+void Util::InitCrc32()
+{
+	unsigned long crc, poly;
+	int i, j;
+
+	poly = 0xEDB88320L;
+	for (i = 0; i < 256; i++)
+	{
+		crc = i;
+		for (j = 8; j > 0; j--)
+		{
+			if (crc & 1)
+			{
+				crc = (crc >> 1) ^ poly;
+			}
+			else
+			{
+				crc >>= 1;
+			}
+		}
+		Crc32Tab[i] = crc;
+	}
+}
+
+/* This is modified version of chksum_crc() from
+ * crc32.c (http://www.koders.com/c/fid699AFE0A656F0022C9D6B9D1743E697B69CE5815.aspx)
+ * (c) 1999,2000 Krzysztof Dabrowski
+ * (c) 1999,2000 ElysiuM deeZine
+ *
+ * chksum_crc() -- to a given block, this one calculates the
+ *				crc32-checksum until the length is
+ *				reached. the crc32-checksum will be
+ *				the result.
+ */
+unsigned long Util::Crc32m(unsigned long startCrc, unsigned char *block, unsigned long length)
+{
+	unsigned long crc = startCrc;
+	for (unsigned long i = 0; i < length; i++)
+	{
+		crc = ((crc >> 8) & 0x00FFFFFF) ^ Crc32Tab[(crc ^ *block++) & 0xFF];
+	}
+	return crc;
+}
+
+unsigned long Util::Crc32(unsigned char *block, unsigned long length)
+{
+	return Crc32m(0xFFFFFFFF, block, length) ^ 0xFFFFFFFF;
+}
+
+/* Crc32Combine and helper functions are taken from zlib (crc32.c),
+ * (c) 1995-2006, 2010 Mark Adler
+ */
+static unsigned long gf2_matrix_times(unsigned long *mat, unsigned long vec)
+{
+	unsigned long sum = 0;
+	while (vec)
+	{
+		if (vec & 1)
+		{
+			sum ^= *mat;
+		}
+		vec >>= 1;
+		mat++;
+	}
+	return sum;
+}
+
+static void gf2_matrix_square(unsigned long *square, unsigned long *mat)
+{
+	for (int n = 0; n < 32; n++)
+	{
+		square[n] = gf2_matrix_times(mat, mat[n]);
+	}
+}
+
+unsigned long Util::Crc32Combine(unsigned long crc1, unsigned long crc2, unsigned long long len2)
+{
+	unsigned long even[32];	// even-power-of-two zeros operator
+	unsigned long odd[32];	// odd-power-of-two zeros operator
+
+	// degenerate case
+	if (len2 == 0)
+	{
+		return crc1;
+	}
+
+	// put operator for one zero bit in odd
+	odd[0] = 0xEDB88320UL;
+	unsigned long row = 1;
+	for (int n = 1; n < 32; n++)
+	{
+		odd[n] = row;
+		row <<= 1;
+	}
+
+	// put operator for two zero bits in even
+	gf2_matrix_square(even, odd);
+
+	// put operator for four zero bits in odd
+	gf2_matrix_square(odd, even);
+
+	// apply len2 zeros to crc1 (first square will put the operator for one
+	// zero byte, eight zero bits, in even)
+	do
+	{
+		// apply zeros operator for this bit of len2
+		gf2_matrix_square(even, odd);
+		if (len2 & 1)
+		{
+			crc1 = gf2_matrix_times(even, crc1);
+		}
+		len2 >>= 1;
+
+		// if no more bits set, then done
+		if (len2 == 0)
+		{
+			break;
+		}
+
+		// another iteration of the loop with odd and even swapped
+		gf2_matrix_square(odd, even);
+		if (len2 & 1)
+		{
+			crc1 = gf2_matrix_times(odd, crc1);
+		}
+		len2 >>= 1;
+	} while (len2 != 0);
+
+	return crc1 ^ crc2;
+}
+
 /* Base64 decryption is taken from 
  *  Article "BASE 64 Decoding and Encoding Class 2003" by Jan Raddatz
  *  http://www.codeguru.com/cpp/cpp/algorithms/article.php/c5099/
@@ -737,6 +902,31 @@ long long Util::FreeDiskSize(const char* szPath)
 	return -1;
 }
 
+int Util::NumberOfCpuCores()
+{
+#ifdef WIN32
+	SYSTEM_INFO sysinfo;
+	GetSystemInfo(&sysinfo);
+	return sysinfo.dwNumberOfProcessors;
+#elif defined(_SC_NPROCESSORS_ONLN)
+	int iCount = (int)sysconf(_SC_NPROCESSORS_ONLN);
+	return iCount > 0 ? iCount : 1;
+#else
+	return 1;
+#endif
+}
+
+long long Util::CurrentMSec()
+{
+#ifdef WIN32
+	return GetTickCount();
+#else
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return (long long)tv.tv_sec * 1000 + tv.tv_usec / 1000;
+#endif
+}
+
 bool Util::RenameBak(const char* szFilename, const char* szBakPart, bool bRemoveOldExtension, char* szNewNameBuf, int iNewNameBufSize)
 {
 	char szChangedFilename[1024];
@@ -1151,65 +1341,88 @@ unsigned int WebUtil::DecodeBase64(char* szInputBuffer, int iInputBufferLength,
 /* END - Base64
 */
 
-char* WebUtil::XmlEncode(const char* raw)
+/*
+ * Returns pointer to the first character which must be escaped (or to the terminating null).
+ * The string is tested eight bytes at a time: a word is passed as a whole if none of
+ * its bytes is a control character, a non-ASCII character or one of the special
+ * characters of XML or JSON. Words which fail the test are examined byte by byte.
+ */
+static const char* SkipPlainChars(const char* p, const char* pEnd, bool bJson)
 {
-	// calculate the required outputstring-size based on number of xml-entities and their sizes
-	int iReqSize = strlen(raw);
-	for (const char* p = raw; *p; p++)
+	const unsigned long long ONES = 0x0101010101010101ULL;
+	const unsigned long long HIGHS = 0x8080808080808080ULL;
+
+#define HAS_ZERO_BYTE(v) (((v) - ONES) & ~(v) & HIGHS)
+#define HAS_BYTE(v, c) HAS_ZERO_BYTE((v) ^ (ONES * (unsigned char)(c)))
+
+	while (pEnd - p >= 8)
+	{
+		unsigned long long v;
+		memcpy(&v, p, 8);
+		// bytes below 0x20 or with high bit set
+		bool bSpecial = (((v - ONES * 0x20) | v) & HIGHS) != 0;
+		if (!bSpecial)
+		{
+			bSpecial = bJson ?
+				HAS_BYTE(v, '"') || HAS_BYTE(v, '\\') || HAS_BYTE(v, '/') :
+				HAS_BYTE(v, '<') || HAS_BYTE(v, '>') || HAS_BYTE(v, '&') || HAS_BYTE(v, '\'') || HAS_BYTE(v, '"');
+		}
+		if (bSpecial)
+		{
+			break;
+		}
+		p += 8;
+	}
+
+#undef HAS_BYTE
+#undef HAS_ZERO_BYTE
+
+	for (; p < pEnd; p++)
 	{
 		unsigned char ch = *p;
-		switch (ch)
+		if (ch < 0x20 || ch >= 0x80 ||
+			(bJson ? ch == '"' || ch == '\\' || ch == '/' :
+				ch == '<' || ch == '>' || ch == '&' || ch == '\'' || ch == '"'))
 		{
-			case '>':
-			case '<':
-				iReqSize += 4;
-				break;
-			case '&':
-				iReqSize += 5;
-				break;
-			case '\'':
-			case '\"':
-				iReqSize += 6;
-				break;
-			default:
-				if (ch < 0x20 || ch >= 0x80)
-				{
-					iReqSize += 10;
-					break;
-				}
+			break;
 		}
 	}
 
-	char* result = (char*)malloc(iReqSize + 1);
+	return p;
+}
 
-	// copy string
-	char* output = result;
+void WebUtil::XmlEncode(const char* raw, StringBuilder* pOutput)
+{
+	const char* pEnd = raw + strlen(raw);
 	for (const char* p = raw; ; p++)
 	{
+		// copy the run of characters which don't need escaping as one block
+		const char* pPlain = p;
+		p = SkipPlainChars(p, pEnd, false);
+		if (p > pPlain)
+		{
+			pOutput->Append(pPlain, p - pPlain);
+		}
+
 		unsigned char ch = *p;
 		switch (ch)
 		{
 			case '\0':
-				goto BreakLoop;
+				return;
 			case '<':
-				strcpy(output, "&lt;");
-				output += 4;
+				pOutput->Append("&lt;", 4);
 				break;
 			case '>':
-				strcpy(output, "&gt;");
-				output += 4;
+				pOutput->Append("&gt;", 4);
 				break;
 			case '&':
-				strcpy(output, "&amp;");
-				output += 5;
+				pOutput->Append("&amp;", 5);
 				break;
 			case '\'':
-				strcpy(output, "&apos;");
-				output += 6;
+				pOutput->Append("&apos;", 6);
 				break;
 			case '\"':
-				strcpy(output, "&quot;");
-				output += 6;
+				pOutput->Append("&quot;", 6);
 				break;
 			default:
 				if (ch < 0x20 || ch > 0x80)
@@ -1220,25 +1433,25 @@ char* WebUtil::XmlEncode(const char* raw)
 					if ((cp >> 5) == 0x6 && (p[1] & 0xc0) == 0x80)
 					{
 						// 2 bytes
-						if (!(ch = *++p)) goto BreakLoop; // read next char
+						if (!(ch = *++p)) return; // read next char
 						cp = ((cp << 6) & 0x7ff) + (ch & 0x3f);
 					}
 					else if ((cp >> 4) == 0xe && (p[1] & 0xc0) == 0x80)
 					{
 						// 3 bytes
-						if (!(ch = *++p)) goto BreakLoop; // read next char
+						if (!(ch = *++p)) return; // read next char
 						cp = ((cp << 12) & 0xffff) + ((ch << 6) & 0xfff);
-						if (!(ch = *++p)) goto BreakLoop; // read next char
+						if (!(ch = *++p)) return; // read next char
 						cp += ch & 0x3f;
 					}
 					else if ((cp >> 3) == 0x1e && (p[1] & 0xc0) == 0x80)
 					{
 						// 4 bytes
-						if (!(ch = *++p)) goto BreakLoop; // read next char
+						if (!(ch = *++p)) return; // read next char
 						cp = ((cp << 18) & 0x1fffff) + ((ch << 12) & 0x3ffff);
-						if (!(ch = *++p)) goto BreakLoop; // read next char
+						if (!(ch = *++p)) return; // read next char
 						cp += (ch << 6) & 0xfff;
-						if (!(ch = *++p)) goto BreakLoop; // read next char
+						if (!(ch = *++p)) return; // read next char
 						cp += ch & 0x3f;
 					}
 
@@ -1248,28 +1461,23 @@ char* WebUtil::XmlEncode(const char* raw)
 						(0xE000 <= cp && cp <= 0xFFFD) ||
 						(0x10000 <= cp && cp <= 0x10FFFF))
 					{
-						sprintf(output, "&#x%06x;", cp);
-						output += 10;
+						char szEntity[16];
+						sprintf(szEntity, "&#x%06x;", cp);
+						pOutput->Append(szEntity, 10);
 					}
 					else
 					{
 						// replace invalid characters with dots
-						sprintf(output, ".");
-						output += 1;
+						pOutput->Append(".", 1);
 					}
 				}
 				else
 				{
-					*output++ = ch;
+					pOutput->Append(p, 1);
 				}
 				break;
 		}
 	}
-BreakLoop:
-
-	*output = '\0';
-
-	return result;
 }
 
 void WebUtil::XmlDecode(char* raw)
@@ -1378,76 +1586,47 @@ bool WebUtil::XmlParseTagValue(const char* szXml, const char* szTag, char* szVal
 	return true;
 }
 
-char* WebUtil::JsonEncode(const char* raw)
+void WebUtil::JsonEncode(const char* raw, StringBuilder* pOutput)
 {
-	// calculate the required outputstring-size based on number of escape-entities and their sizes
-	int iReqSize = strlen(raw);
-	for (const char* p = raw; *p; p++)
+	const char* pEnd = raw + strlen(raw);
+	for (const char* p = raw; ; p++)
 	{
-		unsigned char ch = *p;
-		switch (ch)
+		// copy the run of characters which don't need escaping as one block
+		const char* pPlain = p;
+		p = SkipPlainChars(p, pEnd, true);
+		if (p > pPlain)
 		{
-			case '\"':
-			case '\\':
-			case '/':
-			case '\b':
-			case '\f':
-			case '\n':
-			case '\r':
-			case '\t':
-				iReqSize++;
-                break;
-			default:
-				if (ch < 0x20 || ch >= 0x80)
-				{
-					iReqSize += 6;
-					break;
-				}
+			pOutput->Append(pPlain, p - pPlain);
 		}
-	}
-
-	char* result = (char*)malloc(iReqSize + 1);
 
-	// copy string
-	char* output = result;
-	for (const char* p = raw; ; p++)
-	{
 		unsigned char ch = *p;
 		switch (ch)
 		{
 			case '\0':
-				goto BreakLoop;
+				return;
 			case '"':
-				strcpy(output, "\\\"");
-				output += 2;
+				pOutput->Append("\\\"", 2);
 				break;
 			case '\\':
-				strcpy(output, "\\\\");
-				output += 2;
+				pOutput->Append("\\\\", 2);
 				break;
 			case '/':
-				strcpy(output, "\\/");
-				output += 2;
+				pOutput->Append("\\/", 2);
 				break;
 			case '\b':
-				strcpy(output, "\\b");
-				output += 2;
+				pOutput->Append("\\b", 2);
 				break;
 			case '\f':
-				strcpy(output, "\\f");
-				output += 2;
+				pOutput->Append("\\f", 2);
 				break;
 			case '\n':
-				strcpy(output, "\\n");
-				output += 2;
+				pOutput->Append("\\n", 2);
 				break;
 			case '\r':
-				strcpy(output, "\\r");
-				output += 2;
+				pOutput->Append("\\r", 2);
 				break;
 			case '\t':
-				strcpy(output, "\\t");
-				output += 2;
+				pOutput->Append("\\t", 2);
 				break;
 			default:
 				if (ch < 0x20 || ch > 0x80)
@@ -1458,44 +1637,40 @@ char* WebUtil::JsonEncode(const char* raw)
 					if ((cp >> 5) == 0x6 && (p[1] & 0xc0) == 0x80)
 					{
 						// 2 bytes
-						if (!(ch = *++p)) goto BreakLoop; // read next char
+						if (!(ch = *++p)) return; // read next char
 						cp = ((cp << 6) & 0x7ff) + (ch & 0x3f);
 					}
 					else if ((cp >> 4) == 0xe && (p[1] & 0xc0) == 0x80)
 					{
 						// 3 bytes
-						if (!(ch = *++p)) goto BreakLoop; // read next char
+						if (!(ch = *++p)) return; // read next char
 						cp = ((cp << 12) & 0xffff) + ((ch << 6) & 0xfff);
-						if (!(ch = *++p)) goto BreakLoop; // read next char
+						if (!(ch = *++p)) return; // read next char
 						cp += ch & 0x3f;
 					}
 					else if ((cp >> 3) == 0x1e && (p[1] & 0xc0) == 0x80)
 					{
 						// 4 bytes
-						if (!(ch = *++p)) goto BreakLoop; // read next char
+						if (!(ch = *++p)) return; // read next char
 						cp = ((cp << 18) & 0x1fffff) + ((ch << 12) & 0x3ffff);
-						if (!(ch = *++p)) goto BreakLoop; // read next char
+						if (!(ch = *++p)) return; // read next char
 						cp += (ch << 6) & 0xfff;
-						if (!(ch = *++p)) goto BreakLoop; // read next char
+						if (!(ch = *++p)) return; // read next char
 						cp += ch & 0x3f;
 					}
 
 					// we support only Unicode range U+0000-U+FFFF
-					sprintf(output, "\\u%04x", cp <= 0xFFFF ? cp : '.');
-					output += 6;
+					char szEscape[16];
+					sprintf(szEscape, "\\u%04x", cp <= 0xFFFF ? cp : '.');
+					pOutput->Append(szEscape, 6);
 				}
 				else
 				{
-					*output++ = ch;
+					pOutput->Append(p, 1);
 				}
 				break;
 		}
 	}
-BreakLoop:
-
-	*output = '\0';
-
-	return result;
 }
 
 void WebUtil::JsonDecode(char* raw)
@@ -1833,6 +2008,76 @@ unsigned int ZLib::GZip(const void* szInputBuffer, int iInputBufferLength, void*
 	return total_out;
 }
 
+GZipStream::GZipStream(int BufferSize)
+{
+	m_iBufferSize = BufferSize;
+	m_bLastBlock = false;
+	m_pZStream = malloc(sizeof(z_stream));
+	m_pOutputBuffer = malloc(BufferSize);
+
+	memset(m_pZStream, 0, sizeof(z_stream));
+
+	/* add 16 to MAX_WBITS to enforce gzip format */
+	int ret = deflateInit2(((z_stream*)m_pZStream), Z_DEFAULT_COMPRESSION, Z_DEFLATED, MAX_WBITS + 16, MAX_MEM_LEVEL, Z_DEFAULT_STRATEGY);
+	if (ret != Z_OK)
+	{
+		free(m_pZStream);
+		m_pZStream = NULL;
+	}
+}
+
+GZipStream::~GZipStream()
+{
+	if (m_pZStream)
+	{
+		deflateEnd(((z_stream*)m_pZStream));
+		free(m_pZStream);
+	}
+	free(m_pOutputBuffer);
+}
+
+void GZipStream::Write(const void *pInputBuffer, int iInputBufferLength, bool bLastBlock)
+{
+	m_bLastBlock = bLastBlock;
+
+	if (!m_pZStream)
+	{
+		return;
+	}
+
+	((z_stream*)m_pZStream)->next_in = (Bytef*)pInputBuffer;
+	((z_stream*)m_pZStream)->avail_in = iInputBufferLength;
+}
+
+GZipStream::EStatus GZipStream::Read(const void **pOutputBuffer, int *iOutputBufferLength)
+{
+	*iOutputBufferLength = 0;
+
+	if (!m_pZStream)
+	{
+		return zlError;
+	}
+
+	((z_stream*)m_pZStream)->next_out = (Bytef*)m_pOutputBuffer;
+	((z_stream*)m_pZStream)->avail_out = m_iBufferSize;
+
+	int ret = deflate(((z_stream*)m_pZStream), m_bLastBlock ? Z_FINISH : Z_NO_FLUSH);
+
+	switch (ret)
+	{
+		case Z_STREAM_END:
+		case Z_OK:
+			*iOutputBufferLength = m_iBufferSize - ((z_stream*)m_pZStream)->avail_out;
+			*pOutputBuffer = m_pOutputBuffer;
+			return ret == Z_STREAM_END ? zlFinished : zlOK;
+
+		case Z_BUF_ERROR:
+			return zlOK;
+	}
+
+	return zlError;
+}
+
 GUnzipStream::GUnzipStream(int BufferSize)
 {
 	m_iBufferSize = BufferSize;
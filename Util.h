@@ -67,7 +67,11 @@ public:
 						StringBuilder();
 						~StringBuilder();
 	void				Append(const char* szStr);
+	void				Append(const char* szStr, int iLen);
+	void				Overwrite(int iPos, const char* szStr, int iLen);
+	void				Erase(int iPos, int iLen);
 	const char*			GetBuffer() { return m_szBuffer; }
+	int					GetUsedSize() { return m_iUsedSize; }
 };
 
 class Util 
@@ -92,6 +96,13 @@ public:
 	static bool SetCurrentDirectory(const char* szDirFilename);
 	static long long FileSize(const char* szFilename);
 	static long long FreeDiskSize(const char* szPath);
+	static int NumberOfCpuCores();
+
+	/*
+	 * Returns time in milliseconds since an unspecified point, for measuring intervals.
+	 */
+	static long long CurrentMSec();
+
 	static bool DirEmpty(const char* szDirFilename);
 	static bool RenameBak(const char* szFilename, const char* szBakPart, bool bRemoveOldExtension, char* szNewNameBuf, int iNewNameBufSize);
 #ifndef WIN32
@@ -120,6 +131,17 @@ public:
 	static long long JoinInt64(unsigned long Hi, unsigned long Lo);
 	static void SplitInt64(long long Int64, unsigned long* Hi, unsigned long* Lo);
 
+	/*
+	 * CRC32 (the same as used by yEnc, zip and par2).
+	 * Crc32m continues the calculation; the start value is 0xFFFFFFFF and
+	 * the result must be xor-ed with 0xFFFFFFFF.
+	 * Crc32Combine computes the CRC of the concatenation of two blocks from
+	 * the CRCs of both blocks and the length of the second block.
+	 */
+	static unsigned long Crc32(unsigned char *block, unsigned long length);
+	static unsigned long Crc32m(unsigned long startCrc, unsigned char *block, unsigned long length);
+	static unsigned long Crc32Combine(unsigned long crc1, unsigned long crc2, unsigned long long len2);
+
 	/**
 	 * Int64ToFloat converts Int64 to float.
 	 * Simple (float)Int64 does not work on all compilers,
@@ -149,8 +171,16 @@ public:
 	 * call to "VersionRevision()".
 	 */
 	static void InitVersionRevision();
+
+	/*
+	 * Initialize lookup table for CRC32-calculation.
+	 * This function must be called during program initialization before any
+	 * call to "Crc32()", "Crc32m()".
+	 */
+	static void InitCrc32();
 	
 	static char VersionRevisionBuf[40];
+	static unsigned long Crc32Tab[256];
 };
 
 class WebUtil
@@ -160,9 +190,9 @@ public:
 
 	/*
 	 * Encodes string to be used as content of xml-tag.
-	 * Returns new string allocated with malloc, it need to be freed by caller.
+	 * The encoded string is appended to pOutput, no temporary strings are allocated.
 	 */
-	static char* XmlEncode(const char* raw);
+	static void XmlEncode(const char* raw, StringBuilder* pOutput);
 
 	/*
 	 * Decodes string from xml.
@@ -183,9 +213,9 @@ public:
 
 	/*
 	 * Creates JSON-string by replace the certain characters with escape-sequences.
-	 * Returns new string allocated with malloc, it need to be freed by caller.
+	 * The encoded string is appended to pOutput, no temporary strings are allocated.
 	 */
-	static char* JsonEncode(const char* raw);
+	static void JsonEncode(const char* raw, StringBuilder* pOutput);
 
 	/*
 	 * Decodes JSON-string.
@@ -268,6 +298,39 @@ public:
 	static unsigned int GZip(const void* szInputBuffer, int iInputBufferLength, void* szOutputBuffer, int iOutputBufferLength);
 };
 
+class GZipStream
+{
+public:
+	enum EStatus
+	{
+		zlError,
+		zlFinished,
+		zlOK
+	};
+
+private:
+	void*				m_pZStream;
+	void*				m_pOutputBuffer;
+	int					m_iBufferSize;
+	bool				m_bLastBlock;
+
+public:
+						GZipStream(int BufferSize);
+						~GZipStream();
+
+	/*
+	 * set next memory block for compression.
+	 * bLastBlock - must be "true" for the last block (which can be empty).
+	 */
+	void				Write(const void *pInputBuffer, int iInputBufferLength, bool bLastBlock);
+
+	/*
+	 * get next compressed memory block.
+	 * iOutputBufferLength - the size of compressed block. if it is "0" the next block must be provided via "Write".
+	 */
+	EStatus				Read(const void **pOutputBuffer, int *iOutputBufferLength);
+};
+
 class GUnzipStream
 {
 public:
@@ -34,6 +34,8 @@
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
+#include <time.h>
+#include <sys/stat.h>
 #ifndef WIN32
 #include <unistd.h>
 #endif
@@ -52,16 +54,267 @@ static const char* ERR_HTTP_NOT_FOUND = "404 Not Found";
 static const char* ERR_HTTP_SERVICE_UNAVAILABLE = "503 Service Unavailable";
 
 static const int MAX_UNCOMPRESSED_SIZE = 500;
+static const int MAX_CACHED_FILE_SIZE = 1024 * 1024;
+static const long long MAX_CACHE_SIZE = 8 * 1024 * 1024;
+
+//*****************************************************************
+// WebCache
+
+WebCache::CacheEntry::CacheEntry(const char* szFilename, time_t tModified, long long lSize)
+{
+	m_szFilename = strdup(szFilename);
+	m_tModified = tModified;
+	m_lSize = lSize;
+	m_szBody = NULL;
+	m_iBodyLen = 0;
+	m_szGZBody = NULL;
+	m_iGZBodyLen = 0;
+	m_szETag[0] = '\0';
+	m_szGZETag[0] = '\0';
+	m_iRefCount = 0;
+	m_bObsolete = false;
+
+	// format of "Last-Modified" is defined by RFC 1123, the names of days and months
+	// are not localized, therefore we don't use strftime here
+	static const char* DAY_NAMES[] = { "Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat" };
+	static const char* MONTH_NAMES[] = { "Jan", "Feb", "Mar", "Apr", "May", "Jun", "Jul", "Aug", "Sep", "Oct", "Nov", "Dec" };
+	struct tm tmModified;
+	gmtime_r(&tModified, &tmModified);
+	snprintf(m_szLastModified, sizeof(m_szLastModified), "%s, %02i %s %04i %02i:%02i:%02i GMT",
+		DAY_NAMES[tmModified.tm_wday], tmModified.tm_mday, MONTH_NAMES[tmModified.tm_mon],
+		tmModified.tm_year + 1900, tmModified.tm_hour, tmModified.tm_min, tmModified.tm_sec);
+	m_szLastModified[sizeof(m_szLastModified)-1] = '\0';
+}
+
+WebCache::CacheEntry::~CacheEntry()
+{
+	free(m_szFilename);
+	free(m_szBody);
+	free(m_szGZBody);
+}
+
+WebCache::WebCache()
+{
+	m_lCachedSize = 0;
+}
+
+WebCache::~WebCache()
+{
+	for (CacheEntries::iterator it = m_CacheEntries.begin(); it != m_CacheEntries.end(); it++)
+	{
+		delete *it;
+	}
+	m_CacheEntries.clear();
+}
+
+WebCache::CacheEntry* WebCache::Acquire(const char* szFilename)
+{
+	struct stat buffer;
+	if (stat(szFilename, &buffer) || !S_ISREG(buffer.st_mode) || buffer.st_size > MAX_CACHED_FILE_SIZE)
+	{
+		return NULL;
+	}
+
+	m_mutexCacheEntries.Lock();
+	CacheEntry* pCacheEntry = FindEntry(szFilename, buffer.st_mtime, buffer.st_size);
+	if (pCacheEntry)
+	{
+		pCacheEntry->m_iRefCount++;
+	}
+	m_mutexCacheEntries.Unlock();
+
+	if (pCacheEntry)
+	{
+		return pCacheEntry;
+	}
+
+	// the file is read and compressed without holding the lock, other
+	// requests are not blocked by it
+	CacheEntry* pNewEntry = LoadEntry(szFilename, buffer.st_mtime, buffer.st_size);
+	if (!pNewEntry)
+	{
+		return NULL;
+	}
+
+	m_mutexCacheEntries.Lock();
+
+	// the same file could have been loaded by another request in the meantime
+	pCacheEntry = FindEntry(szFilename, buffer.st_mtime, buffer.st_size);
+	if (pCacheEntry)
+	{
+		delete pNewEntry;
+	}
+	else
+	{
+		pCacheEntry = pNewEntry;
+		m_CacheEntries.push_back(pCacheEntry);
+		m_lCachedSize += pCacheEntry->m_iBodyLen + pCacheEntry->m_iGZBodyLen;
+		Evict();
+	}
+
+	pCacheEntry->m_iRefCount++;
+
+	m_mutexCacheEntries.Unlock();
+
+	return pCacheEntry;
+}
+
+void WebCache::Release(CacheEntry* pCacheEntry)
+{
+	m_mutexCacheEntries.Lock();
+	pCacheEntry->m_iRefCount--;
+	if (pCacheEntry->m_bObsolete && pCacheEntry->m_iRefCount == 0)
+	{
+		delete pCacheEntry;
+	}
+	m_mutexCacheEntries.Unlock();
+}
+
+/*
+ * Finds the entry for the file and moves it to the end of the list (most
+ * recently used). An entry of a modified file is removed.
+ * The mutex m_mutexCacheEntries must be locked.
+ */
+WebCache::CacheEntry* WebCache::FindEntry(const char* szFilename, time_t tModified, long long lSize)
+{
+	for (CacheEntries::iterator it = m_CacheEntries.begin(); it != m_CacheEntries.end(); it++)
+	{
+		CacheEntry* pEntry = *it;
+		if (!strcmp(pEntry->m_szFilename, szFilename))
+		{
+			m_CacheEntries.erase(it);
+			if (pEntry->m_tModified == tModified && pEntry->m_lSize == lSize)
+			{
+				m_CacheEntries.push_back(pEntry);
+				return pEntry;
+			}
+
+			debug("Web-cache: file %s was modified", szFilename);
+			RemoveEntry(pEntry);
+			return NULL;
+		}
+	}
+
+	return NULL;
+}
+
+/*
+ * Removes the least recently used entries until the size of cache fits into the limit.
+ * The most recently added entry is always kept.
+ * The mutex m_mutexCacheEntries must be locked.
+ */
+void WebCache::Evict()
+{
+	while (m_lCachedSize > MAX_CACHE_SIZE && m_CacheEntries.size() > 1)
+	{
+		CacheEntry* pEntry = m_CacheEntries.front();
+		m_CacheEntries.pop_front();
+		debug("Web-cache: evicting file %s", pEntry->m_szFilename);
+		RemoveEntry(pEntry);
+	}
+}
+
+/*
+ * The entry must be already taken out of the list. It is deleted when
+ * the last user releases it.
+ * The mutex m_mutexCacheEntries must be locked.
+ */
+void WebCache::RemoveEntry(CacheEntry* pEntry)
+{
+	m_lCachedSize -= pEntry->m_iBodyLen + pEntry->m_iGZBodyLen;
+	pEntry->m_bObsolete = true;
+	if (pEntry->m_iRefCount == 0)
+	{
+		delete pEntry;
+	}
+}
+
+WebCache::CacheEntry* WebCache::LoadEntry(const char* szFilename, time_t tModified, long long lSize)
+{
+	debug("Web-cache: loading file %s", szFilename);
+
+	char *szBody;
+	int iBodyLen;
+	if (!Util::LoadFileIntoBuffer(szFilename, &szBody, &iBodyLen))
+	{
+		return NULL;
+	}
+
+	// "LoadFileIntoBuffer" adds a trailing NULL, which we don't need here
+	iBodyLen--;
+
+	CacheEntry* pCacheEntry = new CacheEntry(szFilename, tModified, lSize);
+	pCacheEntry->m_szBody = szBody;
+	pCacheEntry->m_iBodyLen = iBodyLen;
+
+	// strong validator: FNV-1a hash of the content combined with content length
+	unsigned int iHash = 2166136261U;
+	for (int i = 0; i < iBodyLen; i++)
+	{
+		iHash = (iHash ^ (unsigned char)szBody[i]) * 16777619U;
+	}
+	snprintf(pCacheEntry->m_szETag, sizeof(pCacheEntry->m_szETag), "\"%08x-%x\"", iHash, iBodyLen);
+	pCacheEntry->m_szETag[sizeof(pCacheEntry->m_szETag)-1] = '\0';
+	// compressed representation needs its own entity-tag
+	snprintf(pCacheEntry->m_szGZETag, sizeof(pCacheEntry->m_szGZETag), "\"%08x-%x-gz\"", iHash, iBodyLen);
+	pCacheEntry->m_szGZETag[sizeof(pCacheEntry->m_szGZETag)-1] = '\0';
+
+#ifndef DISABLE_GZIP
+	if (iBodyLen > MAX_UNCOMPRESSED_SIZE)
+	{
+		unsigned int iOutLen = ZLib::GZipLen(iBodyLen);
+		char* szGBuf = (char*)malloc(iOutLen);
+		int iGZippedLen = ZLib::GZip(szBody, iBodyLen, szGBuf, iOutLen);
+		if (iGZippedLen > 0 && iGZippedLen < iBodyLen)
+		{
+			pCacheEntry->m_szGZBody = (char*)realloc(szGBuf, iGZippedLen);
+			pCacheEntry->m_iGZBodyLen = iGZippedLen;
+		}
+		else
+		{
+			free(szGBuf);
+		}
+	}
+#endif
+
+	return pCacheEntry;
+}
 
 //*****************************************************************
 // WebProcessor
 
+WebCache* WebProcessor::m_pWebCache = NULL;
+
+void WebProcessor::Init()
+{
+	m_pWebCache = new WebCache();
+}
+
+/*
+ * The remote servers must be stopped before the call. Request processors which
+ * are still running may use the cache entries; if they don't complete in time
+ * the cache is not destroyed.
+ */
+void WebProcessor::Final()
+{
+	if (!ThreadPool::GetPool("request")->WaitJobs(1000))
+	{
+		debug("Request processors are still running, the web cache is not destroyed");
+		return;
+	}
+
+	delete m_pWebCache;
+	m_pWebCache = NULL;
+}
+
 WebProcessor::WebProcessor()
 {
 	m_pConnection = NULL;
 	m_szRequest = NULL;
 	m_szUrl = NULL;
 	m_szOrigin = NULL;
+	m_szIfNoneMatch = NULL;
+	m_szAccept = NULL;
 }
 
 WebProcessor::~WebProcessor()
@@ -78,6 +331,14 @@ WebProcessor::~WebProcessor()
 	{
 		free(m_szOrigin);
 	}
+	if (m_szIfNoneMatch)
+	{
+		free(m_szIfNoneMatch);
+	}
+	if (m_szAccept)
+	{
+		free(m_szAccept);
+	}
 }
 
 void WebProcessor::SetUrl(const char* szUrl)
@@ -120,6 +381,14 @@ void WebProcessor::Execute()
 		{
 			m_szOrigin = strdup(p + 8);
 		}
+		if (!strncasecmp(p, "If-None-Match: ", 15))
+		{
+			m_szIfNoneMatch = strdup(p + 15);
+		}
+		if (!strncasecmp(p, "Accept: ", 8))
+		{
+			m_szAccept = strdup(p + 8);
+		}
 		if (*p == '\0')
 		{
 			break;
@@ -239,8 +508,12 @@ void WebProcessor::Dispatch()
 		processor.SetRequest(m_szRequest);
 		processor.SetHttpMethod(m_eHttpMethod == hmGet ? XmlRpcProcessor::hmGet : XmlRpcProcessor::hmPost);
 		processor.SetUrl(m_szUrl);
+		if (m_szAccept)
+		{
+			processor.SetAccept(m_szAccept);
+		}
 		processor.Execute();
-		SendBodyResponse(processor.GetResponse(), strlen(processor.GetResponse()), processor.GetContentType()); 
+		SendBodyResponse(processor.GetResponse(), processor.GetResponseLen(), processor.GetContentType());
 		return;
 	}
 
@@ -365,20 +638,6 @@ void WebProcessor::SendRedirectResponse(const char* szURL)
 
 void WebProcessor::SendBodyResponse(const char* szBody, int iBodyLen, const char* szContentType)
 {
-	const char* RESPONSE_HEADER = 
-		"HTTP/1.1 200 OK\r\n"
-		"Connection: close\r\n"
-		"Access-Control-Allow-Methods: GET, POST, OPTIONS\r\n"
-		"Access-Control-Allow-Origin: %s\r\n"
-		"Access-Control-Allow-Credentials: true\r\n"
-		"Access-Control-Max-Age: 86400\r\n"
-		"Access-Control-Allow-Headers: Content-Type, Authorization\r\n"
-		"Content-Length: %i\r\n"
-		"%s"					// Content-Type: xxx
-		"%s"					// Content-Encoding: gzip
-		"Server: nzbget-%s\r\n"
-		"\r\n";
-	
 #ifndef DISABLE_GZIP
 	char *szGBuf = NULL;
 	bool bGZip = m_bGZip && iBodyLen > MAX_UNCOMPRESSED_SIZE;
@@ -403,6 +662,41 @@ void WebProcessor::SendBodyResponse(const char* szBody, int iBodyLen, const char
 	bool bGZip = false;
 #endif
 	
+	SendDataResponse(szBody, iBodyLen, szContentType, bGZip, NULL);
+	
+#ifndef DISABLE_GZIP
+	if (szGBuf)
+	{
+		free(szGBuf);
+	}
+#endif
+}
+
+void WebProcessor::SendDataResponse(const char* szBody, int iBodyLen, const char* szContentType,
+	bool bGZip, const char* szExtraHeaders)
+{
+	SendResponseHeader(iBodyLen, szContentType, bGZip, szExtraHeaders);
+	m_pConnection->Send(szBody, iBodyLen);
+}
+
+void WebProcessor::SendResponseHeader(long long lBodyLen, const char* szContentType,
+	bool bGZip, const char* szExtraHeaders)
+{
+	const char* RESPONSE_HEADER = 
+		"HTTP/1.1 200 OK\r\n"
+		"Connection: close\r\n"
+		"Access-Control-Allow-Methods: GET, POST, OPTIONS\r\n"
+		"Access-Control-Allow-Origin: %s\r\n"
+		"Access-Control-Allow-Credentials: true\r\n"
+		"Access-Control-Max-Age: 86400\r\n"
+		"Access-Control-Allow-Headers: Content-Type, Authorization\r\n"
+		"Content-Length: %lli\r\n"
+		"%s"					// Content-Type: xxx
+		"%s"					// Content-Encoding: gzip
+		"%s"					// ETag, Last-Modified, etc.
+		"Server: nzbget-%s\r\n"
+		"\r\n";
+	
 	char szContentTypeHeader[1024];
 	if (szContentType)
 	{
@@ -416,40 +710,94 @@ void WebProcessor::SendBodyResponse(const char* szBody, int iBodyLen, const char
 	char szResponseHeader[1024];
 	snprintf(szResponseHeader, 1024, RESPONSE_HEADER, 
 		m_szOrigin ? m_szOrigin : "",
-		iBodyLen, szContentTypeHeader,
+		lBodyLen, szContentTypeHeader,
 		bGZip ? "Content-Encoding: gzip\r\n" : "",
+		szExtraHeaders ? szExtraHeaders : "",
 		Util::VersionRevision());
 	
 	// Send the request answer
 	m_pConnection->Send(szResponseHeader, strlen(szResponseHeader));
-	m_pConnection->Send(szBody, iBodyLen);
-	
-#ifndef DISABLE_GZIP
-	if (szGBuf)
+}
+
+void WebProcessor::SendNotModifiedResponse(const char* szETag)
+{
+	const char* NOT_MODIFIED_RESPONSE_HEADER =
+		"HTTP/1.1 304 Not Modified\r\n"
+		"Connection: close\r\n"
+		"ETag: %s\r\n"
+		"Vary: Accept-Encoding\r\n"
+		"Server: nzbget-%s\r\n"
+		"\r\n";
+	char szResponseHeader[1024];
+	snprintf(szResponseHeader, 1024, NOT_MODIFIED_RESPONSE_HEADER, szETag, Util::VersionRevision());
+
+	// Send the response answer
+	debug("ResponseHeader=%s", szResponseHeader);
+	m_pConnection->Send(szResponseHeader, strlen(szResponseHeader));
+}
+
+void WebProcessor::SendCachedFileResponse(WebCache::CacheEntry* pCacheEntry, const char* szContentType)
+{
+	bool bGZip = m_bGZip && pCacheEntry->GetGZBody();
+	const char* szETag = bGZip ? pCacheEntry->GetGZETag() : pCacheEntry->GetETag();
+
+	if (m_szIfNoneMatch && (strstr(m_szIfNoneMatch, szETag) || !strcmp(m_szIfNoneMatch, "*")))
 	{
-		free(szGBuf);
+		SendNotModifiedResponse(szETag);
+		return;
+	}
+
+	char szCacheHeaders[256];
+	snprintf(szCacheHeaders, sizeof(szCacheHeaders), "ETag: %s\r\nLast-Modified: %s\r\nVary: Accept-Encoding\r\n",
+		szETag, pCacheEntry->GetLastModified());
+	szCacheHeaders[sizeof(szCacheHeaders)-1] = '\0';
+
+	if (bGZip)
+	{
+		SendDataResponse(pCacheEntry->GetGZBody(), pCacheEntry->GetGZBodyLen(), szContentType, true, szCacheHeaders);
+	}
+	else
+	{
+		SendDataResponse(pCacheEntry->GetBody(), pCacheEntry->GetBodyLen(), szContentType, false, szCacheHeaders);
 	}
-#endif
 }
 
 void WebProcessor::SendFileResponse(const char* szFilename)
 {
 	debug("serving file: %s", szFilename);
 
-	char *szBody;
-	int iBodyLen;
-	if (!Util::LoadFileIntoBuffer(szFilename, &szBody, &iBodyLen))
+	if (WebCache::CacheEntry* pCacheEntry = m_pWebCache->Acquire(szFilename))
+	{
+		SendCachedFileResponse(pCacheEntry, DetectContentType(szFilename));
+		m_pWebCache->Release(pCacheEntry);
+		return;
+	}
+
+	// the file is too large for the cache, it is sent in chunks (or using "sendfile")
+	// without loading it into memory and without compression;
+	// directories can be opened with "fopen" too, they must not be served
+#ifdef WIN32
+	struct _stat32i64 buffer;
+	bool bRegularFile = !_stat32i64(szFilename, &buffer) && S_ISREG(buffer.st_mode);
+#else
+	struct stat buffer;
+	bool bRegularFile = !stat(szFilename, &buffer) && S_ISREG(buffer.st_mode);
+#endif
+	FILE* pFile = bRegularFile ? fopen(szFilename, "rb") : NULL;
+	if (!pFile)
 	{
 		SendErrorResponse(ERR_HTTP_NOT_FOUND);
 		return;
 	}
-	
-	// "LoadFileIntoBuffer" adds a trailing NULL, which we don't need here
-	iBodyLen--;
-	
-	SendBodyResponse(szBody, iBodyLen, DetectContentType(szFilename));
 
-	free(szBody);
+	long long lFileSize = buffer.st_size;
+	SendResponseHeader(lFileSize, DetectContentType(szFilename), false, NULL);
+	if (!m_pConnection->SendFile(pFile, lFileSize))
+	{
+		debug("Could not send file %s", szFilename);
+	}
+
+	fclose(pFile);
 }
 
 const char* WebProcessor::DetectContentType(const char* szFilename)
@@ -1,7 +1,7 @@
 /*
  *  This file is part of nzbget
  *
- *  Copyright (C) 2012 Andrey Prygunkov <hugbug@users.sourceforge.net>
+ *  Copyright (C) 2012-2013 Andrey Prygunkov <hugbug@users.sourceforge.net>
  *
  *  This program is free software; you can redistribute it and/or modify
  *  it under the terms of the GNU General Public License as published by
@@ -26,7 +26,72 @@
 #ifndef WEBSERVER_H
 #define WEBSERVER_H
 
+#include <deque>
+#include <time.h>
+
 #include "Connection.h"
+#include "Thread.h"
+
+class WebCache
+{
+public:
+	class CacheEntry
+	{
+	private:
+		char*			m_szFilename;
+		time_t			m_tModified;
+		long long		m_lSize;
+		char*			m_szBody;
+		int				m_iBodyLen;
+		char*			m_szGZBody;
+		int				m_iGZBodyLen;
+		char			m_szETag[32];
+		char			m_szGZETag[36];
+		char			m_szLastModified[32];
+		int				m_iRefCount;
+		bool			m_bObsolete;
+
+		friend class WebCache;
+
+	public:
+						CacheEntry(const char* szFilename, time_t tModified, long long lSize);
+						~CacheEntry();
+		const char*		GetFilename() { return m_szFilename; }
+		const char*		GetBody() { return m_szBody; }
+		int				GetBodyLen() { return m_iBodyLen; }
+		const char*		GetGZBody() { return m_szGZBody; }
+		int				GetGZBodyLen() { return m_iGZBodyLen; }
+		const char*		GetETag() { return m_szETag; }
+		const char*		GetGZETag() { return m_szGZETag; }
+		const char*		GetLastModified() { return m_szLastModified; }
+	};
+
+	typedef std::deque<CacheEntry*>		CacheEntries;
+
+private:
+	CacheEntries		m_CacheEntries;
+	Mutex				m_mutexCacheEntries;
+	long long			m_lCachedSize;
+
+	CacheEntry*			LoadEntry(const char* szFilename, time_t tModified, long long lSize);
+	CacheEntry*			FindEntry(const char* szFilename, time_t tModified, long long lSize);
+	void				Evict();
+	void				RemoveEntry(CacheEntry* pEntry);
+
+public:
+						WebCache();
+						~WebCache();
+
+	/*
+	 * Returns cache entry for the file, loading (and compressing) it on first access
+	 * or if the file was modified since it was cached. The least recently used
+	 * entries are evicted if the total size of cached data exceeds the limit.
+	 * Returns NULL if the file doesn't exist or is too large to be cached.
+	 * The returned entry must be released with "Release".
+	 */
+	CacheEntry*			Acquire(const char* szFilename);
+	void				Release(CacheEntry* pCacheEntry);
+};
 
 class WebProcessor
 {
@@ -45,19 +110,31 @@ private:
 	EHttpMethod			m_eHttpMethod;
 	bool				m_bGZip;
 	char*				m_szOrigin;
+	char*				m_szIfNoneMatch;
+	char*				m_szAccept;
+
+	static WebCache*	m_pWebCache;
 
 	void				Dispatch();
 	void				SendAuthResponse();
 	void				SendOptionsResponse();
 	void				SendErrorResponse(const char* szErrCode);
 	void				SendFileResponse(const char* szFilename);
+	void				SendCachedFileResponse(WebCache::CacheEntry* pCacheEntry, const char* szContentType);
+	void				SendNotModifiedResponse(const char* szETag);
 	void				SendBodyResponse(const char* szBody, int iBodyLen, const char* szContentType);
+	void				SendDataResponse(const char* szBody, int iBodyLen, const char* szContentType,
+							bool bGZip, const char* szExtraHeaders);
+	void				SendResponseHeader(long long lBodyLen, const char* szContentType,
+							bool bGZip, const char* szExtraHeaders);
 	void				SendRedirectResponse(const char* szURL);
 	const char*			DetectContentType(const char* szFilename);
 
 public:
 						WebProcessor();
 						~WebProcessor();
+	static void			Init();
+	static void			Final();
 	void				Execute();
 	void				SetConnection(Connection* pConnection) { m_pConnection = pConnection; }
 	void				SetUrl(const char* szUrl);
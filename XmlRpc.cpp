@@ -63,6 +63,438 @@ extern void ExitProc();
 extern void Reload();
 
 
+//*****************************************************************
+// ResponseWriter
+
+ResponseWriter::ResponseWriter(StringBuilder* pStringBuilder)
+{
+	m_pStringBuilder = pStringBuilder;
+	m_iDepth = 0;
+}
+
+void ResponseWriter::BeginValue()
+{
+	if (m_iDepth > 0 && !m_Frames[m_iDepth - 1].bStruct)
+	{
+		WriteItemStart(m_Frames[m_iDepth - 1].iCount++);
+	}
+}
+
+void ResponseWriter::EndValue()
+{
+	if (m_iDepth > 0)
+	{
+		if (m_Frames[m_iDepth - 1].bStruct)
+		{
+			WriteMemberEnd();
+		}
+		else
+		{
+			WriteItemEnd();
+		}
+	}
+}
+
+void ResponseWriter::BeginStruct()
+{
+	BeginValue();
+	Frame* pFrame = &m_Frames[m_iDepth++];
+	pFrame->bStruct = true;
+	pFrame->iCount = 0;
+	pFrame->iStartPos = m_pStringBuilder->GetUsedSize();
+	WriteStructStart();
+}
+
+void ResponseWriter::EndStruct()
+{
+	Frame* pFrame = &m_Frames[--m_iDepth];
+	WriteStructEnd(pFrame->iStartPos, pFrame->iCount);
+	EndValue();
+}
+
+void ResponseWriter::BeginArray()
+{
+	BeginValue();
+	Frame* pFrame = &m_Frames[m_iDepth++];
+	pFrame->bStruct = false;
+	pFrame->iCount = 0;
+	pFrame->iStartPos = m_pStringBuilder->GetUsedSize();
+	WriteArrayStart();
+}
+
+void ResponseWriter::EndArray()
+{
+	Frame* pFrame = &m_Frames[--m_iDepth];
+	WriteArrayEnd(pFrame->iStartPos, pFrame->iCount);
+	EndValue();
+}
+
+void ResponseWriter::Member(const char* szName)
+{
+	WriteMemberStart(szName, m_Frames[m_iDepth - 1].iCount++);
+}
+
+void ResponseWriter::IntValue(int iValue)
+{
+	BeginValue();
+	WriteInt(iValue);
+	EndValue();
+}
+
+void ResponseWriter::UIntValue(unsigned int iValue)
+{
+	BeginValue();
+	WriteUInt(iValue);
+	EndValue();
+}
+
+void ResponseWriter::BoolValue(bool bValue)
+{
+	BeginValue();
+	WriteBool(bValue);
+	EndValue();
+}
+
+void ResponseWriter::StrValue(const char* szValue)
+{
+	BeginValue();
+	WriteStr(szValue ? szValue : "");
+	EndValue();
+}
+
+/*
+ * Appends already encoded value (produced by another writer of the same kind).
+ */
+void ResponseWriter::RawValue(const char* szData, int iLen)
+{
+	BeginValue();
+	m_pStringBuilder->Append(szData, iLen);
+	EndValue();
+}
+
+//*****************************************************************
+// XmlResponseWriter
+
+void XmlResponseWriter::WriteStructStart()
+{
+	m_pStringBuilder->Append("<struct>\n");
+}
+
+void XmlResponseWriter::WriteStructEnd(int iStartPos, int iCount)
+{
+	m_pStringBuilder->Append("</struct>");
+}
+
+void XmlResponseWriter::WriteArrayStart()
+{
+	m_pStringBuilder->Append("<array><data>\n");
+}
+
+void XmlResponseWriter::WriteArrayEnd(int iStartPos, int iCount)
+{
+	m_pStringBuilder->Append("</data></array>");
+}
+
+void XmlResponseWriter::WriteMemberStart(const char* szName, int iIndex)
+{
+	m_pStringBuilder->Append("<member><name>");
+	m_pStringBuilder->Append(szName);
+	m_pStringBuilder->Append("</name><value>");
+}
+
+void XmlResponseWriter::WriteMemberEnd()
+{
+	m_pStringBuilder->Append("</value></member>\n");
+}
+
+void XmlResponseWriter::WriteItemStart(int iIndex)
+{
+	m_pStringBuilder->Append("<value>");
+}
+
+void XmlResponseWriter::WriteItemEnd()
+{
+	m_pStringBuilder->Append("</value>\n");
+}
+
+void XmlResponseWriter::WriteInt(int iValue)
+{
+	char szValue[32];
+	snprintf(szValue, sizeof(szValue), "<i4>%i</i4>", iValue);
+	szValue[sizeof(szValue)-1] = '\0';
+	m_pStringBuilder->Append(szValue);
+}
+
+void XmlResponseWriter::WriteUInt(unsigned int iValue)
+{
+	char szValue[32];
+	snprintf(szValue, sizeof(szValue), "<i4>%u</i4>", iValue);
+	szValue[sizeof(szValue)-1] = '\0';
+	m_pStringBuilder->Append(szValue);
+}
+
+void XmlResponseWriter::WriteBool(bool bValue)
+{
+	m_pStringBuilder->Append(bValue ? "<boolean>1</boolean>" : "<boolean>0</boolean>");
+}
+
+void XmlResponseWriter::WriteStr(const char* szValue)
+{
+	m_pStringBuilder->Append("<string>");
+	WebUtil::XmlEncode(szValue, m_pStringBuilder);
+	m_pStringBuilder->Append("</string>");
+}
+
+//*****************************************************************
+// JsonResponseWriter
+
+void JsonResponseWriter::WriteStructStart()
+{
+	m_pStringBuilder->Append("{\n");
+}
+
+void JsonResponseWriter::WriteStructEnd(int iStartPos, int iCount)
+{
+	m_pStringBuilder->Append("\n}");
+}
+
+void JsonResponseWriter::WriteArrayStart()
+{
+	m_pStringBuilder->Append("[\n");
+}
+
+void JsonResponseWriter::WriteArrayEnd(int iStartPos, int iCount)
+{
+	m_pStringBuilder->Append("\n]");
+}
+
+void JsonResponseWriter::WriteMemberStart(const char* szName, int iIndex)
+{
+	m_pStringBuilder->Append(iIndex > 0 ? ",\n\"" : "\"");
+	m_pStringBuilder->Append(szName);
+	m_pStringBuilder->Append("\" : ");
+}
+
+void JsonResponseWriter::WriteItemStart(int iIndex)
+{
+	if (iIndex > 0)
+	{
+		m_pStringBuilder->Append(",\n");
+	}
+}
+
+void JsonResponseWriter::WriteInt(int iValue)
+{
+	char szValue[32];
+	snprintf(szValue, sizeof(szValue), "%i", iValue);
+	szValue[sizeof(szValue)-1] = '\0';
+	m_pStringBuilder->Append(szValue);
+}
+
+void JsonResponseWriter::WriteUInt(unsigned int iValue)
+{
+	char szValue[32];
+	snprintf(szValue, sizeof(szValue), "%u", iValue);
+	szValue[sizeof(szValue)-1] = '\0';
+	m_pStringBuilder->Append(szValue);
+}
+
+void JsonResponseWriter::WriteBool(bool bValue)
+{
+	m_pStringBuilder->Append(bValue ? "true" : "false");
+}
+
+void JsonResponseWriter::WriteStr(const char* szValue)
+{
+	m_pStringBuilder->Append("\"");
+	WebUtil::JsonEncode(szValue, m_pStringBuilder);
+	m_pStringBuilder->Append("\"");
+}
+
+//*****************************************************************
+// MsgPackResponseWriter
+
+static const int MSGPACK_MAX_HEADER_SIZE = 5;
+
+void MsgPackResponseWriter::WriteStructStart()
+{
+	m_pStringBuilder->Append("\0\0\0\0\0", MSGPACK_MAX_HEADER_SIZE);
+}
+
+void MsgPackResponseWriter::WriteStructEnd(int iStartPos, int iCount)
+{
+	WriteHeader(iStartPos, iCount, 0x80, 0xde);
+}
+
+void MsgPackResponseWriter::WriteArrayStart()
+{
+	m_pStringBuilder->Append("\0\0\0\0\0", MSGPACK_MAX_HEADER_SIZE);
+}
+
+void MsgPackResponseWriter::WriteArrayEnd(int iStartPos, int iCount)
+{
+	WriteHeader(iStartPos, iCount, 0x90, 0xdc);
+}
+
+/*
+ * Writes map- or array-header into the reserved space and removes the unused part of it.
+ * cFixType - type byte for small (up to 15 elements) maps/arrays;
+ * c16Type - type byte for maps/arrays with 16-bit length, the type with 32-bit length follows it.
+ */
+void MsgPackResponseWriter::WriteHeader(int iStartPos, int iCount, unsigned char cFixType, unsigned char c16Type)
+{
+	unsigned char szHeader[MSGPACK_MAX_HEADER_SIZE];
+	int iLen;
+	if (iCount < 16)
+	{
+		szHeader[0] = cFixType | (unsigned char)iCount;
+		iLen = 1;
+	}
+	else if (iCount < 0x10000)
+	{
+		szHeader[0] = c16Type;
+		szHeader[1] = (unsigned char)(iCount >> 8);
+		szHeader[2] = (unsigned char)iCount;
+		iLen = 3;
+	}
+	else
+	{
+		szHeader[0] = c16Type + 1;
+		szHeader[1] = (unsigned char)(iCount >> 24);
+		szHeader[2] = (unsigned char)(iCount >> 16);
+		szHeader[3] = (unsigned char)(iCount >> 8);
+		szHeader[4] = (unsigned char)iCount;
+		iLen = 5;
+	}
+
+	m_pStringBuilder->Overwrite(iStartPos + MSGPACK_MAX_HEADER_SIZE - iLen, (char*)szHeader, iLen);
+	if (iLen < MSGPACK_MAX_HEADER_SIZE)
+	{
+		m_pStringBuilder->Erase(iStartPos, MSGPACK_MAX_HEADER_SIZE - iLen);
+	}
+}
+
+void MsgPackResponseWriter::WriteMemberStart(const char* szName, int iIndex)
+{
+	WriteStr(szName);
+}
+
+void MsgPackResponseWriter::WriteInt(int iValue)
+{
+	if (iValue >= 0)
+	{
+		WriteUInt((unsigned int)iValue);
+		return;
+	}
+
+	unsigned char szData[5];
+	int iLen;
+	if (iValue >= -32)
+	{
+		szData[0] = (unsigned char)iValue;
+		iLen = 1;
+	}
+	else if (iValue >= -128)
+	{
+		szData[0] = 0xd0;
+		szData[1] = (unsigned char)iValue;
+		iLen = 2;
+	}
+	else if (iValue >= -32768)
+	{
+		szData[0] = 0xd1;
+		szData[1] = (unsigned char)(iValue >> 8);
+		szData[2] = (unsigned char)iValue;
+		iLen = 3;
+	}
+	else
+	{
+		szData[0] = 0xd2;
+		szData[1] = (unsigned char)(iValue >> 24);
+		szData[2] = (unsigned char)(iValue >> 16);
+		szData[3] = (unsigned char)(iValue >> 8);
+		szData[4] = (unsigned char)iValue;
+		iLen = 5;
+	}
+	WriteData((char*)szData, iLen);
+}
+
+void MsgPackResponseWriter::WriteUInt(unsigned int iValue)
+{
+	unsigned char szData[5];
+	int iLen;
+	if (iValue < 0x80)
+	{
+		szData[0] = (unsigned char)iValue;
+		iLen = 1;
+	}
+	else if (iValue < 0x100)
+	{
+		szData[0] = 0xcc;
+		szData[1] = (unsigned char)iValue;
+		iLen = 2;
+	}
+	else if (iValue < 0x10000)
+	{
+		szData[0] = 0xcd;
+		szData[1] = (unsigned char)(iValue >> 8);
+		szData[2] = (unsigned char)iValue;
+		iLen = 3;
+	}
+	else
+	{
+		szData[0] = 0xce;
+		szData[1] = (unsigned char)(iValue >> 24);
+		szData[2] = (unsigned char)(iValue >> 16);
+		szData[3] = (unsigned char)(iValue >> 8);
+		szData[4] = (unsigned char)iValue;
+		iLen = 5;
+	}
+	WriteData((char*)szData, iLen);
+}
+
+void MsgPackResponseWriter::WriteBool(bool bValue)
+{
+	WriteData(bValue ? "\xc3" : "\xc2", 1);
+}
+
+void MsgPackResponseWriter::WriteStr(const char* szValue)
+{
+	unsigned int iStrLen = strlen(szValue);
+	unsigned char szHeader[5];
+	int iLen;
+	if (iStrLen < 32)
+	{
+		szHeader[0] = 0xa0 | (unsigned char)iStrLen;
+		iLen = 1;
+	}
+	else if (iStrLen < 0x100)
+	{
+		szHeader[0] = 0xd9;
+		szHeader[1] = (unsigned char)iStrLen;
+		iLen = 2;
+	}
+	else if (iStrLen < 0x10000)
+	{
+		szHeader[0] = 0xda;
+		szHeader[1] = (unsigned char)(iStrLen >> 8);
+		szHeader[2] = (unsigned char)iStrLen;
+		iLen = 3;
+	}
+	else
+	{
+		szHeader[0] = 0xdb;
+		szHeader[1] = (unsigned char)(iStrLen >> 24);
+		szHeader[2] = (unsigned char)(iStrLen >> 16);
+		szHeader[3] = (unsigned char)(iStrLen >> 8);
+		szHeader[4] = (unsigned char)iStrLen;
+		iLen = 5;
+	}
+	WriteData((char*)szHeader, iLen);
+	WriteData(szValue, iStrLen);
+}
+
+
 //*****************************************************************
 // XmlRpcProcessor
 
@@ -71,6 +503,7 @@ XmlRpcProcessor::XmlRpcProcessor()
 	m_szRequest = NULL;
 	m_eProtocol = rpUndefined;
 	m_eHttpMethod = hmPost;
+	m_bMsgPack = false;
 	m_szUrl = NULL;
 	m_szContentType = NULL;
 }
@@ -88,6 +521,15 @@ void XmlRpcProcessor::SetUrl(const char* szUrl)
 	m_szUrl = strdup(szUrl);
 }
 
+/*
+ * Clients can request a compact binary (MessagePack) encoding of JSON-RPC responses
+ * by sending header "Accept: application/x-msgpack" (or "application/msgpack").
+ */
+void XmlRpcProcessor::SetAccept(const char* szAccept)
+{
+	m_bMsgPack = strstr(szAccept, "application/x-msgpack") || strstr(szAccept, "application/msgpack");
+}
+
 
 bool XmlRpcProcessor::IsRpcRequest(const char* szUrl)
 {
@@ -117,6 +559,9 @@ void XmlRpcProcessor::Execute()
 		return;
 	}
 
+	// the binary encoding is supported for JSON-RPC only
+	m_bMsgPack = m_bMsgPack && m_eProtocol == rpJsonRpc;
+
 	Dispatch();
 }
 
@@ -174,9 +619,17 @@ void XmlRpcProcessor::Dispatch()
 		command->SetRequest(szRequest);
 		command->SetProtocol(m_eProtocol);
 		command->SetHttpMethod(m_eHttpMethod);
+		command->SetMsgPack(m_bMsgPack);
 		command->PrepareParams();
 		command->Execute();
-		BuildResponse(command->GetResponse(), command->GetCallbackFunc(), command->GetFault());
+		if (m_bMsgPack)
+		{
+			BuildMsgPackResponse(command->GetResponse(), command->GetResponseLen(), command->GetFault());
+		}
+		else
+		{
+			BuildResponse(command->GetResponse(), command->GetCallbackFunc(), command->GetFault());
+		}
 		delete command;
 	}
 }
@@ -206,8 +659,12 @@ void XmlRpcProcessor::MutliCall()
 		WebUtil::XmlParseTagValue(szNameEnd, "string", szMethodName, sizeof(szMethodName), NULL);
 		debug("MutliCall, MethodName=%s", szMethodName);
 
+		// the parameters are parsed by position, the string with method name must
+		// not be taken as first parameter
+		char* szParams = strstr(szRequestPtr, "<name>params</name>");
 		XmlCommand* command = CreateCommand(szMethodName);
-		command->SetRequest(szRequestPtr);
+		command->SetRequest(szParams ? szParams + 19 : szCallEnd); // strlen("<name>params</name>")
+		command->PrepareParams();
 		command->Execute();
 
 		debug("MutliCall, Response=%s", command->GetResponse());
@@ -294,6 +751,18 @@ void XmlRpcProcessor::BuildResponse(const char* szResponse, const char* szCallba
 	m_szContentType = bXmlRpc ? "text/xml" : "application/json";
 }
 
+void XmlRpcProcessor::BuildMsgPackResponse(const char* szResponse, int iResponseLen, bool bFault)
+{
+	MsgPackResponseWriter writer(&m_cResponse);
+	writer.BeginStruct();
+	writer.StrMember("version", "1.1");
+	writer.Member(bFault ? "error" : "result");
+	writer.RawValue(szResponse, iResponseLen);
+	writer.EndStruct();
+
+	m_szContentType = "application/x-msgpack";
+}
+
 XmlCommand* XmlRpcProcessor::CreateCommand(const char* szMethodName)
 {
 	XmlCommand* command = NULL;
@@ -342,6 +811,10 @@ XmlCommand* XmlRpcProcessor::CreateCommand(const char* szMethodName)
 	{
 		command = new LogXmlCommand();
 	}
+	else if (!strcasecmp(szMethodName, "loadlog"))
+	{
+		command = new LoadLogXmlCommand();
+	}
 	else if (!strcasecmp(szMethodName, "listfiles"))
 	{
 		command = new ListFilesXmlCommand();
@@ -453,37 +926,26 @@ XmlCommand* XmlRpcProcessor::CreateCommand(const char* szMethodName)
 XmlCommand::XmlCommand()
 {
 	m_szRequest = NULL;
-	m_szRequestPtr = NULL;
 	m_szCallbackFunc = NULL;
+	m_iParamIndex = 0;
+	m_pWriter = NULL;
 	m_bFault = false;
+	m_bMsgPack = false;
 	m_eProtocol = XmlRpcProcessor::rpUndefined;
 }
 
+XmlCommand::~XmlCommand()
+{
+	delete m_pWriter;
+}
+
 bool XmlCommand::IsJson()
 { 
 	return m_eProtocol == XmlRpcProcessor::rpJsonRpc || m_eProtocol == XmlRpcProcessor::rpJsonPRpc;
 }
 
-void XmlCommand::AppendResponse(const char* szPart)
-{
-	m_StringBuilder.Append(szPart);
-}
-
 void XmlCommand::BuildErrorResponse(int iErrCode, const char* szErrText, ...)
 {
-	const char* XML_RESPONSE_ERROR_BODY = 
-		"<struct>\n"
-		"<member><name>faultCode</name><value><i4>%i</i4></value></member>\n"
-		"<member><name>faultString</name><value><string>%s</string></value></member>\n"
-		"</struct>\n";
-
-	const char* JSON_RESPONSE_ERROR_BODY = 
-		"{\n"
-        "\"name\" : \"JSONRPCError\",\n"
-        "\"code\" : %i,\n"
-        "\"message\" : \"%s\"\n"
-        "}";
-
 	char szFullText[1024];
 
 	va_list ap;
@@ -492,43 +954,58 @@ void XmlCommand::BuildErrorResponse(int iErrCode, const char* szErrText, ...)
 	szFullText[1024-1] = '\0';
 	va_end(ap);
 
-	char* xmlText = EncodeStr(szFullText);
-
-	char szContent[1024];
-	snprintf(szContent, 1024, IsJson() ? JSON_RESPONSE_ERROR_BODY : XML_RESPONSE_ERROR_BODY, iErrCode, xmlText);
-	szContent[1024-1] = '\0';
-
-	free(xmlText);
-
-	AppendResponse(szContent);
+	m_pWriter->BeginStruct();
+	if (IsJson())
+	{
+		m_pWriter->StrMember("name", "JSONRPCError");
+		m_pWriter->IntMember("code", iErrCode);
+		m_pWriter->StrMember("message", szFullText);
+	}
+	else
+	{
+		m_pWriter->IntMember("faultCode", iErrCode);
+		m_pWriter->StrMember("faultString", szFullText);
+	}
+	m_pWriter->EndStruct();
 
 	m_bFault = true;
 }
 
 void XmlCommand::BuildBoolResponse(bool bOK)
 {
-	const char* XML_RESPONSE_BOOL_BODY = "<boolean>%s</boolean>";
-	const char* JSON_RESPONSE_BOOL_BODY = "%s";
-
-	char szContent[1024];
-	snprintf(szContent, 1024, IsJson() ? JSON_RESPONSE_BOOL_BODY : XML_RESPONSE_BOOL_BODY,
-		BoolToStr(bOK));
-	szContent[1024-1] = '\0';
-
-	AppendResponse(szContent);
+	m_pWriter->BoolValue(bOK);
 }
 
 void XmlCommand::PrepareParams()
 {
-	if (IsJson() && m_eHttpMethod == XmlRpcProcessor::hmPost)
+	if (m_bMsgPack)
+	{
+		m_pWriter = new MsgPackResponseWriter(&m_StringBuilder);
+	}
+	else if (IsJson())
+	{
+		m_pWriter = new JsonResponseWriter(&m_StringBuilder);
+	}
+	else
+	{
+		m_pWriter = new XmlResponseWriter(&m_StringBuilder);
+	}
+
+	if (m_eHttpMethod == XmlRpcProcessor::hmGet)
 	{
-		char* szParams = strstr(m_szRequestPtr, "\"params\"");
-		if (!szParams)
+		ParseUrlParams(m_szRequest);
+	}
+	else if (IsJson())
+	{
+		char* szParams = strstr(m_szRequest, "\"params\"");
+		if (szParams)
 		{
-			m_szRequestPtr[0] = '\0';
-			return;
+			ParseJsonParams(szParams + 8); // strlen("\"params\"")
 		}
-		m_szRequestPtr = szParams + 8; // strlen("\"params\"")
+	}
+	else
+	{
+		ParseXmlParams(m_szRequest);
 	}
 
 	if (m_eProtocol == XmlRpcProcessor::rpJsonPRpc)
@@ -537,194 +1014,283 @@ void XmlCommand::PrepareParams()
 	}
 }
 
-bool XmlCommand::NextParamAsInt(int* iValue)
+void XmlCommand::AddParam(EParamType eType, char* szValue, int iLen, bool bEscaped)
 {
-	if (m_eHttpMethod == XmlRpcProcessor::hmGet)
+	RequestParam param;
+	param.eType = eType;
+	param.szValue = szValue;
+	param.iLen = iLen;
+	param.bEscaped = bEscaped;
+	m_Params.push_back(param);
+}
+
+/*
+ * The request is parsed only once, all values are collected into the parameter list.
+ * The values are not copied: they are terminated with null-character in the request buffer.
+ */
+void XmlCommand::ParseUrlParams(char* szRequest)
+{
+	// name1=value1&name2=value2...
+	char* p = szRequest;
+	while (*p)
 	{
-		char* szParam = strchr(m_szRequestPtr, '=');
-		if (!szParam)
+		char* szParamEnd = strchr(p, '&');
+		if (szParamEnd)
 		{
-			return false;
+			*szParamEnd = '\0';
 		}
-		*iValue = atoi(szParam + 1);
-		m_szRequestPtr = szParam + 1;
-		return true;
-	}
-	else if (IsJson())
-	{
-		int iLen = 0;
-		char* szParam = (char*)WebUtil::JsonNextValue(m_szRequestPtr, &iLen);
-		if (!szParam || !strchr("-+0123456789", *szParam))
+
+		char* szValue = strchr(p, '=');
+		if (szValue)
 		{
-			return false;
+			szValue++; // skip '='
+			AddParam(ptText, szValue, szParamEnd ? (int)(szParamEnd - szValue) : strlen(szValue), false);
 		}
-		*iValue = atoi(szParam);
-		m_szRequestPtr = szParam + iLen + 1;
-		return true;
+
+		if (!szParamEnd)
+		{
+			break;
+		}
+		p = szParamEnd + 1;
 	}
-	else
-	{
-		int iLen = 0;
-		int iTagLen = 4; //strlen("<i4>");
-		char* szParam = (char*)WebUtil::XmlFindTag(m_szRequestPtr, "i4", &iLen);
-		if (!szParam)
+}
+
+void XmlCommand::ParseJsonParams(char* szRequest)
+{
+	// the structure of nested arrays and objects is not preserved, all values are
+	// collected into one flat list in the order of appearance; the list ends with
+	// the closing bracket of the top-level params array
+	char* p = szRequest;
+	int iDepth = 0;
+	while (true)
+	{
+		while (*p && strchr(" ,:\r\n\t\f", *p)) p++;
+		if (!*p)
 		{
-			szParam = (char*)WebUtil::XmlFindTag(m_szRequestPtr, "int", &iLen);
-			iTagLen = 5; //strlen("<int>");
+			break;
 		}
-		if (!szParam || !strchr("-+0123456789", *szParam))
+
+		if (*p == '[' || *p == '{')
 		{
-			return false;
+			iDepth++;
+			p++;
+			continue;
 		}
-		*iValue = atoi(szParam);
-		m_szRequestPtr = szParam + iLen + iTagLen;
-		return true;
-	}
-}
 
-bool XmlCommand::NextParamAsBool(bool* bValue)
-{
-	if (m_eHttpMethod == XmlRpcProcessor::hmGet)
-	{
-		char* szParam;
-		if (!NextParamAsStr(&szParam))
+		if (*p == ']' || *p == '}')
 		{
-			return false;
+			iDepth--;
+			p++;
+			if (iDepth <= 0)
+			{
+				break;
+			}
+			continue;
 		}
 
-		if (IsJson())
+		if (*p == '"')
 		{
-			if (!strcmp(szParam, "true"))
+			char* szValue = ++p;
+			bool bEscaped = false;
+			while (*p && *p != '"')
 			{
-				*bValue = true;
-				return true;
+				if (*p == '\\')
+				{
+					bEscaped = true;
+					if (!*++p)
+					{
+						break;
+					}
+				}
+				p++;
 			}
-			else if (!strcmp(szParam, "false"))
+			if (!*p)
 			{
-				*bValue = false;
-				return true;
+				// unterminated string
+				break;
 			}
+			*p = '\0';
+			AddParam(ptString, szValue, (int)(p - szValue), bEscaped);
+			p++;
 		}
 		else
 		{
-			*bValue = szParam[0] == '1';
-			return true;
+			char* szValue = p;
+			while (*p && !strchr(" ,]}\r\n\t\f", *p)) p++;
+			int iLen = (int)(p - szValue);
+			EParamType eType = 
+				strchr("-+0123456789", *szValue) ? ptInt :
+				(iLen == 4 && !strncmp(szValue, "true", 4)) || (iLen == 5 && !strncmp(szValue, "false", 5)) ? ptBool :
+				ptOther;
+			AddParam(eType, szValue, iLen, false);
+		}
+
+		if (iDepth == 0)
+		{
+			// params is a single value, not an array
+			break;
 		}
-		return false;
 	}
-	else if (IsJson())
+}
+
+void XmlCommand::ParseXmlParams(char* szRequest)
+{
+	// only values of supported types are collected, the other tags are skipped
+	char* p = szRequest;
+	while ((p = strchr(p, '<')))
 	{
-		int iLen = 0;
-		char* szParam = (char*)WebUtil::JsonNextValue(m_szRequestPtr, &iLen);
-		if (!szParam)
+		p++;
+		char* szTagEnd = strchr(p, '>');
+		if (!szTagEnd)
 		{
-			return false;
+			break;
 		}
-		if (iLen == 4 && !strncmp(szParam, "true", 4))
+
+		int iTagLen = (int)(szTagEnd - p);
+		bool bEmpty = iTagLen > 0 && p[iTagLen - 1] == '/';
+		if (bEmpty)
 		{
-			*bValue = true;
-			m_szRequestPtr = szParam + iLen + 1;
-			return true;
+			iTagLen--;
 		}
-		else if (iLen == 5 && !strncmp(szParam, "false", 5))
+
+		EParamType eType =
+			(iTagLen == 2 && !strncmp(p, "i4", 2)) || (iTagLen == 3 && !strncmp(p, "int", 3)) ? ptInt :
+			iTagLen == 7 && !strncmp(p, "boolean", 7) ? ptBool :
+			iTagLen == 6 && !strncmp(p, "string", 6) ? ptString :
+			ptOther;
+
+		if (eType == ptOther)
 		{
-			*bValue = false;
-			m_szRequestPtr = szParam + iLen + 1;
-			return true;
+			p = szTagEnd + 1;
+			continue;
 		}
-		else
+
+		if (bEmpty)
 		{
-			return false;
+			// <string/>
+			p[iTagLen] = '\0';
+			AddParam(eType, p + iTagLen, 0, false);
+			p = szTagEnd + 1;
+			continue;
 		}
-	}
-	else
-	{
-		int iLen = 0;
-		char* szParam = (char*)WebUtil::XmlFindTag(m_szRequestPtr, "boolean", &iLen);
-		if (!szParam)
+
+		char* szValue = szTagEnd + 1;
+		char* szValueEnd = strchr(szValue, '<');
+		if (!szValueEnd)
 		{
-			return false;
+			break;
 		}
-		*bValue = szParam[0] == '1';
-		m_szRequestPtr = szParam + iLen + 9; //strlen("<boolean>");
+		*szValueEnd = '\0';
+		AddParam(eType, szValue, (int)(szValueEnd - szValue), false);
+		p = szValueEnd + 1;
+	}
+}
+
+bool XmlCommand::NextParamAsInt(int* iValue)
+{
+	if (m_iParamIndex >= m_Params.size())
+	{
+		return false;
+	}
+
+	RequestParam& param = m_Params[m_iParamIndex];
+	if (param.eType == ptText ||
+		(param.eType == ptInt && strchr("-+0123456789", *param.szValue)))
+	{
+		*iValue = atoi(param.szValue);
+		m_iParamIndex++;
 		return true;
 	}
+
+	return false;
 }
 
-bool XmlCommand::NextParamAsStr(char** szValue)
+bool XmlCommand::NextParamAsBool(bool* bValue)
 {
-	if (m_eHttpMethod == XmlRpcProcessor::hmGet)
+	if (m_iParamIndex >= m_Params.size())
+	{
+		return false;
+	}
+
+	RequestParam& param = m_Params[m_iParamIndex];
+	if (param.eType == ptText && IsJson())
 	{
-		char* szParam = strchr(m_szRequestPtr, '=');
-		if (!szParam)
+		if (!strcmp(param.szValue, "true"))
 		{
-			return false;
+			*bValue = true;
 		}
-		szParam++; // skip '='
-		int iLen = 0;
-		char* szParamEnd = strchr(m_szRequestPtr, '&');
-		if (szParamEnd)
+		else if (!strcmp(param.szValue, "false"))
 		{
-			iLen = (int)(szParamEnd - szParam);
-			szParam[iLen] = '\0';
+			*bValue = false;
 		}
 		else
 		{
-			iLen = strlen(szParam) - 1;
+			return false;
 		}
-		m_szRequestPtr = szParam + iLen + 1;
-		*szValue = szParam;
-		return true;
 	}
-	else if (IsJson())
+	else if (param.eType == ptBool && IsJson())
 	{
-		int iLen = 0;
-		char* szParam = (char*)WebUtil::JsonNextValue(m_szRequestPtr, &iLen);
-		if (!szParam || iLen < 2 || szParam[0] != '"' || szParam[iLen - 1] != '"')
-		{
-			return false;
-		}
-		szParam++; // skip first '"'
-		szParam[iLen - 2] = '\0'; // skip last '"'
-		m_szRequestPtr = szParam + iLen;
-		*szValue = szParam;
-		return true;
+		*bValue = param.iLen == 4;	// "true"
+	}
+	else if (param.eType == ptText || param.eType == ptBool)
+	{
+		*bValue = param.szValue[0] == '1';
 	}
 	else
 	{
-		int iLen = 0;
-		char* szParam = (char*)WebUtil::XmlFindTag(m_szRequestPtr, "string", &iLen);
-		if (!szParam)
-		{
-			return false;
-		}
-		szParam[iLen] = '\0';
-		m_szRequestPtr = szParam + iLen + 8; //strlen("<string>")
-		*szValue = szParam;
-		return true;
+		return false;
 	}
+
+	m_iParamIndex++;
+	return true;
 }
 
-const char* XmlCommand::BoolToStr(bool bValue)
+bool XmlCommand::NextParamAsStr(char** szValue)
 {
-	return IsJson() ? (bValue ? "true" : "false") : (bValue ? "1" : "0");
+	if (m_iParamIndex >= m_Params.size())
+	{
+		return false;
+	}
+
+	RequestParam& param = m_Params[m_iParamIndex];
+	if (param.eType != ptText && param.eType != ptString)
+	{
+		return false;
+	}
+
+	*szValue = param.szValue;
+	m_iParamIndex++;
+	return true;
 }
 
-char* XmlCommand::EncodeStr(const char* szStr)
+/*
+ * Decodes base64-encoded string parameter in place, no additional buffers are allocated.
+ */
+bool XmlCommand::NextParamAsBase64(char** pData, int* pLen)
 {
-	if (!szStr)
+	if (m_iParamIndex >= m_Params.size())
 	{
-		return strdup("");
+		return false;
 	}
 
-	if (IsJson()) 
+	RequestParam& param = m_Params[m_iParamIndex];
+	if (!NextParamAsStr(pData))
 	{
-		return WebUtil::JsonEncode(szStr);
+		return false;
 	}
-	else
+
+	int iLen = param.iLen;
+	if (param.bEscaped)
 	{
-		return WebUtil::XmlEncode(szStr);
+		// JSON-string may contain '/'-character used in Base64, which must be escaped in JSON
+		WebUtil::JsonDecode(param.szValue);
+		iLen = strlen(param.szValue);
 	}
+
+	*pLen = WebUtil::DecodeBase64(param.szValue, iLen, param.szValue);
+	param.szValue[*pLen] = '\0';
+
+	return true;
 }
 
 void XmlCommand::DecodeStr(char* szStr)
@@ -749,6 +1315,32 @@ bool XmlCommand::CheckSafeMethod()
 	return bSafe;
 }
 
+void XmlCommand::WriteMessage(Message* pMessage)
+{
+	const char* szMessageType[] = { "INFO", "WARNING", "ERROR", "DEBUG", "DETAIL" };
+
+	m_pWriter->BeginStruct();
+	m_pWriter->IntMember("ID", pMessage->GetID());
+	m_pWriter->StrMember("Kind", szMessageType[pMessage->GetKind()]);
+	m_pWriter->IntMember("Time", (int)pMessage->GetTime());
+	m_pWriter->StrMember("Text", pMessage->GetText());
+	m_pWriter->EndStruct();
+}
+
+void XmlCommand::WriteParameters(NZBParameterList* pParameters)
+{
+	m_pWriter->BeginArray();
+	for (NZBParameterList::iterator it = pParameters->begin(); it != pParameters->end(); it++)
+	{
+		NZBParameter* pParameter = *it;
+		m_pWriter->BeginStruct();
+		m_pWriter->StrMember("Name", pParameter->GetName());
+		m_pWriter->StrMember("Value", pParameter->GetValue());
+		m_pWriter->EndStruct();
+	}
+	m_pWriter->EndArray();
+}
+
 //*****************************************************************
 // Commands
 
@@ -852,14 +1444,7 @@ void ReloadXmlCommand::Execute()
 
 void VersionXmlCommand::Execute()
 {
-	const char* XML_RESPONSE_STRING_BODY = "<string>%s</string>";
-	const char* JSON_RESPONSE_STRING_BODY = "\"%s\"";
-
-	char szContent[1024];
-	snprintf(szContent, 1024, IsJson() ? JSON_RESPONSE_STRING_BODY : XML_RESPONSE_STRING_BODY, Util::VersionRevision());
-	szContent[1024-1] = '\0';
-
-	AppendResponse(szContent);
+	m_pWriter->StrValue(Util::VersionRevision());
 }
 
 void DumpDebugXmlCommand::Execute()
@@ -890,88 +1475,6 @@ void SetDownloadRateXmlCommand::Execute()
 
 void StatusXmlCommand::Execute()
 {
-	const char* XML_STATUS_START = 
-		"<struct>\n"
-		"<member><name>RemainingSizeLo</name><value><i4>%u</i4></value></member>\n"
-		"<member><name>RemainingSizeHi</name><value><i4>%u</i4></value></member>\n"
-		"<member><name>RemainingSizeMB</name><value><i4>%i</i4></value></member>\n"
-		"<member><name>DownloadedSizeLo</name><value><i4>%u</i4></value></member>\n"
-		"<member><name>DownloadedSizeHi</name><value><i4>%u</i4></value></member>\n"
-		"<member><name>DownloadedSizeMB</name><value><i4>%i</i4></value></member>\n"
-		"<member><name>DownloadRate</name><value><i4>%i</i4></value></member>\n"
-		"<member><name>AverageDownloadRate</name><value><i4>%i</i4></value></member>\n"
-		"<member><name>DownloadLimit</name><value><i4>%i</i4></value></member>\n"
-		"<member><name>ThreadCount</name><value><i4>%i</i4></value></member>\n"
-		"<member><name>ParJobCount</name><value><i4>%i</i4></value></member>\n"					// deprecated (renamed to PostJobCount)
-		"<member><name>PostJobCount</name><value><i4>%i</i4></value></member>\n"
-		"<member><name>UrlCount</name><value><i4>%i</i4></value></member>\n"
-		"<member><name>UpTimeSec</name><value><i4>%i</i4></value></member>\n"
-		"<member><name>DownloadTimeSec</name><value><i4>%i</i4></value></member>\n"
-		"<member><name>ServerPaused</name><value><boolean>%s</boolean></value></member>\n"		// deprecated (renamed to DownloadPaused)
-		"<member><name>DownloadPaused</name><value><boolean>%s</boolean></value></member>\n"
-		"<member><name>Download2Paused</name><value><boolean>%s</boolean></value></member>\n"
-		"<member><name>ServerStandBy</name><value><boolean>%s</boolean></value></member>\n"
-		"<member><name>PostPaused</name><value><boolean>%s</boolean></value></member>\n"
-		"<member><name>ScanPaused</name><value><boolean>%s</boolean></value></member>\n"
-		"<member><name>FreeDiskSpaceLo</name><value><i4>%u</i4></value></member>\n"
-		"<member><name>FreeDiskSpaceHi</name><value><i4>%u</i4></value></member>\n"
-		"<member><name>FreeDiskSpaceMB</name><value><i4>%i</i4></value></member>\n"
-		"<member><name>ServerTime</name><value><i4>%i</i4></value></member>\n"
-		"<member><name>ResumeTime</name><value><i4>%i</i4></value></member>\n"
-		"<member><name>FeedActive</name><value><boolean>%s</boolean></value></member>\n"
-		"<member><name>NewsServers</name><value><array><data>\n";
-
-	const char* XML_STATUS_END =
-		"</data></array></value></member>\n"
-		"</struct>\n";
-
-	const char* JSON_STATUS_START = 
-		"{\n"
-		"\"RemainingSizeLo\" : %u,\n"
-		"\"RemainingSizeHi\" : %u,\n"
-		"\"RemainingSizeMB\" : %i,\n"
-		"\"DownloadedSizeLo\" : %u,\n"
-		"\"DownloadedSizeHi\" : %u,\n"
-		"\"DownloadedSizeMB\" : %i,\n"
-		"\"DownloadRate\" : %i,\n"
-		"\"AverageDownloadRate\" : %i,\n"
-		"\"DownloadLimit\" : %i,\n"
-		"\"ThreadCount\" : %i,\n"
-		"\"ParJobCount\" : %i,\n"			// deprecated (renamed to PostJobCount)
-		"\"PostJobCount\" : %i,\n"
-		"\"UrlCount\" : %i,\n"
-		"\"UpTimeSec\" : %i,\n"
-		"\"DownloadTimeSec\" : %i,\n"
-		"\"ServerPaused\" : %s,\n"			// deprecated (renamed to DownloadPaused)
-		"\"DownloadPaused\" : %s,\n"
-		"\"Download2Paused\" : %s,\n"
-		"\"ServerStandBy\" : %s,\n"
-		"\"PostPaused\" : %s,\n"
-		"\"ScanPaused\" : %s,\n"
-		"\"FreeDiskSpaceLo\" : %u,\n"
-		"\"FreeDiskSpaceHi\" : %u,\n"
-		"\"FreeDiskSpaceMB\" : %i,\n"
-		"\"ServerTime\" : %i,\n"
-		"\"ResumeTime\" : %i,\n"
-		"\"FeedActive\" : %s,\n"
-		"\"NewsServers\" : [\n";
-
-	const char* JSON_STATUS_END = 
-		"]\n"
-		"}";
-
-	const char* XML_NEWSSERVER_ITEM = 
-		"<value><struct>\n"
-		"<member><name>ID</name><value><i4>%i</i4></value></member>\n"
-		"<member><name>Active</name><value><boolean>%s</boolean></value></member>\n"
-		"</struct></value>\n";
-
-	const char* JSON_NEWSSERVER_ITEM = 
-		"{\n"
-		"\"ID\" : %i,\n"
-		"\"Active\" : %s\n"
-		"}";
-
 	unsigned long iRemainingSizeHi, iRemainingSizeLo;
 	int iDownloadRate = (int)(g_pQueueCoordinator->CalcCurrentDownloadSpeed());
 	long long iRemainingSize = g_pQueueCoordinator->CalcRemainingSize();
@@ -1002,36 +1505,56 @@ void StatusXmlCommand::Execute()
 	int iServerTime = time(NULL);
 	int iResumeTime = g_pOptions->GetResumeTime();
 	bool bFeedActive = g_pFeedCoordinator->HasActiveDownloads();
-	
-	char szContent[3072];
-	snprintf(szContent, 3072, IsJson() ? JSON_STATUS_START : XML_STATUS_START, 
-		iRemainingSizeLo, iRemainingSizeHi,	iRemainingMBytes, iDownloadedSizeLo, iDownloadedSizeHi, 
-		iDownloadedMBytes, iDownloadRate, iAverageDownloadRate, iDownloadLimit,	iThreadCount, 
-		iPostJobCount, iPostJobCount, iUrlCount, iUpTimeSec, iDownloadTimeSec, 
-		BoolToStr(bDownloadPaused), BoolToStr(bDownloadPaused), BoolToStr(bDownload2Paused), 
-		BoolToStr(bServerStandBy), BoolToStr(bPostPaused), BoolToStr(bScanPaused),
-		iFreeDiskSpaceLo, iFreeDiskSpaceHi,	iFreeDiskSpaceMB, iServerTime, iResumeTime,
-		BoolToStr(bFeedActive));
-	szContent[3072-1] = '\0';
-
-	AppendResponse(szContent);
-
-	int index = 0;
+
+	m_pWriter->BeginStruct();
+	m_pWriter->UIntMember("RemainingSizeLo", iRemainingSizeLo);
+	m_pWriter->UIntMember("RemainingSizeHi", iRemainingSizeHi);
+	m_pWriter->IntMember("RemainingSizeMB", iRemainingMBytes);
+	m_pWriter->UIntMember("DownloadedSizeLo", iDownloadedSizeLo);
+	m_pWriter->UIntMember("DownloadedSizeHi", iDownloadedSizeHi);
+	m_pWriter->IntMember("DownloadedSizeMB", iDownloadedMBytes);
+	m_pWriter->IntMember("DownloadRate", iDownloadRate);
+	m_pWriter->IntMember("AverageDownloadRate", iAverageDownloadRate);
+	m_pWriter->IntMember("DownloadLimit", iDownloadLimit);
+	m_pWriter->IntMember("ThreadCount", iThreadCount);
+	m_pWriter->IntMember("ParJobCount", iPostJobCount);			// deprecated (renamed to PostJobCount)
+	m_pWriter->IntMember("PostJobCount", iPostJobCount);
+	m_pWriter->IntMember("UrlCount", iUrlCount);
+	m_pWriter->IntMember("UpTimeSec", iUpTimeSec);
+	m_pWriter->IntMember("DownloadTimeSec", iDownloadTimeSec);
+	m_pWriter->BoolMember("ServerPaused", bDownloadPaused);		// deprecated (renamed to DownloadPaused)
+	m_pWriter->BoolMember("DownloadPaused", bDownloadPaused);
+	m_pWriter->BoolMember("Download2Paused", bDownload2Paused);
+	m_pWriter->BoolMember("ServerStandBy", bServerStandBy);
+	m_pWriter->BoolMember("PostPaused", bPostPaused);
+	m_pWriter->BoolMember("ScanPaused", bScanPaused);
+	m_pWriter->UIntMember("FreeDiskSpaceLo", iFreeDiskSpaceLo);
+	m_pWriter->UIntMember("FreeDiskSpaceHi", iFreeDiskSpaceHi);
+	m_pWriter->IntMember("FreeDiskSpaceMB", iFreeDiskSpaceMB);
+	m_pWriter->IntMember("ServerTime", iServerTime);
+	m_pWriter->IntMember("ResumeTime", iResumeTime);
+	m_pWriter->BoolMember("FeedActive", bFeedActive);
+
+	m_pWriter->Member("NewsServers");
+	m_pWriter->BeginArray();
 	for (ServerPool::Servers::iterator it = g_pServerPool->GetServers()->begin(); it != g_pServerPool->GetServers()->end(); it++)
 	{
 		NewsServer* pServer = *it;
-		snprintf(szContent, sizeof(szContent), IsJson() ? JSON_NEWSSERVER_ITEM : XML_NEWSSERVER_ITEM,
-			pServer->GetID(), BoolToStr(pServer->GetActive()));
-		szContent[3072-1] = '\0';
-
-		if (IsJson() && index++ > 0)
-		{
-			AppendResponse(",\n");
-		}
-		AppendResponse(szContent);
-	}
-
-	AppendResponse(IsJson() ? JSON_STATUS_END : XML_STATUS_END);
+		m_pWriter->BeginStruct();
+		m_pWriter->IntMember("ID", pServer->GetID());
+		m_pWriter->BoolMember("Active", pServer->GetActive());
+		m_pWriter->IntMember("DownloadRate", pServer->GetDownloadRate());
+		m_pWriter->IntMember("ConnectTime", pServer->GetTiming(NewsServer::tmConnect));
+		m_pWriter->IntMember("AuthTime", pServer->GetTiming(NewsServer::tmAuth));
+		m_pWriter->IntMember("FirstByteTime", pServer->GetTiming(NewsServer::tmFirstByte));
+		m_pWriter->IntMember("IdleTime", pServer->GetTiming(NewsServer::tmIdle));
+		m_pWriter->IntMember("Weight", pServer->GetWeight());
+		m_pWriter->BoolMember("Demoted", pServer->GetDemoted());
+		m_pWriter->EndStruct();
+	}
+	m_pWriter->EndArray();
+
+	m_pWriter->EndStruct();
 }
 
 void LogXmlCommand::Execute()
@@ -1047,8 +1570,8 @@ void LogXmlCommand::Execute()
 	debug("iIDFrom=%i", iIDFrom);
 	debug("iNrEntries=%i", iNrEntries);
 
-	AppendResponse(IsJson() ? "[\n" : "<array><data>\n");
-	Log::Messages* pMessages = g_pLog->LockMessages();
+	m_pWriter->BeginArray();
+	Messages* pMessages = LockMessages();
 
 	int iStart = pMessages->size();
 	if (iNrEntries > 0)
@@ -1069,48 +1592,79 @@ void LogXmlCommand::Execute()
 		}
 	}
 
-	const char* XML_LOG_ITEM = 
-		"<value><struct>\n"
-		"<member><name>ID</name><value><i4>%i</i4></value></member>\n"
-		"<member><name>Kind</name><value><string>%s</string></value></member>\n"
-		"<member><name>Time</name><value><i4>%i</i4></value></member>\n"
-		"<member><name>Text</name><value><string>%s</string></value></member>\n"
-		"</struct></value>\n";
+	for (unsigned int i = (unsigned int)iStart; i < pMessages->size(); i++)
+	{
+		WriteMessage((*pMessages)[i]);
+	}
 
-	const char* JSON_LOG_ITEM = 
-		"{\n"
-		"\"ID\" : %i,\n"
-		"\"Kind\" : \"%s\",\n"
-		"\"Time\" : %i,\n"
-		"\"Text\" : \"%s\"\n"
-		"}";
+	UnlockMessages();
+	m_pWriter->EndArray();
+}
 
-    const char* szMessageType[] = { "INFO", "WARNING", "ERROR", "DEBUG", "DETAIL" };
+LogXmlCommand::Messages* LogXmlCommand::LockMessages()
+{
+	return g_pLog->LockMessages();
+}
 
-	int szItemBufSize = 10240;
-	char* szItemBuf = (char*)malloc(szItemBufSize);
-	int index = 0;
+void LogXmlCommand::UnlockMessages()
+{
+	g_pLog->UnlockMessages();
+}
 
-	for (unsigned int i = (unsigned int)iStart; i < pMessages->size(); i++)
+// struct[] loadlog(int ID, int IDFrom, int NumberOfEntries)
+// Returns log-messages of nzb-file (in queue or in history) with given ID.
+// Parameters IDFrom and NumberOfEntries have the same meaning as in method "log".
+void LoadLogXmlCommand::Execute()
+{
+	int iNZBID = 0;
+	if (!NextParamAsInt(&iNZBID))
+	{
+		BuildErrorResponse(2, "Invalid parameter");
+		return;
+	}
+
+	DownloadQueue* pDownloadQueue = g_pQueueCoordinator->LockQueue();
+
+	m_pNZBInfo = NULL;
+	for (NZBInfoList::iterator it = pDownloadQueue->GetNZBInfoList()->begin(); it != pDownloadQueue->GetNZBInfoList()->end(); it++)
 	{
-		Message* pMessage = (*pMessages)[i];
-		char* xmltext = EncodeStr(pMessage->GetText());
-		snprintf(szItemBuf, szItemBufSize, IsJson() ? JSON_LOG_ITEM : XML_LOG_ITEM,
-			pMessage->GetID(), szMessageType[pMessage->GetKind()], pMessage->GetTime(), xmltext);
-		szItemBuf[szItemBufSize-1] = '\0';
-		free(xmltext);
+		NZBInfo* pNZBInfo = *it;
+		if (pNZBInfo->GetID() == iNZBID)
+		{
+			m_pNZBInfo = pNZBInfo;
+			break;
+		}
+	}
 
-		if (IsJson() && index++ > 0)
+	for (HistoryList::iterator it = pDownloadQueue->GetHistoryList()->begin(); !m_pNZBInfo && it != pDownloadQueue->GetHistoryList()->end(); it++)
+	{
+		HistoryInfo* pHistoryInfo = *it;
+		if (pHistoryInfo->GetKind() == HistoryInfo::hkNZBInfo && pHistoryInfo->GetNZBInfo()->GetID() == iNZBID)
 		{
-			AppendResponse(",\n");
+			m_pNZBInfo = pHistoryInfo->GetNZBInfo();
 		}
-		AppendResponse(szItemBuf);
 	}
 
-	free(szItemBuf);
+	if (m_pNZBInfo)
+	{
+		LogXmlCommand::Execute();
+	}
+	else
+	{
+		BuildErrorResponse(3, "NZB not found");
+	}
 
-	g_pLog->UnlockMessages();
-	AppendResponse(IsJson() ? "\n]" : "</data></array>\n");
+	g_pQueueCoordinator->UnlockQueue();
+}
+
+LogXmlCommand::Messages* LoadLogXmlCommand::LockMessages()
+{
+	return m_pNZBInfo->LockMessages();
+}
+
+void LoadLogXmlCommand::UnlockMessages()
+{
+	m_pNZBInfo->UnlockMessages();
 }
 
 // struct[] listfiles(int IDFrom, int IDTo, int NZBID) 
@@ -1138,57 +1692,9 @@ void ListFilesXmlCommand::Execute()
 	debug("iIDStart=%i", iIDStart);
 	debug("iIDEnd=%i", iIDEnd);
 
-	AppendResponse(IsJson() ? "[\n" : "<array><data>\n");
+	m_pWriter->BeginArray();
 	DownloadQueue* pDownloadQueue = g_pQueueCoordinator->LockQueue();
 
-	const char* XML_LIST_ITEM = 
-		"<value><struct>\n"
-		"<member><name>ID</name><value><i4>%i</i4></value></member>\n"
-		"<member><name>FileSizeLo</name><value><i4>%u</i4></value></member>\n"
-		"<member><name>FileSizeHi</name><value><i4>%u</i4></value></member>\n"
-		"<member><name>RemainingSizeLo</name><value><i4>%u</i4></value></member>\n"
-		"<member><name>RemainingSizeHi</name><value><i4>%u</i4></value></member>\n"
-		"<member><name>PostTime</name><value><i4>%i</i4></value></member>\n"
-		"<member><name>FilenameConfirmed</name><value><boolean>%s</boolean></value></member>\n"
-		"<member><name>Paused</name><value><boolean>%s</boolean></value></member>\n"
-		"<member><name>NZBID</name><value><i4>%i</i4></value></member>\n"
-		"<member><name>NZBName</name><value><string>%s</string></value></member>\n"
-		"<member><name>NZBNicename</name><value><string>%s</string></value></member>\n"	// deprecated, use "NZBName" instead
-		"<member><name>NZBFilename</name><value><string>%s</string></value></member>\n"
-		"<member><name>Subject</name><value><string>%s</string></value></member>\n"
-		"<member><name>Filename</name><value><string>%s</string></value></member>\n"
-		"<member><name>DestDir</name><value><string>%s</string></value></member>\n"
-		"<member><name>Category</name><value><string>%s</string></value></member>\n"
-		"<member><name>Priority</name><value><i4>%i</i4></value></member>\n"
-		"<member><name>ActiveDownloads</name><value><i4>%i</i4></value></member>\n"
-		"</struct></value>\n";
-
-	const char* JSON_LIST_ITEM = 
-		"{\n"
-		"\"ID\" : %i,\n"
-		"\"FileSizeLo\" : %u,\n"
-		"\"FileSizeHi\" : %u,\n"
-		"\"RemainingSizeLo\" : %u,\n"
-		"\"RemainingSizeHi\" : %u,\n"
-		"\"PostTime\" : %i,\n"
-		"\"FilenameConfirmed\" : %s,\n"
-		"\"Paused\" : %s,\n"
-		"\"NZBID\" : %i,\n"
-		"\"NZBName\" : \"%s\",\n"
-		"\"NZBNicename\" : \"%s\",\n" 		// deprecated, use "NZBName" instead
-		"\"NZBFilename\" : \"%s\",\n"
-		"\"Subject\" : \"%s\",\n"
-		"\"Filename\" : \"%s\",\n"
-		"\"DestDir\" : \"%s\",\n"
-		"\"Category\" : \"%s\",\n"
-		"\"Priority\" : %i,\n"
-		"\"ActiveDownloads\" : %i\n"
-		"}";
-
-	int szItemBufSize = 10240;
-	char* szItemBuf = (char*)malloc(szItemBufSize);
-	int index = 0;
-
 	for (FileQueue::iterator it = pDownloadQueue->GetFileQueue()->begin(); it != pDownloadQueue->GetFileQueue()->end(); it++)
 	{
 		FileInfo* pFileInfo = *it;
@@ -1199,132 +1705,43 @@ void ListFilesXmlCommand::Execute()
 			unsigned long iRemainingSizeLo, iRemainingSizeHi;
 			Util::SplitInt64(pFileInfo->GetSize(), &iFileSizeHi, &iFileSizeLo);
 			Util::SplitInt64(pFileInfo->GetRemainingSize(), &iRemainingSizeHi, &iRemainingSizeLo);
-			char* xmlNZBFilename = EncodeStr(pFileInfo->GetNZBInfo()->GetFilename());
-			char* xmlSubject = EncodeStr(pFileInfo->GetSubject());
-			char* xmlFilename = EncodeStr(pFileInfo->GetFilename());
-			char* xmlDestDir = EncodeStr(pFileInfo->GetNZBInfo()->GetDestDir());
-			char* xmlCategory = EncodeStr(pFileInfo->GetNZBInfo()->GetCategory());
-			char* xmlNZBNicename = EncodeStr(pFileInfo->GetNZBInfo()->GetName());
-
-			snprintf(szItemBuf, szItemBufSize, IsJson() ? JSON_LIST_ITEM : XML_LIST_ITEM,
-				pFileInfo->GetID(), iFileSizeLo, iFileSizeHi, iRemainingSizeLo, iRemainingSizeHi, 
-				pFileInfo->GetTime(), BoolToStr(pFileInfo->GetFilenameConfirmed()), 
-				BoolToStr(pFileInfo->GetPaused()), pFileInfo->GetNZBInfo()->GetID(), xmlNZBNicename,
-				xmlNZBNicename, xmlNZBFilename, xmlSubject, xmlFilename, xmlDestDir, xmlCategory,
-				pFileInfo->GetPriority(), pFileInfo->GetActiveDownloads());
-			szItemBuf[szItemBufSize-1] = '\0';
-
-			free(xmlNZBFilename);
-			free(xmlSubject);
-			free(xmlFilename);
-			free(xmlDestDir);
-			free(xmlCategory);
-			free(xmlNZBNicename);
-
-			if (IsJson() && index++ > 0)
-			{
-				AppendResponse(",\n");
-			}
-			AppendResponse(szItemBuf);
+
+			m_pWriter->BeginStruct();
+			m_pWriter->IntMember("ID", pFileInfo->GetID());
+			m_pWriter->UIntMember("FileSizeLo", iFileSizeLo);
+			m_pWriter->UIntMember("FileSizeHi", iFileSizeHi);
+			m_pWriter->UIntMember("RemainingSizeLo", iRemainingSizeLo);
+			m_pWriter->UIntMember("RemainingSizeHi", iRemainingSizeHi);
+			m_pWriter->IntMember("PostTime", pFileInfo->GetTime());
+			m_pWriter->BoolMember("FilenameConfirmed", pFileInfo->GetFilenameConfirmed());
+			m_pWriter->BoolMember("Paused", pFileInfo->GetPaused());
+			m_pWriter->IntMember("NZBID", pFileInfo->GetNZBInfo()->GetID());
+			m_pWriter->StrMember("NZBName", pFileInfo->GetNZBInfo()->GetName());
+			m_pWriter->StrMember("NZBNicename", pFileInfo->GetNZBInfo()->GetName());	// deprecated, use "NZBName" instead
+			m_pWriter->StrMember("NZBFilename", pFileInfo->GetNZBInfo()->GetFilename());
+			m_pWriter->StrMember("Subject", pFileInfo->GetSubject());
+			m_pWriter->StrMember("Filename", pFileInfo->GetFilename());
+			m_pWriter->StrMember("DestDir", pFileInfo->GetNZBInfo()->GetDestDir());
+			m_pWriter->StrMember("Category", pFileInfo->GetNZBInfo()->GetCategory());
+			m_pWriter->IntMember("Priority", pFileInfo->GetPriority());
+			m_pWriter->IntMember("ActiveDownloads", pFileInfo->GetActiveDownloads());
+			m_pWriter->EndStruct();
 		}
 	}
-	free(szItemBuf);
 
 	g_pQueueCoordinator->UnlockQueue();
-	AppendResponse(IsJson() ? "\n]" : "</data></array>\n");
+	m_pWriter->EndArray();
 }
 
 void ListGroupsXmlCommand::Execute()
 {
-	AppendResponse(IsJson() ? "[\n" : "<array><data>\n");
-
-	const char* XML_LIST_ITEM_START = 
-		"<value><struct>\n"
-		"<member><name>FirstID</name><value><i4>%i</i4></value></member>\n"
-		"<member><name>LastID</name><value><i4>%i</i4></value></member>\n"
-		"<member><name>FileSizeLo</name><value><i4>%u</i4></value></member>\n"
-		"<member><name>FileSizeHi</name><value><i4>%u</i4></value></member>\n"
-		"<member><name>FileSizeMB</name><value><i4>%i</i4></value></member>\n"
-		"<member><name>RemainingSizeLo</name><value><i4>%u</i4></value></member>\n"
-		"<member><name>RemainingSizeHi</name><value><i4>%u</i4></value></member>\n"
-		"<member><name>RemainingSizeMB</name><value><i4>%i</i4></value></member>\n"
-		"<member><name>PausedSizeLo</name><value><i4>%u</i4></value></member>\n"
-		"<member><name>PausedSizeHi</name><value><i4>%u</i4></value></member>\n"
-		"<member><name>PausedSizeMB</name><value><i4>%i</i4></value></member>\n"
-		"<member><name>FileCount</name><value><i4>%i</i4></value></member>\n"
-		"<member><name>RemainingFileCount</name><value><i4>%i</i4></value></member>\n"
-		"<member><name>RemainingParCount</name><value><i4>%i</i4></value></member>\n"
-		"<member><name>MinPostTime</name><value><i4>%i</i4></value></member>\n"
-		"<member><name>MaxPostTime</name><value><i4>%i</i4></value></member>\n"
-		"<member><name>NZBID</name><value><i4>%i</i4></value></member>\n"
-		"<member><name>NZBName</name><value><string>%s</string></value></member>\n"
-		"<member><name>NZBNicename</name><value><string>%s</string></value></member>\n"	// deprecated, use "NZBName" instead
-		"<member><name>NZBFilename</name><value><string>%s</string></value></member>\n"
-		"<member><name>DestDir</name><value><string>%s</string></value></member>\n"
-		"<member><name>Category</name><value><string>%s</string></value></member>\n"
-		"<member><name>MinPriority</name><value><i4>%i</i4></value></member>\n"
-		"<member><name>MaxPriority</name><value><i4>%i</i4></value></member>\n"
-		"<member><name>ActiveDownloads</name><value><i4>%i</i4></value></member>\n"
-		"<member><name>Parameters</name><value><array><data>\n";
-
-	const char* XML_LIST_ITEM_END = 
-		"</data></array></value></member>\n"
-		"</struct></value>\n";
-
-	const char* JSON_LIST_ITEM_START = 
-		"{\n"
-		"\"FirstID\" : %i,\n"
-		"\"LastID\" : %i,\n"
-		"\"FileSizeLo\" : %u,\n"
-		"\"FileSizeHi\" : %u,\n"
-		"\"FileSizeMB\" : %i,\n"
-		"\"RemainingSizeLo\" : %u,\n"
-		"\"RemainingSizeHi\" : %u,\n"
-		"\"RemainingSizeMB\" : %i,\n"
-		"\"PausedSizeLo\" : %u,\n"
-		"\"PausedSizeHi\" : %u,\n"
-		"\"PausedSizeMB\" : %i,\n"
-		"\"FileCount\" : %i,\n"
-		"\"RemainingFileCount\" : %i,\n"
-		"\"RemainingParCount\" : %i,\n"
-		"\"MinPostTime\" : %i,\n"
-		"\"MaxPostTime\" : %i,\n"
-		"\"NZBID\" : %i,\n"
-		"\"NZBName\" : \"%s\",\n"
-		"\"NZBNicename\" : \"%s\",\n"	// deprecated, use "NZBName" instead
-		"\"NZBFilename\" : \"%s\",\n"
-		"\"DestDir\" : \"%s\",\n"
-		"\"Category\" : \"%s\",\n"
-		"\"MinPriority\" : %i,\n"
-		"\"MaxPriority\" : %i,\n"
-		"\"ActiveDownloads\" : %i,\n"
-		"\"Parameters\" : [\n";
-
-	const char* JSON_LIST_ITEM_END = 
-		"]\n"
-		"}";
-
-	const char* XML_PARAMETER_ITEM = 
-		"<value><struct>\n"
-		"<member><name>Name</name><value><string>%s</string></value></member>\n"
-		"<member><name>Value</name><value><string>%s</string></value></member>\n"
-		"</struct></value>\n";
-
-	const char* JSON_PARAMETER_ITEM = 
-		"{\n"
-		"\"Name\" : \"%s\",\n"
-		"\"Value\" : \"%s\"\n"
-		"}";
-
 	GroupQueue groupQueue;
 	groupQueue.clear();
 	DownloadQueue* pDownloadQueue = g_pQueueCoordinator->LockQueue();
 	pDownloadQueue->BuildGroups(&groupQueue);
 	g_pQueueCoordinator->UnlockQueue();
 
-	int szItemBufSize = 10240;
-	char* szItemBuf = (char*)malloc(szItemBufSize);
-	int index = 0;
+	m_pWriter->BeginArray();
 
 	for (GroupQueue::iterator it = groupQueue.begin(); it != groupQueue.end(); it++)
 	{
@@ -1339,58 +1756,39 @@ void ListGroupsXmlCommand::Execute()
 		Util::SplitInt64(pGroupInfo->GetPausedSize(), &iPausedSizeHi, &iPausedSizeLo);
 		iPausedSizeMB = (int)(pGroupInfo->GetPausedSize() / 1024 / 1024);
 
-		char* xmlNZBNicename = EncodeStr(pGroupInfo->GetNZBInfo()->GetName());
-		char* xmlNZBFilename = EncodeStr(pGroupInfo->GetNZBInfo()->GetFilename());
-		char* xmlDestDir = EncodeStr(pGroupInfo->GetNZBInfo()->GetDestDir());
-		char* xmlCategory = EncodeStr(pGroupInfo->GetNZBInfo()->GetCategory());
-
-		snprintf(szItemBuf, szItemBufSize, IsJson() ? JSON_LIST_ITEM_START : XML_LIST_ITEM_START,
-			pGroupInfo->GetFirstID(), pGroupInfo->GetLastID(), iFileSizeLo, iFileSizeHi, iFileSizeMB, 
-			iRemainingSizeLo, iRemainingSizeHi, iRemainingSizeMB, iPausedSizeLo, iPausedSizeHi, iPausedSizeMB, 
-			pGroupInfo->GetNZBInfo()->GetFileCount(), pGroupInfo->GetRemainingFileCount(), 
-			pGroupInfo->GetRemainingParCount(), pGroupInfo->GetMinTime(), pGroupInfo->GetMaxTime(),
-			pGroupInfo->GetNZBInfo()->GetID(), xmlNZBNicename, xmlNZBNicename, xmlNZBFilename, xmlDestDir, xmlCategory,
-			pGroupInfo->GetMinPriority(), pGroupInfo->GetMaxPriority(), pGroupInfo->GetActiveDownloads());
-		szItemBuf[szItemBufSize-1] = '\0';
-
-		free(xmlNZBNicename);
-		free(xmlNZBFilename);
-		free(xmlDestDir);
-		free(xmlCategory);
-
-		if (IsJson() && index++ > 0)
-		{
-			AppendResponse(",\n");
-		}
-		AppendResponse(szItemBuf);
-
-		int iParamIndex = 0;
-
-		for (NZBParameterList::iterator it = pGroupInfo->GetNZBInfo()->GetParameters()->begin(); it != pGroupInfo->GetNZBInfo()->GetParameters()->end(); it++)
-		{
-			NZBParameter* pParameter = *it;
-
-			char* xmlName = EncodeStr(pParameter->GetName());
-			char* xmlValue = EncodeStr(pParameter->GetValue());
-
-			snprintf(szItemBuf, szItemBufSize, IsJson() ? JSON_PARAMETER_ITEM : XML_PARAMETER_ITEM, xmlName, xmlValue);
-			szItemBuf[szItemBufSize-1] = '\0';
-
-			free(xmlName);
-			free(xmlValue);
-
-			if (IsJson() && iParamIndex++ > 0)
-			{
-				AppendResponse(",\n");
-			}
-			AppendResponse(szItemBuf);
-		}
-
-		AppendResponse(IsJson() ? JSON_LIST_ITEM_END : XML_LIST_ITEM_END);
-	}
-	free(szItemBuf);
-
-	AppendResponse(IsJson() ? "\n]" : "</data></array>\n");
+		m_pWriter->BeginStruct();
+		m_pWriter->IntMember("FirstID", pGroupInfo->GetFirstID());
+		m_pWriter->IntMember("LastID", pGroupInfo->GetLastID());
+		m_pWriter->UIntMember("FileSizeLo", iFileSizeLo);
+		m_pWriter->UIntMember("FileSizeHi", iFileSizeHi);
+		m_pWriter->IntMember("FileSizeMB", iFileSizeMB);
+		m_pWriter->UIntMember("RemainingSizeLo", iRemainingSizeLo);
+		m_pWriter->UIntMember("RemainingSizeHi", iRemainingSizeHi);
+		m_pWriter->IntMember("RemainingSizeMB", iRemainingSizeMB);
+		m_pWriter->UIntMember("PausedSizeLo", iPausedSizeLo);
+		m_pWriter->UIntMember("PausedSizeHi", iPausedSizeHi);
+		m_pWriter->IntMember("PausedSizeMB", iPausedSizeMB);
+		m_pWriter->IntMember("FileCount", pGroupInfo->GetNZBInfo()->GetFileCount());
+		m_pWriter->IntMember("RemainingFileCount", pGroupInfo->GetRemainingFileCount());
+		m_pWriter->IntMember("RemainingParCount", pGroupInfo->GetRemainingParCount());
+		m_pWriter->IntMember("MinPostTime", pGroupInfo->GetMinTime());
+		m_pWriter->IntMember("MaxPostTime", pGroupInfo->GetMaxTime());
+		m_pWriter->IntMember("NZBID", pGroupInfo->GetNZBInfo()->GetID());
+		m_pWriter->StrMember("NZBName", pGroupInfo->GetNZBInfo()->GetName());
+		m_pWriter->StrMember("NZBNicename", pGroupInfo->GetNZBInfo()->GetName());	// deprecated, use "NZBName" instead
+		m_pWriter->StrMember("NZBFilename", pGroupInfo->GetNZBInfo()->GetFilename());
+		m_pWriter->StrMember("DestDir", pGroupInfo->GetNZBInfo()->GetDestDir());
+		m_pWriter->StrMember("Category", pGroupInfo->GetNZBInfo()->GetCategory());
+		m_pWriter->IntMember("MinPriority", pGroupInfo->GetMinPriority());
+		m_pWriter->IntMember("MaxPriority", pGroupInfo->GetMaxPriority());
+		m_pWriter->IntMember("ActiveDownloads", pGroupInfo->GetActiveDownloads());
+		m_pWriter->IntMember("DownloadRate", pGroupInfo->GetNZBInfo()->GetDownloadRate());
+		m_pWriter->Member("Parameters");
+		WriteParameters(pGroupInfo->GetNZBInfo()->GetParameters());
+		m_pWriter->EndStruct();
+	}
+
+	m_pWriter->EndArray();
 
 	for (GroupQueue::iterator it = groupQueue.begin(); it != groupQueue.end(); it++)
 	{
@@ -1550,22 +1948,13 @@ void DownloadXmlCommand::Execute()
 	}
 
 	char* szFileContent;
-	if (!NextParamAsStr(&szFileContent))
+	int iLen;
+	if (!NextParamAsBase64(&szFileContent, &iLen))
 	{
 		BuildErrorResponse(2, "Invalid parameter");
 		return;
 	}
 
-	if (IsJson())
-	{
-		// JSON-string may contain '/'-character used in Base64, which must be escaped in JSON
-		WebUtil::JsonDecode(szFileContent);
-	}
-
-	int iLen = WebUtil::DecodeBase64(szFileContent, 0, szFileContent);
-	szFileContent[iLen] = '\0';
-	//debug("FileContent=%s", szFileContent);
-
 	bool bOK = g_pScanner->AddExternalFile(szFileName, szCategory, iPriority, NULL, bAddTop,
 		false, NULL, szFileContent, iLen, true);
 
@@ -1577,76 +1966,11 @@ void PostQueueXmlCommand::Execute()
 	int iNrEntries = 0;
 	NextParamAsInt(&iNrEntries);
 
-	AppendResponse(IsJson() ? "[\n" : "<array><data>\n");
-
-	const char* XML_POSTQUEUE_ITEM_START = 
-		"<value><struct>\n"
-		"<member><name>ID</name><value><i4>%i</i4></value></member>\n"
-		"<member><name>NZBID</name><value><i4>%i</i4></value></member>\n"
-		"<member><name>NZBName</name><value><string>%s</string></value></member>\n"
-		"<member><name>NZBNicename</name><value><string>%s</string></value></member>\n"		// deprecated, use "NZBName" instead
-		"<member><name>NZBFilename</name><value><string>%s</string></value></member>\n"
-		"<member><name>DestDir</name><value><string>%s</string></value></member>\n"
-		"<member><name>ParFilename</name><value><string>%s</string></value></member>\n"		// deprecated, always empty
-		"<member><name>InfoName</name><value><string>%s</string></value></member>\n"
-		"<member><name>Stage</name><value><string>%s</string></value></member>\n"
-		"<member><name>ProgressLabel</name><value><string>%s</string></value></member>\n"
-		"<member><name>FileProgress</name><value><i4>%i</i4></value></member>\n"
-		"<member><name>StageProgress</name><value><i4>%i</i4></value></member>\n"
-		"<member><name>TotalTimeSec</name><value><i4>%i</i4></value></member>\n"
-		"<member><name>StageTimeSec</name><value><i4>%i</i4></value></member>\n"
-		"<member><name>Log</name><value><array><data>\n";
-
-	const char* XML_POSTQUEUE_ITEM_END = 
-		"</data></array></value></member>\n"
-		"</struct></value>\n";
-
-	const char* JSON_POSTQUEUE_ITEM_START = 
-		"{\n"
-		"\"ID\" : %i,\n"
-		"\"NZBID\" : %i,\n"
-		"\"NZBName\" : \"%s\",\n"
-		"\"NZBNicename\" : \"%s\",\n"	// deprecated, use "NZBName" instead
-		"\"NZBFilename\" : \"%s\",\n"
-		"\"DestDir\" : \"%s\",\n"
-		"\"ParFilename\" : \"%s\",\n"	// deprecated, always empty
-		"\"InfoName\" : \"%s\",\n"
-		"\"Stage\" : \"%s\",\n"
-		"\"ProgressLabel\" : \"%s\",\n"
-		"\"FileProgress\" : %i,\n"
-		"\"StageProgress\" : %i,\n"
-		"\"TotalTimeSec\" : %i,\n"
-		"\"StageTimeSec\" : %i,\n"
-		"\"Log\" : [\n";
-
-	const char* JSON_POSTQUEUE_ITEM_END = 
-		"]\n"
-		"}";
-
-	const char* XML_LOG_ITEM = 
-		"<value><struct>\n"
-		"<member><name>ID</name><value><i4>%i</i4></value></member>\n"
-		"<member><name>Kind</name><value><string>%s</string></value></member>\n"
-		"<member><name>Time</name><value><i4>%i</i4></value></member>\n"
-		"<member><name>Text</name><value><string>%s</string></value></member>\n"
-		"</struct></value>\n";
-
-	const char* JSON_LOG_ITEM = 
-		"{\n"
-		"\"ID\" : %i,\n"
-		"\"Kind\" : \"%s\",\n"
-		"\"Time\" : %i,\n"
-		"\"Text\" : \"%s\"\n"
-		"}";
-
-	const char* szMessageType[] = { "INFO", "WARNING", "ERROR", "DEBUG", "DETAIL"};
+	m_pWriter->BeginArray();
 
 	PostQueue* pPostQueue = g_pQueueCoordinator->LockQueue()->GetPostQueue();
 
 	time_t tCurTime = time(NULL);
-	int szItemBufSize = 10240;
-	char* szItemBuf = (char*)malloc(szItemBufSize);
-	int index = 0;
 
 	for (PostQueue::iterator it = pPostQueue->begin(); it != pPostQueue->end(); it++)
 	{
@@ -1654,33 +1978,24 @@ void PostQueueXmlCommand::Execute()
 
 	    const char* szPostStageName[] = { "QUEUED", "LOADING_PARS", "VERIFYING_SOURCES", "REPAIRING", "VERIFYING_REPAIRED", "RENAMING", "UNPACKING", "MOVING", "EXECUTING_SCRIPT", "FINISHED" };
 
-		char* xmlNZBNicename = EncodeStr(pPostInfo->GetNZBInfo()->GetName());
-		char* xmlNZBFilename = EncodeStr(pPostInfo->GetNZBInfo()->GetFilename());
-		char* xmlDestDir = EncodeStr(pPostInfo->GetNZBInfo()->GetDestDir());
-		char* xmlInfoName = EncodeStr(pPostInfo->GetInfoName());
-		char* xmlProgressLabel = EncodeStr(pPostInfo->GetProgressLabel());
-
-		snprintf(szItemBuf, szItemBufSize, IsJson() ? JSON_POSTQUEUE_ITEM_START : XML_POSTQUEUE_ITEM_START,
-			pPostInfo->GetID(), pPostInfo->GetNZBInfo()->GetID(), xmlNZBNicename,
-			xmlNZBNicename, xmlNZBFilename, xmlDestDir, "",
-			xmlInfoName, szPostStageName[pPostInfo->GetStage()], xmlProgressLabel,
-			pPostInfo->GetFileProgress(), pPostInfo->GetStageProgress(),
-			pPostInfo->GetStartTime() ? tCurTime - pPostInfo->GetStartTime() : 0,
-			pPostInfo->GetStageTime() ? tCurTime - pPostInfo->GetStageTime() : 0);
-		szItemBuf[szItemBufSize-1] = '\0';
-
-		free(xmlNZBNicename);
-		free(xmlNZBFilename);
-		free(xmlDestDir);
-		free(xmlInfoName);
-		free(xmlProgressLabel);
-
-		if (IsJson() && index++ > 0)
-		{
-			AppendResponse(",\n");
-		}
-		AppendResponse(szItemBuf);
-
+		m_pWriter->BeginStruct();
+		m_pWriter->IntMember("ID", pPostInfo->GetID());
+		m_pWriter->IntMember("NZBID", pPostInfo->GetNZBInfo()->GetID());
+		m_pWriter->StrMember("NZBName", pPostInfo->GetNZBInfo()->GetName());
+		m_pWriter->StrMember("NZBNicename", pPostInfo->GetNZBInfo()->GetName());		// deprecated, use "NZBName" instead
+		m_pWriter->StrMember("NZBFilename", pPostInfo->GetNZBInfo()->GetFilename());
+		m_pWriter->StrMember("DestDir", pPostInfo->GetNZBInfo()->GetDestDir());
+		m_pWriter->StrMember("ParFilename", "");		// deprecated, always empty
+		m_pWriter->StrMember("InfoName", pPostInfo->GetInfoName());
+		m_pWriter->StrMember("Stage", szPostStageName[pPostInfo->GetStage()]);
+		m_pWriter->StrMember("ProgressLabel", pPostInfo->GetProgressLabel());
+		m_pWriter->IntMember("FileProgress", pPostInfo->GetFileProgress());
+		m_pWriter->IntMember("StageProgress", pPostInfo->GetStageProgress());
+		m_pWriter->IntMember("TotalTimeSec", (int)(pPostInfo->GetStartTime() ? tCurTime - pPostInfo->GetStartTime() : 0));
+		m_pWriter->IntMember("StageTimeSec", (int)(pPostInfo->GetStageTime() ? tCurTime - pPostInfo->GetStageTime() : 0));
+
+		m_pWriter->Member("Log");
+		m_pWriter->BeginArray();
 		if (iNrEntries > 0)
 		{
 			PostInfo::Messages* pMessages = pPostInfo->LockMessages();
@@ -1692,33 +2007,21 @@ void PostQueueXmlCommand::Execute()
 				}
 				int iStart = pMessages->size() - iNrEntries;
 
-				int index = 0;
 				for (unsigned int i = (unsigned int)iStart; i < pMessages->size(); i++)
 				{
-					Message* pMessage = (*pMessages)[i];
-					char* xmltext = EncodeStr(pMessage->GetText());
-					snprintf(szItemBuf, szItemBufSize, IsJson() ? JSON_LOG_ITEM : XML_LOG_ITEM,
-						pMessage->GetID(), szMessageType[pMessage->GetKind()], pMessage->GetTime(), xmltext);
-					szItemBuf[szItemBufSize-1] = '\0';
-					free(xmltext);
-
-					if (IsJson() && index++ > 0)
-					{
-						AppendResponse(",\n");
-					}
-					AppendResponse(szItemBuf);
+					WriteMessage((*pMessages)[i]);
 				}
 			}
 			pPostInfo->UnlockMessages();
 		}
+		m_pWriter->EndArray();
 
-		AppendResponse(IsJson() ? JSON_POSTQUEUE_ITEM_END : XML_POSTQUEUE_ITEM_END);
+		m_pWriter->EndStruct();
 	}
-	free(szItemBuf);
 
 	g_pQueueCoordinator->UnlockQueue();
 
-	AppendResponse(IsJson() ? "\n]" : "</data></array>\n");
+	m_pWriter->EndArray();
 }
 
 void WriteLogXmlCommand::Execute()
@@ -1793,132 +2096,15 @@ void ScanXmlCommand::Execute()
 
 void HistoryXmlCommand::Execute()
 {
-	AppendResponse(IsJson() ? "[\n" : "<array><data>\n");
-
-	const char* XML_HISTORY_ITEM_START = 
-		"<value><struct>\n"
-		"<member><name>ID</name><value><i4>%i</i4></value></member>\n"
-		"<member><name>NZBID</name><value><i4>%i</i4></value></member>\n"
-		"<member><name>Kind</name><value><string>%s</string></value></member>\n"
-		"<member><name>Name</name><value><string>%s</string></value></member>\n"
-		"<member><name>NZBNicename</name><value><string>%s</string></value></member>\n"		// deprecated, use Name instead
-		"<member><name>NZBFilename</name><value><string>%s</string></value></member>\n"
-		"<member><name>DestDir</name><value><string>%s</string></value></member>\n"
-		"<member><name>Category</name><value><string>%s</string></value></member>\n"
-		"<member><name>ParStatus</name><value><string>%s</string></value></member>\n"
-		"<member><name>UnpackStatus</name><value><string>%s</string></value></member>\n"
-		"<member><name>MoveStatus</name><value><string>%s</string></value></member>\n"
-		"<member><name>ScriptStatus</name><value><string>%s</string></value></member>\n"
-		"<member><name>FileSizeLo</name><value><i4>%u</i4></value></member>\n"
-		"<member><name>FileSizeHi</name><value><i4>%u</i4></value></member>\n"
-		"<member><name>FileSizeMB</name><value><i4>%i</i4></value></member>\n"
-		"<member><name>FileCount</name><value><i4>%i</i4></value></member>\n"
-		"<member><name>RemainingFileCount</name><value><i4>%i</i4></value></member>\n"
-		"<member><name>HistoryTime</name><value><i4>%i</i4></value></member>\n"
-		"<member><name>URL</name><value><string>%s</string></value></member>\n"
-		"<member><name>UrlStatus</name><value><string>%s</string></value></member>\n"
-		"<member><name>Parameters</name><value><array><data>\n";
-
-	const char* XML_HISTORY_ITEM_SCRIPT_START =
-		"</data></array></value></member>\n"
-		"<member><name>ScriptStatuses</name><value><array><data>\n";
-
-	const char* XML_HISTORY_ITEM_LOG_START =
-		"</data></array></value></member>\n"
-		"<member><name>Log</name><value><array><data>\n";
-
-	const char* XML_HISTORY_ITEM_END =
-		"</data></array></value></member>\n"
-		"</struct></value>\n";
-
-	const char* JSON_HISTORY_ITEM_START = 
-		"{\n"
-		"\"ID\" : %i,\n"
-		"\"NZBID\" : %i,\n"
-		"\"Kind\" : \"%s\",\n"
-		"\"Name\" : \"%s\",\n"
-		"\"NZBNicename\" : \"%s\",\n"		// deprecated, use Name instead
-		"\"NZBFilename\" : \"%s\",\n"
-		"\"DestDir\" : \"%s\",\n"
-		"\"Category\" : \"%s\",\n"
-		"\"ParStatus\" : \"%s\",\n"
-		"\"UnpackStatus\" : \"%s\",\n"
-		"\"MoveStatus\" : \"%s\",\n"
-		"\"ScriptStatus\" : \"%s\",\n"
-		"\"FileSizeLo\" : %u,\n"
-		"\"FileSizeHi\" : %u,\n"
-		"\"FileSizeMB\" : %i,\n"
-		"\"FileCount\" : %i,\n"
-		"\"RemainingFileCount\" : %i,\n"
-		"\"HistoryTime\" : %i,\n"
-		"\"URL\" : \"%s\",\n"
-		"\"UrlStatus\" : \"%s\",\n"
-		"\"Parameters\" : [\n";
-
-	const char* JSON_HISTORY_ITEM_SCRIPT_START =
-		"],\n"
-		"\"ScriptStatuses\" : [\n";
-
-	const char* JSON_HISTORY_ITEM_LOG_START =
-		"],\n"
-		"\"Log\" : [\n";
-
-	const char* JSON_HISTORY_ITEM_END = 
-		"]\n"
-		"}";
-
-	const char* XML_PARAMETER_ITEM = 
-		"<value><struct>\n"
-		"<member><name>Name</name><value><string>%s</string></value></member>\n"
-		"<member><name>Value</name><value><string>%s</string></value></member>\n"
-		"</struct></value>\n";
-
-	const char* JSON_PARAMETER_ITEM = 
-		"{\n"
-		"\"Name\" : \"%s\",\n"
-		"\"Value\" : \"%s\"\n"
-		"}";
-
-	const char* XML_SCRIPT_ITEM =
-		"<value><struct>\n"
-		"<member><name>Name</name><value><string>%s</string></value></member>\n"
-		"<member><name>Status</name><value><string>%s</string></value></member>\n"
-		"</struct></value>\n";
-
-	const char* JSON_SCRIPT_ITEM =
-		"{\n"
-		"\"Name\" : \"%s\",\n"
-		"\"Status\" : \"%s\"\n"
-		"}";
-
-	const char* XML_LOG_ITEM =
-		"<value><struct>\n"
-		"<member><name>ID</name><value><i4>%i</i4></value></member>\n"
-		"<member><name>Kind</name><value><string>%s</string></value></member>\n"
-		"<member><name>Time</name><value><i4>%i</i4></value></member>\n"
-		"<member><name>Text</name><value><string>%s</string></value></member>\n"
-		"</struct></value>\n";
-
-	const char* JSON_LOG_ITEM = 
-		"{\n"
-		"\"ID\" : %i,\n"
-		"\"Kind\" : \"%s\",\n"
-		"\"Time\" : %i,\n"
-		"\"Text\" : \"%s\"\n"
-		"}";
-
     const char* szParStatusName[] = { "NONE", "NONE", "FAILURE", "SUCCESS", "REPAIR_POSSIBLE", "MANUAL" };
     const char* szUnpackStatusName[] = { "NONE", "NONE", "FAILURE", "SUCCESS" };
     const char* szMoveStatusName[] = { "NONE", "FAILURE", "SUCCESS" };
     const char* szScriptStatusName[] = { "NONE", "FAILURE", "SUCCESS" };
 	const char* szUrlStatusName[] = { "UNKNOWN", "UNKNOWN", "SUCCESS", "FAILURE", "UNKNOWN" };
-	const char* szMessageType[] = { "INFO", "WARNING", "ERROR", "DEBUG", "DETAIL"};
 
-	DownloadQueue* pDownloadQueue = g_pQueueCoordinator->LockQueue();
+	m_pWriter->BeginArray();
 
-	int szItemBufSize = 10240;
-	char* szItemBuf = (char*)malloc(szItemBufSize);
-	int index = 0;
+	DownloadQueue* pDownloadQueue = g_pQueueCoordinator->LockQueue();
 
 	for (HistoryList::iterator it = pDownloadQueue->GetHistoryList()->begin(); it != pDownloadQueue->GetHistoryList()->end(); it++)
 	{
@@ -1928,8 +2114,8 @@ void HistoryXmlCommand::Execute()
 		char szNicename[1024];
 		pHistoryInfo->GetName(szNicename, sizeof(szNicename));
 
-		char *xmlNicename = EncodeStr(szNicename);
-		char *xmlNZBFilename, *xmlCategory;
+		m_pWriter->BeginStruct();
+		m_pWriter->IntMember("ID", pHistoryInfo->GetID());
 
 		if (pHistoryInfo->GetKind() == HistoryInfo::hkNZBInfo)
 		{
@@ -1939,133 +2125,97 @@ void HistoryXmlCommand::Execute()
 			Util::SplitInt64(pNZBInfo->GetSize(), &iFileSizeHi, &iFileSizeLo);
 			iFileSizeMB = (int)(pNZBInfo->GetSize() / 1024 / 1024);
 
-			xmlNZBFilename = EncodeStr(pNZBInfo->GetFilename());
-			char* xmlDestDir = EncodeStr(pNZBInfo->GetDestDir());
-			xmlCategory = EncodeStr(pNZBInfo->GetCategory());
-
-			snprintf(szItemBuf, szItemBufSize, IsJson() ? JSON_HISTORY_ITEM_START : XML_HISTORY_ITEM_START,
-				pHistoryInfo->GetID(), pNZBInfo->GetID(), "NZB", xmlNicename, xmlNicename, xmlNZBFilename, 
-				xmlDestDir, xmlCategory, szParStatusName[pNZBInfo->GetParStatus()],
-				szUnpackStatusName[pNZBInfo->GetUnpackStatus()], szMoveStatusName[pNZBInfo->GetMoveStatus()],
-				szScriptStatusName[pNZBInfo->GetScriptStatuses()->CalcTotalStatus()],
-				iFileSizeLo, iFileSizeHi, iFileSizeMB, pNZBInfo->GetFileCount(),
-				pNZBInfo->GetParkedFileCount(), pHistoryInfo->GetTime(), "", "");
-
-			free(xmlDestDir);
+			m_pWriter->IntMember("NZBID", pNZBInfo->GetID());
+			m_pWriter->StrMember("Kind", "NZB");
+			m_pWriter->StrMember("Name", szNicename);
+			m_pWriter->StrMember("NZBNicename", szNicename);		// deprecated, use Name instead
+			m_pWriter->StrMember("NZBFilename", pNZBInfo->GetFilename());
+			m_pWriter->StrMember("DestDir", pNZBInfo->GetDestDir());
+			m_pWriter->StrMember("Category", pNZBInfo->GetCategory());
+			m_pWriter->StrMember("ParStatus", szParStatusName[pNZBInfo->GetParStatus()]);
+			m_pWriter->StrMember("UnpackStatus", szUnpackStatusName[pNZBInfo->GetUnpackStatus()]);
+			m_pWriter->StrMember("MoveStatus", szMoveStatusName[pNZBInfo->GetMoveStatus()]);
+			m_pWriter->StrMember("ScriptStatus", szScriptStatusName[pNZBInfo->GetScriptStatuses()->CalcTotalStatus()]);
+			m_pWriter->UIntMember("FileSizeLo", iFileSizeLo);
+			m_pWriter->UIntMember("FileSizeHi", iFileSizeHi);
+			m_pWriter->IntMember("FileSizeMB", iFileSizeMB);
+			m_pWriter->IntMember("FileCount", pNZBInfo->GetFileCount());
+			m_pWriter->IntMember("RemainingFileCount", pNZBInfo->GetParkedFileCount());
+			m_pWriter->IntMember("HistoryTime", pHistoryInfo->GetTime());
+			m_pWriter->StrMember("URL", "");
+			m_pWriter->StrMember("UrlStatus", "");
 		}
 		else if (pHistoryInfo->GetKind() == HistoryInfo::hkUrlInfo)
 		{
 			UrlInfo* pUrlInfo = pHistoryInfo->GetUrlInfo();
 
-			xmlNZBFilename = EncodeStr(pUrlInfo->GetNZBFilename());
-			xmlCategory = EncodeStr(pUrlInfo->GetCategory());
-			char* xmlURL = EncodeStr(pUrlInfo->GetURL());
-
-			snprintf(szItemBuf, szItemBufSize, IsJson() ? JSON_HISTORY_ITEM_START : XML_HISTORY_ITEM_START,
-				pHistoryInfo->GetID(), 0, "URL", xmlNicename, xmlNicename, xmlNZBFilename, 
-				"", xmlCategory, "", "", "", "", 0, 0, 0, 0, 0, pHistoryInfo->GetTime(), xmlURL,
-				szUrlStatusName[pUrlInfo->GetStatus()]);
-
-			free(xmlURL);
+			m_pWriter->IntMember("NZBID", 0);
+			m_pWriter->StrMember("Kind", "URL");
+			m_pWriter->StrMember("Name", szNicename);
+			m_pWriter->StrMember("NZBNicename", szNicename);		// deprecated, use Name instead
+			m_pWriter->StrMember("NZBFilename", pUrlInfo->GetNZBFilename());
+			m_pWriter->StrMember("DestDir", "");
+			m_pWriter->StrMember("Category", pUrlInfo->GetCategory());
+			m_pWriter->StrMember("ParStatus", "");
+			m_pWriter->StrMember("UnpackStatus", "");
+			m_pWriter->StrMember("MoveStatus", "");
+			m_pWriter->StrMember("ScriptStatus", "");
+			m_pWriter->UIntMember("FileSizeLo", 0);
+			m_pWriter->UIntMember("FileSizeHi", 0);
+			m_pWriter->IntMember("FileSizeMB", 0);
+			m_pWriter->IntMember("FileCount", 0);
+			m_pWriter->IntMember("RemainingFileCount", 0);
+			m_pWriter->IntMember("HistoryTime", pHistoryInfo->GetTime());
+			m_pWriter->StrMember("URL", pUrlInfo->GetURL());
+			m_pWriter->StrMember("UrlStatus", szUrlStatusName[pUrlInfo->GetStatus()]);
 		}
 
-		szItemBuf[szItemBufSize-1] = '\0';
-
-		free(xmlNicename);
-		free(xmlNZBFilename);
-		free(xmlCategory);
-
-		if (IsJson() && index++ > 0)
+		// Post-processing parameters
+		m_pWriter->Member("Parameters");
+		if (pNZBInfo)
 		{
-			AppendResponse(",\n");
+			WriteParameters(pNZBInfo->GetParameters());
 		}
-		AppendResponse(szItemBuf);
-
-		if (pNZBInfo)
+		else
 		{
-			// Post-processing parameters
-			int iParamIndex = 0;
-			for (NZBParameterList::iterator it = pNZBInfo->GetParameters()->begin(); it != pNZBInfo->GetParameters()->end(); it++)
-			{
-				NZBParameter* pParameter = *it;
-
-				char* xmlName = EncodeStr(pParameter->GetName());
-				char* xmlValue = EncodeStr(pParameter->GetValue());
-
-				snprintf(szItemBuf, szItemBufSize, IsJson() ? JSON_PARAMETER_ITEM : XML_PARAMETER_ITEM, xmlName, xmlValue);
-				szItemBuf[szItemBufSize-1] = '\0';
-
-				free(xmlName);
-				free(xmlValue);
-
-				if (IsJson() && iParamIndex++ > 0)
-				{
-					AppendResponse(",\n");
-				}
-				AppendResponse(szItemBuf);
-			}
+			m_pWriter->BeginArray();
+			m_pWriter->EndArray();
 		}
 
-		AppendResponse(IsJson() ? JSON_HISTORY_ITEM_SCRIPT_START : XML_HISTORY_ITEM_SCRIPT_START);
-
+		// Script statuses
+		m_pWriter->Member("ScriptStatuses");
+		m_pWriter->BeginArray();
 		if (pNZBInfo)
 		{
-			// Script statuses
-			int iScriptIndex = 0;
 			for (ScriptStatusList::iterator it = pNZBInfo->GetScriptStatuses()->begin(); it != pNZBInfo->GetScriptStatuses()->end(); it++)
 			{
 				ScriptStatus* pScriptStatus = *it;
-				
-				char* xmlName = EncodeStr(pScriptStatus->GetName());
-				char* xmlStatus = EncodeStr(szScriptStatusName[pScriptStatus->GetStatus()]);
-				
-				snprintf(szItemBuf, szItemBufSize, IsJson() ? JSON_SCRIPT_ITEM : XML_SCRIPT_ITEM, xmlName, xmlStatus);
-				szItemBuf[szItemBufSize-1] = '\0';
-				
-				free(xmlName);
-				free(xmlStatus);
-				
-				if (IsJson() && iScriptIndex++ > 0)
-				{
-					AppendResponse(",\n");
-				}
-				AppendResponse(szItemBuf);
+				m_pWriter->BeginStruct();
+				m_pWriter->StrMember("Name", pScriptStatus->GetName());
+				m_pWriter->StrMember("Status", szScriptStatusName[pScriptStatus->GetStatus()]);
+				m_pWriter->EndStruct();
 			}
 		}
+		m_pWriter->EndArray();
 
-		AppendResponse(IsJson() ? JSON_HISTORY_ITEM_LOG_START : XML_HISTORY_ITEM_LOG_START);
-
+		// Log-Messages
+		m_pWriter->Member("Log");
+		m_pWriter->BeginArray();
 		if (pNZBInfo)
 		{
-			// Log-Messages
 			NZBInfo::Messages* pMessages = pNZBInfo->LockMessages();
-			if (!pMessages->empty())
+			for (NZBInfo::Messages::iterator it = pMessages->begin(); it != pMessages->end(); it++)
 			{
-				int iLogIndex = 0;
-				for (NZBInfo::Messages::iterator it = pMessages->begin(); it != pMessages->end(); it++)
-				{
-					Message* pMessage = *it;
-					char* xmltext = EncodeStr(pMessage->GetText());
-					snprintf(szItemBuf, szItemBufSize, IsJson() ? JSON_LOG_ITEM : XML_LOG_ITEM,
-						pMessage->GetID(), szMessageType[pMessage->GetKind()], pMessage->GetTime(), xmltext);
-					szItemBuf[szItemBufSize-1] = '\0';
-					free(xmltext);
-
-					if (IsJson() && iLogIndex++ > 0)
-					{
-						AppendResponse(",\n");
-					}
-					AppendResponse(szItemBuf);
-				}
+				WriteMessage(*it);
 			}
 			pNZBInfo->UnlockMessages();
 		}
+		m_pWriter->EndArray();
 
-		AppendResponse(IsJson() ? JSON_HISTORY_ITEM_END : XML_HISTORY_ITEM_END);
+		m_pWriter->EndStruct();
 	}
-	free(szItemBuf);
 
-	AppendResponse(IsJson() ? "\n]" : "</data></array>\n");
+	m_pWriter->EndArray();
 
 	g_pQueueCoordinator->UnlockQueue();
 }
@@ -2144,132 +2294,55 @@ void DownloadUrlXmlCommand::Execute()
 
 void UrlQueueXmlCommand::Execute()
 {
-	AppendResponse(IsJson() ? "[\n" : "<array><data>\n");
-
-	const char* XML_URLQUEUE_ITEM = 
-		"<value><struct>\n"
-		"<member><name>ID</name><value><i4>%i</i4></value></member>\n"
-		"<member><name>NZBFilename</name><value><string>%s</string></value></member>\n"
-		"<member><name>URL</name><value><string>%s</string></value></member>\n"
-		"<member><name>Name</name><value><string>%s</string></value></member>\n"
-		"<member><name>Category</name><value><string>%s</string></value></member>\n"
-		"<member><name>Priority</name><value><i4>%i</i4></value></member>\n"
-		"</struct></value>\n";
-
-	const char* JSON_URLQUEUE_ITEM = 
-		"{\n"
-		"\"ID\" : %i,\n"
-		"\"NZBFilename\" : \"%s\",\n"
-		"\"URL\" : \"%s\",\n"
-		"\"Name\" : \"%s\",\n"
-		"\"Category\" : \"%s\",\n"
-		"\"Priority\" : %i\n"
-		"}";
+	m_pWriter->BeginArray();
 
 	UrlQueue* pUrlQueue = g_pQueueCoordinator->LockQueue()->GetUrlQueue();
 
-	int szItemBufSize = 10240;
-	char* szItemBuf = (char*)malloc(szItemBufSize);
-	int index = 0;
-
 	for (UrlQueue::iterator it = pUrlQueue->begin(); it != pUrlQueue->end(); it++)
 	{
 		UrlInfo* pUrlInfo = *it;
 		char szNicename[1024];
 		pUrlInfo->GetName(szNicename, sizeof(szNicename));
 
-		char* xmlNicename = EncodeStr(szNicename);
-		char* xmlNZBFilename = EncodeStr(pUrlInfo->GetNZBFilename());
-		char* xmlURL = EncodeStr(pUrlInfo->GetURL());
-		char* xmlCategory = EncodeStr(pUrlInfo->GetCategory());
-
-		snprintf(szItemBuf, szItemBufSize, IsJson() ? JSON_URLQUEUE_ITEM : XML_URLQUEUE_ITEM,
-			pUrlInfo->GetID(), xmlNZBFilename, xmlURL, xmlNicename, xmlCategory, pUrlInfo->GetPriority());
-		szItemBuf[szItemBufSize-1] = '\0';
-
-		free(xmlNicename);
-		free(xmlNZBFilename);
-		free(xmlURL);
-		free(xmlCategory);
-
-		if (IsJson() && index++ > 0)
-		{
-			AppendResponse(",\n");
-		}
-		AppendResponse(szItemBuf);
+		m_pWriter->BeginStruct();
+		m_pWriter->IntMember("ID", pUrlInfo->GetID());
+		m_pWriter->StrMember("NZBFilename", pUrlInfo->GetNZBFilename());
+		m_pWriter->StrMember("URL", pUrlInfo->GetURL());
+		m_pWriter->StrMember("Name", szNicename);
+		m_pWriter->StrMember("Category", pUrlInfo->GetCategory());
+		m_pWriter->IntMember("Priority", pUrlInfo->GetPriority());
+		m_pWriter->EndStruct();
 	}
-	free(szItemBuf);
 
 	g_pQueueCoordinator->UnlockQueue();
 
-	AppendResponse(IsJson() ? "\n]" : "</data></array>\n");
+	m_pWriter->EndArray();
 }
 
 // struct[] config()
 void ConfigXmlCommand::Execute()
 {
-	const char* XML_CONFIG_ITEM = 
-		"<value><struct>\n"
-		"<member><name>Name</name><value><string>%s</string></value></member>\n"
-		"<member><name>Value</name><value><string>%s</string></value></member>\n"
-		"</struct></value>\n";
-
-	const char* JSON_CONFIG_ITEM = 
-		"{\n"
-		"\"Name\" : \"%s\",\n"
-		"\"Value\" : \"%s\"\n"
-		"}";
-
-	AppendResponse(IsJson() ? "[\n" : "<array><data>\n");
+	m_pWriter->BeginArray();
 
 	Options::OptEntries* pOptEntries = g_pOptions->LockOptEntries();
 
-	int szItemBufSize = 10240;
-	char* szItemBuf = (char*)malloc(szItemBufSize);
-	int index = 0;
-
 	for (Options::OptEntries::iterator it = pOptEntries->begin(); it != pOptEntries->end(); it++)
 	{
 		Options::OptEntry* pOptEntry = *it;
-
-		char* xmlName = EncodeStr(pOptEntry->GetName());
-		char* xmlValue = EncodeStr(pOptEntry->GetValue());
-
-		snprintf(szItemBuf, szItemBufSize, IsJson() ? JSON_CONFIG_ITEM : XML_CONFIG_ITEM, xmlName, xmlValue);
-		szItemBuf[szItemBufSize-1] = '\0';
-
-		free(xmlName);
-		free(xmlValue);
-
-		if (IsJson() && index++ > 0)
-		{
-			AppendResponse(",\n");
-		}
-		AppendResponse(szItemBuf);
+		m_pWriter->BeginStruct();
+		m_pWriter->StrMember("Name", pOptEntry->GetName());
+		m_pWriter->StrMember("Value", pOptEntry->GetValue());
+		m_pWriter->EndStruct();
 	}
 
 	g_pOptions->UnlockOptEntries();
 
-	free(szItemBuf);
-
-	AppendResponse(IsJson() ? "\n]" : "</data></array>\n");
+	m_pWriter->EndArray();
 }
 
 // struct[] loadconfig()
 void LoadConfigXmlCommand::Execute()
 {
-	const char* XML_CONFIG_ITEM = 
-		"<value><struct>\n"
-		"<member><name>Name</name><value><string>%s</string></value></member>\n"
-		"<member><name>Value</name><value><string>%s</string></value></member>\n"
-		"</struct></value>\n";
-
-	const char* JSON_CONFIG_ITEM = 
-		"{\n"
-		"\"Name\" : \"%s\",\n"
-		"\"Value\" : \"%s\"\n"
-		"}";
-
 	Options::OptEntries* pOptEntries = new Options::OptEntries();
 	if (!g_pOptions->LoadConfig(pOptEntries))
 	{
@@ -2278,37 +2351,20 @@ void LoadConfigXmlCommand::Execute()
 		return;
 	}
 
-	AppendResponse(IsJson() ? "[\n" : "<array><data>\n");
-
-	int szItemBufSize = 10240;
-	char* szItemBuf = (char*)malloc(szItemBufSize);
-	int index = 0;
+	m_pWriter->BeginArray();
 
 	for (Options::OptEntries::iterator it = pOptEntries->begin(); it != pOptEntries->end(); it++)
 	{
 		Options::OptEntry* pOptEntry = *it;
-
-		char* xmlName = EncodeStr(pOptEntry->GetName());
-		char* xmlValue = EncodeStr(pOptEntry->GetValue());
-
-		snprintf(szItemBuf, szItemBufSize, IsJson() ? JSON_CONFIG_ITEM : XML_CONFIG_ITEM, xmlName, xmlValue);
-		szItemBuf[szItemBufSize-1] = '\0';
-
-		free(xmlName);
-		free(xmlValue);
-
-		if (IsJson() && index++ > 0)
-		{
-			AppendResponse(",\n");
-		}
-		AppendResponse(szItemBuf);
+		m_pWriter->BeginStruct();
+		m_pWriter->StrMember("Name", pOptEntry->GetName());
+		m_pWriter->StrMember("Value", pOptEntry->GetValue());
+		m_pWriter->EndStruct();
 	}
 
 	delete pOptEntries;
 
-	free(szItemBuf);
-
-	AppendResponse(IsJson() ? "\n]" : "</data></array>\n");
+	m_pWriter->EndArray();
 }
 
 // bool saveconfig(struct[] data)
@@ -2337,20 +2393,6 @@ void SaveConfigXmlCommand::Execute()
 // struct[] configtemplates()
 void ConfigTemplatesXmlCommand::Execute()
 {
-	const char* XML_CONFIG_ITEM = 
-		"<value><struct>\n"
-		"<member><name>Name</name><value><string>%s</string></value></member>\n"
-		"<member><name>DisplayName</name><value><string>%s</string></value></member>\n"
-		"<member><name>Template</name><value><string>%s</string></value></member>\n"
-		"</struct></value>\n";
-
-	const char* JSON_CONFIG_ITEM = 
-		"{\n"
-		"\"Name\" : \"%s\",\n"
-		"\"DisplayName\" : \"%s\",\n"
-		"\"Template\" : \"%s\"\n"
-		"}";
-
 	Options::ConfigTemplates* pConfigTemplates = new Options::ConfigTemplates();
 
 	if (!g_pOptions->LoadConfigTemplates(pConfigTemplates))
@@ -2360,40 +2402,21 @@ void ConfigTemplatesXmlCommand::Execute()
 		return;
 	}
 
-	AppendResponse(IsJson() ? "[\n" : "<array><data>\n");
-
-	int index = 0;
+	m_pWriter->BeginArray();
 
 	for (Options::ConfigTemplates::iterator it = pConfigTemplates->begin(); it != pConfigTemplates->end(); it++)
 	{
 		Options::ConfigTemplate* pConfigTemplate = *it;
-
-		char* xmlName = EncodeStr(pConfigTemplate->GetName());
-		char* xmlDisplayName = EncodeStr(pConfigTemplate->GetDisplayName());
-		char* xmlTemplate = EncodeStr(pConfigTemplate->GetTemplate());
-
-		int szItemBufSize = strlen(xmlName) + strlen(xmlTemplate) + 1024;
-		char* szItemBuf = (char*)malloc(szItemBufSize);
-
-		snprintf(szItemBuf, szItemBufSize, IsJson() ? JSON_CONFIG_ITEM : XML_CONFIG_ITEM, xmlName, xmlDisplayName, xmlTemplate);
-		szItemBuf[szItemBufSize-1] = '\0';
-
-		free(xmlName);
-		free(xmlDisplayName);
-		free(xmlTemplate);
-
-		if (IsJson() && index++ > 0)
-		{
-			AppendResponse(",\n");
-		}
-		AppendResponse(szItemBuf);
-
-		free(szItemBuf);
+		m_pWriter->BeginStruct();
+		m_pWriter->StrMember("Name", pConfigTemplate->GetName());
+		m_pWriter->StrMember("DisplayName", pConfigTemplate->GetDisplayName());
+		m_pWriter->StrMember("Template", pConfigTemplate->GetTemplate());
+		m_pWriter->EndStruct();
 	}
 
 	delete pConfigTemplates;
 
-	AppendResponse(IsJson() ? "\n]" : "</data></array>\n");
+	m_pWriter->EndArray();
 }
 
 ViewFeedXmlCommand::ViewFeedXmlCommand(bool bPreview)
@@ -2453,41 +2476,9 @@ void ViewFeedXmlCommand::Execute()
 		return;
 	}
 
-	const char* XML_FEED_ITEM = 
-		"<value><struct>\n"
-		"<member><name>Title</name><value><string>%s</string></value></member>\n"
-		"<member><name>Filename</name><value><string>%s</string></value></member>\n"
-		"<member><name>URL</name><value><string>%s</string></value></member>\n"
-		"<member><name>SizeLo</name><value><i4>%i</i4></value></member>\n"
-		"<member><name>SizeHi</name><value><i4>%i</i4></value></member>\n"
-		"<member><name>SizeMB</name><value><i4>%i</i4></value></member>\n"
-		"<member><name>Category</name><value><string>%s</string></value></member>\n"
-		"<member><name>Time</name><value><i4>%i</i4></value></member>\n"
-		"<member><name>Match</name><value><boolean>%s</boolean></value></member>\n"
-		"<member><name>Status</name><value><string>%s</string></value></member>\n"
-		"</struct></value>\n";
-
-	const char* JSON_FEED_ITEM = 
-		"{\n"
-		"\"Title\" : \"%s\",\n"
-		"\"Filename\" : \"%s\",\n"
-		"\"URL\" : \"%s\",\n"
-		"\"SizeLo\" : %i,\n"
-		"\"SizeHi\" : %i,\n"
-		"\"SizeMB\" : %i,\n"
-		"\"Category\" : \"%s\",\n"
-		"\"Time\" : %i,\n"
-		"\"Match\" : %s,\n"
-		"\"Status\" : \"%s\"\n"
-		"}";
-
     const char* szStatusType[] = { "UNKNOWN", "BACKLOG", "FETCHED", "NEW" };
 
-	int szItemBufSize = 10240;
-	char* szItemBuf = (char*)malloc(szItemBufSize);
-
-	AppendResponse(IsJson() ? "[\n" : "<array><data>\n");
-	int index = 0;
+	m_pWriter->BeginArray();
 
     for (FeedItemInfos::iterator it = pFeedItemInfos->begin(); it != pFeedItemInfos->end(); it++)
     {
@@ -2499,38 +2490,28 @@ void ViewFeedXmlCommand::Execute()
 			Util::SplitInt64(pFeedItemInfo->GetSize(), &iSizeHi, &iSizeLo);
 			int iSizeMB = (int)(pFeedItemInfo->GetSize() / 1024 / 1024);
 
-			char* xmltitle = EncodeStr(pFeedItemInfo->GetTitle());
-			char* xmlfilename = EncodeStr(pFeedItemInfo->GetFilename());
-			char* xmlurl = EncodeStr(pFeedItemInfo->GetUrl());
-			char* xmlcategory = EncodeStr(pFeedItemInfo->GetCategory());
-
-			snprintf(szItemBuf, szItemBufSize, IsJson() ? JSON_FEED_ITEM : XML_FEED_ITEM,
-				xmltitle, xmlfilename, xmlurl, iSizeLo, iSizeHi, iSizeMB, xmlcategory, pFeedItemInfo->GetTime(),
-				BoolToStr(pFeedItemInfo->GetMatch()), szStatusType[pFeedItemInfo->GetStatus()]);
-			szItemBuf[szItemBufSize-1] = '\0';
-
-			free(xmltitle);
-			free(xmlfilename);
-			free(xmlurl);
-			free(xmlcategory);
-
-			if (IsJson() && index++ > 0)
-			{
-				AppendResponse(",\n");
-			}
-			AppendResponse(szItemBuf);
+			m_pWriter->BeginStruct();
+			m_pWriter->StrMember("Title", pFeedItemInfo->GetTitle());
+			m_pWriter->StrMember("Filename", pFeedItemInfo->GetFilename());
+			m_pWriter->StrMember("URL", pFeedItemInfo->GetUrl());
+			m_pWriter->UIntMember("SizeLo", iSizeLo);
+			m_pWriter->UIntMember("SizeHi", iSizeHi);
+			m_pWriter->IntMember("SizeMB", iSizeMB);
+			m_pWriter->StrMember("Category", pFeedItemInfo->GetCategory());
+			m_pWriter->IntMember("Time", pFeedItemInfo->GetTime());
+			m_pWriter->BoolMember("Match", pFeedItemInfo->GetMatch());
+			m_pWriter->StrMember("Status", szStatusType[pFeedItemInfo->GetStatus()]);
+			m_pWriter->EndStruct();
 		}
     }
 
-	free(szItemBuf);
-
     for (FeedItemInfos::iterator it = pFeedItemInfos->begin(); it != pFeedItemInfos->end(); it++)
     {
         delete *it;
     }
 	delete pFeedItemInfos;
 
-	AppendResponse(IsJson() ? "\n]" : "</data></array>\n");
+	m_pWriter->EndArray();
 }
 
 void FetchFeedsXmlCommand::Execute()
@@ -26,10 +26,139 @@
 #ifndef XMLRPC_H
 #define XMLRPC_H
 
+#include <vector>
+#include <deque>
+
 #include "Connection.h"
 #include "Util.h"
 
 class XmlCommand;
+class Message;
+class NZBParameterList;
+class NZBInfo;
+
+/*
+ * Serializes the result of a command. Commands describe the structure of response
+ * (structs, arrays, members and values) once, the concrete writer produces
+ * XML-RPC, JSON-RPC or MessagePack encoding.
+ */
+class ResponseWriter
+{
+private:
+	static const int	MAX_DEPTH = 16;
+
+	struct Frame
+	{
+		bool			bStruct;
+		int				iCount;
+		int				iStartPos;
+	};
+
+	Frame				m_Frames[MAX_DEPTH];
+	int					m_iDepth;
+
+	void				BeginValue();
+	void				EndValue();
+
+protected:
+	StringBuilder*		m_pStringBuilder;
+
+	virtual void		WriteStructStart() = 0;
+	virtual void		WriteStructEnd(int iStartPos, int iCount) = 0;
+	virtual void		WriteArrayStart() = 0;
+	virtual void		WriteArrayEnd(int iStartPos, int iCount) = 0;
+	virtual void		WriteMemberStart(const char* szName, int iIndex) = 0;
+	virtual void		WriteMemberEnd() {}
+	virtual void		WriteItemStart(int iIndex) = 0;
+	virtual void		WriteItemEnd() {}
+	virtual void		WriteInt(int iValue) = 0;
+	virtual void		WriteUInt(unsigned int iValue) = 0;
+	virtual void		WriteBool(bool bValue) = 0;
+	virtual void		WriteStr(const char* szValue) = 0;
+
+public:
+						ResponseWriter(StringBuilder* pStringBuilder);
+	virtual				~ResponseWriter() {}
+	void				BeginStruct();
+	void				EndStruct();
+	void				BeginArray();
+	void				EndArray();
+	void				Member(const char* szName);
+	void				IntValue(int iValue);
+	void				UIntValue(unsigned int iValue);
+	void				BoolValue(bool bValue);
+	void				StrValue(const char* szValue);
+	void				RawValue(const char* szData, int iLen);
+	void				IntMember(const char* szName, int iValue) { Member(szName); IntValue(iValue); }
+	void				UIntMember(const char* szName, unsigned int iValue) { Member(szName); UIntValue(iValue); }
+	void				BoolMember(const char* szName, bool bValue) { Member(szName); BoolValue(bValue); }
+	void				StrMember(const char* szName, const char* szValue) { Member(szName); StrValue(szValue); }
+};
+
+class XmlResponseWriter : public ResponseWriter
+{
+protected:
+	virtual void		WriteStructStart();
+	virtual void		WriteStructEnd(int iStartPos, int iCount);
+	virtual void		WriteArrayStart();
+	virtual void		WriteArrayEnd(int iStartPos, int iCount);
+	virtual void		WriteMemberStart(const char* szName, int iIndex);
+	virtual void		WriteMemberEnd();
+	virtual void		WriteItemStart(int iIndex);
+	virtual void		WriteItemEnd();
+	virtual void		WriteInt(int iValue);
+	virtual void		WriteUInt(unsigned int iValue);
+	virtual void		WriteBool(bool bValue);
+	virtual void		WriteStr(const char* szValue);
+
+public:
+						XmlResponseWriter(StringBuilder* pStringBuilder) : ResponseWriter(pStringBuilder) {}
+};
+
+class JsonResponseWriter : public ResponseWriter
+{
+protected:
+	virtual void		WriteStructStart();
+	virtual void		WriteStructEnd(int iStartPos, int iCount);
+	virtual void		WriteArrayStart();
+	virtual void		WriteArrayEnd(int iStartPos, int iCount);
+	virtual void		WriteMemberStart(const char* szName, int iIndex);
+	virtual void		WriteItemStart(int iIndex);
+	virtual void		WriteInt(int iValue);
+	virtual void		WriteUInt(unsigned int iValue);
+	virtual void		WriteBool(bool bValue);
+	virtual void		WriteStr(const char* szValue);
+
+public:
+						JsonResponseWriter(StringBuilder* pStringBuilder) : ResponseWriter(pStringBuilder) {}
+};
+
+/*
+ * Binary encoding (http://msgpack.org). The number of elements in maps and arrays
+ * is not known in advance, the space for the header is reserved and the header
+ * is written (in the most compact form) when the map or array is finished.
+ */
+class MsgPackResponseWriter : public ResponseWriter
+{
+private:
+	void				WriteHeader(int iStartPos, int iCount, unsigned char cFixType, unsigned char c16Type);
+	void				WriteData(const char* szData, int iLen) { m_pStringBuilder->Append(szData, iLen); }
+
+protected:
+	virtual void		WriteStructStart();
+	virtual void		WriteStructEnd(int iStartPos, int iCount);
+	virtual void		WriteArrayStart();
+	virtual void		WriteArrayEnd(int iStartPos, int iCount);
+	virtual void		WriteMemberStart(const char* szName, int iIndex);
+	virtual void		WriteItemStart(int iIndex) {}
+	virtual void		WriteInt(int iValue);
+	virtual void		WriteUInt(unsigned int iValue);
+	virtual void		WriteBool(bool bValue);
+	virtual void		WriteStr(const char* szValue);
+
+public:
+						MsgPackResponseWriter(StringBuilder* pStringBuilder) : ResponseWriter(pStringBuilder) {}
+};
 
 class XmlRpcProcessor
 {
@@ -53,6 +182,7 @@ private:
 	const char*			m_szContentType;
 	ERpcProtocol		m_eProtocol;
 	EHttpMethod			m_eHttpMethod;
+	bool				m_bMsgPack;
 	char*				m_szUrl;
 	StringBuilder		m_cResponse;
 
@@ -60,6 +190,7 @@ private:
 	XmlCommand*			CreateCommand(const char* szMethodName);
 	void				MutliCall();
 	void				BuildResponse(const char* szResponse, const char* szCallbackFunc, bool bFault);
+	void				BuildMsgPackResponse(const char* szResponse, int iResponseLen, bool bFault);
 
 public:
 						XmlRpcProcessor();
@@ -68,43 +199,76 @@ public:
 	void				SetHttpMethod(EHttpMethod eHttpMethod) { m_eHttpMethod = eHttpMethod; }
 	void				SetUrl(const char* szUrl);
 	void				SetRequest(char* szRequest) { m_szRequest = szRequest; }
+	void				SetAccept(const char* szAccept);
 	const char*			GetResponse() { return m_cResponse.GetBuffer(); }
+	int					GetResponseLen() { return m_cResponse.GetUsedSize(); }
 	const char*			GetContentType() { return m_szContentType; }
 	static bool			IsRpcRequest(const char* szUrl);
 };
 
 class XmlCommand
 {
+private:
+	enum EParamType
+	{
+		ptText,			// untyped value from the query string of GET-request
+		ptString,
+		ptInt,
+		ptBool,
+		ptOther
+	};
+
+	struct RequestParam
+	{
+		EParamType		eType;
+		char*			szValue;
+		int				iLen;
+		bool			bEscaped;
+	};
+
+	typedef std::vector<RequestParam>	RequestParams;
+
+	RequestParams		m_Params;
+	unsigned int		m_iParamIndex;
+
+	void				AddParam(EParamType eType, char* szValue, int iLen, bool bEscaped);
+	void				ParseUrlParams(char* szRequest);
+	void				ParseJsonParams(char* szRequest);
+	void				ParseXmlParams(char* szRequest);
+
 protected:
 	char*				m_szRequest;
-	char*				m_szRequestPtr;
 	char*				m_szCallbackFunc;
 	StringBuilder		m_StringBuilder;
+	ResponseWriter*		m_pWriter;
 	bool				m_bFault;
+	bool				m_bMsgPack;
 	XmlRpcProcessor::ERpcProtocol	m_eProtocol;
 	XmlRpcProcessor::EHttpMethod	m_eHttpMethod;
 
 	void				BuildErrorResponse(int iErrCode, const char* szErrText, ...);
 	void				BuildBoolResponse(bool bOK);
-	void				AppendResponse(const char* szPart);
+	void				WriteMessage(Message* pMessage);
+	void				WriteParameters(NZBParameterList* pParameters);
 	bool				IsJson();
 	bool				CheckSafeMethod();
 	bool				NextParamAsInt(int* iValue);
 	bool				NextParamAsBool(bool* bValue);
 	bool				NextParamAsStr(char** szValueBuf);
-	const char*			BoolToStr(bool bValue);
-	char*				EncodeStr(const char* szStr);
+	bool				NextParamAsBase64(char** pData, int* pLen);
 	void				DecodeStr(char* szStr);
 
 public:
 						XmlCommand();
-	virtual 			~XmlCommand() {}
+	virtual 			~XmlCommand();
 	virtual void		Execute() = 0;
 	void				PrepareParams();
-	void				SetRequest(char* szRequest) { m_szRequest = szRequest; m_szRequestPtr = m_szRequest; }
+	void				SetRequest(char* szRequest) { m_szRequest = szRequest; }
 	void				SetProtocol(XmlRpcProcessor::ERpcProtocol eProtocol) { m_eProtocol = eProtocol; }
 	void				SetHttpMethod(XmlRpcProcessor::EHttpMethod eHttpMethod) { m_eHttpMethod = eHttpMethod; }
+	void				SetMsgPack(bool bMsgPack) { m_bMsgPack = bMsgPack; }
 	const char*			GetResponse() { return m_StringBuilder.GetBuffer(); }
+	int					GetResponseLen() { return m_StringBuilder.GetUsedSize(); }
 	const char*			GetCallbackFunc() { return m_szCallbackFunc; }
 	bool				GetFault() { return m_bFault; }
 };
@@ -184,6 +348,25 @@ public:
 
 class LogXmlCommand: public XmlCommand
 {
+protected:
+	typedef std::deque<Message*>	Messages;
+
+	virtual Messages*	LockMessages();
+	virtual void		UnlockMessages();
+
+public:
+	virtual void		Execute();
+};
+
+class LoadLogXmlCommand: public LogXmlCommand
+{
+private:
+	NZBInfo*			m_pNZBInfo;
+
+protected:
+	virtual Messages*	LockMessages();
+	virtual void		UnlockMessages();
+
 public:
 	virtual void		Execute();
 };
@@ -0,0 +1,209 @@
+/*
+ *  This file is part of nzbget
+ *
+ *  Copyright (C) 2013 Andrey Prygunkov <hugbug@users.sourceforge.net>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ * $Revision$
+ * $Date$
+ *
+ */
+
+/*
+ * Measures the launch latency of child processes started with fork/exec and
+ * with posix_spawn, the same way as ScriptController::Execute does it: the
+ * output of the child goes into a pipe, the child gets its own session.
+ *
+ * The parent process allocates (and touches) the given amount of memory and
+ * starts the given number of idle threads to look like a running nzbget.
+ * Each launch is measured from the start of the process until the child has
+ * exited, the child is "/bin/true" by default.
+ *
+ * Build and run (not part of the nzbget build):
+ *   g++ -O2 -o spawnbench benchmark/SpawnBenchmark.cpp -lpthread
+ *   ./spawnbench [memory-MB [threads [launches [program]]]]
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <spawn.h>
+#include <pthread.h>
+#include <sys/wait.h>
+#include <sys/time.h>
+
+extern char** environ;
+
+static const char* g_szProgram = "/bin/true";
+
+static void* IdleThread(void* pArg)
+{
+	while (true)
+	{
+		pause();
+	}
+	return NULL;
+}
+
+static double CurrentMSec()
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec * 1000.0 + tv.tv_usec / 1000.0;
+}
+
+static pid_t LaunchFork(int pipeout)
+{
+	pid_t pid = fork();
+	if (pid == 0)
+	{
+		setsid();
+		sigset_t sigMask;
+		sigemptyset(&sigMask);
+		sigprocmask(SIG_SETMASK, &sigMask, NULL);
+		dup2(pipeout, 1);
+		dup2(pipeout, 2);
+		close(pipeout);
+		char* szArgs[] = { (char*)g_szProgram, NULL };
+		execvp(g_szProgram, szArgs);
+		_exit(254);
+	}
+	return pid;
+}
+
+static pid_t LaunchSpawn(int pipeout)
+{
+	posix_spawn_file_actions_t fileActions;
+	posix_spawn_file_actions_init(&fileActions);
+	posix_spawn_file_actions_adddup2(&fileActions, pipeout, 1);
+	posix_spawn_file_actions_adddup2(&fileActions, pipeout, 2);
+	posix_spawn_file_actions_addclose(&fileActions, pipeout);
+
+	posix_spawnattr_t spawnAttr;
+	posix_spawnattr_init(&spawnAttr);
+	sigset_t sigMask;
+	sigemptyset(&sigMask);
+	posix_spawnattr_setsigmask(&spawnAttr, &sigMask);
+#ifdef POSIX_SPAWN_SETSID
+	posix_spawnattr_setflags(&spawnAttr, POSIX_SPAWN_SETSID | POSIX_SPAWN_SETSIGMASK);
+#else
+	posix_spawnattr_setflags(&spawnAttr, POSIX_SPAWN_SETPGROUP | POSIX_SPAWN_SETSIGMASK);
+	posix_spawnattr_setpgroup(&spawnAttr, 0);
+#endif
+
+	pid_t pid = 0;
+	char* szArgs[] = { (char*)g_szProgram, NULL };
+	int iErrCode = posix_spawnp(&pid, g_szProgram, &fileActions, &spawnAttr, szArgs, environ);
+
+	posix_spawnattr_destroy(&spawnAttr);
+	posix_spawn_file_actions_destroy(&fileActions);
+
+	return iErrCode ? -1 : pid;
+}
+
+/*
+ * Returns the average launch time in milliseconds or -1 on error.
+ */
+static double Measure(bool bSpawn, int iLaunches)
+{
+	double fTotal = 0;
+	for (int i = 0; i < iLaunches; i++)
+	{
+		int p[2];
+		if (pipe(p))
+		{
+			return -1;
+		}
+		fcntl(p[0], F_SETFD, FD_CLOEXEC);
+		fcntl(p[1], F_SETFD, FD_CLOEXEC);
+
+		double fStart = CurrentMSec();
+		pid_t pid = bSpawn ? LaunchSpawn(p[1]) : LaunchFork(p[1]);
+		if (pid == -1)
+		{
+			close(p[0]);
+			close(p[1]);
+			return -1;
+		}
+		close(p[1]);
+
+		// read until the child has closed its end of the pipe
+		char buf[1024];
+		while (read(p[0], buf, sizeof(buf)) > 0) ;
+		close(p[0]);
+
+		int iStatus;
+		waitpid(pid, &iStatus, 0);
+		fTotal += CurrentMSec() - fStart;
+	}
+
+	return fTotal / iLaunches;
+}
+
+int main(int argc, char* argv[])
+{
+	int iMemoryMB = argc > 1 ? atoi(argv[1]) : 256;
+	int iThreads = argc > 2 ? atoi(argv[2]) : 16;
+	int iLaunches = argc > 3 ? atoi(argv[3]) : 200;
+	if (argc > 4)
+	{
+		g_szProgram = argv[4];
+	}
+
+	// SIGCHLD is blocked in nzbget threads (see ScriptController::Init)
+	sigset_t sigMask;
+	sigemptyset(&sigMask);
+	sigaddset(&sigMask, SIGCHLD);
+	pthread_sigmask(SIG_BLOCK, &sigMask, NULL);
+
+	size_t iSize = (size_t)iMemoryMB * 1024 * 1024;
+	char* pMemory = (char*)malloc(iSize > 0 ? iSize : 1);
+	if (!pMemory)
+	{
+		fprintf(stderr, "Could not allocate %i MB\n", iMemoryMB);
+		return 1;
+	}
+	memset(pMemory, 1, iSize);
+
+	for (int i = 0; i < iThreads; i++)
+	{
+		pthread_t thread;
+		pthread_create(&thread, NULL, IdleThread, NULL);
+	}
+
+	// warm up the caches of the dynamic loader
+	Measure(false, 5);
+	Measure(true, 5);
+
+	double fFork = Measure(false, iLaunches);
+	double fSpawn = Measure(true, iLaunches);
+
+	if (fFork < 0 || fSpawn < 0)
+	{
+		fprintf(stderr, "Could not start %s\n", g_szProgram);
+		return 1;
+	}
+
+	printf("memory %i MB, threads %i, launches %i, program %s\n", iMemoryMB, iThreads, iLaunches, g_szProgram);
+	printf("  fork+exec:   %.2f ms\n", fFork);
+	printf("  posix_spawn: %.2f ms\n", fSpawn);
+
+	free(pMemory);
+	return 0;
+}
@@ -68,6 +68,7 @@
 #include "QueueCoordinator.h"
 #include "UrlCoordinator.h"
 #include "RemoteServer.h"
+#include "WebServer.h"
 #include "RemoteClient.h"
 #include "MessageBase.h"
 #include "DiskState.h"
@@ -75,6 +76,7 @@
 #include "ParChecker.h"
 #include "Scheduler.h"
 #include "Scanner.h"
+#include "ScriptController.h"
 #include "FeedCoordinator.h"
 #include "Util.h"
 #ifdef WIN32
@@ -140,6 +142,7 @@ int main(int argc, char *argv[], char *argp[])
 #endif
 
 	Util::InitVersionRevision();
+	Util::InitCrc32();
 	
 #ifdef WIN32
 	InstallUninstallServiceCheck(argc, argv);
@@ -255,9 +258,13 @@ void Run(bool bReload)
 		info("nzbget %s remote-mode", Util::VersionRevision());
 	}
 
+	g_pLog->StartWriter();
+
 	if (!bReload)
 	{
 		Connection::Init();
+		WebProcessor::Init();
+		ScriptController::Init();
 	}
 
 	if (!g_pOptions->GetRemoteClientMode())
@@ -637,6 +644,11 @@ void SignalProc(int iSignal)
 			// ignoring
 			break;
 
+		case SIGHUP:
+			// reopen log-file (log rotation)
+			g_pLog->ReopenFile();
+			break;
+
 #ifdef DEBUG
 		case SIGSEGV:
 			signal(SIGSEGV, SIG_DFL);   // Reset the signal handler
@@ -820,8 +832,12 @@ void Cleanup()
 	}
 	debug("FeedCoordinator deleted");
 
+	g_pLog->StopWriter();
+
 	if (!g_bReloading)
 	{
+		ScriptController::Final();
+		WebProcessor::Final();
 		Connection::Final();
 		Thread::Final();
 	}
@@ -876,6 +892,7 @@ void Daemonize()
 	signal(SIGTSTP, SIG_IGN); /* ignore tty signals */
 	signal(SIGTTOU, SIG_IGN);
 	signal(SIGTTIN, SIG_IGN);
+	signal(SIGHUP, SignalProc); /* reopen log-file */
 }
 #endif
 